@@ -76,7 +76,7 @@ system("xxd -i rtl_nic/rtl8153b-2.fw ./8153.h");
 system("tail -n +2 8153.h     | head -n -2  | sponge 8153.h");
 system("tail -n +2  8156.h    | head -n -2  | sponge 8156.h");
 
-system("@CC -DCHOOSEN_PLATFORM=1 rtl_plugin.c -lusb-1.0 -o rtl81xx -Wno-incompatible-pointer-types -finstrument-functions");
+system("@CC -DCHOOSEN_PLATFORM=1 rtl_plugin.c -lusb-1.0 -lpthread -o rtl81xx -Wno-incompatible-pointer-types -finstrument-functions");
 system("rm ./8153.h");
 system("rm ./8156.h");
 
@@ -20,6 +20,8 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 
 #define DEBUG_V2                0
 #define DEBUG_V1                1
@@ -179,6 +181,20 @@ MT7921_DISABLE_INSTRUMENT static inline void MT7921_VENDOR_RESET(void);
 MT7921_DISABLE_INSTRUMENT static inline void MT7921_INIT(void);
 MT7921_DISABLE_INSTRUMENT static inline void MT7921_EXIT(void);
 
+/** HOTPLUG DRIVEN DISCOVERY **/
+MT7921_DISABLE_INSTRUMENT static inline const struct mt7921_usb_id *MT7921_ID_LOOKUP(uint16_t vid, uint16_t pid, uint16_t bcd);
+MT7921_DISABLE_INSTRUMENT static inline bool MT7921_ID_TABLE_SORTED(void);
+MT7921_DISABLE_INSTRUMENT static inline const struct mt7921_usb_id *MT7921_HOTPLUG_MATCH(libusb_device *dev);
+MT7921_DISABLE_INSTRUMENT static int LIBUSB_CALL MT7921_HOTPLUG_CALLBACK(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data);
+MT7921_DISABLE_INSTRUMENT static inline void *MT7921_HOTPLUG_EVENT_THREAD(void *arg);
+MT7921_DISABLE_INSTRUMENT static inline void *MT7921_HOTPLUG_WORKER_THREAD(void *arg);
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_BRING_UP(libusb_device *dev, const struct mt7921_usb_id *id);
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_TEAR_DOWN(void);
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_HOTPLUG_WAIT(unsigned int timeout_ms);
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_HOTPLUG_STOP(void);
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_INITIALIZE_USB_INTERFACE(void);
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_DEINITIALIZE_USB_INTERFACE(void);
+
 enum usbdev_enum_t{
 	MT7921,
         MT7921U,
@@ -314,6 +330,13 @@ PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct usbdev_ops{
         void (*mtk_reset_packet_filter)(void);
         void *mtk_io_ops;       /** for this driver is unused **/
 }mt_ops[] = {
+        /** both are MT7961 based, the adapters differ only by their USB id **/
+        [MT7921]   = {
+                .mtk_init       = MT7921_INIT,
+                .mtk_exit       = MT7921_EXIT,
+                .mtk_tx         = NULL,
+                .mtk_rx         = NULL,
+        },
         [MT7921U]  = {
                 .mtk_init       = MT7921_INIT,
                 .mtk_exit       = MT7921_EXIT,
@@ -327,6 +350,7 @@ PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct usbdev_ops{
 PLUGIN_SPECIFIC_STRUCT_OPT(unsigned long) struct device_flags{
         unsigned long flags;
         unsigned long capabilities;
+        unsigned long quirks;           /** taken from the USB id table **/
         unsigned long rx_timeout;
         unsigned long tx_timeout;
 };
@@ -348,6 +372,7 @@ PLUGIN_STRUCT_OPT struct usbdev_identifier{
         unsigned long device_vid;
         unsigned long device_version_identifier;
         unsigned long device_max_mtu;
+        const struct mt7921_usb_id  *device_id;     /** entry of mt7921_usb_ids the adapter matched **/
         struct libusb_device_handle *device_handler;
         struct device_firmware      *device_firmware;
         struct ethtool_eee          *device_eee;
@@ -359,13 +384,13 @@ PLUGIN_STRUCT_OPT struct usbdev_identifier{
 MT_PLUGIN_OPS_SECTION struct usbdev_identifier MT7921_LIST[] = {
 	[MT7921]  = {
 		.device_name			= "Comfast CF-952 AX",
-		.device_pid			= 0x3574,
-		.device_vid			= 0x6211,
+		.device_pid			= 0x6211,
+		.device_vid			= 0x3574,
 	},
         [MT7921U] = {
                 .device_name                    = "MT7921U",
-                .device_pid                     = 0x0e8d,
-                .device_vid                     = 0x7961,
+                .device_pid                     = 0x7961,
+                .device_vid                     = 0x0e8d,
                 .device_version_identifier      = 0x00,
                 .device_handler                 = NULL,
                 .device_cb                      = NULL,
@@ -380,10 +405,35 @@ MT_PLUGIN_OPS_SECTION struct usbdev_identifier MT7921_LIST[] = {
         }
 };
 
+/** USB ID TABLE, kept sorted by vid, pid and bcd_lo for MT7921_ID_LOOKUP **/
+struct mt7921_usb_id{
+	uint16_t		vid;
+	uint16_t		pid;
+	uint16_t		bcd_lo;
+	uint16_t		bcd_hi;
+	enum usbdev_enum_t	device;		/** entry of MT7921_LIST **/
+	struct usbdev_ops	*ops;
+	const char		*fw_name;	/** WM firmware, the same for every MT7961 based adapter **/
+	unsigned long		quirks;
+};
+
+#define MT7921_USB_ID(_vid, _pid, _device, _fw, _quirks)	\
+	{ .vid = _vid, .pid = _pid, .bcd_lo = 0x0000, .bcd_hi = 0xffff, .device = _device, .ops = &mt_ops[_device], .fw_name = _fw, .quirks = _quirks }
+
+#define MT7921_FIRMWARE_WM	"mediatek/WIFI_RAM_CODE_MT7961_1.bin"
+
+static const struct mt7921_usb_id mt7921_usb_ids[] = {
+	MT7921_USB_ID(0x0e8d, 0x7961, MT7921U, MT7921_FIRMWARE_WM, 0),	/** MediaTek reference design **/
+	MT7921_USB_ID(0x3574, 0x6211, MT7921,  MT7921_FIRMWARE_WM, 0),	/** Comfast CF-952AX **/
+};
+
+#define MT7921_USB_ID_KEY(vid, pid, bcd)	( ((uint64_t)(vid) << 32) | ((uint64_t)(pid) << 16) | (bcd) )
+
 /** GLOBAL VARIABLES MAIN DECLARATION **/
 struct   usbdev_identifier      *device_context         = NULL;
 unsigned char                   *data_context           = NULL;
-signed   int                    return_context          = 0;
+/** the hotplug worker and the caller both report through it, each thread gets its own **/
+__thread signed int             return_context          = 0;
 
 enum error_handler_t{
         NO_ERROR,
@@ -432,6 +482,34 @@ PLUGIN_STRUCT_OPT struct mt7921_mcu_eeprom_info {
         #define TIMING_COUNTER 10
 #endif
 
+/** attach/detach events waiting for the bring-up worker **/
+#ifndef MT7921_HOTPLUG_EVENTS
+	#define MT7921_HOTPLUG_EVENTS	16
+#endif
+
+#define MT7921_HOTPLUG_POLL_MS		100
+
+struct mt7921_hotplug_event{
+	libusb_device		*dev;
+	libusb_hotplug_event	event;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct mt7921_hotplug{
+	volatile bool			running;
+	bool				registered;
+	libusb_hotplug_callback_handle	handle;
+	pthread_t			event_thread;
+	pthread_t			worker_thread;
+	pthread_mutex_t			lock;
+	pthread_cond_t			cond;
+	struct mt7921_hotplug_event	queue[MT7921_HOTPLUG_EVENTS];
+	unsigned int			head;
+	unsigned int			tail;
+	libusb_device			*active;	/** NULL while nothing is plugged **/
+};
+
+struct   mt7921_hotplug		hotplug			= { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
 MT_PLUGIN_IO_OPTIMIZE static inline void MT7601U_USB_VENDOR_REQUEST(const uint8_t request, const uint8_t direction, const uint16_t val, const uint16_t offset, void *buf, const size_t buflen){
 	int ret = 0;
 	const uint8_t req_type = direction | USB_TYPE_VENDOR | USB_RECIP_DEVICE;
@@ -773,36 +851,274 @@ MT7921_DISABLE_INSTRUMENT static inline void MT7921_EXIT(void){
 
 }
 
+/** HOTPLUG DRIVEN DISCOVERY, SAME SCHEME AS THE RTL81XX PLUGIN **/
+
+/** last entry whose (vid, pid, bcd_lo) is not above the key, then the bcdDevice range decides **/
+MT7921_DISABLE_INSTRUMENT static inline const struct mt7921_usb_id *MT7921_ID_LOOKUP(uint16_t vid, uint16_t pid, uint16_t bcd){
+	const uint64_t key = MT7921_USB_ID_KEY(vid, pid, bcd);
+	size_t lo	   = 0;
+	size_t hi	   = sizeof(mt7921_usb_ids) / sizeof(mt7921_usb_ids[0]);
+	size_t mid	   = 0;
+
+	while( lo < hi ){
+		mid = lo + (hi - lo) / 2;
+		if( MT7921_USB_ID_KEY(mt7921_usb_ids[mid].vid, mt7921_usb_ids[mid].pid, mt7921_usb_ids[mid].bcd_lo) <= key ){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+	if( lo == 0 || mt7921_usb_ids[lo - 1].vid != vid || mt7921_usb_ids[lo - 1].pid != pid || bcd > mt7921_usb_ids[lo - 1].bcd_hi ){
+		return NULL;
+	}
+	return &mt7921_usb_ids[lo - 1];
+}
+
+/** the binary search above silently misses adapters when an entry is added out of order **/
+MT7921_DISABLE_INSTRUMENT static inline bool MT7921_ID_TABLE_SORTED(void){
+	for(size_t i = 1; i < sizeof(mt7921_usb_ids) / sizeof(mt7921_usb_ids[0]); i++){
+		const struct mt7921_usb_id *prev = &mt7921_usb_ids[i - 1];
+		const struct mt7921_usb_id *cur	 = &mt7921_usb_ids[i];
+
+		if( MT7921_USB_ID_KEY(prev->vid, prev->pid, prev->bcd_lo) >= MT7921_USB_ID_KEY(cur->vid, cur->pid, cur->bcd_lo) ){
+			return FALSE;
+		}
+		if( prev->vid == cur->vid && prev->pid == cur->pid && prev->bcd_hi >= cur->bcd_lo ){
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/** NULL when the device is not one of ours **/
+MT7921_DISABLE_INSTRUMENT static inline const struct mt7921_usb_id *MT7921_HOTPLUG_MATCH(libusb_device *dev){
+	struct libusb_device_descriptor desc = { 0 };
+
+	if( libusb_get_device_descriptor(dev, &desc) < 0 ){
+		return NULL;
+	}
+	return MT7921_ID_LOOKUP(desc.idVendor, desc.idProduct, desc.bcdDevice);
+}
+
+/** called from libusb_handle_events, the event is queued and the worker does the rest **/
+MT7921_DISABLE_INSTRUMENT static int LIBUSB_CALL MT7921_HOTPLUG_CALLBACK(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data){
+	if( event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED && MT7921_HOTPLUG_MATCH(dev) == NULL ){
+		return 0;
+	}
+	pthread_mutex_lock(&hotplug.lock);
+	if( hotplug.tail - hotplug.head < MT7921_HOTPLUG_EVENTS ){
+		hotplug.queue[hotplug.tail % MT7921_HOTPLUG_EVENTS].dev   = libusb_ref_device(dev);
+		hotplug.queue[hotplug.tail % MT7921_HOTPLUG_EVENTS].event = event;
+		hotplug.tail++;
+		pthread_cond_broadcast(&hotplug.cond);
+	}
+	pthread_mutex_unlock(&hotplug.lock);
+	return 0;
+}
+
+MT7921_DISABLE_INSTRUMENT static inline void *MT7921_HOTPLUG_EVENT_THREAD(void *arg){
+	struct timeval tv = { 0 };
+
+	while( hotplug.running ){
+		tv.tv_sec  = 0;
+		tv.tv_usec = MT7921_HOTPLUG_POLL_MS * 1000;
+		libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+	}
+	return NULL;
+}
+
+MT7921_DISABLE_INSTRUMENT static inline void *MT7921_HOTPLUG_WORKER_THREAD(void *arg){
+	struct mt7921_hotplug_event ev	= { 0 };
+	const struct mt7921_usb_id *id	= NULL;
+
+	for(;;){
+		pthread_mutex_lock(&hotplug.lock);
+		while( hotplug.running && hotplug.head == hotplug.tail ){
+			pthread_cond_wait(&hotplug.cond, &hotplug.lock);
+		}
+		if( !hotplug.running ){
+			pthread_mutex_unlock(&hotplug.lock);
+			break;
+		}
+		ev = hotplug.queue[hotplug.head % MT7921_HOTPLUG_EVENTS];
+		hotplug.head++;
+		pthread_mutex_unlock(&hotplug.lock);
+
+		if( ev.event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED ){
+			id = MT7921_HOTPLUG_MATCH(ev.dev);
+			if( hotplug.active == NULL && id != NULL ){
+				MT7921_BRING_UP(ev.dev, id);
+				if( return_context >= 0 ){
+					pthread_mutex_lock(&hotplug.lock);
+					hotplug.active = libusb_ref_device(ev.dev);
+					pthread_cond_broadcast(&hotplug.cond);
+					pthread_mutex_unlock(&hotplug.lock);
+				}
+			}
+		}else if( ev.dev == hotplug.active ){
+			DEBUG_PRINTF("[!] %s has been unplugged!\n", device_context->device_name);
+			MT7921_TEAR_DOWN();
+			pthread_mutex_lock(&hotplug.lock);
+			libusb_unref_device(hotplug.active);
+			hotplug.active = NULL;
+			pthread_cond_broadcast(&hotplug.cond);
+			pthread_mutex_unlock(&hotplug.lock);
+		}
+		libusb_unref_device(ev.dev);
+	}
+	return NULL;
+}
+
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_BRING_UP(libusb_device *dev, const struct mt7921_usb_id *id){
+	struct libusb_device_handle *handle = NULL;
+
+	if( libusb_open(dev, &handle) < 0 ){
+		return_context = -ERROR_DEV_NOT_FOUND;
+		return;
+	}
+	MT7921_LIST[id->device].device_handler = handle;
+	// set the device context
+	device_context			  = &MT7921_LIST[id->device];
+	device_context->device_id	  = id;
+	device_context->device_cb	  = id->ops;
+	device_context->dev_flags.quirks = id->quirks;
+	DEBUG_PRINTF("[!] found a new device: %s!\n", device_context->device_name);
+	/** reproduce the driver's init sequence **/
+	MT7921_INIT();
+	return_context = NO_ERROR;
+}
+
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_TEAR_DOWN(void){
+	if( device_context == NULL ){
+		return;
+	}
+	MT7921_EXIT();
+	libusb_close(device_context->device_handler);
+	device_context->device_handler = NULL;
+	device_context		       = NULL;
+}
+
+/** wait until an adapter has been brought up, 0 waits forever **/
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_HOTPLUG_WAIT(unsigned int timeout_ms){
+	struct timespec deadline = { 0 };
+	int ret			 = 0;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec  += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if( deadline.tv_nsec >= 1000000000L ){
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&hotplug.lock);
+	while( hotplug.active == NULL && ret == 0 ){
+		if( timeout_ms == 0 ){
+			ret = pthread_cond_wait(&hotplug.cond, &hotplug.lock);
+		}else{
+			ret = pthread_cond_timedwait(&hotplug.cond, &hotplug.lock, &deadline);
+		}
+	}
+	return_context = ( hotplug.active != NULL ) ? NO_ERROR : -ERROR_OUT_OF_TIME;
+	pthread_mutex_unlock(&hotplug.lock);
+}
+
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_HOTPLUG_STOP(void){
+	if( !hotplug.running ){
+		return;
+	}
+	if( hotplug.registered ){
+		libusb_hotplug_deregister_callback(NULL, hotplug.handle);
+		hotplug.registered = FALSE;
+	}
+	pthread_mutex_lock(&hotplug.lock);
+	hotplug.running = FALSE;
+	pthread_cond_broadcast(&hotplug.cond);
+	pthread_mutex_unlock(&hotplug.lock);
+	if( hotplug.event_thread ){
+		pthread_join(hotplug.event_thread, NULL);
+	}
+	pthread_join(hotplug.worker_thread, NULL);
+	while( hotplug.head != hotplug.tail ){
+		libusb_unref_device(hotplug.queue[hotplug.head % MT7921_HOTPLUG_EVENTS].dev);
+		hotplug.head++;
+	}
+}
+
 /** MAIN DETECTION ROUTINE, IT WILL BE MERGED IN THE GENERIC SUBSYSTEM USB INTERFACE SOON! **/
+/** the bus is enumerated a single time, then attach/detach events bring the adapter up and down **/
 MT7921_DISABLE_INSTRUMENT static inline void MT7921_INITIALIZE_USB_INTERFACE(void){
-        libusb_init(NULL);
-        struct libusb_device_handle *dev = NULL;
-        for(short j = 0; j < TIMING_COUNTER; j++){
-                for(int z = 0; MT7921_LIST[z].device_name != NULL; z++){
-                        dev = libusb_open_device_with_vid_pid(NULL, MT7921_LIST[z].device_pid, MT7921_LIST[z].device_vid);
-                        if( dev != NULL ){
-                                MT7921_LIST[z].device_handler = dev;
-                                // set the device context
-                                device_context = &MT7921_LIST[z];
-                                DEBUG_PRINTF("[!] found a new device: %s!\n", device_context->device_name);
-                                return;
-                        }
-                        if( MT7921_LIST[z + 1].device_name == NULL ){
-                                z -= z;
-                        }
-                }
+	libusb_device **list		   = NULL;
+	ssize_t count			   = 0;
+	const struct mt7921_usb_id *id	   = NULL;
 
-                sleep(TIMING_COUNTER / TIMING_COUNTER);
-        }
-        DEBUG_PRINTF("[!] failed to search for a new device!\n");
-        exit(-ERROR_DEV_NOT_FOUND);
+	if( !MT7921_ID_TABLE_SORTED() ){
+		DEBUG_PRINTF("[%s][line %d] mt7921_usb_ids is not sorted by vid, pid and bcd_lo, or two ranges overlap\n", __FUNCTION__, __LINE__);
+		exit(-ERROR_INVALID_ARGS);
+	}
+	libusb_init(NULL);
+	if( !libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) ){
+		count = libusb_get_device_list(NULL, &list);
+		for(ssize_t i = 0; i < count; i++){
+			id = MT7921_HOTPLUG_MATCH(list[i]);
+			if( id != NULL ){
+				MT7921_BRING_UP(list[i], id);
+				break;
+			}
+		}
+		libusb_free_device_list(list, 1);
+		if( device_context == NULL ){
+			DEBUG_PRINTF("[!] failed to search for a new device!\n");
+			exit(-ERROR_DEV_NOT_FOUND);
+		}
+		return;
+	}
+
+	hotplug.running = TRUE;
+	if( pthread_create(&hotplug.worker_thread, NULL, MT7921_HOTPLUG_WORKER_THREAD, NULL) != 0 ){
+		hotplug.running = FALSE;
+		exit(-ERROR_DEV_NOT_FOUND);
+	}
+	/** LIBUSB_HOTPLUG_ENUMERATE reports the adapters already plugged as arrivals **/
+	if( libusb_hotplug_register_callback(NULL,
+					LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+					LIBUSB_HOTPLUG_ENUMERATE,
+					LIBUSB_HOTPLUG_MATCH_ANY,
+					LIBUSB_HOTPLUG_MATCH_ANY,
+					LIBUSB_HOTPLUG_MATCH_ANY,
+					MT7921_HOTPLUG_CALLBACK,
+					NULL,
+					&hotplug.handle) == LIBUSB_SUCCESS ){
+		hotplug.registered = TRUE;
+	}
+	if( !hotplug.registered || pthread_create(&hotplug.event_thread, NULL, MT7921_HOTPLUG_EVENT_THREAD, NULL) != 0 ){
+		DEBUG_PRINTF("[%s][line %d] failed to register for hotplug events\n", __FUNCTION__, __LINE__);
+		MT7921_HOTPLUG_STOP();
+		exit(-ERROR_DEV_NOT_FOUND);
+	}
+
+	MT7921_HOTPLUG_WAIT(TIMING_COUNTER * 1000);
+	if( return_context < 0 ){
+		DEBUG_PRINTF("[!] failed to search for a new device!\n");
+		exit(-ERROR_DEV_NOT_FOUND);
+	}
+}
+
+MT7921_DISABLE_INSTRUMENT static inline void MT7921_DEINITIALIZE_USB_INTERFACE(void){
+	MT7921_HOTPLUG_STOP();
+	MT7921_TEAR_DOWN();
+	if( hotplug.active != NULL ){
+		libusb_unref_device(hotplug.active);
+		hotplug.active = NULL;
+	}
+	libusb_exit(NULL);
 }
 
 
 int main(int argc, char *argv[], char *envp[]){
 	MT7921_INITIALIZE_USB_INTERFACE();
-        /** reproduce the driver's init sequence **/
+        /** the driver's init sequence runs from the hotplug worker on attach **/
 
+	MT7921_DEINITIALIZE_USB_INTERFACE();
 	return 0;
 }
 
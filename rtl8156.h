@@ -41,7 +41,12 @@ enum rtl8152_flags {
 #define EEE_NWAY_EN		0x1000
 #define TX_QUIET_EN		0x0200
 #define RX_QUIET_EN		0x0100
+#define sd_rise_time_mask	0x0070
+#define sd_rise_time(x)		(((x) & 0x7) << 4)	/* bit 4 ~ 6 */
 
+/* OCP_EEE_CONFIG3 */
+#define fast_snr_mask		0xff80
+#define fast_snr(x)		(((x) & 0x1ff) << 7)	/* bit 7 ~ 15 */
 
 /* OCP_EEE_CONFIG2 */
 #define RG_LPIHYS_NUM		0x7000	/* bit 12 ~ 15 */
@@ -50,6 +55,12 @@ enum rtl8152_flags {
 #define RG_CKRSEL		0x0020
 #define RG_EEEPRG_EN		0x0010
 
+/* OCP_ALDPS_CONFIG */
+#define ENPWRSAVE		0x8000
+#define ENPDNPS			0x0200
+#define LINKENA			0x0100
+#define DIS_SDSAVE		0x0010
+
 /* OCP_POWER_CFG */
 #define EEE_CLKDIV_EN		0x8000
 #define EN_ALDPS		0x0004
@@ -184,6 +195,12 @@ enum rtl8152_flags {
 #define TALLY_RESET		0x0001
 #define LINK_STATUS		0x02
 
+/* PLA_PHYSTATUS */
+#define _10bps			0x04
+#define _100bps			0x08
+#define _1000bps		0x10
+#define _2500bps		BIT(10)
+
 /* USB_BMU_RESET */
 #define BMU_RESET_EP_IN		0x01
 #define BMU_RESET_EP_OUT	0x02
@@ -14,11 +14,24 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <endian.h>
 #include <stddef.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+	#include <arm_neon.h>
+#endif
 
 #define DEBUG_V2		0
 #define DEBUG_V1		1
@@ -52,6 +65,11 @@
 #include <linux/mdio.h>
 #include <linux/mii.h>
 #include <linux/const.h>
+#include <linux/in.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
 #include <libusb-1.0/libusb.h>
 
 #else
@@ -81,6 +99,10 @@
 	#define swab32 __swab32
 #endif
 
+#ifndef swab16
+	#define swab16 __swab16
+#endif
+
 #ifndef RTL81XX_ADVANCED_IO
         #define RTL81XX_OPTYPE_READ     0
         #define RTL81XX_OPTYPE_WRITE    1
@@ -136,6 +158,11 @@ enum RTL81XX_INTERFACE_MODE{
 	RTL81XX_MULTICAST_MODE = 1,
 };
 
+/** past this many groups the hash filter lets almost everything through, accept all multicast instead **/
+#ifndef RTL81XX_MC_FILTER_LIMIT
+	#define RTL81XX_MC_FILTER_LIMIT	32
+#endif
+
 struct tx_desc {
 	__le32 opts1;
 #define TX_FS			BIT(31) /* First segment of a packet */
@@ -157,6 +184,892 @@ struct tx_desc {
 #define TX_VLAN_TAG		BIT(16)
 };
 
+struct rx_desc {
+	__le32 opts1;
+#define RD_CRC			BIT(15)
+#define RX_LEN_MASK		0x7fff
+	__le32 opts2;
+#define RD_UDP_CS		BIT(23)
+#define RD_TCP_CS		BIT(22)
+#define RD_IPV6_CS		BIT(20)
+#define RD_IPV4_CS		BIT(19)
+#define RX_VLAN_TAG		BIT(16)
+	__le32 opts3;
+#define IPF			BIT(23) /* IP checksum fail */
+#define UDPF			BIT(22) /* UDP checksum fail */
+#define TCPF			BIT(21) /* TCP checksum fail */
+	__le32 opts4;
+	__le32 opts5;
+	__le32 opts6;
+};
+
+/** every frame inside an aggregated bulk-IN buffer starts 8 bytes aligned **/
+#ifndef RX_ALIGN
+	#define RX_ALIGN		8
+#endif
+
+#ifndef RTL81XX_BULK_IN_EP
+	#define RTL81XX_BULK_IN_EP	0x81
+	#define RTL81XX_BULK_OUT_EP	0x02
+#endif
+
+/** number of bulk-IN transfers kept queued at any time **/
+#ifndef RTL81XX_RX_URB_NUM
+	#define RTL81XX_RX_URB_NUM	10
+#endif
+
+/** size of a single aggregated bulk-IN buffer, the same value used by r8152 for the RTL8153B/RTL8156 **/
+#ifndef RTL81XX_RX_AGG_SIZE
+	#define RTL81XX_RX_AGG_SIZE	(48 * 1024)
+#endif
+
+/** maximum number of frame views handed to the consumer in a single call **/
+#ifndef RTL81XX_RX_BATCH
+	#define RTL81XX_RX_BATCH	64
+#endif
+
+/** failed bulk-IN completions in a row after which a buffer is parked instead of resubmitted **/
+#ifndef RTL81XX_RX_ERR_RETRY
+	#define RTL81XX_RX_ERR_RETRY	8
+#endif
+
+/** the parked bulk-IN buffers go back to the chip after this long (ms) **/
+#ifndef RTL81XX_RX_ERR_BACKOFF_MS
+	#define RTL81XX_RX_ERR_BACKOFF_MS	100
+#endif
+
+/** rx coalescing timer in ns, the r8152 default for super speed links **/
+#ifndef RTL81XX_RX_COALESCE
+	#define RTL81XX_RX_COALESCE	85000U
+#endif
+
+/** hybrid polling: spin for this long without completions before blocking again **/
+#ifndef RTL81XX_RX_POLL_IDLE_US
+	#define RTL81XX_RX_POLL_IDLE_US	1000
+#endif
+
+/** while the push mode completion thread runs, the other threads waiting for a transfer sleep this long (us) between two checks **/
+#ifndef RTL81XX_RX_POLL_PARK_US
+	#define RTL81XX_RX_POLL_PARK_US	50
+#endif
+
+/** how the push mode completion thread waits for the bulk-IN transfers **/
+enum rtl_rx_poll_mode_t{
+	RTL81XX_RX_POLL_EVENT,		/** block inside libusb until something completes **/
+	RTL81XX_RX_POLL_BUSY,		/** spin with a zero timeout, the thread keeps its core **/
+	RTL81XX_RX_POLL_HYBRID,		/** spin while traffic flows, block after RTL81XX_RX_POLL_IDLE_US without completions **/
+};
+
+struct rtl_rx_urb;
+
+/** checksum status reported by the chip for a received frame **/
+enum rtl_rx_csum_t{
+	RTL81XX_RX_CSUM_NONE,		/** not verified, the consumer has to check it **/
+	RTL81XX_RX_CSUM_OK,		/** IP and TCP/UDP checksums verified **/
+	RTL81XX_RX_CSUM_BAD,		/** the chip found a wrong checksum **/
+};
+
+/** BUFFER SLAB **/
+
+/** ids of the slabs, every thread keeps a small cache for each one of them **/
+enum rtl_slab_id_t{
+	RTL81XX_SLAB_PKT,
+	RTL81XX_SLAB_RX,
+	RTL81XX_SLAB_TX,
+	RTL81XX_SLAB_MAX,
+};
+
+#define RTL81XX_SLAB_HUGEPAGE	BIT(0)	/** try MAP_HUGETLB first **/
+#define RTL81XX_SLAB_DEV_MEM	BIT(1)	/** try usbfs memory first, the kernel does not bounce it **/
+
+/** slots kept by every thread before touching the global free list **/
+#ifndef RTL81XX_SLAB_CACHE_SIZE
+	#define RTL81XX_SLAB_CACHE_SIZE	32
+#endif
+
+/** packet buffers, each one holds a frame of the biggest MTU supported plus its descriptor **/
+#ifndef RTL81XX_PKT_SLAB_SLOTS
+	#define RTL81XX_PKT_SLAB_SLOTS	1024
+#endif
+
+#ifndef RTL81XX_PKT_SLAB_FLAGS
+	#define RTL81XX_PKT_SLAB_FLAGS	RTL81XX_SLAB_HUGEPAGE
+#endif
+
+/** room left in front of every packet buffer, enough for a rx_desc or a tx_desc **/
+#ifndef RTL81XX_PKT_HEADROOM
+	#define RTL81XX_PKT_HEADROOM	ALIGN(sizeof(struct rx_desc), RX_ALIGN)
+#endif
+
+#ifndef RTL81XX_HUGEPAGE_SIZE
+	#define RTL81XX_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+#endif
+
+/**
+ * fixed size slots carved from a single region. The global free list is a
+ * Treiber stack, free_head holds an ABA tag in the upper 32 bits and the
+ * index of the first free slot plus one in the lower 32 bits.
+ */
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_slab{
+	uint8_t			*base;
+	size_t			 region_size;
+	uint32_t		 slot_size;
+	uint32_t		 slot_count;
+	uint32_t		*next;
+	volatile uint64_t	 free_head;
+	uint32_t		 generation;
+	enum rtl_slab_id_t	 id;
+	bool			 is_hugepage;
+	bool			 is_dev_mem;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_slab_cache{
+	uint32_t	generation;
+	uint32_t	count;
+	uint32_t	slot[RTL81XX_SLAB_CACHE_SIZE];
+};
+
+/** view of a received frame, data points inside the bulk-IN buffer and it is never copied **/
+struct rtl_rx_frame{
+	uint8_t			*data;
+	uint32_t		 len;
+	uint8_t			 csum;		/** enum rtl_rx_csum_t **/
+	bool			 has_vlan;	/** the chip stripped an 802.1Q tag, see RTL81XX_FEATURE_RX_VLAN **/
+	uint16_t		 vlan_tci;	/** host order, valid when has_vlan is set **/
+	struct rx_desc		*desc;
+	struct rtl_rx_urb	*urb;		/** owner of the buffer, see RTL81XX_RX_FRAME_HOLD **/
+};
+
+typedef void (*rtl_rx_consumer_t)(struct rtl_rx_frame *frames, unsigned int count, void *priv);
+
+/** every tx_desc inside an aggregated bulk-OUT buffer starts 8 bytes aligned **/
+#ifndef TX_ALIGN
+	#define TX_ALIGN		8
+#endif
+
+/** number of bulk-OUT buffers, one is filled while the others are in flight **/
+#ifndef RTL81XX_TX_URB_NUM
+	#define RTL81XX_TX_URB_NUM	4
+#endif
+
+/** size of a single aggregated bulk-OUT buffer, the r8152 agg_buf_sz **/
+#ifndef RTL81XX_TX_AGG_SIZE
+	#define RTL81XX_TX_AGG_SIZE	(16 * 1024)
+#endif
+
+/** a partially filled bulk-OUT buffer is sent after this time (us) **/
+#ifndef RTL81XX_TX_FLUSH_US
+	#define RTL81XX_TX_FLUSH_US	50
+#endif
+
+struct rtl_tx_agg;
+
+/** what the flusher is waiting for, RTL81XX_TX_KICK_LOCKED wakes it accordingly **/
+enum rtl_tx_flusher_t{
+	RTL81XX_TX_FLUSHER_BUSY,
+	RTL81XX_TX_FLUSHER_IDLE,	/** on kick_cond, nothing to send nor to reap **/
+	RTL81XX_TX_FLUSHER_REAPING,	/** inside libusb without a flush deadline **/
+};
+
+/** the flusher reaps the bulk-OUT completions in slices of this length (us) when no buffer is being filled **/
+#ifndef RTL81XX_TX_REAP_US
+	#define RTL81XX_TX_REAP_US	100000
+#endif
+
+/** biggest TCP super-frame accepted by RTL81XX_DO_TRANSMIT_GSO, L2 header excluded **/
+#ifndef RTL81XX_GSO_MAX_SIZE
+	#define RTL81XX_GSO_MAX_SIZE	65535
+#endif
+
+/** below this size the scalar checksum is faster than the vector kernels **/
+#ifndef RTL81XX_CSUM_SIMD_MIN
+	#define RTL81XX_CSUM_SIMD_MIN	128
+#endif
+
+/** a computed checksum of zero is sent as all ones, zero means "no checksum" for UDP **/
+#ifndef CSUM_MANGLED_0
+	#define CSUM_MANGLED_0		0xffff
+#endif
+
+typedef uint64_t (*rtl_csum_partial_t)(const void *buf, uint32_t len, uint64_t sum);
+
+/** PACKET INJECTION **/
+
+#define RTL81XX_INJECT_PENDING	1	/** status of a frame still queued or in flight **/
+
+/** status: RTL81XX_INJECT_PENDING, NO_ERROR once the bulk-OUT transfer completed, a negative error_handler_t otherwise **/
+struct rtl_inject_frame{
+	void		*data;
+	uint32_t	 len;
+	volatile int32_t status;
+};
+
+struct rtl_inject_batch;
+typedef void (*rtl_inject_cb_t)(struct rtl_inject_batch *batch);
+
+/**
+ * owned by the caller, it must stay valid until pending drops to zero. done
+ * runs on the thread that reaps the bulk-OUT completions, it must not block
+ * and it must not transmit.
+ */
+struct rtl_inject_batch{
+	struct rtl_inject_frame	*frames;
+	unsigned int		 count;
+	volatile unsigned int	 pending;
+	rtl_inject_cb_t		 done;
+	void			*priv;
+};
+
+/** frame queued by RTL81XX_INJECT_BATCH, its status is written when the transfer completes **/
+struct rtl_tx_track{
+	struct rtl_inject_frame	*frame;
+	struct rtl_inject_batch	*batch;
+};
+
+/** SINGLE CONSUMER WAKE-UP **/
+
+/** a consumer thread parks here once its queue is empty, the producer wakes it only when it is parked **/
+struct rtl_waiter{
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	volatile int		sleeping;
+};
+
+/** the rest of the ring is skipped, the next record starts at offset 0 **/
+#define RTL81XX_COPY_RING_WRAP		0xffffffffU
+
+/**
+ * single producer byte ring for the frames copied out of the bulk-IN buffers,
+ * every record starts with its size (uint32_t) and is 16 bytes aligned.
+ */
+struct rtl_copy_ring{
+	uint8_t			*data;
+	uint32_t		 size;		/** power of two **/
+	volatile uint32_t	 head __attribute__((aligned(64)));
+	volatile uint32_t	 tail __attribute__((aligned(64)));
+};
+
+/** PCAPNG CAPTURE **/
+
+/** bytes of frames copied by the receive path and waiting for the writer thread, power of two **/
+#ifndef RTL81XX_CAPTURE_RING_SIZE
+	#define RTL81XX_CAPTURE_RING_SIZE	(32U * 1024 * 1024)
+#endif
+
+/** size of every capture file, each one is pre-allocated and mapped **/
+#ifndef RTL81XX_CAPTURE_FILE_SIZE
+	#define RTL81XX_CAPTURE_FILE_SIZE	(256ULL * 1024 * 1024)
+#endif
+
+/** files written in a ring before the oldest is overwritten **/
+#ifndef RTL81XX_CAPTURE_FILES
+	#define RTL81XX_CAPTURE_FILES		8
+#endif
+
+#define PCAPNG_BLOCK_SHB		0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB		0x00000001
+#define PCAPNG_BLOCK_EPB		0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC		0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET	1
+#define PCAPNG_OPT_ENDOFOPT		0
+#define PCAPNG_OPT_IF_TSRESOL		9
+
+/** record of the capture ring, the frame follows it **/
+struct rtl_capture_entry{
+	uint32_t		 size;
+	uint32_t		 len;
+	uint64_t		 ts_ns;
+};
+
+struct rtl_capture_file{
+	int			 fd;
+	uint8_t			*map;
+	uint64_t		 map_size;
+	uint64_t		 pos;
+};
+
+/** SOFTWARE RECEIVE SIDE SCALING **/
+
+#ifndef RTL81XX_RSS_MAX_WORKERS
+	#define RTL81XX_RSS_MAX_WORKERS		16
+#endif
+
+/** bytes of copied frames waiting for each worker, power of two **/
+#ifndef RTL81XX_RSS_RING_SIZE
+	#define RTL81XX_RSS_RING_SIZE		(4U * 1024 * 1024)
+#endif
+
+/** 802.1Q tag, linux/if_vlan.h is not exported to user space **/
+#ifndef VLAN_HLEN
+	#define VLAN_HLEN			4
+#endif
+
+/** mixes the flow key words into the hash that picks the worker **/
+typedef uint32_t (*rtl_rss_mix_t)(const uint32_t *key, unsigned int words);
+
+struct rtl_rss_stats{
+	uint64_t	enqueued;
+	uint64_t	dropped;	/** queue full, the receive path never waits for a worker **/
+	uint64_t	processed;
+	uint32_t	depth;
+	uint32_t	max_depth;
+};
+
+/** record of a worker ring, the view points to the copy that follows it **/
+struct rtl_rss_entry{
+	uint32_t		 size;
+	uint32_t		 reserved;
+	struct rtl_rx_frame	 frame;
+	struct rx_desc		 desc;
+};
+
+/** single producer (RX completion thread), single consumer (worker) **/
+struct rtl_rss_queue{
+	struct rtl_copy_ring	 ring;
+	struct rtl_waiter	 waiter;
+	/** producer side **/
+	uint64_t		 enqueued;
+	uint64_t		 dropped;
+	uint32_t		 max_depth;
+	/** consumer side **/
+	volatile uint64_t	 processed __attribute__((aligned(64)));
+	pthread_t		 thread;
+}__attribute__((aligned(64)));
+
+/** MAC statistics block at PLA_TALLYCNT, struct tally_counter of r8152 **/
+struct tally_counter{
+	__le64	tx_packets;
+	__le64	rx_packets;
+	__le64	tx_errors;
+	__le32	rx_errors;
+	__le16	rx_missed;	/** frames lost because the RX FIFO was full **/
+	__le16	align_errors;
+	__le32	tx_one_collision;
+	__le32	tx_multi_collision;
+	__le64	rx_unicast;
+	__le64	rx_broadcast;
+	__le32	rx_multicast;
+	__le16	tx_aborted;
+	__le16	tx_underrun;
+};
+
+/** PERIODIC WORKERS **/
+
+struct rtl_periodic;
+
+/** TALLY COUNTERS **/
+
+/** period of the background sampler **/
+#ifndef RTL81XX_TALLY_INTERVAL_MS
+	#define RTL81XX_TALLY_INTERVAL_MS	1000
+#endif
+
+/** decoded tally block, the hardware counters extended to 64 bits **/
+struct rtl_tally_stats{
+	uint64_t	ts_ns;		/** CLOCK_MONOTONIC of the sample **/
+	uint64_t	tx_packets;
+	uint64_t	rx_packets;
+	uint64_t	tx_errors;
+	uint64_t	rx_errors;
+	uint64_t	rx_missed;
+	uint64_t	align_errors;
+	uint64_t	tx_one_collision;
+	uint64_t	tx_multi_collision;
+	uint64_t	rx_unicast;
+	uint64_t	rx_broadcast;
+	uint64_t	rx_multicast;
+	uint64_t	tx_aborted;
+	uint64_t	tx_underrun;
+};
+
+/** where each hardware counter lives and how wide it is **/
+struct rtl_tally_field{
+	uint8_t		raw;		/** offset inside struct tally_counter **/
+	uint8_t		width;		/** bytes **/
+	uint8_t		stat;		/** offset inside struct rtl_tally_stats **/
+};
+
+/** ADAPTIVE FLOW CONTROL **/
+
+/** period of the controller **/
+#ifndef RTL81XX_FC_INTERVAL_MS
+	#define RTL81XX_FC_INTERVAL_MS		100
+#endif
+
+/** the thresholds move by this much for each adjustment, FIFO free space in bytes **/
+#ifndef RTL81XX_FC_STEP
+	#define RTL81XX_FC_STEP			1024
+#endif
+
+/** quiet periods in a row before the pause-on threshold is lowered again **/
+#ifndef RTL81XX_FC_RELAX_PERIODS
+	#define RTL81XX_FC_RELAX_PERIODS	50
+#endif
+
+/** the pause-off threshold is kept this much above the pause-on one, as r8156_fc_parameter does **/
+#define RTL81XX_FC_HYSTERESIS		(8 * 1024)
+
+/** the pause-on threshold stays between one maximum frame plus these margins **/
+#define RTL81XX_FC_MIN_MARGIN		(2 * 1024)
+#define RTL81XX_FC_MAX_MARGIN		(16 * 1024)
+
+#define RTL81XX_FC_EVENTS		64
+
+struct rtl_fc_event{
+	uint64_t	ts_ns;		/** CLOCK_MONOTONIC **/
+	uint32_t	missed;		/** FIFO overruns seen during the period **/
+	uint32_t	pause_on;	/** new thresholds in bytes **/
+	uint32_t	pause_off;
+};
+
+/** LINK POWER MANAGEMENT GOVERNOR **/
+
+#ifndef RTL81XX_LPM_INTERVAL_MS
+	#define RTL81XX_LPM_INTERVAL_MS		10
+#endif
+
+/** idle time before U1/U2, then U2P3, are allowed **/
+#ifndef RTL81XX_LPM_U1U2_IDLE_MS
+	#define RTL81XX_LPM_U1U2_IDLE_MS	50
+#endif
+
+#ifndef RTL81XX_LPM_U2P3_IDLE_MS
+	#define RTL81XX_LPM_U2P3_IDLE_MS	500
+#endif
+
+/** RX + TX packets per second, the link is idle at or below the first one and busy above the second **/
+#ifndef RTL81XX_LPM_ENTER_PPS
+	#define RTL81XX_LPM_ENTER_PPS		100
+#endif
+
+#ifndef RTL81XX_LPM_EXIT_PPS
+	#define RTL81XX_LPM_EXIT_PPS		1000
+#endif
+
+/** passed to 'rtl_lpm_start', a zero field picks the RTL81XX_LPM_* default **/
+struct rtl_lpm_cfg{
+	unsigned int	interval_ms;
+	unsigned int	u1u2_idle_ms;
+	unsigned int	u2p3_idle_ms;
+	unsigned int	enter_pps;
+	unsigned int	exit_pps;
+};
+
+struct rtl_lpm_stats{
+	uint64_t	u1u2_entries;
+	uint64_t	u2p3_entries;
+	uint64_t	exits;			/** traffic came back while a low power state was allowed **/
+	uint64_t	u1u2_ns;		/** time spent with U1/U2 allowed **/
+	uint64_t	u2p3_ns;
+	/** from the start of the period that saw the traffic to the end of the disabling writes **/
+	uint64_t	exit_latency_ns;
+	uint64_t	exit_latency_max_ns;
+	uint64_t	exit_packets;		/** packets of those periods, they could have paid a link wake-up **/
+};
+
+/** LOAD ADAPTIVE EEE, ALDPS AND GREEN ETHERNET **/
+
+#ifndef RTL81XX_PWR_INTERVAL_MS
+	#define RTL81XX_PWR_INTERVAL_MS		20
+#endif
+
+/** time the utilisation has to stay low before the power saving features are switched on **/
+#ifndef RTL81XX_PWR_IDLE_MS
+	#define RTL81XX_PWR_IDLE_MS		200
+#endif
+
+/** RX + TX bits over the link speed, in per mille: low at or below the first one, busy above the second **/
+#ifndef RTL81XX_PWR_ENTER_PERMILLE
+	#define RTL81XX_PWR_ENTER_PERMILLE	50
+#endif
+
+#ifndef RTL81XX_PWR_EXIT_PERMILLE
+	#define RTL81XX_PWR_EXIT_PERMILLE	300
+#endif
+
+/** small frames that barely load the link but pay for every LPI wake-up **/
+#ifndef RTL81XX_PWR_BURST_PPS
+	#define RTL81XX_PWR_BURST_PPS		5000
+#endif
+
+#ifndef RTL81XX_PWR_EVENTS
+	#define RTL81XX_PWR_EVENTS		64
+#endif
+
+#define RTL81XX_PWR_EEE			BIT(0)	/** LPI of the MAC, EEE_RX_EN and EEE_TX_EN of PLA_EEE_CR **/
+#define RTL81XX_PWR_ALDPS		BIT(1)
+#define RTL81XX_PWR_GREEN		BIT(2)	/** GREEN_ETH_EN of SRAM_GREEN_CFG **/
+#define RTL81XX_PWR_ALL			(RTL81XX_PWR_EEE | RTL81XX_PWR_ALDPS | RTL81XX_PWR_GREEN)
+
+/** passed to 'rtl_pwr_start', a zero field picks the RTL81XX_PWR_* default **/
+struct rtl_pwr_cfg{
+	unsigned int	interval_ms;
+	unsigned int	idle_ms;
+	unsigned int	enter_permille;
+	unsigned int	exit_permille;
+	unsigned int	burst_pps;
+	unsigned long	features;	/** RTL81XX_PWR_*, the ones the chip lacks are dropped **/
+};
+
+/** one switch of the power saving features **/
+struct rtl_pwr_event{
+	uint64_t	ts_ns;		/** CLOCK_MONOTONIC, end of the register writes **/
+	uint64_t	duration_ns;	/** register writes, ocp_lock included **/
+	uint64_t	reaction_ns;	/** exits only, from the start of the period that saw the burst **/
+	uint32_t	speed;		/** Mbps, 0 while the link is down **/
+	uint32_t	util;		/** per mille of the period **/
+	uint32_t	pps;
+	uint32_t	on;		/** RTL81XX_PWR_* left on **/
+};
+
+struct rtl_pwr_stats{
+	uint64_t		entries;
+	uint64_t		exits;
+	uint64_t		saving_ns;		/** time spent with the features on **/
+	uint64_t		enter_ns;
+	uint64_t		enter_max_ns;
+	/** the latency paid by a burst: ALDPS waits for the PHY, everything holds ocp_lock **/
+	uint64_t		exit_ns;
+	uint64_t		exit_max_ns;
+	uint64_t		exit_reaction_ns;
+	uint64_t		exit_reaction_max_ns;
+	uint64_t		exit_packets;		/** packets of the periods that ended a power saving phase **/
+	/** events[(entries + exits) % RTL81XX_PWR_EVENTS] is the next slot **/
+	struct rtl_pwr_event	events[RTL81XX_PWR_EVENTS];
+};
+
+/** STALL WATCHDOG **/
+
+#ifndef RTL81XX_WD_INTERVAL_MS
+	#define RTL81XX_WD_INTERVAL_MS		100
+#endif
+
+/** age of a bulk-OUT transfer that counts as a stall, the kernel uses a 5s watchdog_timeo **/
+#ifndef RTL81XX_WD_TX_TIMEOUT_MS
+	#define RTL81XX_WD_TX_TIMEOUT_MS	5000
+#endif
+
+/** failed bulk-IN completions in a period without a single good one **/
+#ifndef RTL81XX_WD_RX_ERRORS
+	#define RTL81XX_WD_RX_ERRORS		16
+#endif
+
+/** control transfers failed in a row **/
+#ifndef RTL81XX_WD_CTRL_FAILURES
+	#define RTL81XX_WD_CTRL_FAILURES	3
+#endif
+
+/** a stall seen this soon after a recovery escalates to the next level **/
+#ifndef RTL81XX_WD_SETTLE_MS
+	#define RTL81XX_WD_SETTLE_MS		10000
+#endif
+
+/** time given to the cancelled transfers to complete **/
+#ifndef RTL81XX_WD_DRAIN_MS
+	#define RTL81XX_WD_DRAIN_MS		500
+#endif
+
+/** recovery levels, each one does what the previous did plus its own step **/
+#define RTL81XX_WD_CLEAR_HALT		1	/** libusb_clear_halt of both bulk endpoints **/
+#define RTL81XX_WD_RESET		2	/** RTL81XX_NIC_RESET and RTL81XX_RESET_BMU **/
+#define RTL81XX_WD_REINIT		3	/** RTL81XX_INIT and RTL81XX_POST_INIT, the registers of rtl_state_regs are put back **/
+
+/** endpoints that returned LIBUSB_TRANSFER_STALL **/
+#define RTL81XX_WD_HALT_IN		BIT(0)
+#define RTL81XX_WD_HALT_OUT		BIT(1)
+
+/** passed to 'rtl_wd_start', a zero field picks the RTL81XX_WD_* default **/
+struct rtl_wd_cfg{
+	unsigned int	interval_ms;
+	unsigned int	tx_timeout_ms;
+	unsigned int	rx_errors;
+	unsigned int	ctrl_failures;
+	unsigned int	settle_ms;
+};
+
+struct rtl_wd_stats{
+	/** what was detected **/
+	uint64_t	tx_stalls;		/** a bulk-OUT transfer older than tx_timeout_ms **/
+	uint64_t	mcu_stalls;		/** the same, while PLA_TCR0 never reported TCR0_TX_EMPTY **/
+	uint64_t	rx_stalls;		/** rx_errors failed bulk-IN completions and no good one **/
+	uint64_t	halts;			/** LIBUSB_TRANSFER_STALL on a bulk endpoint **/
+	uint64_t	ctrl_stalls;		/** ctrl_failures control transfers failed in a row **/
+	/** what was done, indexed by RTL81XX_WD_* level **/
+	uint64_t	recoveries[RTL81XX_WD_REINIT + 1];
+	uint64_t	failures;		/** recoveries whose control transfers failed **/
+	uint64_t	preserved;		/** buffers given back to the chip untouched, frames included **/
+	/** from the detection to the resubmission, the detection itself takes up to tx_timeout_ms **/
+	uint64_t	outage_ns;
+	uint64_t	outage_max_ns;
+};
+
+/** OVERLAPPED BRING-UP **/
+
+/** who runs a step of a rtl_init_step table **/
+#define RTL81XX_LANE_PHY		0	/** PHY OCP, firmware patch, the waits on the PHY **/
+#define RTL81XX_LANE_MAC		1	/** PLA and USB MCU, the caller of RTL81XX_BRINGUP_RUN **/
+#define RTL81XX_LANES			2
+/** a single thread runs the whole table, in table order **/
+#define RTL81XX_LANE_ALL		RTL81XX_LANES
+
+/** 'deps' is a bit mask of the step indexes **/
+#define RTL81XX_BRINGUP_STEPS		32
+
+/** a table is in dependency order, a step only depends on the ones before it **/
+struct rtl_init_step{
+	const char	*name;
+	void		(*fn)(void);
+	uint32_t	deps;		/** BIT() of the steps that must be finished first **/
+	uint8_t		lane;		/** RTL81XX_LANE_PHY or RTL81XX_LANE_MAC **/
+};
+
+/** of the last RTL81XX_BRINGUP_RUN, the times are from its start **/
+struct rtl_bringup_stats{
+	unsigned int	count;
+	bool		concurrent;	/** FALSE when the caller ran the whole table **/
+	uint64_t	start_ns[RTL81XX_BRINGUP_STEPS];
+	uint64_t	end_ns[RTL81XX_BRINGUP_STEPS];
+	signed int	status[RTL81XX_BRINGUP_STEPS];	/** return_context left by the step **/
+	uint64_t	total_ns;
+	uint64_t	serial_ns;	/** sum of the step durations, what the strictly ordered sequence pays **/
+	uint32_t	critical;	/** BIT() of the steps on the critical path **/
+	uint64_t	critical_ns;	/** time spent inside them **/
+};
+
+/** REGISTER SNAPSHOT **/
+
+/** one snapshot per adapter, named after its serial number; created 0700, refused when anyone else can write it **/
+#ifndef RTL81XX_STATE_DIR
+	#define RTL81XX_STATE_DIR		"/var/lib/rtl81xx"
+#endif
+
+#define RTL81XX_STATE_MAGIC		0x534c5452	/** "RTLS" **/
+/** bumped whenever rtl_state_regs changes, older files are ignored **/
+#define RTL81XX_STATE_FORMAT		1
+
+#define RTL81XX_SERIAL_LEN		64
+
+/** written between CRWECR_CONFIG and CRWECR_NORAML **/
+#define RTL81XX_STATE_CONFIG		BIT(0)
+/** PHY OCP register, reached through the PLA_OCP_GPHY_BASE page **/
+#define RTL81XX_STATE_PHY		BIT(1)
+
+/** a dword of the chip whose programmed value survives a re-enumeration **/
+struct rtl_state_reg{
+	uint16_t	type;		/** MCU_TYPE_PLA or MCU_TYPE_USB **/
+	uint16_t	addr;		/** dword aligned, the PHY OCP address with RTL81XX_STATE_PHY **/
+	uint8_t		byen;		/** bytes of the dword owned by the entry, BYTE_EN_START_MASK bits **/
+	uint8_t		flags;		/** RTL81XX_STATE_* **/
+};
+
+#define RTL81XX_STATE_REG(_type, _reg, _width, _flags)	\
+	{ .type = _type, .addr = (_reg) & ~3, .byen = ((1 << (_width)) - 1) << ((_reg) & 3), .flags = _flags }
+
+/** header of the snapshot file, one little endian dword per rtl_state_regs entry follows **/
+struct rtl_state_hdr{
+	uint32_t	magic;
+	uint16_t	format;
+	uint16_t	count;
+	uint16_t	vid;
+	uint16_t	pid;
+	uint32_t	version;	/** device_version_identifier **/
+	uint32_t	mtu;
+	uint32_t	crc;		/** RTL81XX_ETHER_CRC of the dwords **/
+	uint64_t	features;
+};
+
+/** control transfer of a RTL81XX_CTRL_BATCH **/
+struct rtl_ctrl_req{
+	uint8_t		request_type;	/** RTL8152_REQT_READ or RTL8152_REQT_WRITE **/
+	uint16_t	value;		/** register address **/
+	uint16_t	index;		/** MCU type and byte enables **/
+	uint16_t	len;
+	void		*data;
+	int		status;		/** bytes moved or a negative error **/
+};
+
+struct rtl_ctrl_batch{
+	unsigned int	pending;
+	int		done;		/** checked by libusb_handle_events_timeout_completed **/
+};
+
+struct rtl_ctrl_urb{
+	struct libusb_transfer	*transfer;
+	struct rtl_ctrl_req	*req;
+	struct rtl_ctrl_batch	*batch;
+};
+
+/** REGISTER SPACE DUMP **/
+
+/** bytes of a control read, the limit of generic_ocp_read, a multiple of 4 **/
+#ifndef RTL81XX_DUMP_CHUNK
+	#define RTL81XX_DUMP_CHUNK		64
+#endif
+/** reads in flight, a window is one RTL81XX_CTRL_BATCH **/
+#ifndef RTL81XX_DUMP_DEPTH
+	#define RTL81XX_DUMP_DEPTH		256
+#endif
+
+/** a part of the MCU_TYPE_PLA or MCU_TYPE_USB space **/
+struct rtl_dump_range{
+	uint16_t	type;
+	uint16_t	start;		/** dword aligned **/
+	uint32_t	length;		/** a multiple of 4, up to the end of the 64 KiB space **/
+};
+
+struct rtl_dump_result{
+	uint64_t	bytes;		/** in the file, short of the total after a failed read **/
+	uint64_t	duration_ns;
+	uint8_t		sha256[32];	/** of the bytes in the file **/
+};
+
+/** @done and @total are bytes of the whole dump, @range is the one being read **/
+typedef void (*rtl_dump_progress_t)(const struct rtl_dump_range *range, uint64_t done, uint64_t total, void *arg);
+
+struct rtl_sha256{
+	uint32_t	h[8];
+	uint64_t	bytes;
+	uint8_t		block[64];
+	unsigned int	fill;
+};
+
+/** HOTPLUG DRIVEN DISCOVERY **/
+
+/** attach/detach events waiting for the bring-up worker **/
+#ifndef RTL81XX_HOTPLUG_EVENTS
+	#define RTL81XX_HOTPLUG_EVENTS		16
+#endif
+
+/** the event thread comes back this often to notice a stop request **/
+#define RTL81XX_HOTPLUG_POLL_MS		100
+
+struct rtl_hotplug_event{
+	libusb_device		*dev;		/** referenced until the worker is done with it **/
+	libusb_hotplug_event	event;
+};
+
+/** EARLY DROP RX CLASSIFIER **/
+
+#ifndef RTL81XX_CLS_MAX_RULES
+	#define RTL81XX_CLS_MAX_RULES		32
+#endif
+
+/** fields a rule matches on, the others are wildcards **/
+#define RTL81XX_CLS_MATCH_DST_MAC	BIT(0)
+#define RTL81XX_CLS_MATCH_ETHERTYPE	BIT(1)
+#define RTL81XX_CLS_MATCH_VLAN		BIT(2)
+#define RTL81XX_CLS_MATCH_IP_PROTO	BIT(3)
+#define RTL81XX_CLS_MATCH_SRC_IP	BIT(4)
+#define RTL81XX_CLS_MATCH_DST_IP	BIT(5)
+#define RTL81XX_CLS_MATCH_SRC_PORT	BIT(6)
+#define RTL81XX_CLS_MATCH_DST_PORT	BIT(7)
+
+enum rtl_cls_action_t{
+	RTL81XX_CLS_ACCEPT = 0,
+	RTL81XX_CLS_DROP   = 1,
+};
+
+/** first matching rule wins, addresses in network order like struct iphdr, the rest in host order **/
+struct rtl_cls_rule{
+	uint32_t	fields;
+	uint8_t		dst_mac[ETH_ALEN];
+	uint16_t	ethertype;	/** inner one for tagged frames **/
+	uint16_t	vlan_id;
+	uint8_t		ip_proto;
+	uint32_t	src_ip;
+	uint8_t		src_prefix_len;
+	uint32_t	dst_ip;
+	uint8_t		dst_prefix_len;
+	uint16_t	src_port;
+	uint16_t	dst_port;
+	uint8_t		action;		/** enum rtl_cls_action_t **/
+};
+
+/** header fields of a frame at fixed offsets, one 256 bit compare tests a rule **/
+#define RTL81XX_CLS_KEY_VLAN		BIT(0)
+#define RTL81XX_CLS_KEY_IPV4		BIT(1)
+#define RTL81XX_CLS_KEY_PORTS		BIT(2)
+
+struct rtl_cls_key{
+	uint8_t		dst_mac[ETH_ALEN];
+	__be16		ethertype;
+	__be16		vlan_id;
+	uint8_t		ip_proto;
+	uint8_t		flags;		/** RTL81XX_CLS_KEY_* **/
+	uint32_t	src_ip;
+	uint32_t	dst_ip;
+	__be16		src_port;
+	__be16		dst_port;
+	uint8_t		pad[8];
+}__attribute__((aligned(32)));
+
+typedef void (*rtl_cls_match_t)(const struct rtl_cls_key *keys, unsigned int count, uint8_t *verdict);
+
+/** header offsets of a TCP/UDP frame **/
+struct rtl_gso_info{
+	uint16_t	l3_off;
+	uint16_t	l4_off;
+	uint16_t	hdr_len;
+	uint8_t		l4_proto;
+	bool		is_ipv6;
+};
+
+/** SHARED MEMORY RINGS BETWEEN THE HOST AND THE PLUGIN (AF_XDP LIKE) **/
+
+/** descriptors moved by the RX and TX rings, addr is an offset inside the UMEM **/
+struct rtl_xsk_desc{
+	uint64_t	addr;
+	uint32_t	len;
+	uint32_t	options;	/** RX: enum rtl_rx_csum_t **/
+};
+
+/** producer and consumer live on their own cache line, the entries follow the header **/
+struct rtl_xsk_ring_hdr{
+	volatile uint32_t	producer __attribute__((aligned(64)));
+	volatile uint32_t	consumer __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+/** bytes the host has to reserve for a ring, @entries must be a power of two **/
+#define RTL81XX_XSK_RING_MEM_SIZE(entries, entry_size)	( sizeof(struct rtl_xsk_ring_hdr) + (size_t)(entries) * (entry_size) )
+
+/**
+ * filled by the host and passed to 'rtl_xsk_bind'. The UMEM and the rings are
+ * owned by the host:
+ *	fill:       host -> plugin, UMEM addresses (uint64_t) free for RX
+ *	rx:         plugin -> host, struct rtl_xsk_desc of the received frames
+ *	tx:         host -> plugin, struct rtl_xsk_desc of the frames to send
+ *	completion: plugin -> host, UMEM addresses (uint64_t) of the frames sent
+ */
+struct rtl_xsk_umem_cfg{
+	void		*area;
+	uint64_t	 size;
+	uint32_t	 frame_size;
+	uint32_t	 headroom;	/** RX frames are written at addr + headroom **/
+	void		*fill_mem;
+	void		*rx_mem;
+	void		*tx_mem;
+	void		*comp_mem;
+	uint32_t	 fill_entries;
+	uint32_t	 rx_entries;
+	uint32_t	 tx_entries;
+	uint32_t	 comp_entries;
+};
+
+/** descriptors moved in a single ring operation **/
+#ifndef RTL81XX_XSK_BATCH
+	#define RTL81XX_XSK_BATCH	64
+#endif
+
+/** plugin side view of a ring, the cached indexes avoid touching the shared cache lines **/
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_xsk_ring{
+	struct rtl_xsk_ring_hdr	*hdr;
+	void			*entries;
+	uint32_t		 mask;
+	uint32_t		 size;
+	uint32_t		 cached_prod;
+	uint32_t		 cached_cons;
+};
+
 #if DEBUG_V1
         #pragma message("DEBUG_V1 FEATURE IS ENABLED!")
         static inline bool return_debug_choose(unsigned char *n){
@@ -221,33 +1134,283 @@ RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_READ_WORD(uint16_t type, u
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_WRITE_WORD(uint16_t type, uint16_t index, uint32_t data);
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_READ_DWORD(uint16_t type, uint16_t index);
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_WRITE_DWORD(uint16_t type, uint16_t index, uint32_t data);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_CLR_SET(uint16_t type, uint16_t index, uint8_t size, uint32_t clear, uint32_t set);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_SET_BITS(uint16_t type, uint16_t index, uint8_t size, uint32_t bits);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_CLR_BITS(uint16_t type, uint16_t index, uint8_t size, uint32_t bits);
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_REG_READ(uint16_t addr);
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_REG_WRITE(uint16_t addr, uint16_t data);
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_IO_SRAM(unsigned char op_type, uint16_t addr, uint16_t data);
 
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SELECT_OPS(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_INIT(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_POST_INIT(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_ETHER_ADDR(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DISABLE(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_NIC_RESET(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8152_NIC_RESET(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_NIC_RESET(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RESET_BMU(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HW_PHY_WORK(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_VLAN_ENABLE(unsigned char enable);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8152_RX_VLAN_ENABLE(unsigned char enable);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_RX_VLAN_ENABLE(unsigned char enable);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_FEATURES(unsigned long features);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_INITIALIZE_USB_INTERFACE(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_GET_HW_VERSION(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ASSIGN_MTU(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_MTU(unsigned int mtu);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_GET_WOWLAN(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_WOWLAN(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PHY_PATCH_REQUEST(bool request, bool wait);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ENABLE_GREEN_FEATURE(bool enable);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_GREEN_EN(bool enable);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_EEE_ENABLE(bool enable);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ALDPS_ENABLE(bool enable);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DEINITIALIZE_USB_INTERFACE(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_MAC_ADDR(unsigned char new_mac_addr[MAC_ADDR_LEN]);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_RX_MODE(enum RTL81XX_INTERFACE_MODE mode);
-RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LOAD_FIRMWARE(bool power_cut);
-RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DO_TRANSMIT(void *tx_buf, unsigned int tx_len);
-
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_ETHER_CRC(const uint8_t *data, int length);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WRITE_RX_FILTER(uint32_t rcr, uint32_t mc_filter[2]);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_MC_LIST(const uint8_t (*mc_list)[ETH_ALEN], unsigned int count);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LOAD_FIRMWARE(bool power_cut, unsigned int blocks);
+
+/** BUFFER SLAB **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SLAB_INIT(struct rtl_slab *slab, enum rtl_slab_id_t id, uint32_t slot_size, uint32_t slot_count, unsigned int flags);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SLAB_DESTROY(struct rtl_slab *slab);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_SLAB_POP(struct rtl_slab *slab);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_SLAB_PUSH(struct rtl_slab *slab, uint32_t index);
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_SLAB_ALLOC(struct rtl_slab *slab);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_SLAB_FREE(struct rtl_slab *slab, void *ptr);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SLAB_CACHE_DRAIN(struct rtl_slab *slab);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PKT_SLAB_INIT(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_BUF_ALLOC(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_BUF_FREE(void *buf);
+
+/** BULK DATA PATH **/
+RTL_PLUGIN_IO_OPTIMIZE static inline unsigned int RTL81XX_RX_PARSE_AGG(uint8_t *rx_buf, uint32_t rx_len, uint32_t *offset, struct rtl_rx_frame *frames, unsigned int max_frames);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_SUBMIT(struct rtl_rx_urb *urb);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_PARK(struct rtl_rx_urb *urb);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_UNPARK(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline unsigned int RTL81XX_RX_RESUBMIT_IDLE(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_COMPLETE(struct libusb_transfer *transfer);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_REAP_HANDED(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_REAP(struct rtl_rx_urb *urb);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_CANCEL_ALL(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_URB_PUT(struct rtl_rx_urb *urb);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_FRAME_HOLD(struct rtl_rx_frame *frame);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_FRAME_RELEASE(struct rtl_rx_frame *frame);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_RX_COMPLETION_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_RELEASE_EVENTS(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_SET_POLL_MODE(enum rtl_rx_poll_mode_t mode, int cpu, unsigned int idle_us);
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_EVENTS_OWNED(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HANDLE_EVENTS(struct timeval *tv, int *completed);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CLAIM_DATA_INTERFACE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ENABLE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_SET_AGGREGATION(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_START(rtl_rx_consumer_t consumer, void *priv);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_STOP(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DO_RECEIVE(void *rx_buffer, unsigned int rx_size, unsigned int timeout);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_SUBMIT(struct rtl_tx_agg *agg);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_FLUSH_LOCKED(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_COMPLETE(struct libusb_transfer *transfer);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_TRACK_COMPLETE(struct rtl_tx_agg *agg, int32_t status);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_INJECT_BATCH(struct rtl_inject_batch *batch, unsigned int timeout);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_FLUSH(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_TX_FLUSH_THREAD(void *arg);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_KICK_LOCKED(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_KICK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_START(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_START_LOCKED(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_STOP(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_STOP_LOCKED(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline struct tx_desc *RTL81XX_TX_RESERVE_LOCKED(uint32_t len, unsigned int timeout);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_COMMIT_LOCKED(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT(void *tx_buf, unsigned int tx_len, unsigned int timeout);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT_VLAN(void *tx_buf, unsigned int tx_len, uint16_t vlan_tci, unsigned int timeout);
+
+/** LARGE SEND OFFLOAD AND CHECKSUM HELPERS **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint64_t RTL81XX_CSUM_PARTIAL_SCALAR(const void *buf, uint32_t len, uint64_t sum);
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static inline uint64_t RTL81XX_CSUM_PARTIAL_AVX2(const void *buf, uint32_t len, uint64_t sum);
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+static inline uint64_t RTL81XX_CSUM_PARTIAL_NEON(const void *buf, uint32_t len, uint64_t sum);
+#endif
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CSUM_SELECT(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint64_t RTL81XX_CSUM_PARTIAL(const void *buf, uint32_t len, uint64_t sum);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint16_t RTL81XX_CSUM_FOLD(uint64_t sum);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint64_t RTL81XX_CSUM_PSEUDO(const uint8_t *l3, bool is_ipv6, uint8_t proto, uint32_t l4_len);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_PARSE_L4(const uint8_t *frame, uint32_t len, struct rtl_gso_info *info);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_GSO_HW(const uint8_t *frame, uint32_t len, uint32_t mss, struct rtl_gso_info *info, unsigned int timeout);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_GSO_SW(const uint8_t *frame, uint32_t len, uint32_t mss, struct rtl_gso_info *info, unsigned int timeout);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT_GSO(void *tx_buf, unsigned int tx_len, unsigned int mss, unsigned int timeout);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_TX_CSUM_OPTS(const uint8_t *frame, uint32_t len, uint32_t csum_start, uint32_t csum_offset);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT_CSUM(void *tx_buf, unsigned int tx_len, unsigned int csum_start, unsigned int csum_offset, unsigned int timeout);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint8_t RTL81XX_RX_CSUM(struct rx_desc *desc);
+
+/** SHARED MEMORY RINGS **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_XSK_RING_SETUP(struct rtl_xsk_ring *ring, void *mem, uint32_t entries);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_XSK_PROD_RESERVE(struct rtl_xsk_ring *ring, uint32_t count, uint32_t *index);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_PROD_SUBMIT(struct rtl_xsk_ring *ring, uint32_t count);
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_XSK_CONS_PEEK(struct rtl_xsk_ring *ring, uint32_t count, uint32_t *index);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_CONS_RELEASE(struct rtl_xsk_ring *ring, uint32_t count);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_RX_CONSUMER(struct rtl_rx_frame *frames, unsigned int count, void *priv);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_TX_KICK(unsigned int budget);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_XSK_BIND(struct rtl_xsk_umem_cfg *cfg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_XSK_UNBIND(void);
+
+/** SINGLE CONSUMER WAKE-UP **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WAITER_SLEEP(struct rtl_waiter *waiter, volatile uint32_t *head, uint32_t seen, volatile bool *running);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_WAITER_WAKE(struct rtl_waiter *waiter);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WAITER_WAKE_ALL(struct rtl_waiter *waiter);
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_COPY_RING_INIT(struct rtl_copy_ring *ring, uint32_t size);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_COPY_RING_DESTROY(struct rtl_copy_ring *ring);
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_COPY_RING_RESERVE(struct rtl_copy_ring *ring, uint32_t *head, uint32_t *tail, uint32_t len);
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_COPY_RING_NEXT(struct rtl_copy_ring *ring, uint32_t *tail, uint32_t head);
+
+/** PCAPNG CAPTURE **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_CAPTURE_OPEN_FILE(struct rtl_capture_file *file, const char *path);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CAPTURE_CLOSE_FILE(struct rtl_capture_file *file);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_CAPTURE_FILE_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_CAPTURE_ROTATE(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CAPTURE_CONSUMER(struct rtl_rx_frame *frames, unsigned int count, void *priv);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CAPTURE_WRITE(struct rtl_capture_entry *entry);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_CAPTURE_WRITER_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CAPTURE_START(const char *path_prefix);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CAPTURE_STOP(void);
+
+/** SOFTWARE RECEIVE SIDE SCALING **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_RSS_MIX_SCALAR(const uint32_t *key, unsigned int words);
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2"))) static inline uint32_t RTL81XX_RSS_MIX_CRC32C(const uint32_t *key, unsigned int words);
+#elif defined(__ARM_FEATURE_CRC32)
+static inline uint32_t RTL81XX_RSS_MIX_CRC32C(const uint32_t *key, unsigned int words);
+#endif
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_RSS_HASH(const uint8_t *frame, uint32_t len);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RSS_DISPATCH(struct rtl_rx_frame *frames, unsigned int count, void *priv);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_RSS_WORKER_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RSS_START(rtl_rx_consumer_t consumer, void *priv, unsigned int workers);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RSS_STOP(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RSS_STATS(unsigned int queue, struct rtl_rss_stats *stats);
+
+/** PERIODIC WORKERS **/
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_PERIODIC_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PERIODIC_START(struct rtl_periodic *worker, unsigned int interval_ms, void (*tick)(void));
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_PERIODIC_STOP(struct rtl_periodic *worker);
+
+/** TALLY COUNTERS **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_READ(struct tally_counter *tally);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_SAMPLE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_START(unsigned int interval_ms);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_STOP(void);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TALLY_SNAPSHOT(struct rtl_tally_stats *total, struct rtl_tally_stats *delta);
+
+/** ADAPTIVE FLOW CONTROL **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_PROGRAM(uint32_t pause_on, uint32_t missed);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_TICK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_START(unsigned int interval_ms);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_STOP(void);
+
+/** LINK POWER MANAGEMENT GOVERNOR **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_PROGRAM(bool u1u2, bool u2p3);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_TICK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_START(const struct rtl_lpm_cfg *cfg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_STOP(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_STATS(struct rtl_lpm_stats *stats);
+
+/** LOAD ADAPTIVE EEE, ALDPS AND GREEN ETHERNET **/
+RTL81XX_DISABLE_INSTRUMENT static inline unsigned long RTL81XX_PWR_READ(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_PROGRAM(unsigned long on);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_TICK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_START(const struct rtl_pwr_cfg *cfg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_STOP(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_STATS(struct rtl_pwr_stats *stats);
+
+/** STALL WATCHDOG **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_QUIESCE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_RESUME(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_RECOVER(unsigned int level);
+RTL81XX_DISABLE_INSTRUMENT static inline unsigned int RTL81XX_WD_CHECK(uint64_t now_ns);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_TICK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_START(const struct rtl_wd_cfg *cfg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_STOP(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_STATS(struct rtl_wd_stats *stats);
+
+/** OVERLAPPED BRING-UP **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_LANE(unsigned int lane);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_BRINGUP_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_CRITICAL(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_RUN(const struct rtl_init_step *steps, unsigned int count);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_STATS(struct rtl_bringup_stats *stats);
+
+/** REGISTER SNAPSHOT **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CTRL_COMPLETE(struct libusb_transfer *transfer);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CTRL_BATCH(struct rtl_ctrl_req *reqs, unsigned int count);
+RTL81XX_DISABLE_INSTRUMENT static inline int RTL81XX_CTRL_XFER(uint8_t request_type, uint16_t value, uint16_t index, void *data, uint16_t len);
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_STATE_PATH(char *path, size_t size);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_XFER(__le32 *values, const bool *dirty);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_SAVE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_RESTORE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_REFRESH(void);
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_STATE_TRUSTED(const struct stat *st, bool directory);
+
+/** REGISTER SPACE DUMP **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_INIT(struct rtl_sha256 *sha);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_BLOCK(struct rtl_sha256 *sha, const uint8_t *p);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_UPDATE(struct rtl_sha256 *sha, const uint8_t *data, size_t len);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_FINAL(struct rtl_sha256 *sha, uint8_t *digest);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DUMP(const char *path, const struct rtl_dump_range *ranges, unsigned int count, rtl_dump_progress_t progress, void *arg, struct rtl_dump_result *result);
+
+/** HOTPLUG DRIVEN DISCOVERY **/
+RTL81XX_DISABLE_INSTRUMENT static inline const struct rtl_usb_id *RTL81XX_ID_LOOKUP(uint16_t vid, uint16_t pid, uint16_t bcd);
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_ID_TABLE_SORTED(void);
+RTL81XX_DISABLE_INSTRUMENT static inline const struct rtl_usb_id *RTL81XX_HOTPLUG_MATCH(libusb_device *dev);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HOTPLUG_QUEUE(libusb_device *dev, libusb_hotplug_event event);
+RTL81XX_DISABLE_INSTRUMENT static int LIBUSB_CALL RTL81XX_HOTPLUG_CALLBACK(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_HOTPLUG_EVENT_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_HOTPLUG_WORKER_THREAD(void *arg);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRING_UP(libusb_device *dev, const struct rtl_usb_id *id);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TEAR_DOWN(void);
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_DEVICE_GET(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DEVICE_PUT(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HOTPLUG_WAIT(unsigned int timeout_ms);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HOTPLUG_STOP(void);
+
+/** EARLY DROP RX CLASSIFIER **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CLS_EXTRACT(const struct rtl_rx_frame *frame, struct rtl_cls_key *key);
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CLS_MATCH_SCALAR(const struct rtl_cls_key *keys, unsigned int count, uint8_t *verdict);
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static inline void RTL81XX_CLS_MATCH_AVX2(const struct rtl_cls_key *keys, unsigned int count, uint8_t *verdict);
+#elif defined(__aarch64__)
+static inline void RTL81XX_CLS_MATCH_NEON(const struct rtl_cls_key *keys, unsigned int count, uint8_t *verdict);
+#endif
+RTL_PLUGIN_IO_OPTIMIZE static inline unsigned int RTL81XX_CLS_RUN(struct rtl_rx_frame *frames, unsigned int count);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CLS_LOAD(const struct rtl_cls_rule *rules, unsigned int count, uint8_t default_action);
+
 /** DEVICE SPECIFIC INIT AND EXIT FUNCTIONS **/
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_USB_MODE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_U1U2(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_FLASH(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_AUTOLOAD(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_PHY_STATUS(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_U2P3(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_POWER_CUT(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_MCU_PATCH(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_PHY_CFG(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_WAKE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_RX_FC(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_MAC_CLK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_ETHER_ADDR(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_SPEED(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_MDIO_FORCE(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_FW_TASK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_LINK(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_TALLY(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_RESUME(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_EXIT(void);
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8153_CHANGE_MTU(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_CHANGE_MTU(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_UP(void);
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_DOWN(void);
@@ -297,12 +1460,99 @@ PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct plugin_cb_installer{
 	void (*plugin_handle_emergency)(void);
 };
 
+/**
+ * the 'rtl_*' callbacks pin the adapter for the length of the call, see
+ * RTL81XX_DEVICE_GET: once it is unplugged they fail with -ERROR_DEV_NOT_FOUND
+ * and RTL81XX_TEAR_DOWN closes the handle only after the last one returned.
+ */
+#define RTL81XX_GUARDED_OP(name, proto, args)		\
+	RTL81XX_DISABLE_INSTRUMENT static inline void name##_OP proto{	\
+		if( RTL81XX_DEVICE_GET() ){		\
+			name args;			\
+			RTL81XX_DEVICE_PUT();		\
+		}					\
+	}
+
+/** same, for the callbacks that change what RTL81XX_STATE_RESTORE puts back: the snapshot is refreshed on success **/
+#define RTL81XX_CONFIG_OP(name, proto, args)		\
+	RTL81XX_DISABLE_INSTRUMENT static inline void name##_OP proto{	\
+		if( RTL81XX_DEVICE_GET() ){		\
+			name args;			\
+			RTL81XX_STATE_REFRESH();	\
+			RTL81XX_DEVICE_PUT();		\
+		}					\
+	}
+
+RTL81XX_GUARDED_OP(RTL81XX_DO_TRANSMIT, (void *tx_buffer, unsigned tx_size, unsigned timeout), (tx_buffer, tx_size, timeout))
+RTL81XX_GUARDED_OP(RTL81XX_DO_TRANSMIT_GSO, (void *tx_buffer, unsigned tx_size, unsigned mss, unsigned timeout), (tx_buffer, tx_size, mss, timeout))
+RTL81XX_GUARDED_OP(RTL81XX_DO_TRANSMIT_CSUM, (void *tx_buffer, unsigned tx_size, unsigned csum_start, unsigned csum_offset, unsigned timeout), (tx_buffer, tx_size, csum_start, csum_offset, timeout))
+RTL81XX_GUARDED_OP(RTL81XX_DO_TRANSMIT_VLAN, (void *tx_buffer, unsigned tx_size, uint16_t vlan_tci, unsigned timeout), (tx_buffer, tx_size, vlan_tci, timeout))
+RTL81XX_GUARDED_OP(RTL81XX_DO_RECEIVE, (void *rx_buffer, unsigned rx_size, unsigned timeout), (rx_buffer, rx_size, timeout))
+RTL81XX_GUARDED_OP(RTL81XX_RX_START, (rtl_rx_consumer_t consumer, void *priv), (consumer, priv))
+RTL81XX_GUARDED_OP(RTL81XX_RX_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_BUF_FREE, (void *buf), (buf))
+RTL81XX_GUARDED_OP(RTL81XX_XSK_BIND, (struct rtl_xsk_umem_cfg *cfg), (cfg))
+RTL81XX_GUARDED_OP(RTL81XX_XSK_UNBIND, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_XSK_TX_KICK, (unsigned budget), (budget))
+RTL81XX_GUARDED_OP(RTL81XX_INJECT_BATCH, (struct rtl_inject_batch *batch, unsigned timeout), (batch, timeout))
+RTL81XX_GUARDED_OP(RTL81XX_CAPTURE_START, (const char *path_prefix), (path_prefix))
+RTL81XX_GUARDED_OP(RTL81XX_CAPTURE_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_RSS_START, (rtl_rx_consumer_t consumer, void *priv, unsigned int workers), (consumer, priv, workers))
+RTL81XX_GUARDED_OP(RTL81XX_RSS_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_CLS_LOAD, (const struct rtl_cls_rule *rules, unsigned int count, uint8_t default_action), (rules, count, default_action))
+RTL81XX_CONFIG_OP(RTL81XX_SET_FEATURES, (unsigned long features), (features))
+RTL81XX_CONFIG_OP(RTL81XX_SET_MTU, (unsigned int mtu), (mtu))
+RTL81XX_GUARDED_OP(RTL81XX_TALLY_START, (unsigned int interval_ms), (interval_ms))
+RTL81XX_GUARDED_OP(RTL81XX_TALLY_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_FC_START, (unsigned int interval_ms), (interval_ms))
+RTL81XX_GUARDED_OP(RTL81XX_FC_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_LPM_START, (const struct rtl_lpm_cfg *cfg), (cfg))
+RTL81XX_GUARDED_OP(RTL81XX_LPM_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_PWR_START, (const struct rtl_pwr_cfg *cfg), (cfg))
+RTL81XX_GUARDED_OP(RTL81XX_PWR_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_WD_START, (const struct rtl_wd_cfg *cfg), (cfg))
+RTL81XX_GUARDED_OP(RTL81XX_WD_STOP, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_STATE_SAVE, (void), ())
+RTL81XX_GUARDED_OP(RTL81XX_DUMP, (const char *path, const struct rtl_dump_range *ranges, unsigned int count, rtl_dump_progress_t progress, void *arg, struct rtl_dump_result *result), (path, ranges, count, progress, arg, result))
+RTL81XX_CONFIG_OP(RTL81XX_SET_MC_LIST, (const uint8_t (*mc_list)[ETH_ALEN], unsigned int count), (mc_list, count))
+RTL81XX_CONFIG_OP(RTL8156_SET_EEE, (void), ())
+
+/** the slab goes away with the adapter **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_BUF_ALLOC_OP(void){
+	void *buf = NULL;
+
+	if( RTL81XX_DEVICE_GET() ){
+		buf = RTL81XX_BUF_ALLOC();
+		RTL81XX_DEVICE_PUT();
+	}
+	return buf;
+}
+
 /** -------THIS WILL BE ENCRYPTED------- **/
 PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct usbdev_ops{
 	void (*rtl_init)(void);
+	void (*rtl_resume)(void);	/** instead of rtl_init when the chip kept its state **/
 	void (*rtl_exit)(void);
 	void (*rtl_tx)(void *tx_buffer, unsigned tx_size, unsigned timeout);
+	void (*rtl_tx_gso)(void *tx_buffer, unsigned tx_size, unsigned mss, unsigned timeout);
+	void (*rtl_tx_csum)(void *tx_buffer, unsigned tx_size, unsigned csum_start, unsigned csum_offset, unsigned timeout);
+	void (*rtl_tx_vlan)(void *tx_buffer, unsigned tx_size, uint16_t vlan_tci, unsigned timeout);
 	void (*rtl_rx)(void *rx_buffer, unsigned rx_size, unsigned timeout);
+	void (*rtl_rx_start)(rtl_rx_consumer_t consumer, void *priv);
+	void (*rtl_rx_stop)(void);
+	void (*rtl_rx_set_poll_mode)(enum rtl_rx_poll_mode_t mode, int cpu, unsigned int idle_us);
+	void *(*rtl_buf_alloc)(void);
+	void (*rtl_buf_free)(void *buf);
+	void (*rtl_xsk_bind)(struct rtl_xsk_umem_cfg *cfg);
+	void (*rtl_xsk_unbind)(void);
+	void (*rtl_xsk_kick)(unsigned budget);
+	void (*rtl_inject_batch)(struct rtl_inject_batch *batch, unsigned timeout);
+	void (*rtl_capture_start)(const char *path_prefix);
+	void (*rtl_capture_stop)(void);
+	void (*rtl_rss_start)(rtl_rx_consumer_t consumer, void *priv, unsigned int workers);
+	void (*rtl_rss_stop)(void);
+	void (*rtl_rss_stats)(unsigned int queue, struct rtl_rss_stats *stats);
+	void (*rtl_cls_load)(const struct rtl_cls_rule *rules, unsigned int count, uint8_t default_action);
 	void (*rtl_intf_up)(char rtl_index, unsigned timeout);
 	void (*rtl_intf_down)();
 	void (*rtl_unload)(void);
@@ -312,8 +1562,28 @@ PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct usbdev_ops{
 	void (*rtl_open)(void);
 	void (*rtl_close)(void);
 	void (*rtl_set_rx_mode)(void);
+	void (*rtl_set_mc_list)(const uint8_t (*mc_list)[ETH_ALEN], unsigned int count);
 	void (*rtl_set_mac_addr)(void);
-	void (*rtl_set_features)(void);
+	void (*rtl_set_mtu)(unsigned int mtu);
+	void (*rtl_tally_start)(unsigned int interval_ms);
+	void (*rtl_tally_stop)(void);
+	void (*rtl_tally_snapshot)(struct rtl_tally_stats *total, struct rtl_tally_stats *delta);
+	void (*rtl_fc_start)(unsigned int interval_ms);
+	void (*rtl_fc_stop)(void);
+	void (*rtl_lpm_start)(const struct rtl_lpm_cfg *cfg);
+	void (*rtl_lpm_stop)(void);
+	void (*rtl_lpm_stats)(struct rtl_lpm_stats *stats);
+	void (*rtl_pwr_start)(const struct rtl_pwr_cfg *cfg);
+	void (*rtl_pwr_stop)(void);
+	void (*rtl_pwr_stats)(struct rtl_pwr_stats *stats);
+	void (*rtl_wd_start)(const struct rtl_wd_cfg *cfg);
+	void (*rtl_wd_stop)(void);
+	void (*rtl_wd_stats)(struct rtl_wd_stats *stats);
+	void (*rtl_bringup_stats)(struct rtl_bringup_stats *stats);
+	void (*rtl_wait_device)(unsigned int timeout_ms);
+	void (*rtl_state_save)(void);
+	void (*rtl_dump)(const char *path, const struct rtl_dump_range *ranges, unsigned int count, rtl_dump_progress_t progress, void *arg, struct rtl_dump_result *result);
+	void (*rtl_set_features)(unsigned long features);
 	void (*rtl_set_packet_filter)(void);
 	void (*rtl_reset_packet_filter)(void);
 	void *rtl_io_ops;	/** for this driver is unused **/
@@ -321,12 +1591,92 @@ PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct usbdev_ops{
 	[RTL8153]  = {
 		.rtl_init 	= RTL8153_INIT,
 		.rtl_exit 	= RTL8153_EXIT,
-		.rtl_tx  	= NULL,
-		.rtl_rx   	= NULL,
+		.rtl_tx  	= RTL81XX_DO_TRANSMIT_OP,
+		.rtl_tx_gso	= RTL81XX_DO_TRANSMIT_GSO_OP,
+		.rtl_tx_csum	= RTL81XX_DO_TRANSMIT_CSUM_OP,
+		.rtl_tx_vlan	= RTL81XX_DO_TRANSMIT_VLAN_OP,
+		.rtl_rx   	= RTL81XX_DO_RECEIVE_OP,
+		.rtl_rx_start	= RTL81XX_RX_START_OP,
+		.rtl_rx_stop	= RTL81XX_RX_STOP_OP,
+		.rtl_rx_set_poll_mode = RTL81XX_RX_SET_POLL_MODE,
+		.rtl_buf_alloc	= RTL81XX_BUF_ALLOC_OP,
+		.rtl_buf_free	= RTL81XX_BUF_FREE_OP,
+		.rtl_xsk_bind	= RTL81XX_XSK_BIND_OP,
+		.rtl_xsk_unbind	= RTL81XX_XSK_UNBIND_OP,
+		.rtl_xsk_kick	= RTL81XX_XSK_TX_KICK_OP,
+		.rtl_inject_batch = RTL81XX_INJECT_BATCH_OP,
+		.rtl_capture_start = RTL81XX_CAPTURE_START_OP,
+		.rtl_capture_stop  = RTL81XX_CAPTURE_STOP_OP,
+		.rtl_rss_start = RTL81XX_RSS_START_OP,
+		.rtl_rss_stop  = RTL81XX_RSS_STOP_OP,
+		.rtl_rss_stats = RTL81XX_RSS_STATS,
+		.rtl_cls_load  = RTL81XX_CLS_LOAD_OP,
+		.rtl_set_features = RTL81XX_SET_FEATURES_OP,
+		.rtl_set_mtu	  = RTL81XX_SET_MTU_OP,
+		.rtl_tally_start    = RTL81XX_TALLY_START_OP,
+		.rtl_tally_stop     = RTL81XX_TALLY_STOP_OP,
+		.rtl_tally_snapshot = RTL81XX_TALLY_SNAPSHOT,
+		.rtl_fc_start	  = RTL81XX_FC_START_OP,
+		.rtl_fc_stop	  = RTL81XX_FC_STOP_OP,
+		.rtl_lpm_start	  = RTL81XX_LPM_START_OP,
+		.rtl_lpm_stop	  = RTL81XX_LPM_STOP_OP,
+		.rtl_lpm_stats	  = RTL81XX_LPM_STATS,
+		.rtl_pwr_start	  = RTL81XX_PWR_START_OP,
+		.rtl_pwr_stop	  = RTL81XX_PWR_STOP_OP,
+		.rtl_pwr_stats	  = RTL81XX_PWR_STATS,
+		.rtl_wd_start	  = RTL81XX_WD_START_OP,
+		.rtl_wd_stop	  = RTL81XX_WD_STOP_OP,
+		.rtl_wd_stats	  = RTL81XX_WD_STATS,
+		.rtl_bringup_stats = RTL81XX_BRINGUP_STATS,
+		.rtl_wait_device  = RTL81XX_HOTPLUG_WAIT,
+		.rtl_state_save	  = RTL81XX_STATE_SAVE_OP,
+		.rtl_dump	  = RTL81XX_DUMP_OP,
+		.rtl_set_mc_list = RTL81XX_SET_MC_LIST_OP,
 	},
 	[RTL8156B] = {
 		.rtl_init 	= RTL8156B_INIT,
-
+		.rtl_resume	= RTL8156B_RESUME,
+		.rtl_tx  	= RTL81XX_DO_TRANSMIT_OP,
+		.rtl_tx_gso	= RTL81XX_DO_TRANSMIT_GSO_OP,
+		.rtl_tx_csum	= RTL81XX_DO_TRANSMIT_CSUM_OP,
+		.rtl_tx_vlan	= RTL81XX_DO_TRANSMIT_VLAN_OP,
+		.rtl_rx   	= RTL81XX_DO_RECEIVE_OP,
+		.rtl_rx_start	= RTL81XX_RX_START_OP,
+		.rtl_rx_stop	= RTL81XX_RX_STOP_OP,
+		.rtl_rx_set_poll_mode = RTL81XX_RX_SET_POLL_MODE,
+		.rtl_buf_alloc	= RTL81XX_BUF_ALLOC_OP,
+		.rtl_buf_free	= RTL81XX_BUF_FREE_OP,
+		.rtl_xsk_bind	= RTL81XX_XSK_BIND_OP,
+		.rtl_xsk_unbind	= RTL81XX_XSK_UNBIND_OP,
+		.rtl_xsk_kick	= RTL81XX_XSK_TX_KICK_OP,
+		.rtl_inject_batch = RTL81XX_INJECT_BATCH_OP,
+		.rtl_capture_start = RTL81XX_CAPTURE_START_OP,
+		.rtl_capture_stop  = RTL81XX_CAPTURE_STOP_OP,
+		.rtl_rss_start = RTL81XX_RSS_START_OP,
+		.rtl_rss_stop  = RTL81XX_RSS_STOP_OP,
+		.rtl_rss_stats = RTL81XX_RSS_STATS,
+		.rtl_cls_load  = RTL81XX_CLS_LOAD_OP,
+		.rtl_set_features = RTL81XX_SET_FEATURES_OP,
+		.rtl_set_mtu	  = RTL81XX_SET_MTU_OP,
+		.rtl_tally_start    = RTL81XX_TALLY_START_OP,
+		.rtl_tally_stop     = RTL81XX_TALLY_STOP_OP,
+		.rtl_tally_snapshot = RTL81XX_TALLY_SNAPSHOT,
+		.rtl_fc_start	  = RTL81XX_FC_START_OP,
+		.rtl_fc_stop	  = RTL81XX_FC_STOP_OP,
+		.rtl_lpm_start	  = RTL81XX_LPM_START_OP,
+		.rtl_lpm_stop	  = RTL81XX_LPM_STOP_OP,
+		.rtl_lpm_stats	  = RTL81XX_LPM_STATS,
+		.rtl_pwr_start	  = RTL81XX_PWR_START_OP,
+		.rtl_pwr_stop	  = RTL81XX_PWR_STOP_OP,
+		.rtl_pwr_stats	  = RTL81XX_PWR_STATS,
+		.rtl_wd_start	  = RTL81XX_WD_START_OP,
+		.rtl_wd_stop	  = RTL81XX_WD_STOP_OP,
+		.rtl_wd_stats	  = RTL81XX_WD_STATS,
+		.rtl_bringup_stats = RTL81XX_BRINGUP_STATS,
+		.rtl_wait_device  = RTL81XX_HOTPLUG_WAIT,
+		.rtl_state_save	  = RTL81XX_STATE_SAVE_OP,
+		.rtl_dump	  = RTL81XX_DUMP_OP,
+		.rtl_set_mc_list = RTL81XX_SET_MC_LIST_OP,
 	},
 
 };
@@ -335,10 +1685,18 @@ PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct usbdev_ops{
 PLUGIN_SPECIFIC_STRUCT_OPT(unsigned long) struct device_flags{
 	unsigned long flags;
 	unsigned long capabilities;
+	unsigned long features;		/** RTL81XX_FEATURE_* currently enabled **/
+	unsigned long quirks;		/** RTL81XX_QUIRK_*, taken from the USB id table **/
 	unsigned long rx_timeout;
 	unsigned long tx_timeout;
+	unsigned long eee_adv;		/** MDIO_EEE_* of OCP_EEE_ADV, see RTL81XX_EEE_ENABLE **/
+	unsigned long eee_adv2;		/** MDIO_EEE_2_5GT of OCP_EEE_ADV2 **/
 };
 
+/** offloads switched on and off with 'rtl_set_features' **/
+#define RTL81XX_FEATURE_RX_VLAN		BIT(0)	/** strip the 802.1Q tag into struct rtl_rx_frame **/
+#define RTL81XX_FEATURES_ALL		(RTL81XX_FEATURE_RX_VLAN)
+
 #ifndef RTL_VER_SIZE
         #define RTL_VER_SIZE            32
 #endif
@@ -352,6 +1710,7 @@ enum fw_blob_name_idx{
 	RTL81XX_FIRMWARE_BLOB_8153C_1,
 	RTL81XX_FIRMWARE_BLOB_8156A_2,
 	RTL81XX_FIRMWARE_BLOB_8156B_2,
+	RTL81XX_FIRMWARE_BLOB_NONE = -1,	/** the blob depends on the hw version only **/
 };
 
 unsigned char *fw_blob_names[] = {
@@ -364,6 +1723,11 @@ unsigned char *fw_blob_names[] = {
 	[RTL81XX_FIRMWARE_BLOB_8156B_2] = "RTL8156B"
 };
 
+/** blocks of a blob applied by RTL81XX_LOAD_FIRMWARE **/
+#define RTL81XX_FW_MAC	BIT(0)	/** RTL_FW_PLA and RTL_FW_USB, the MCU patches **/
+#define RTL81XX_FW_PHY	BIT(1)	/** RTL_FW_PHY_*, through the PHY OCP and the SRAM **/
+#define RTL81XX_FW_ALL	( RTL81XX_FW_MAC | RTL81XX_FW_PHY )
+
 PLUGIN_STRUCT_OPT struct fw_block{
         __le32 type;
         __le32 length;
@@ -494,6 +1858,10 @@ PLUGIN_STRUCT_OPT struct usbdev_identifier{
 	unsigned long device_vid;
 	unsigned long device_version_identifier;
 	unsigned long device_max_mtu;
+	unsigned long device_mtu;		/** programmed inside PLA_RMS, see RTL81XX_SET_MTU **/
+	const struct rtl_usb_id	    *device_id;	/** entry of rtl_usb_ids the adapter matched **/
+	const struct rtl_chip_info  *device_chip;	/** rtl_chips[device_version_identifier], set by RTL81XX_GET_HW_VERSION **/
+	unsigned char		    device_serial[RTL81XX_SERIAL_LEN];	/** iSerialNumber, empty when the adapter has none **/
 	struct libusb_device_handle *device_handler;
 	struct device_firmware	    *device_firmware;
 	struct ethtool_eee	    *device_eee;
@@ -505,8 +1873,8 @@ PLUGIN_STRUCT_OPT struct usbdev_identifier{
 RTL_PLUGIN_OPS_SECTION struct usbdev_identifier RTL81XX_LIST[] = {
 	[RTL8153] = {
 		.device_name 			= "RTL8153",
-		.device_pid  			= 0x2357,
-		.device_vid  			= 0x0601,
+		.device_pid  			= 0x0601,
+		.device_vid  			= 0x2357,
 		.device_version_identifier	= 0x00,
 		.device_handler 		= NULL,
 		.device_cb      		= NULL,
@@ -514,8 +1882,8 @@ RTL_PLUGIN_OPS_SECTION struct usbdev_identifier RTL81XX_LIST[] = {
 
 	[RTL8156B] = {
 		.device_name 			= "RTL8156B",
-		.device_pid 			= 0xA69C, //0x0bda,
-		.device_vid 			= 0x88dd, //0x8156,
+		.device_pid 			= 0x88dd, //0x8156,
+		.device_vid 			= 0xA69C, //0x0bda,
 		.device_version_identifier 	= 0x00,
 		.device_handler 		= NULL,
 		.device_cb			= NULL,
@@ -531,12 +1899,462 @@ RTL_PLUGIN_OPS_SECTION struct usbdev_identifier RTL81XX_LIST[] = {
 	}
 };
 
+/** USB ID TABLE **/
+
+/**
+ * every supported (VID, PID, bcdDevice range), kept sorted by vid, pid and bcd_lo
+ * so RTL81XX_ID_LOOKUP can binary search it; the ranges of one VID/PID never overlap.
+ * ops and firmware are the defaults, RTL81XX_INIT and RTL81XX_LOAD_FIRMWARE refine
+ * them from the hw version when it is a known one.
+ */
+struct rtl_usb_id{
+	uint16_t		vid;
+	uint16_t		pid;
+	uint16_t		bcd_lo;
+	uint16_t		bcd_hi;
+	enum usbdev_enum_t	device;		/** entry of RTL81XX_LIST **/
+	struct usbdev_ops	*ops;
+	enum fw_blob_name_idx	fw;
+	unsigned long		quirks;		/** RTL81XX_QUIRK_* **/
+};
+
+#define RTL81XX_USB_ID(_vid, _pid, _device, _fw, _quirks)	\
+	{ .vid = _vid, .pid = _pid, .bcd_lo = 0x0000, .bcd_hi = 0xffff, .device = _device, .ops = &rtl_ops[_device], .fw = _fw, .quirks = _quirks }
+
+#define RTL81XX_QUIRK_NONE		0
+
+static const struct rtl_usb_id rtl_usb_ids[] = {
+	RTL81XX_USB_ID(0x0bda, 0x8153, RTL8153,  RTL81XX_FIRMWARE_BLOB_NONE,	RTL81XX_QUIRK_NONE),	/** Realtek RTL8153 family **/
+	RTL81XX_USB_ID(0x0bda, 0x8156, RTL8156B, RTL81XX_FIRMWARE_BLOB_NONE,	RTL81XX_QUIRK_NONE),	/** Realtek RTL8156 family **/
+	RTL81XX_USB_ID(0x2357, 0x0601, RTL8153,  RTL81XX_FIRMWARE_BLOB_NONE,	RTL81XX_QUIRK_NONE),	/** TP-Link UE300 **/
+	RTL81XX_USB_ID(0xa69c, 0x88dd, RTL8156B, RTL81XX_FIRMWARE_BLOB_8156B_2, RTL81XX_QUIRK_NONE),
+};
+
+#define RTL81XX_USB_ID_KEY(vid, pid, bcd)	( ((uint64_t)(vid) << 32) | ((uint64_t)(pid) << 16) | (bcd) )
+
+/** CHIP DESCRIPTORS **/
+
+/** how the PLA/USB breakpoints are cleared before a firmware is applied, see 'rtl_clear_bp' **/
+enum rtl_bp_style_t{
+	RTL81XX_BP_BP2,		/** USB_BP2_EN, 16 breakpoints **/
+	RTL81XX_BP_PLA,		/** 8 breakpoints, no enable register **/
+	RTL81XX_BP_PLA_EN,	/** PLA_BP_EN, 8 breakpoints **/
+	RTL81XX_BP_USB2,	/** USB_BP2_EN and 16 breakpoints on the USB MCU, PLA_BP_EN and 8 on the PLA one **/
+};
+
+/** which of 'r8152_eee_en', 'r8153_eee_en' or 'r8156_eee_en' drives EEE **/
+enum rtl_eee_style_t{
+	RTL81XX_EEE_NONE,
+	RTL81XX_EEE_R8152,
+	RTL81XX_EEE_R8153,
+	RTL81XX_EEE_R8156,
+};
+
+/** how USB_RX_EARLY_TIMEOUT/SIZE are programmed, see RTL81XX_RX_SET_AGGREGATION **/
+enum rtl_rx_agg_style_t{
+	RTL81XX_RX_AGG_NONE,	/** one frame per transfer **/
+	RTL81XX_RX_AGG_EARLY,	/** early timeout only **/
+	RTL81XX_RX_AGG_EXTRA,	/** fixed early timeout plus USB_RX_EXTRA_AGGR_TMR **/
+};
+
+/** how U1/U2 are allowed, U2P3 goes through USB_U2P3_CTRL on every chip but the RTL8152 **/
+enum rtl_lpm_style_t{
+	RTL81XX_LPM_NONE,	/** USB 2.0 only **/
+	RTL81XX_LPM_TOLERANCE,	/** USB_TOLERANCE, r8153_u1u2en **/
+	RTL81XX_LPM_CONFIG,	/** LPM_U1U2_EN of USB_LPM_CONFIG, r8153b_u1u2en **/
+};
+
+/**
+ * everything the driver used to switch on device_version_identifier for,
+ * resolved once by RTL81XX_GET_HW_VERSION; a new revision is one more entry.
+ */
+struct rtl_chip_info{
+	const char		*name;
+	struct usbdev_ops	*ops;			/** NULL keeps the ops of the USB id table **/
+	unsigned long		max_mtu;
+	enum fw_blob_name_idx	fw;
+	enum rtl_bp_style_t	bp;
+	enum rtl_eee_style_t	eee;
+	enum rtl_rx_agg_style_t	rx_agg;
+	enum rtl_lpm_style_t	lpm;
+	uint16_t		rx_early_timeout;	/** ns, RTL81XX_RX_AGG_EXTRA only **/
+	uint8_t			rx_early_size_unit;	/** bytes per USB_RX_EARLY_SIZE unit **/
+	bool			fifo_fc;		/** PLA_RX_FIFO_FULL/EMPTY are there **/
+	void			(*nic_reset)(void);
+	void			(*rx_vlan_enable)(unsigned char enable);
+	void			(*change_mtu)(void);
+};
+
+#define RTL81XX_CHIP_8152(_name)											\
+	.name = _name, .max_mtu = ETH_DATA_LEN, .fw = RTL81XX_FIRMWARE_BLOB_NONE, .bp = RTL81XX_BP_PLA,		\
+	.eee = RTL81XX_EEE_R8152, .rx_agg = RTL81XX_RX_AGG_NONE, .lpm = RTL81XX_LPM_NONE,			\
+	.nic_reset = RTL8152_NIC_RESET, .rx_vlan_enable = RTL8152_RX_VLAN_ENABLE, .change_mtu = RTL8153_CHANGE_MTU
+
+#define RTL81XX_CHIP_8153(_name, _fw, _bp, _timeout, _unit)								\
+	.name = _name, .max_mtu = size_to_mtu(9 * 1024), .fw = _fw, .bp = _bp, .eee = RTL81XX_EEE_R8153,		\
+	.rx_agg = ( _timeout ) ? RTL81XX_RX_AGG_EXTRA : RTL81XX_RX_AGG_EARLY, .rx_early_timeout = _timeout,	\
+	.rx_early_size_unit = _unit, .lpm = ( _timeout ) ? RTL81XX_LPM_CONFIG : RTL81XX_LPM_TOLERANCE,		\
+	.nic_reset = RTL8152_NIC_RESET, .rx_vlan_enable = RTL8152_RX_VLAN_ENABLE, .change_mtu = RTL8153_CHANGE_MTU
+
+#define RTL81XX_CHIP_8156(_name, _max_mtu, _fw, _bp, _eee, _reset)							\
+	.name = _name, .max_mtu = _max_mtu, .fw = _fw, .bp = _bp, .eee = _eee,			\
+	.rx_agg = RTL81XX_RX_AGG_EXTRA, .rx_early_timeout = 640, .rx_early_size_unit = 8, .fifo_fc = TRUE,	\
+	.lpm = RTL81XX_LPM_CONFIG,											\
+	.nic_reset = _reset, .rx_vlan_enable = RTL8156_RX_VLAN_ENABLE, .change_mtu = RTL8156B_CHANGE_MTU
+
+static const struct rtl_chip_info rtl_chips[RTL_VER_MAX] = {
+	[RTL_VER_01]  = { RTL81XX_CHIP_8152("RTL8152") },
+	[RTL_VER_02]  = { RTL81XX_CHIP_8152("RTL8152") },
+	[RTL_VER_03]  = { RTL81XX_CHIP_8153("RTL8153", RTL81XX_FIRMWARE_BLOB_NONE,	 RTL81XX_BP_PLA_EN, 0, 4) },
+	[RTL_VER_04]  = { RTL81XX_CHIP_8153("RTL8153", RTL81XX_FIRMWARE_BLOB_8153A_2, RTL81XX_BP_PLA_EN, 0, 4) },
+	[RTL_VER_05]  = { RTL81XX_CHIP_8153("RTL8153", RTL81XX_FIRMWARE_BLOB_8153A_3, RTL81XX_BP_PLA_EN, 0, 4) },
+	[RTL_VER_06]  = { RTL81XX_CHIP_8153("RTL8153", RTL81XX_FIRMWARE_BLOB_8153A_4, RTL81XX_BP_PLA_EN, 0, 4) },
+	[RTL_VER_07]  = { RTL81XX_CHIP_8152("RTL8152B") },
+	[RTL_VER_08]  = { RTL81XX_CHIP_8153("RTL8153B", RTL81XX_FIRMWARE_BLOB_NONE,	 RTL81XX_BP_USB2, 1264, 8), .ops = &rtl_ops[RTL8153] },
+	[RTL_VER_09]  = { RTL81XX_CHIP_8153("RTL8153B", RTL81XX_FIRMWARE_BLOB_8153B_2, RTL81XX_BP_USB2, 1264, 8), .ops = &rtl_ops[RTL8153] },
+	[RTL_TEST_01] = { RTL81XX_CHIP_8156("RTL8156", ETH_DATA_LEN, RTL81XX_FIRMWARE_BLOB_NONE,	  RTL81XX_BP_BP2,  RTL81XX_EEE_NONE, RTL8156_NIC_RESET) },
+	[RTL_VER_10]  = { RTL81XX_CHIP_8156("RTL8156", size_to_mtu(15 * 1024), RTL81XX_FIRMWARE_BLOB_NONE,	  RTL81XX_BP_USB2, RTL81XX_EEE_R8156, RTL8156_NIC_RESET) },
+	[RTL_VER_11]  = { RTL81XX_CHIP_8156("RTL8156", size_to_mtu(15 * 1024), RTL81XX_FIRMWARE_BLOB_8153C_1, RTL81XX_BP_USB2, RTL81XX_EEE_R8156, RTL8156_NIC_RESET) },
+	[RTL_VER_12]  = { RTL81XX_CHIP_8156("RTL8156B", size_to_mtu(16 * 1024), RTL81XX_FIRMWARE_BLOB_NONE,	  RTL81XX_BP_USB2, RTL81XX_EEE_R8156, RTL8152_NIC_RESET), .ops = &rtl_ops[RTL8156B] },
+	[RTL_VER_13]  = { RTL81XX_CHIP_8156("RTL8156B", size_to_mtu(16 * 1024), RTL81XX_FIRMWARE_BLOB_8156B_2, RTL81XX_BP_USB2, RTL81XX_EEE_R8156, RTL8152_NIC_RESET), .ops = &rtl_ops[RTL8156B] },
+	[RTL_VER_14]  = { RTL81XX_CHIP_8153("RTL8153C", RTL81XX_FIRMWARE_BLOB_8153C_1, RTL81XX_BP_BP2, 1264, 8) },
+	[RTL_VER_15]  = { RTL81XX_CHIP_8156("RTL8156BG", size_to_mtu(16 * 1024), RTL81XX_FIRMWARE_BLOB_8156B_2, RTL81XX_BP_USB2, RTL81XX_EEE_R8156, RTL8152_NIC_RESET), .ops = &rtl_ops[RTL8156B] },
+};
+
+enum rtl_urb_state_t{
+	RTL81XX_URB_IDLE,
+	RTL81XX_URB_QUEUED,
+	RTL81XX_URB_COMPLETED,
+	RTL81XX_URB_HELD,
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_rx_urb{
+	struct libusb_transfer	*transfer;
+	uint8_t			*buffer;
+	uint32_t		 offset;	/** parse cursor, only used by the pull mode **/
+	enum rtl_urb_state_t	 state;
+	volatile int		 refs;		/** frame views still held, the buffer goes back to the chip at zero **/
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_rx_engine{
+	struct rtl_rx_urb	urb[RTL81XX_RX_URB_NUM];
+	uint32_t		buf_size;
+	struct rtl_slab		slab;
+	volatile bool		running;
+	volatile int		inflight;
+	rtl_rx_consumer_t	consumer;
+	void			*consumer_priv;
+	pthread_t		completion_thread;
+	/** push mode wait policy, see RTL81XX_RX_SET_POLL_MODE **/
+	enum rtl_rx_poll_mode_t	poll_mode;
+	int			poll_cpu;
+	unsigned int		poll_idle_us;
+	/** the push mode completion thread is the only libusb event handler, see RTL81XX_HANDLE_EVENTS **/
+	volatile bool		owns_events;
+	/** the completion thread is inside the consumer, the waiters handle the events meanwhile **/
+	volatile bool		in_consumer;
+	volatile uint64_t	completions;
+	/**
+	 * pull mode: completed transfers waiting to be parsed, in completion order.
+	 * push mode: the ones reaped by another thread, for the completion thread
+	 */
+	unsigned char		done_ring[RTL81XX_RX_URB_NUM];
+	volatile unsigned int	done_head;
+	volatile unsigned int	done_tail;
+	/** failed completions since the last good one, see RTL81XX_RX_ERR_RETRY **/
+	unsigned int		err_streak;
+	/** CLOCK_MONOTONIC of the first buffer parked by RTL81XX_RX_COMPLETE, 0 when none is **/
+	uint64_t		parked_ns;
+	/** counters, only touched by the thread that handles the libusb events **/
+	uint64_t		rx_packets;
+	uint64_t		rx_bytes;
+	uint64_t		rx_errors;
+	uint64_t		rx_urb_errors;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_tx_agg{
+	struct libusb_transfer	*transfer;
+	uint8_t			*buffer;
+	uint32_t		 len;		/** bytes used, descriptors included **/
+	uint32_t		 frames;
+	uint64_t		 payload;
+	enum rtl_urb_state_t	 state;
+	/** injected frames carried by this buffer **/
+	struct rtl_tx_track	*track;
+	uint32_t		 tracked;
+	uint64_t		 submit_ns;	/** CLOCK_MONOTONIC of the submission, aged by the watchdog **/
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_tx_engine{
+	struct rtl_tx_agg	agg[RTL81XX_TX_URB_NUM];
+	uint32_t		buf_size;
+	uint32_t		track_size;
+	struct rtl_slab		slab;
+	volatile bool		running;
+	/** the producers start the engine on their first frame, a single one sets it up **/
+	pthread_mutex_t		start_lock;
+	int			inflight;
+	pthread_mutex_t		lock;
+	pthread_cond_t		free_cond;
+	pthread_t		flush_thread;
+	/** the flusher sleeps on kick_cond when idle, libusb is interrupted when it is reaping **/
+	pthread_cond_t		kick_cond;
+	enum rtl_tx_flusher_t	flusher;
+	/** buffer being filled and the time its first frame was queued **/
+	struct rtl_tx_agg	*fill;
+	struct timespec		fill_ts;
+	unsigned char		free_list[RTL81XX_TX_URB_NUM];
+	unsigned int		free_count;
+	/** counters, protected by lock **/
+	uint64_t		tx_packets;
+	uint64_t		tx_bytes;
+	uint64_t		tx_errors;
+	uint64_t		tx_urb_errors;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_xsk{
+	struct rtl_xsk_umem_cfg	cfg;
+	struct rtl_xsk_ring	fill;
+	struct rtl_xsk_ring	rx;
+	struct rtl_xsk_ring	tx;
+	struct rtl_xsk_ring	comp;
+	volatile bool		bound;
+	/** counters **/
+	uint64_t		rx_packets;
+	uint64_t		rx_dropped;	/** no UMEM frame in the fill ring or no room in the rx ring **/
+	uint64_t		tx_packets;
+	uint64_t		tx_invalid;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_capture{
+	char			 prefix[256];
+	volatile bool		 accepting;
+	volatile bool		 running;
+	pthread_t		 writer;
+	struct rtl_waiter	 waiter;
+	/** single producer (RX completion thread) copying the frames, single consumer (writer) **/
+	struct rtl_copy_ring	 ring;
+	/** file being written, the writer only touches this one **/
+	struct rtl_capture_file	 cur;
+	unsigned int		 file_index;
+	/** the file thread creates the next file and closes the previous one, protected by file_lock **/
+	pthread_t		 file_thread;
+	pthread_mutex_t		 file_lock;
+	pthread_cond_t		 file_cond;
+	struct rtl_capture_file	 spare;
+	struct rtl_capture_file	 retired;
+	bool			 spare_ready;
+	bool			 spare_failed;
+	bool			 file_stop;	/** set once the writer is gone **/
+	/** counters **/
+	uint64_t		 captured;
+	uint64_t		 bytes;
+	uint64_t		 dropped;	/** ring full, the receive path never waits for the writer **/
+	uint64_t		 write_dropped;	/** no file to write into **/
+	uint64_t		 rotations;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_rss{
+	struct rtl_rss_queue	 queue[RTL81XX_RSS_MAX_WORKERS];
+	unsigned int		 workers;
+	volatile bool		 accepting;
+	volatile bool		 running;
+	rtl_rss_mix_t		 mix;
+	rtl_rx_consumer_t	 consumer;	/** called by every worker with frames of the flows it owns **/
+	void			*consumer_priv;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_classifier{
+	/** compiled rules, a frame matches when (key & mask) == value **/
+	struct rtl_cls_key	 value[RTL81XX_CLS_MAX_RULES];
+	struct rtl_cls_key	 mask[RTL81XX_CLS_MAX_RULES];
+	uint8_t			 action[RTL81XX_CLS_MAX_RULES + 1];	/** the last one is taken when nothing matches **/
+	unsigned int		 rules;
+	bool			 enabled;
+	rtl_cls_match_t		 match;
+	/** counters, only touched by the thread parsing the bulk-IN buffers **/
+	uint64_t		 hits[RTL81XX_CLS_MAX_RULES + 1];
+	uint64_t		 dropped;
+};
+
+/** a thread calling tick every interval_ms, shared by the samplers, the governors and the watchdog **/
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_periodic{
+	volatile bool		running;
+	pthread_t		thread;
+	unsigned int		interval_ms;
+	void			(*tick)(void);
+	/** only for RTL81XX_PERIODIC_STOP to cut the wait short **/
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_tally{
+	struct rtl_periodic	worker;
+	bool			started;	/** total and delta hold something, they stay readable after RTL81XX_TALLY_STOP **/
+	struct tally_counter	raw;		/** last block read, the wrap of each counter is taken against it **/
+	/** seqlock: odd while the sampler writes, readers retry when it moved **/
+	volatile uint32_t	seq;
+	struct rtl_tally_stats	total;
+	struct rtl_tally_stats	delta;		/** last sampling period only **/
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_fc{
+	struct rtl_periodic	worker;
+	uint32_t		pause_on;	/** bytes, as last programmed by the controller **/
+	uint32_t		pause_off;
+	uint16_t		last_missed;	/** the hardware counter is only 16 bits wide **/
+	/** while the tally sampler runs its rx_missed accumulator is read instead of the block **/
+	uint64_t		last_ts_ns;	/** of the sample last used, 0 when the block was read directly **/
+	uint64_t		last_total;
+	unsigned int		quiet;
+	uint64_t		missed;
+	uint64_t		adjustments;
+	/** last RTL81XX_FC_EVENTS adjustments, events[adjustments % RTL81XX_FC_EVENTS] is the next slot **/
+	struct rtl_fc_event	events[RTL81XX_FC_EVENTS];
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_lpm{
+	struct rtl_periodic	worker;
+	struct rtl_lpm_cfg	cfg;
+	bool			u1u2;		/** as last programmed **/
+	bool			u2p3;
+	uint64_t		idle_ns;
+	uint64_t		last_ns;	/** start of the current period **/
+	uint64_t		last_packets;
+	pthread_mutex_t		stats_lock;	/** the governor updates stats a field at a time **/
+	struct rtl_lpm_stats	stats;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_pwr{
+	struct rtl_periodic	worker;
+	struct rtl_pwr_cfg	cfg;
+	unsigned long		on;		/** RTL81XX_PWR_* as last programmed **/
+	unsigned long		saved;		/** found by RTL81XX_PWR_START, put back by RTL81XX_PWR_STOP **/
+	uint64_t		idle_ns;
+	uint64_t		last_ns;	/** start of the current period **/
+	uint64_t		last_packets;
+	uint64_t		last_bytes;
+	pthread_mutex_t		stats_lock;	/** the governor updates stats a field at a time **/
+	struct rtl_pwr_stats	stats;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_wd{
+	struct rtl_periodic	worker;
+	/** the bulk engines park their buffers instead of submitting them **/
+	volatile bool		recovering;
+	struct rtl_wd_cfg	cfg;
+	volatile unsigned int	halted;		/** RTL81XX_WD_HALT_*, set from the completions **/
+	volatile unsigned int	ctrl_failures;	/** in a row, reset by every successful control transfer **/
+	unsigned int		level;		/** of the last recovery **/
+	uint64_t		last_ns;	/** end of the last recovery **/
+	uint64_t		last_rx_errors;
+	uint64_t		last_rx_packets;
+	struct rtl_wd_stats	stats;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_bringup{
+	/** the caller holds ocp_lock, a second lane would wait on it forever **/
+	bool				serial;
+	/** RTL8156B_INIT_ETHER_ADDR ran, RTL81XX_POST_INIT skips set_ethernet_addr once **/
+	bool				ether_addr;
+	/** PCUT_STATUS as RTL8156B_INIT_MCU_PATCH found it, the PHY lane patches the PHY after it **/
+	bool				pcut;
+	pthread_mutex_t			lock;
+	pthread_cond_t			cond;
+	const struct rtl_init_step	*steps;
+	uint32_t			done;		/** BIT() of the finished steps **/
+	uint64_t			base_ns;
+	struct rtl_bringup_stats	stats;
+};
+
+PLUGIN_SPECIFIC_STRUCT_OPT(void *) struct rtl_hotplug{
+	volatile bool			running;
+	bool				registered;
+	libusb_hotplug_callback_handle	handle;
+	pthread_t			event_thread;	/** runs libusb_handle_events, the callback is called from there **/
+	pthread_t			worker_thread;	/** bring-up and teardown, the callback must not do synchronous I/O **/
+	pthread_mutex_t			lock;
+	pthread_cond_t			cond;
+	struct rtl_hotplug_event	queue[RTL81XX_HOTPLUG_EVENTS];
+	unsigned int			head;
+	unsigned int			tail;
+	/** the adapter currently brought up, NULL while nothing is plugged **/
+	libusb_device			*active;
+	unsigned long			attached;
+	unsigned long			detached;
+};
+
+/** REGISTER SNAPSHOT **/
+
+/** what the init sequence and the host programmed, replayed by RTL81XX_STATE_RESTORE **/
+static const struct rtl_state_reg rtl_state_regs[] = {
+	/** MAC address **/
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_IDR,		4, RTL81XX_STATE_CONFIG),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_IDR + 4,		2, RTL81XX_STATE_CONFIG),
+	/** receive filter, PLA_RCR1 shares the dword of PLA_RCR **/
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_RCR,		4, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_MAR,		4, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_MAR + 4,		4, 0),
+	/** frame sizes **/
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_RMS,		2, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_MTPS,		1, 0),
+	/** FIFO thresholds and RX aggregation, PLA_TXFIFO_FULL and USB_RX_EARLY_SIZE share a dword **/
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_RX_FIFO_FULL,	2, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_RX_FIFO_EMPTY,	2, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_TXFIFO_CTRL,	4, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_USB, USB_RX_EARLY_TIMEOUT,	4, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_USB, USB_RX_EXTRA_AGGR_TMR,	2, 0),
+	/** VLAN stripping **/
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_CPCR,		2, 0),
+	/** wake on LAN, PLA_CONFIG5 shares the dword of PLA_CONFIG34 **/
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_CFG_WOL,		2, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, PLA_CONFIG34,		4, RTL81XX_STATE_CONFIG),
+	/** link power management **/
+	RTL81XX_STATE_REG(MCU_TYPE_USB, USB_LPM_CONFIG,		2, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_USB, USB_LPM_CTRL,		1, 0),
+	RTL81XX_STATE_REG(MCU_TYPE_USB, USB_U2P3_CTRL,		2, 0),
+	/** ALDPS and EEE **/
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, OCP_POWER_CFG,		2, RTL81XX_STATE_PHY),
+	RTL81XX_STATE_REG(MCU_TYPE_PLA, OCP_EEE_CFG,		2, RTL81XX_STATE_PHY),
+};
+
+#define RTL81XX_STATE_REGS	( sizeof(rtl_state_regs) / sizeof(rtl_state_regs[0]) )
+
 /** GLOBAL VARIABLES MAIN DECLARATION **/
 struct   usbdev_identifier	*device_context 	= NULL;
 unsigned char			*data_context 		= NULL;
-signed   int			return_context 		= 0;
+/** every thread gets the result of its own last operation **/
+__thread signed int		return_context 		= 0;
 signed   int			wolopts 		= 0;
 uint16_t			global_ocp_base         = 0;
+/** held for reading by every 'rtl_*' callback, for writing by RTL81XX_TEAR_DOWN **/
+pthread_rwlock_t		device_lock		= PTHREAD_RWLOCK_INITIALIZER;
+volatile bool			device_gone		= FALSE;
+/** set by RTL81XX_BRING_UP once the adapter is initialized and its snapshot saved **/
+volatile bool			device_ready		= FALSE;
+/** serializes the control transfers and the paged OCP accesses between the threads **/
+pthread_mutex_t			ocp_lock		= PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+bool				data_intf_claimed	= FALSE;
+struct   rtl_rx_engine		rx_engine		= { .poll_cpu = -1, .poll_idle_us = RTL81XX_RX_POLL_IDLE_US };
+struct   rtl_tx_engine		tx_engine		= { .start_lock = PTHREAD_MUTEX_INITIALIZER, .lock = PTHREAD_MUTEX_INITIALIZER };
+rtl_csum_partial_t		csum_partial_impl	= NULL;
+struct   rtl_slab		pkt_slab		= { 0 };
+struct   rtl_xsk		xsk			= { 0 };
+struct   rtl_capture		capture			= { .cur.fd = -1, .spare.fd = -1, .retired.fd = -1,
+							    .waiter = { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER },
+							    .file_lock = PTHREAD_MUTEX_INITIALIZER, .file_cond = PTHREAD_COND_INITIALIZER };
+struct   rtl_rss		rss			= { 0 };
+struct   rtl_classifier		cls			= { 0 };
+struct   rtl_tally		tally			= { 0 };
+struct   rtl_fc			fc			= { 0 };
+struct   rtl_lpm		lpm			= { .stats_lock = PTHREAD_MUTEX_INITIALIZER };
+struct   rtl_pwr		pwr			= { .stats_lock = PTHREAD_MUTEX_INITIALIZER };
+struct   rtl_wd			wd			= { 0 };
+struct   rtl_bringup		bringup			= { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+/** behind device_context->device_eee **/
+struct   ethtool_eee		eee			= { 0 };
+struct   rtl_hotplug		hotplug			= { .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+__thread struct rtl_slab_cache	slab_cache[RTL81XX_SLAB_MAX];
 
 enum error_handler_t{
 	NO_ERROR,
@@ -548,6 +2366,9 @@ enum error_handler_t{
 	ERROR_FAILED_TO_IDENTIFY_ADAPTER,
 	ERROR_FAILED_TO_READ_HW_VERSION,
 	ERROR_OPERATION_NOT_SUPPORTED,
+	ERROR_OUT_OF_MEMORY,
+	ERROR_USB_TRANSFER_FAILED,
+	ERROR_STATE_UNAVAILABLE,
 	ERROR_MAXIMUN_VALUE_POSSIBLE,
 };
 
@@ -602,6 +2423,21 @@ struct error_translation_handler_t{
 		.ERROR_STRING	  = "failed to find a valid HW version identifier!",
                 .ERROR_DEFINITION = ERROR_INVALICABLE,
                 .IS_ABORTABLE     = TRUE,
+	},
+	[ERROR_OUT_OF_MEMORY] = {
+		.ERROR_STRING	  = "failed to allocate the transfer buffers!",
+                .ERROR_DEFINITION = ERROR_INVALICABLE,
+                .IS_ABORTABLE     = TRUE,
+	},
+	[ERROR_USB_TRANSFER_FAILED] = {
+		.ERROR_STRING	  = "a bulk transfer could not be submitted to the USB stack!",
+                .ERROR_DEFINITION = ERROR_INVALICABLE,
+                .IS_ABORTABLE     = FALSE,
+	},
+	[ERROR_STATE_UNAVAILABLE] = {
+		.ERROR_STRING	  = "no register snapshot matches the adapter, the full init is needed!",
+                .ERROR_DEFINITION = ERROR_DEBUG,
+                .IS_ABORTABLE     = FALSE,
 	}
 };
 
@@ -640,7 +2476,7 @@ RTL_PLUGIN_IO_OPTIMIZE static inline bool RTL81XX_IS_ZERO_ETHER_ADDR(const uint8
  */
 RTL_PLUGIN_IO_OPTIMIZE static inline bool RTL81XX_IS_MULTICAST_ETHER_ADDR(const uint8_t *addr){
         uint16_t a = *(const uint16_t  *)addr;
-	#ifdef __BIG_ENDIAN
+	#if __BYTE_ORDER == __BIG_ENDIAN
         	return 0x01 & (a >> ((sizeof(a) * 8) - 8));
 	#else
 	        return 0x01 & a;
@@ -676,36 +2512,47 @@ RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_MANIP_REG(uint16_t value, uint
 		size += 96;
 	}
 	unsigned char *tmp = (unsigned char *)malloc(size);
+	pthread_mutex_lock(&ocp_lock);
 	switch(OPS){
 	case RTL8152_REQT_WRITE:
 				{
 				signed int r = 0;
-				r = libusb_control_transfer(
-						device_context->device_handler,
-	                	                RTL8152_REQT_WRITE,
-        	                	        RTL8152_REQ_SET_REGS,
-						value,
-						index,
-						tmp,
-						size,
-						DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG
-						);
+				memcpy(tmp, data, size);
+				if( RTL81XX_EVENTS_OWNED() ){
+					/** a synchronous transfer would handle the libusb events on this thread **/
+					r = RTL81XX_CTRL_XFER(RTL8152_REQT_WRITE, value, index, tmp, size);
+				}else{
+					r = libusb_control_transfer(
+							device_context->device_handler,
+		                	                RTL8152_REQT_WRITE,
+	        	                	        RTL8152_REQ_SET_REGS,
+							value,
+							index,
+							tmp,
+							size,
+							DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG
+							);
+				}
 				return_context = r;
 				break;
 				}
 	case RTL8152_REQT_READ:
 				{
 				signed int r = 0;
-                		r = libusb_control_transfer(
-                                                device_context->device_handler,
-                                                RTL8152_REQT_READ,
-                                                RTL8152_REQ_GET_REGS,
-                                                value,
-                                                index,
-                                                tmp,
-                                                size,
-                                                DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG
-                                                );
+				if( RTL81XX_EVENTS_OWNED() ){
+					r = RTL81XX_CTRL_XFER(RTL8152_REQT_READ, value, index, tmp, size);
+				}else{
+	                		r = libusb_control_transfer(
+	                                                device_context->device_handler,
+	                                                RTL8152_REQT_READ,
+	                                                RTL8152_REQ_GET_REGS,
+	                                                value,
+	                                                index,
+	                                                tmp,
+	                                                size,
+	                                                DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG
+	                                                );
+				}
 				if(r < 0){
 					memset(data, 0xFF, size);
 				}else{
@@ -719,6 +2566,13 @@ RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_MANIP_REG(uint16_t value, uint
 		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
 	break;
 	}
+	/** a run of failures is a wedged MCU for the watchdog, an unplug is left to the hotplug thread **/
+	if( return_context >= 0 ){
+		wd.ctrl_failures = 0;
+	}else if( return_context != LIBUSB_ERROR_NO_DEVICE && return_context != -ERROR_OPERATION_NOT_SUPPORTED ){
+		wd.ctrl_failures++;
+	}
+	pthread_mutex_unlock(&ocp_lock);
 	free(tmp);
 	#if DEBUG
 		/** STILL TO THIN ON IT **/
@@ -908,11 +2762,53 @@ RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_WRITE_DWORD(uint16_t type,
 	return_context = 0;
 }
 
+/**
+ * read-modify-write of a @size bytes (1, 2 or 4) register inside one ocp_lock
+ * section: the flow control, LPM, power and watchdog threads rewrite some of
+ * the same registers and a write between the two accesses would be undone.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_CLR_SET(uint16_t type, uint16_t index, uint8_t size, uint32_t clear, uint32_t set){
+	uint32_t ocp_data = 0;
+
+	pthread_mutex_lock(&ocp_lock);
+	switch(size){
+	case 1:
+		RTL81XX_OCP_READ(type, index);
+		ocp_data = (return_context & ~clear) | set;
+		RTL81XX_OCP_WRITE(type, index, ocp_data);
+		break;
+	case 2:
+		RTL81XX_OCP_READ_WORD(type, index);
+		ocp_data = (return_context & ~clear) | set;
+		RTL81XX_OCP_WRITE_WORD(type, index, ocp_data);
+		break;
+	case 4:
+		RTL81XX_OCP_READ_DWORD(type, index);
+		ocp_data = ((uint32_t)return_context & ~clear) | set;
+		RTL81XX_OCP_WRITE_DWORD(type, index, ocp_data);
+		break;
+	default:
+		return_context = -ERROR_INVALID_SIZE;
+		break;
+	}
+	pthread_mutex_unlock(&ocp_lock);
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_SET_BITS(uint16_t type, uint16_t index, uint8_t size, uint32_t bits){
+	RTL81XX_OCP_CLR_SET(type, index, size, 0, bits);
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_CLR_BITS(uint16_t type, uint16_t index, uint8_t size, uint32_t bits){
+	RTL81XX_OCP_CLR_SET(type, index, size, bits, 0);
+}
+
 
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_REG_READ(uint16_t addr){
 	uint16_t ocp_base  = 0;
 	uint16_t ocp_index = 0;
 
+	/** the page selection and the access must not be split by another thread **/
+	pthread_mutex_lock(&ocp_lock);
 	ocp_base = addr & 0xf000;
 	if (ocp_base != global_ocp_base) {
 		RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_OCP_GPHY_BASE, ocp_base);
@@ -921,12 +2817,14 @@ RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_REG_READ(uint16_t addr){
 
 	ocp_index = (addr & 0x0fff) | 0xb000;
 	RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, ocp_index);
+	pthread_mutex_unlock(&ocp_lock);
 
 }
 
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_REG_WRITE(uint16_t addr, uint16_t data){
 	uint16_t ocp_base  = 0;
 	uint16_t ocp_index = 0;
+	pthread_mutex_lock(&ocp_lock);
 	ocp_base = addr & 0xf000;
 
 	if (ocp_base != global_ocp_base) {
@@ -936,6 +2834,7 @@ RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_REG_WRITE(uint16_t addr, u
 
 	ocp_index = (addr & 0x0fff) | 0xb000;
 	RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, ocp_index, data);
+	pthread_mutex_unlock(&ocp_lock);
 	return_context = 0;
 }
 
@@ -987,21 +2886,17 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HW_PHY_WORK(void){
 
 /** HW INDEPENDENT FUNCTIONS, WORKS BY SWITCHING THE HW IDENTIFIER **/
 
-RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_INIT(void){
-	switch(device_context->device_version_identifier){
-		case RTL_VER_12:
-		case RTL_VER_13:
-		case RTL_VER_15:
-			device_context->device_cb = &rtl_ops[RTL8156B];
-		break;
-		case RTL_VER_08:
-		case RTL_VER_09:
-			device_context->device_cb = &rtl_ops[RTL8153];
-		break;
-		default:
-			device_context->device_cb = NULL;
-		break;
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SELECT_OPS(void){
+	if( device_context->device_chip->ops != NULL ){
+		device_context->device_cb = device_context->device_chip->ops;
+	}else{
+		/** no dedicated ops for this revision, keep the ones of the USB id table **/
+		device_context->device_cb = ( device_context->device_id != NULL ) ? device_context->device_id->ops : NULL;
 	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_INIT(void){
+	RTL81XX_SELECT_OPS();
 	/** let's start the init callback! **/
 	if( device_context->device_cb->rtl_init != NULL ){
 		device_context->device_cb->rtl_init();
@@ -1019,11 +2914,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DISABLE(void){
 
 	/** static void rxdy_gated_en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_MISC_1 ) );
-		ocp_data = return_context;
-		ocp_data |= RXDY_GATED_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MISC_1, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_MISC_1, 2, RXDY_GATED_EN ) );
 	}
 
 	for (short i = 0; i < (DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG * 2); i++) {
@@ -1046,95 +2937,99 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DISABLE(void){
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_NIC_RESET(void){
+	device_context->device_chip->nic_reset();
+}
+
+/** static void rtl8152_nic_reset(struct r8152 *tp), CR_RST flavour **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8152_NIC_RESET(void){
 	uint32_t ocp_data = 0;
-        switch(device_context->device_version_identifier){
-		case RTL_TEST_01:
-		case RTL_VER_10:
-		case RTL_VER_11:
-			DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_PLA, PLA_CR) );
-			ocp_data = return_context;
-			ocp_data &= ~CR_TE;
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_PLA, PLA_CR, ocp_data) );
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_PLA, PLA_CR, CR_RST) );
+	for(short j = 0; j < (DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG * 2); j++) {
+		DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_PLA, PLA_CR) );
+		ocp_data = return_context;
+		if(!ocp_data & CR_RST){
+			break;
+		}
+		usleep(240);
+	}
+}
 
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_BMU_RESET) );
-			ocp_data = return_context;
-			ocp_data &= ~BMU_RESET_EP_IN;
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_BMU_RESET, ocp_data) );
+/** static void rtl8152_nic_reset(struct r8152 *tp), RTL_TEST_01, RTL_VER_10 and RTL_VER_11 **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_NIC_RESET(void){
+	DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_CR, 1, CR_TE ) );
 
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_USB_CTRL) );
-			ocp_data = return_context;
-			ocp_data |= CDC_ECM_EN;
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_USB_CTRL, ocp_data) );
+	DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_BMU_RESET, 2, BMU_RESET_EP_IN ) );
 
-			DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_PLA, PLA_CR) );
-			ocp_data = return_context;
-			ocp_data &= ~CR_RE;
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_PLA, PLA_CR, ocp_data) );
+	DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_USB, USB_USB_CTRL, 2, CDC_ECM_EN ) );
 
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_BMU_RESET) );
-			ocp_data = return_context;
-			ocp_data |= BMU_RESET_EP_IN;
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_BMU_RESET, ocp_data) );
+	DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_CR, 1, CR_RE ) );
 
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_USB_CTRL) );
-			ocp_data = return_context;
-			ocp_data &= ~CDC_ECM_EN;
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_USB_CTRL, ocp_data) );
-		break;
-		default:
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_PLA, PLA_CR, CR_RST) );
-			for(short j = 0; j < (DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG * 2); j++) {
-				DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_PLA, PLA_CR) );
-				ocp_data = return_context;
-				if(!ocp_data & CR_RST){
-					break;
-				}
-				usleep(240);
-			}
-		break;
-	}
+	DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_USB, USB_BMU_RESET, 2, BMU_RESET_EP_IN ) );
+
+	DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_USB_CTRL, 2, CDC_ECM_EN ) );
+}
+
+/** static void rtl_reset_bmu(struct r8152 *tp) **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RESET_BMU(void){
+	uint32_t ocp_data = 0;
+
+	DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_USB, USB_BMU_RESET) );
+	ocp_data = return_context;
+	ocp_data &= ~(BMU_RESET_EP_IN | BMU_RESET_EP_OUT);
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_USB, USB_BMU_RESET, ocp_data) );
+	ocp_data |= BMU_RESET_EP_IN | BMU_RESET_EP_OUT;
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_USB, USB_BMU_RESET, ocp_data) );
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_VLAN_ENABLE(unsigned char enable){
-        uint32_t ocp_data = 0;
-        switch(device_context->device_version_identifier){
-		case RTL_VER_01:
-		case RTL_VER_02:
-		case RTL_VER_03:
-		case RTL_VER_04:
-		case RTL_VER_05:
-		case RTL_VER_06:
-		case RTL_VER_07:
-		case RTL_VER_08:
-		case RTL_VER_09:
-		case RTL_VER_14:
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, PLA_CPCR) );
-			ocp_data = return_context;
-			if (enable){
-				ocp_data |= CPCR_RX_VLAN;
-			}else{
-				ocp_data &= ~CPCR_RX_VLAN;
-			}
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_CPCR, ocp_data) );
-		break;
+	device_context->device_chip->rx_vlan_enable(enable);
+}
 
-		case RTL_TEST_01:
-		case RTL_VER_10:
-		case RTL_VER_11:
-		case RTL_VER_12:
-		case RTL_VER_13:
-		case RTL_VER_15:
-		default:
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, PLA_RCR1) );
-			ocp_data = return_context;
-			if(enable){
-				ocp_data |= OUTER_VLAN | INNER_VLAN;
-			}else{
-				ocp_data &= ~(OUTER_VLAN | INNER_VLAN);
-			}
-			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_RCR1, ocp_data) );
-		break;
+/** static void rtl_rx_vlan_en(struct r8152 *tp, bool enable), up to the RTL8153 family and RTL_VER_14 **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8152_RX_VLAN_ENABLE(unsigned char enable){
+	uint32_t ocp_data = 0;
+	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, PLA_CPCR) );
+	ocp_data = return_context;
+	if (enable){
+		ocp_data |= CPCR_RX_VLAN;
+	}else{
+		ocp_data &= ~CPCR_RX_VLAN;
+	}
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_CPCR, ocp_data) );
+}
+
+/** static void rtl_rx_vlan_en(struct r8152 *tp, bool enable), the RTL8156 family **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_RX_VLAN_ENABLE(unsigned char enable){
+	uint32_t ocp_data = 0;
+	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, PLA_RCR1) );
+	ocp_data = return_context;
+	if(enable){
+		ocp_data |= OUTER_VLAN | INNER_VLAN;
+	}else{
+		ocp_data &= ~(OUTER_VLAN | INNER_VLAN);
+	}
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_RCR1, ocp_data) );
+}
+
+/**
+ * RTL81XX_SET_FEATURES - switch offloads on and off, this is the 'rtl_set_features' callback
+ * @features: RTL81XX_FEATURE_* wanted, the ones missing are disabled
+ *
+ * static int rtl8152_set_features(struct net_device *dev, netdev_features_t features)
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_FEATURES(unsigned long features){
+	unsigned long changed = 0;
+
+	if( features & ~RTL81XX_FEATURES_ALL ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
 	}
+	changed = features ^ device_context->dev_flags.features;
+	if( changed & RTL81XX_FEATURE_RX_VLAN ){
+		RTL81XX_RX_VLAN_ENABLE(!!(features & RTL81XX_FEATURE_RX_VLAN));
+	}
+	device_context->dev_flags.features = features;
+	return_context = NO_ERROR;
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_MAC_ADDR(unsigned char new_mac_addr[MAC_ADDR_LEN]){
@@ -1146,13 +3041,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_MAC_ADDR(unsigned char
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_RX_MODE(enum RTL81XX_INTERFACE_MODE mode){
 	uint32_t mc_filter[2];	/* Multicast hash filter */
-	__le32 tmp[2] = { 0 };
-
 	uint32_t ocp_data = 0;
-	DEBUG_RTL81XX( RTL81XX_OCP_READ_DWORD(MCU_TYPE_PLA, PLA_RCR) );
-	ocp_data = return_context;
-	ocp_data &= ~RCR_ACPT_ALL;
-	ocp_data |= RCR_AB | RCR_APM;
 
 	switch(mode){
 		case RTL81XX_PROMISC_MODE:
@@ -1172,83 +3061,105 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_RX_MODE(enum RTL81XX_I
 			/** do nothing... */
 		break;
 	}
+	RTL81XX_WRITE_RX_FILTER(ocp_data, mc_filter);
+}
+
+/** static inline unsigned int ether_crc(int length, unsigned char *data) **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_ETHER_CRC(const uint8_t *data, int length){
+	uint32_t crc = 0xffffffff;
+
+	while( --length >= 0 ){
+		uint8_t current_octet = *data++;
+		for(int bit = 0; bit < 8; bit++, current_octet >>= 1){
+			crc = (crc << 1) ^ (((crc >> 31) ^ (current_octet & 1)) ? 0x04c11db7 : 0);
+		}
+	}
+	return crc;
+}
+
+/** program the receive configuration, @rcr only carries the accept bits on top of broadcast and own address **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WRITE_RX_FILTER(uint32_t rcr, uint32_t mc_filter[2]){
+	__le32 tmp[2] = { 0 };
+
 	tmp[0] = __cpu_to_le32(swab32(mc_filter[1]));
 	tmp[1] = __cpu_to_le32(swab32(mc_filter[0]));
+	/** the hash and the mode go together **/
+	pthread_mutex_lock(&ocp_lock);
 	DEBUG_RTL81XX( RTL81XX_GENERIC_REG_WRITE(PLA_MAR, BYTE_EN_DWORD, sizeof(tmp), tmp, MCU_TYPE_PLA) );
-	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_DWORD(MCU_TYPE_PLA, PLA_RCR, ocp_data) );
+	DEBUG_RTL81XX( RTL81XX_OCP_CLR_SET(MCU_TYPE_PLA, PLA_RCR, 4, RCR_ACPT_ALL, RCR_AB | RCR_APM | rcr) );
+	pthread_mutex_unlock(&ocp_lock);
+}
+
+/**
+ * RTL81XX_SET_MC_LIST - receive only the listed multicast groups, this is the 'rtl_set_mc_list' callback
+ * @mc_list: multicast MAC addresses, the broadcast address is always received
+ * @count:   number of entries, 0 drops every multicast frame
+ *
+ * every address sets one bit of the 64 bit PLA_MAR hash, picked by the top 6
+ * bits of its ethernet CRC, the same way 'rtl8152_set_rx_mode' does. Past
+ * RTL81XX_MC_FILTER_LIMIT groups the chip simply accepts all multicast, and
+ * a promiscuous chip (RTL81XX_CAPTURE_START) stays promiscuous.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_MC_LIST(const uint8_t (*mc_list)[ETH_ALEN], unsigned int count){
+	uint32_t mc_filter[2] = { 0 };
+	uint32_t rcr	      = 0;
 
+	if( count != 0 && mc_list == NULL ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	for(unsigned int i = 0; i < count; i++){
+		if( !RTL81XX_IS_MULTICAST_ETHER_ADDR(mc_list[i]) ){
+			DEBUG_PRINTF("[%s][line %d] entry %u is not a multicast address\n", __FUNCTION__, __LINE__, i);
+			return_context = -ERROR_INVALID_ARGS;
+			return;
+		}
+	}
+	/** a capture could switch the chip to promiscuous between the read and the write **/
+	pthread_mutex_lock(&ocp_lock);
+	DEBUG_RTL81XX( RTL81XX_OCP_READ_DWORD(MCU_TYPE_PLA, PLA_RCR) );
+	if( return_context >= 0 && ( (uint32_t)return_context & RCR_AAP ) ){
+		/** 'rtl8152_set_rx_mode' with IFF_PROMISC, the list narrows nothing **/
+		RTL81XX_SET_RX_MODE(RTL81XX_PROMISC_MODE);
+	}else if( count > RTL81XX_MC_FILTER_LIMIT ){
+		RTL81XX_SET_RX_MODE(RTL81XX_MULTICAST_MODE);
+	}else{
+		for(unsigned int i = 0; i < count; i++){
+			int bit_nr = RTL81XX_ETHER_CRC(mc_list[i], ETH_ALEN) >> 26;
+			mc_filter[bit_nr >> 5] |= 1U << (bit_nr & 31);
+			rcr |= RCR_AM;
+		}
+		RTL81XX_WRITE_RX_FILTER(rcr, mc_filter);
+	}
+	pthread_mutex_unlock(&ocp_lock);
 }
 
-RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LOAD_FIRMWARE(bool power_cut){
+/** look the blob of the chip up and apply its @blocks, RTL81XX_FW_ALL applies all of them in blob order **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LOAD_FIRMWARE(bool power_cut, unsigned int blocks){
 	/** FIRST PART: AUTO DETECT THE FIRMWARE BLOB **/
 	{
-
-	#define STATIC_STRING_SIZE(x)	(sizeof(x)/sizeof(char))
-	/** allocate device_firmware */
-	device_context->device_firmware = (struct device_firmware *)malloc(sizeof(struct device_firmware));
-	switch(device_context->device_version_identifier){
-		case RTL_VER_04:
-			device_context->device_firmware->device_fw_blob_name = (unsigned char *)malloc(STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_2]));
-			strncpy( device_context->device_firmware->device_fw_blob_name, fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_2], STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_2]) );
-			DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
-			//rtl_fw->pre_fw		= r8153_pre_firmware_1;
-			//rtl_fw->post_fw		= r8153_post_firmware_1;
-		break;
-		case RTL_VER_05:
-			device_context->device_firmware->device_fw_blob_name = (unsigned char *)malloc(STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_3]));
-                        strncpy( device_context->device_firmware->device_fw_blob_name, fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_3], STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_3]) );
-                        DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
-			//rtl_fw->pre_fw		= r8153_pre_firmware_2;
-			//rtl_fw->post_fw		= r8153_post_firmware_2;
-		break;
-		case RTL_VER_06:
-			device_context->device_firmware->device_fw_blob_name = (unsigned char *)malloc(STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_4]));
-                        strncpy( device_context->device_firmware->device_fw_blob_name, fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_4], STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153A_4]) );
-		        #if DEBUG_V1 == 1 || DEBUG_V2 == 1
-                                DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
-                        #endif
-			//rtl_fw->post_fw		= r8153_post_firmware_3;
-		break;
-		case RTL_VER_09:
-			device_context->device_firmware->device_fw_blob_name = (unsigned char *)malloc(STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153B_2]));
-                        strncpy( device_context->device_firmware->device_fw_blob_name, fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153B_2], STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153B_2]) );
-		        #if DEBUG_V1 == 1 || DEBUG_V2 == 1
-                                DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
-                        #endif
-			//rtl_fw->pre_fw		= r8153b_pre_firmware_1;
-			//rtl_fw->post_fw		= r8153b_post_firmware_1;
-		break;
-		case RTL_VER_11:
-			device_context->device_firmware->device_fw_blob_name = (unsigned char *)malloc(STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153C_1]));
-                        strncpy( device_context->device_firmware->device_fw_blob_name, fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153C_1], STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153C_1]) );
-		        #if DEBUG_V1 == 1 || DEBUG_V2 == 1
-                                DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
-                        #endif
-			//rtl_fw->post_fw		= r8156a_post_firmware_1;
-		break;
-		case RTL_VER_13:
-		case RTL_VER_15:
-			device_context->device_firmware->device_fw_blob_name = (unsigned char *)malloc(STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8156B_2]) + 1);
-                        strncpy( device_context->device_firmware->device_fw_blob_name, fw_blob_names[RTL81XX_FIRMWARE_BLOB_8156B_2], STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8156B_2]) );
-                        DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
-			/** NOTE: the rtl8156b adapter doesn't have both pre/post fw loading callbacks... **/
-			device_context->device_firmware->device_pre_fw_loading  = NULL;
-			device_context->device_firmware->device_post_fw_loading = NULL;
-		break;
-		case RTL_VER_14:
-			device_context->device_firmware->device_fw_blob_name = (unsigned char *)malloc(STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153C_1]));
-                        strncpy( device_context->device_firmware->device_fw_blob_name, fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153C_1], STATIC_STRING_SIZE(fw_blob_names[RTL81XX_FIRMWARE_BLOB_8153C_1]) );
-		        #if DEBUG_V1 == 1 || DEBUG_V2 == 1
-                                DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
-                        #endif
-			//rtl_fw->pre_fw		= r8153b_pre_firmware_1;
-			//rtl_fw->post_fw		= r8153c_post_firmware_1;
-		break;
-		default:
-			/** THROWN AN EXCEPTION **/
-			/** TODO **/
-		break;
+	/** allocate device_firmware, none of the blobs has pre/post loading callbacks yet **/
+	if( device_context->device_firmware == NULL ){
+		device_context->device_firmware = (struct device_firmware *)calloc(1, sizeof(struct device_firmware));
+		if( device_context->device_firmware == NULL ){
+			return_context = -ERROR_OUT_OF_MEMORY;
+			return;
+		}
+	}else{
+		/** RTL81XX_WD_REINIT runs the init again, the blob is looked up from scratch **/
+		free(device_context->device_firmware->device_fw_blob_name);
+		memset(device_context->device_firmware, 0, sizeof(struct device_firmware));
+	}
+	if( device_context->device_chip->fw != RTL81XX_FIRMWARE_BLOB_NONE ){
+		device_context->device_firmware->device_fw_blob_name = (unsigned char *)strdup(fw_blob_names[device_context->device_chip->fw]);
+	}else if( device_context->device_id != NULL && device_context->device_id->fw != RTL81XX_FIRMWARE_BLOB_NONE ){
+		/** the USB id table may still pin the blob **/
+		device_context->device_firmware->device_fw_blob_name = (unsigned char *)strdup(fw_blob_names[device_context->device_id->fw]);
+	}else{
+		/** THROWN AN EXCEPTION **/
+		/** TODO **/
 	}
+	DEBUG_PRINTF("[%s][line %d] current firmware name is: %s\n", __FUNCTION__, __LINE__, device_context->device_firmware->device_fw_blob_name );
 	}
 	/** SECOND PART: PARSE THE FIRMWARE BLOB AND CHOOSE WHAT TO DO **/
 	{
@@ -1351,6 +3262,13 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LOAD_FIRMWARE(bool power_c
 
 		for ( short i = offsetof(struct fw_header, blocks); i < device_context->device_firmware->device_fw_blob_size; ){
 			struct fw_block *block = (struct fw_block *)&device_context->device_firmware->device_fw_blob_start[i];
+			uint32_t part = ( __le32_to_cpu(block->type) == RTL_FW_PLA || __le32_to_cpu(block->type) == RTL_FW_USB ) ? RTL81XX_FW_MAC : RTL81XX_FW_PHY;
+
+			/** the blocks of the other part are left to another call **/
+			if( __le32_to_cpu(block->type) != RTL_FW_END && !(blocks & part) ){
+				i += ALIGN(__le32_to_cpu(block->length), 8);
+				continue;
+			}
 			switch (__le32_to_cpu(block->type)){
 				case RTL_FW_END:
 					goto post_fw;
@@ -1390,32 +3308,21 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LOAD_FIRMWARE(bool power_c
 							uint16_t bp[16] = {0};
 							uint16_t bp_num = 0;
 
-							switch ( device_context->device_version_identifier ) {
-								case RTL_VER_08:
-								case RTL_VER_09:
-								case RTL_VER_10:
-								case RTL_VER_11:
-								case RTL_VER_12:
-								case RTL_VER_13:
-								case RTL_VER_15:
+							switch ( device_context->device_chip->bp ) {
+								case RTL81XX_BP_USB2:
 									if (type == MCU_TYPE_USB) {
 										DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_BP2_EN, 0 ) );
 										bp_num = 16;
 										break;
 									}
 								__attribute__((fallthrough));
-								case RTL_VER_03:
-								case RTL_VER_04:
-								case RTL_VER_05:
-								case RTL_VER_06:
+								case RTL81XX_BP_PLA_EN:
 									DEBUG_RTL81XX( RTL81XX_OCP_WRITE( type, PLA_BP_EN, 0 ) );
 								__attribute__((fallthrough));
-								case RTL_VER_01:
-								case RTL_VER_02:
-								case RTL_VER_07:
+								case RTL81XX_BP_PLA:
 									bp_num = 8;
 								break;
-								case RTL_VER_14:
+								case RTL81XX_BP_BP2:
 								default:
 									DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( type, USB_BP2_EN, 0 ) );
 									bp_num = 16;
@@ -1701,85 +3608,5037 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LOAD_FIRMWARE(bool power_c
 							}else{
 								size = 2048;
 							}
-							DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_GPHY_CTRL ) );
-							ocp_data = return_context;
-							ocp_data |= GPHY_PATCH_DONE | BACKUP_RESTRORE;
-							DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_GPHY_CTRL, ocp_data ) );
+							DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_USB, USB_GPHY_CTRL, 2, GPHY_PATCH_DONE | BACKUP_RESTRORE ) );
 
 							DEBUG_RTL81XX( RTL81XX_GENERIC_REG_WRITE(__le16_to_cpu(phy->fw_reg), 0xff, size, data, MCU_TYPE_USB) );
 
 							data += size;
 							len -= size;
 
-							DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_POL_GPIO_CTRL ) );
-							ocp_data = return_context;
-							ocp_data |= POL_GPHY_PATCH;
-							DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_POL_GPIO_CTRL, ocp_data ) );
+							DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_POL_GPIO_CTRL, 2, POL_GPHY_PATCH ) );
+
+							for (short i = 0; i < DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG; i++) {
+								DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_POL_GPIO_CTRL ) );
+								ocp_data = return_context;
+								if (!(ocp_data) & POL_GPHY_PATCH){
+									break;
+								}
+							}
+						}
+						/** reset the global_ocp_base offset **/
+                                                global_ocp_base = -1;
+						RTL81XX_PHY_PATCH_REQUEST(false, wait);
+					}
+				break;
+				default:
+					/** DO NOTHING **/
+				break;
+			}
+		i += ALIGN(__le32_to_cpu(block->length), 8);
+		}
+	post_fw:
+		if( device_context->device_firmware->device_post_fw_loading != NULL ){
+			device_context->device_firmware->device_post_fw_loading();
+		}else{
+			DEBUG_PRINTF("[!] device_post_fw_loading is disabled!\n");
+		}
+		//strncpy(rtl_fw->version, fw_hdr->version, RTL_VER_SIZE);
+	        /** reset the global_ocp_base offset **/
+                global_ocp_base = -1;
+	}
+}
+
+/** BUFFER SLAB, THE DATA PATH NEVER CALLS MALLOC **/
+
+/**
+ * RTL81XX_SLAB_INIT - carve @slot_count slots of @slot_size bytes from a single region
+ * @flags: RTL81XX_SLAB_DEV_MEM and/or RTL81XX_SLAB_HUGEPAGE, tried in this order
+ *
+ * the region falls back to plain anonymous memory when the backing asked is
+ * not available. Slots are 64 bytes aligned.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SLAB_INIT(struct rtl_slab *slab, enum rtl_slab_id_t id, uint32_t slot_size, uint32_t slot_count, unsigned int flags){
+	uint32_t generation = slab->generation;
+
+	if( slab->base != NULL ){
+		RTL81XX_SLAB_DESTROY(slab);
+	}
+	if( slot_size == 0 || slot_count == 0 || id >= RTL81XX_SLAB_MAX ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	memset(slab, 0, sizeof(*slab));
+	slab->id	  = id;
+	slab->generation  = generation + 1;
+	slab->slot_size	  = ALIGN(slot_size, 64);
+	slab->slot_count  = slot_count;
+	slab->region_size = (size_t)slab->slot_size * slot_count;
+
+	if( (flags & RTL81XX_SLAB_DEV_MEM) && device_context != NULL && device_context->device_handler != NULL ){
+		slab->base = libusb_dev_mem_alloc(device_context->device_handler, slab->region_size);
+		slab->is_dev_mem = ( slab->base != NULL );
+	}
+	if( slab->base == NULL && (flags & RTL81XX_SLAB_HUGEPAGE) ){
+		size_t huge_size = ALIGN(slab->region_size, (size_t)RTL81XX_HUGEPAGE_SIZE);
+		void *region	 = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+		if( region != MAP_FAILED ){
+			slab->base	  = region;
+			slab->region_size = huge_size;
+			slab->is_hugepage = TRUE;
+		}
+	}
+	if( slab->base == NULL ){
+		void *region = mmap(NULL, slab->region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+		if( region != MAP_FAILED ){
+			slab->base = region;
+		}
+	}
+	slab->next = calloc(slot_count, sizeof(uint32_t));
+	if( slab->base == NULL || slab->next == NULL ){
+		DEBUG_PRINTF("[%s][line %d] %s\n", __FUNCTION__, __LINE__, "returned ERROR_OUT_OF_MEMORY!");
+		RTL81XX_SLAB_DESTROY(slab);
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+
+	/** every slot starts inside the free list, the lowest index on top **/
+	for(uint32_t i = 0; i < slot_count; i++){
+		slab->next[i] = ( i + 1 < slot_count ) ? i + 2 : 0;
+	}
+	slab->free_head = 1;
+	DEBUG_PRINTF("[%s] slab %d: %u slots of %u bytes%s%s\n", __FUNCTION__, id, slot_count, slab->slot_size,
+		slab->is_dev_mem ? ", usbfs memory" : "", slab->is_hugepage ? ", hugepages" : "");
+	return_context = NO_ERROR;
+}
+
+/** every slot must have been given back, the per-thread caches of this generation become stale **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SLAB_DESTROY(struct rtl_slab *slab){
+	if( slab->base != NULL ){
+		if( slab->is_dev_mem ){
+			libusb_dev_mem_free(device_context->device_handler, slab->base, slab->region_size);
+		}else{
+			munmap(slab->base, slab->region_size);
+		}
+	}
+	free(slab->next);
+	slab->base	 = NULL;
+	slab->next	 = NULL;
+	slab->free_head	 = 0;
+	slab->slot_count = 0;
+	slab->generation++;
+}
+
+/** return the index plus one of a free slot, 0 when the slab is exhausted **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_SLAB_POP(struct rtl_slab *slab){
+	uint64_t head = __atomic_load_n(&slab->free_head, __ATOMIC_ACQUIRE);
+	uint64_t new_head = 0;
+	uint32_t index	  = 0;
+
+	do{
+		index = (uint32_t)head;
+		if( index == 0 ){
+			return 0;
+		}
+		/** the tag changes on every update, a stale next[] read makes the CAS fail **/
+		new_head = ((head >> 32) + 1) << 32 | __atomic_load_n(&slab->next[index - 1], __ATOMIC_RELAXED);
+	}while( !__atomic_compare_exchange_n(&slab->free_head, &head, new_head, TRUE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) );
+	return index;
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_SLAB_PUSH(struct rtl_slab *slab, uint32_t index){
+	uint64_t head = __atomic_load_n(&slab->free_head, __ATOMIC_RELAXED);
+	uint64_t new_head = 0;
+
+	do{
+		__atomic_store_n(&slab->next[index - 1], (uint32_t)head, __ATOMIC_RELAXED);
+		new_head = ((head >> 32) + 1) << 32 | index;
+	}while( !__atomic_compare_exchange_n(&slab->free_head, &head, new_head, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED) );
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_SLAB_ALLOC(struct rtl_slab *slab){
+	struct rtl_slab_cache *cache = &slab_cache[slab->id];
+	uint32_t index		     = 0;
+
+	if( cache->generation != slab->generation ){
+		cache->generation = slab->generation;
+		cache->count	  = 0;
+	}
+	if( cache->count == 0 ){
+		/** refill half of the cache, the other half absorbs the next frees **/
+		while( cache->count < RTL81XX_SLAB_CACHE_SIZE / 2 ){
+			index = RTL81XX_SLAB_POP(slab);
+			if( index == 0 ){
+				break;
+			}
+			cache->slot[cache->count++] = index;
+		}
+		if( cache->count == 0 ){
+			return NULL;
+		}
+	}
+	index = cache->slot[--cache->count];
+	return slab->base + (size_t)(index - 1) * slab->slot_size;
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_SLAB_FREE(struct rtl_slab *slab, void *ptr){
+	struct rtl_slab_cache *cache = &slab_cache[slab->id];
+	uint32_t index		     = 0;
+
+	if( ptr == NULL || (uint8_t *)ptr < slab->base || (uint8_t *)ptr >= slab->base + (size_t)slab->slot_size * slab->slot_count ){
+		return;
+	}
+	index = (uint32_t)(((uint8_t *)ptr - slab->base) / slab->slot_size) + 1;
+
+	if( cache->generation != slab->generation ){
+		cache->generation = slab->generation;
+		cache->count	  = 0;
+	}
+	if( cache->count == RTL81XX_SLAB_CACHE_SIZE ){
+		while( cache->count > RTL81XX_SLAB_CACHE_SIZE / 2 ){
+			RTL81XX_SLAB_PUSH(slab, cache->slot[--cache->count]);
+		}
+	}
+	cache->slot[cache->count++] = index;
+}
+
+/** a thread that is going to exit gives its cached slots back **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SLAB_CACHE_DRAIN(struct rtl_slab *slab){
+	struct rtl_slab_cache *cache = &slab_cache[slab->id];
+
+	if( cache->generation == slab->generation ){
+		while( cache->count ){
+			RTL81XX_SLAB_PUSH(slab, cache->slot[--cache->count]);
+		}
+	}
+}
+
+/** packet buffers sized from the MTU assigned by RTL81XX_ASSIGN_MTU **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PKT_SLAB_INIT(void){
+	RTL81XX_SLAB_INIT(&pkt_slab, RTL81XX_SLAB_PKT, RTL81XX_PKT_HEADROOM + mtu_to_size(device_context->device_max_mtu), RTL81XX_PKT_SLAB_SLOTS, RTL81XX_PKT_SLAB_FLAGS);
+}
+
+/** 'rtl_buf_alloc', the frame starts at the returned address and RTL81XX_PKT_HEADROOM bytes are free in front of it **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_BUF_ALLOC(void){
+	uint8_t *slot = RTL81XX_SLAB_ALLOC(&pkt_slab);
+	return ( slot != NULL ) ? slot + RTL81XX_PKT_HEADROOM : NULL;
+}
+
+/** 'rtl_buf_free', any address inside the buffer is accepted **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_BUF_FREE(void *buf){
+	RTL81XX_SLAB_FREE(&pkt_slab, buf);
+}
+
+/** RX DATA PATH, AGGREGATED BULK-IN ENGINE **/
+
+/** static u8 r8152_rx_csum(struct r8152 *tp, struct rx_desc *rx_desc) **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint8_t RTL81XX_RX_CSUM(struct rx_desc *desc){
+	uint32_t opts2 = __le32_to_cpu(desc->opts2);
+	uint32_t opts3 = __le32_to_cpu(desc->opts3);
+
+	if( opts2 & RD_IPV4_CS ){
+		if( opts3 & IPF ){
+			return RTL81XX_RX_CSUM_BAD;
+		}
+	}else if( !(opts2 & RD_IPV6_CS) ){
+		return RTL81XX_RX_CSUM_NONE;
+	}
+	if( opts2 & RD_UDP_CS ){
+		return ( opts3 & UDPF ) ? RTL81XX_RX_CSUM_BAD : RTL81XX_RX_CSUM_OK;
+	}
+	if( opts2 & RD_TCP_CS ){
+		return ( opts3 & TCPF ) ? RTL81XX_RX_CSUM_BAD : RTL81XX_RX_CSUM_OK;
+	}
+	/** only the IP header has been checked **/
+	return RTL81XX_RX_CSUM_NONE;
+}
+
+/**
+ * RTL81XX_RX_PARSE_AGG - split an aggregated bulk-IN buffer into frame views
+ * @rx_buf:	start of the bulk-IN buffer
+ * @rx_len:	valid bytes inside the buffer (actual_length of the transfer)
+ * @offset:	parse cursor, moved to the first descriptor not consumed yet
+ * @frames:	array filled with the views
+ * @max_frames:	room inside @frames
+ *
+ * Return the number of views written, the payload is never copied.
+ * Once the whole buffer has been consumed *offset is equal to @rx_len,
+ * a malformed descriptor drops the rest of the buffer.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline unsigned int RTL81XX_RX_PARSE_AGG(uint8_t *rx_buf, uint32_t rx_len, uint32_t *offset, struct rtl_rx_frame *frames, unsigned int max_frames){
+	unsigned int count = 0;
+	uint32_t pos	   = *offset;
+
+	while( pos + sizeof(struct rx_desc) <= rx_len ){
+		struct rx_desc *desc = (struct rx_desc *)(rx_buf + pos);
+		uint32_t pkt_len     = __le32_to_cpu(desc->opts1) & RX_LEN_MASK;
+
+		if( count == max_frames ){
+			break;
+		}
+		if( pkt_len < ETH_ZLEN || pos + sizeof(struct rx_desc) + pkt_len > rx_len ){
+			rx_engine.rx_errors++;
+			pos = rx_len;
+			break;
+		}
+		frames[count].desc = desc;
+		frames[count].data = (uint8_t *)(desc + 1);
+		frames[count].len  = pkt_len - ETH_FCS_LEN;
+		frames[count].csum = RTL81XX_RX_CSUM(desc);
+		/** static void rtl_rx_vlan_tag(struct rx_desc *desc, struct sk_buff *skb) **/
+		frames[count].has_vlan = !!(__le32_to_cpu(desc->opts2) & RX_VLAN_TAG);
+		frames[count].vlan_tci = swab16(__le32_to_cpu(desc->opts2) & 0xffff);
+		rx_engine.rx_bytes += frames[count].len;
+		count++;
+
+		pos = ALIGN(pos + sizeof(struct rx_desc) + pkt_len, RX_ALIGN);
+	}
+	rx_engine.rx_packets += count;
+	*offset = ( count == max_frames ) ? pos : rx_len;
+	/** unwanted frames never reach the consumer, their buffer goes back to the chip with the rest **/
+	if( count != 0 && cls.enabled ){
+		count = RTL81XX_CLS_RUN(frames, count);
+	}
+	return count;
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_SUBMIT(struct rtl_rx_urb *urb){
+	if( wd.recovering ){
+		/** the watchdog gives the buffer back to the chip once the endpoint works again **/
+		urb->state     = RTL81XX_URB_IDLE;
+		return_context = NO_ERROR;
+		return;
+	}
+	libusb_fill_bulk_transfer(urb->transfer, device_context->device_handler, RTL81XX_BULK_IN_EP, urb->buffer, rx_engine.buf_size, RTL81XX_RX_COMPLETE, urb, 0);
+	urb->state = RTL81XX_URB_QUEUED;
+	__atomic_add_fetch(&rx_engine.inflight, 1, __ATOMIC_ACQ_REL);
+	return_context = libusb_submit_transfer(urb->transfer);
+	if( return_context < 0 ){
+		__atomic_sub_fetch(&rx_engine.inflight, 1, __ATOMIC_ACQ_REL);
+		RTL81XX_RX_PARK(urb);
+		rx_engine.rx_urb_errors++;
+		return_context = -ERROR_USB_TRANSFER_FAILED;
+	}
+}
+
+/** keep a buffer away from the chip, RTL81XX_RX_UNPARK gives it back after RTL81XX_RX_ERR_BACKOFF_MS **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_PARK(struct rtl_rx_urb *urb){
+	struct timespec now = { 0 };
+
+	urb->state = RTL81XX_URB_IDLE;
+	if( rx_engine.parked_ns == 0 ){
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		rx_engine.parked_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	}
+}
+
+/**
+ * resubmit the parked buffers once the backoff elapsed, called by the thread
+ * that reaps the bulk-IN completions. A halted endpoint is left to the watchdog.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_UNPARK(void){
+	struct timespec now = { 0 };
+
+	if( rx_engine.parked_ns == 0 || !rx_engine.running || wd.recovering || __atomic_load_n(&wd.halted, __ATOMIC_ACQUIRE) ){
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if( (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - rx_engine.parked_ns < RTL81XX_RX_ERR_BACKOFF_MS * 1000000ULL ){
+		return;
+	}
+	rx_engine.parked_ns  = 0;
+	rx_engine.err_streak = 0;
+	RTL81XX_RX_RESUBMIT_IDLE();
+}
+
+/** the watchdog and the completion thread may both resubmit, a buffer is claimed first; returns how many went back **/
+RTL_PLUGIN_IO_OPTIMIZE static inline unsigned int RTL81XX_RX_RESUBMIT_IDLE(void){
+	unsigned int count = 0;
+
+	for(int i = 0; i < RTL81XX_RX_URB_NUM; i++){
+		enum rtl_urb_state_t idle = RTL81XX_URB_IDLE;
+
+		if( __atomic_compare_exchange_n(&rx_engine.urb[i].state, &idle, RTL81XX_URB_QUEUED, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ){
+			RTL81XX_RX_SUBMIT(&rx_engine.urb[i]);
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * called by libusb from the thread that is handling the events. In push mode
+ * that is the completion thread, but a thread that was already inside libusb
+ * when the engine started can still reap a few: those are handed over.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_COMPLETE(struct libusb_transfer *transfer){
+	struct rtl_rx_urb *urb = (struct rtl_rx_urb *)transfer->user_data;
+
+	rx_engine.completions++;
+	if( rx_engine.consumer != NULL && rx_engine.running && !pthread_equal(pthread_self(), rx_engine.completion_thread) ){
+		urb->state = RTL81XX_URB_COMPLETED;
+		rx_engine.done_ring[rx_engine.done_tail % RTL81XX_RX_URB_NUM] = (unsigned char)(urb - rx_engine.urb);
+		__atomic_add_fetch(&rx_engine.done_tail, 1, __ATOMIC_RELEASE);
+		return;
+	}
+	RTL81XX_RX_REAP(urb);
+	/** in flight until the consumer returned, RTL81XX_RX_STOP and the watchdog wait for it **/
+	__atomic_sub_fetch(&rx_engine.inflight, 1, __ATOMIC_ACQ_REL);
+}
+
+/** push mode: the completions RTL81XX_RX_COMPLETE handed over, in completion order **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_REAP_HANDED(void){
+	while( rx_engine.done_head != __atomic_load_n(&rx_engine.done_tail, __ATOMIC_ACQUIRE) ){
+		struct rtl_rx_urb *urb = &rx_engine.urb[rx_engine.done_ring[rx_engine.done_head % RTL81XX_RX_URB_NUM]];
+
+		rx_engine.done_head++;
+		RTL81XX_RX_REAP(urb);
+		__atomic_sub_fetch(&rx_engine.inflight, 1, __ATOMIC_ACQ_REL);
+	}
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_REAP(struct rtl_rx_urb *urb){
+	struct libusb_transfer *transfer = urb->transfer;
+
+	if( !rx_engine.running || transfer->status == LIBUSB_TRANSFER_CANCELLED || transfer->status == LIBUSB_TRANSFER_NO_DEVICE ){
+		urb->state = RTL81XX_URB_IDLE;
+		return;
+	}
+	if( transfer->status == LIBUSB_TRANSFER_STALL && wd.worker.running ){
+		/** resubmitting to a halted endpoint fails forever, the watchdog clears it **/
+		rx_engine.rx_urb_errors++;
+		urb->state = RTL81XX_URB_IDLE;
+		__atomic_or_fetch(&wd.halted, RTL81XX_WD_HALT_IN, __ATOMIC_ACQ_REL);
+		return;
+	}
+	if( transfer->status != LIBUSB_TRANSFER_COMPLETED ){
+		rx_engine.rx_urb_errors++;
+		/** a halted endpoint or a persistent error would complete again right away, park the buffer instead of spinning **/
+		if( transfer->status == LIBUSB_TRANSFER_STALL || ++rx_engine.err_streak >= RTL81XX_RX_ERR_RETRY ){
+			DEBUG_PRINTF("[%s][line %d] bulk-IN transfer %d parked, status %d\n", __FUNCTION__, __LINE__, (int)(urb - rx_engine.urb), transfer->status);
+			RTL81XX_RX_PARK(urb);
+			return;
+		}
+		RTL81XX_RX_SUBMIT(urb);
+		return;
+	}
+	rx_engine.err_streak = 0;
+
+	if( rx_engine.consumer != NULL ){
+		/** push mode: the views are valid until the consumer returns, unless it holds them with RTL81XX_RX_FRAME_HOLD **/
+		struct rtl_rx_frame frames[RTL81XX_RX_BATCH];
+		unsigned int count = 0;
+		uint32_t offset	   = 0;
+
+		/** the completion holds a reference while the consumer runs, the last one dropped resubmits **/
+		urb->refs  = 1;
+		urb->state = RTL81XX_URB_HELD;
+		while( offset < (uint32_t)transfer->actual_length ){
+			count = RTL81XX_RX_PARSE_AGG(urb->buffer, transfer->actual_length, &offset, frames, RTL81XX_RX_BATCH);
+			for(unsigned int i = 0; i < count; i++){
+				frames[i].urb = urb;
+			}
+			if( count ){
+				__atomic_store_n(&rx_engine.in_consumer, TRUE, __ATOMIC_RELEASE);
+				rx_engine.consumer(frames, count, rx_engine.consumer_priv);
+				__atomic_store_n(&rx_engine.in_consumer, FALSE, __ATOMIC_RELEASE);
+			}
+		}
+		RTL81XX_RX_URB_PUT(urb);
+	}else{
+		/** pull mode: park the buffer until RTL81XX_DO_RECEIVE hands its frames out **/
+		urb->offset = 0;
+		urb->state  = RTL81XX_URB_COMPLETED;
+		rx_engine.done_ring[rx_engine.done_tail % RTL81XX_RX_URB_NUM] = (unsigned char)(urb - rx_engine.urb);
+		rx_engine.done_tail++;
+	}
+}
+
+/** push mode: drop a reference, the last one gives the buffer back to the chip **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_URB_PUT(struct rtl_rx_urb *urb){
+	if( __atomic_sub_fetch(&urb->refs, 1, __ATOMIC_ACQ_REL) != 0 || rx_engine.consumer == NULL ){
+		/** pull mode: RTL81XX_DO_RECEIVE resubmits it **/
+		return;
+	}
+	if( rx_engine.running ){
+		RTL81XX_RX_SUBMIT(urb);
+	}else{
+		urb->state = RTL81XX_URB_IDLE;
+	}
+}
+
+/**
+ * keep a frame view valid after the consumer returned (or after the next
+ * RTL81XX_DO_RECEIVE), its whole bulk-IN buffer stays away from the chip until
+ * RTL81XX_RX_FRAME_RELEASE. Every view must be released before RTL81XX_RX_STOP.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_FRAME_HOLD(struct rtl_rx_frame *frame){
+	__atomic_add_fetch(&frame->urb->refs, 1, __ATOMIC_ACQ_REL);
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RX_FRAME_RELEASE(struct rtl_rx_frame *frame){
+	RTL81XX_RX_URB_PUT(frame->urb);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_CANCEL_ALL(void){
+	for(int i = 0; i < RTL81XX_RX_URB_NUM; i++){
+		if( rx_engine.urb[i].state == RTL81XX_URB_QUEUED ){
+			libusb_cancel_transfer(rx_engine.urb[i].transfer);
+		}
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_RX_COMPLETION_THREAD(void *arg){
+	struct timeval tv	= { 0 };
+	struct timespec now	= { 0 };
+	uint64_t seen		= rx_engine.completions;
+	uint64_t last_ns	= 0;
+	uint64_t now_ns		= 0;
+	bool spinning		= ( rx_engine.poll_mode != RTL81XX_RX_POLL_EVENT );
+
+	if( spinning && rx_engine.poll_cpu >= 0 ){
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(rx_engine.poll_cpu, &set);
+		if( pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0 ){
+			DEBUG_PRINTF("[%s][line %d] failed to pin the completion thread on cpu %d\n", __FUNCTION__, __LINE__, rx_engine.poll_cpu);
+		}
+	}
+	/** RTL81XX_RX_COMPLETE hands over what the other threads reap until this is set **/
+	rx_engine.completion_thread = pthread_self();
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	last_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+	while( rx_engine.running || rx_engine.inflight > 0 ){
+		if( !rx_engine.running ){
+			RTL81XX_RX_CANCEL_ALL();
+			spinning = FALSE;
+		}
+		/** a zero timeout only reaps what already completed, the consumer runs inline on this thread **/
+		tv.tv_sec  = 0;
+		tv.tv_usec = spinning ? 0 : 100000;
+		libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+		RTL81XX_RX_REAP_HANDED();
+		RTL81XX_RX_UNPARK();
+
+		if( rx_engine.poll_mode != RTL81XX_RX_POLL_HYBRID || !rx_engine.running ){
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		now_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+		if( rx_engine.completions != seen ){
+			/** traffic again, back to spinning until the link goes quiet **/
+			seen	 = rx_engine.completions;
+			last_ns	 = now_ns;
+			spinning = TRUE;
+		}else if( spinning && now_ns - last_ns > (uint64_t)rx_engine.poll_idle_us * 1000 ){
+			spinning = FALSE;
+		}
+	}
+	RTL81XX_RX_RELEASE_EVENTS();
+	return NULL;
+}
+
+/** the other threads may handle the libusb events again **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_RELEASE_EVENTS(void){
+	__atomic_store_n(&rx_engine.owns_events, FALSE, __ATOMIC_RELEASE);
+	/** the hotplug event thread parks while the events are owned **/
+	pthread_mutex_lock(&hotplug.lock);
+	pthread_cond_broadcast(&hotplug.cond);
+	pthread_mutex_unlock(&hotplug.lock);
+}
+
+/** TRUE on the threads that must leave the libusb events to the push mode completion thread **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_EVENTS_OWNED(void){
+	/** a consumer blocked on ocp_lock would wait for a transfer only the lock holder can reap **/
+	return __atomic_load_n(&rx_engine.owns_events, __ATOMIC_ACQUIRE) && !__atomic_load_n(&rx_engine.in_consumer, __ATOMIC_ACQUIRE)
+		&& !pthread_equal(pthread_self(), rx_engine.completion_thread);
+}
+
+/**
+ * RTL81XX_HANDLE_EVENTS - libusb_handle_events_timeout_completed for the threads waiting on their own transfers
+ *
+ * while the push mode completion thread runs it is the only event handler:
+ * the consumer must not run anywhere else, and a second handler would take
+ * the libusb event lock away from a spinning thread right when a bulk-IN
+ * transfer completes. The caller sleeps instead, at most
+ * RTL81XX_RX_POLL_PARK_US, and checks again what it is waiting for.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HANDLE_EVENTS(struct timeval *tv, int *completed){
+	struct timespec park = { 0 };
+	long wait_us	     = tv->tv_sec * 1000000L + tv->tv_usec;
+
+	if( !RTL81XX_EVENTS_OWNED() ){
+		libusb_handle_events_timeout_completed(NULL, tv, completed);
+		return;
+	}
+	if( completed != NULL && __atomic_load_n(completed, __ATOMIC_ACQUIRE) ){
+		return;
+	}
+	if( wait_us > RTL81XX_RX_POLL_PARK_US ){
+		wait_us = RTL81XX_RX_POLL_PARK_US;
+	}
+	park.tv_nsec = wait_us * 1000L;
+	nanosleep(&park, NULL);
+}
+
+/**
+ * RTL81XX_RX_SET_POLL_MODE - wait policy of the push mode completion thread, this is the 'rtl_rx_set_poll_mode' callback
+ * @mode:    enum rtl_rx_poll_mode_t
+ * @cpu:     core the thread is pinned on when it spins, -1 leaves it to the scheduler
+ * @idle_us: hybrid mode only, quiet time before going back to blocking, 0 picks RTL81XX_RX_POLL_IDLE_US
+ *
+ * taken into account by the next RTL81XX_RX_START.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_SET_POLL_MODE(enum rtl_rx_poll_mode_t mode, int cpu, unsigned int idle_us){
+	if( mode > RTL81XX_RX_POLL_HYBRID || cpu >= CPU_SETSIZE ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	rx_engine.poll_mode    = mode;
+	rx_engine.poll_cpu     = cpu;
+	rx_engine.poll_idle_us = ( idle_us != 0 ) ? idle_us : RTL81XX_RX_POLL_IDLE_US;
+	return_context	       = NO_ERROR;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CLAIM_DATA_INTERFACE(void){
+	if( data_intf_claimed ){
+		return_context = NO_ERROR;
+		return;
+	}
+	libusb_set_auto_detach_kernel_driver(device_context->device_handler, TRUE);
+	return_context = libusb_claim_interface(device_context->device_handler, 0);
+	if( return_context < 0 ){
+		DEBUG_PRINTF("[%s][line %d] failed to claim the data interface: %s\n", __FUNCTION__, __LINE__, libusb_error_name(return_context));
+		return;
+	}
+	data_intf_claimed = TRUE;
+}
+
+/** static int rtl_enable(struct r8152 *tp) **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ENABLE(void){
+	DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_CR, 1, CR_RE | CR_TE ) );
+
+	/** static void rxdy_gated_en(struct r8152 *tp, bool enable) **/
+	DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_MISC_1, 2, RXDY_GATED_EN ) );
+}
+
+/** static void r8153_set_rx_early_timeout(struct r8152 *tp) and static void r8153_set_rx_early_size(struct r8152 *tp) **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_SET_AGGREGATION(void){
+	uint32_t early_size    = rx_engine.buf_size - (mtu_to_size(device_context->device_mtu) + sizeof(struct rx_desc) + RX_ALIGN);
+	uint32_t early_timeout = RTL81XX_RX_COALESCE / 8;
+
+	switch(device_context->device_chip->rx_agg){
+		case RTL81XX_RX_AGG_EARLY:
+			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_RX_EARLY_TIMEOUT, early_timeout ) );
+			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_RX_EARLY_SIZE, early_size / device_context->device_chip->rx_early_size_unit ) );
+		break;
+		case RTL81XX_RX_AGG_EXTRA:
+			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_RX_EARLY_TIMEOUT, device_context->device_chip->rx_early_timeout / 8 ) );
+			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_RX_EXTRA_AGGR_TMR, early_timeout ) );
+			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_RX_EARLY_SIZE, early_size / device_context->device_chip->rx_early_size_unit ) );
+		break;
+		case RTL81XX_RX_AGG_NONE:
+		default:
+			/** the chip does not aggregate, one frame per transfer **/
+		break;
+	}
+}
+
+/**
+ * RTL81XX_RX_START - queue RTL81XX_RX_URB_NUM bulk-IN transfers and keep them queued
+ * @consumer: called with batches of frame views, NULL selects the pull mode (RTL81XX_DO_RECEIVE)
+ * @priv:     passed back to @consumer
+ *
+ * In push mode a completion thread is spawned, the consumer runs on it and the
+ * buffer is resubmitted as soon as the consumer returns. The thread is the
+ * only libusb event handler until RTL81XX_RX_STOP, the others wait for their
+ * own transfers through RTL81XX_HANDLE_EVENTS, so the consumer never runs on
+ * the TX flusher, the hotplug thread or a register access.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_START(rtl_rx_consumer_t consumer, void *priv){
+	uint32_t min_size = 0;
+
+	if( rx_engine.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	RTL81XX_CLAIM_DATA_INTERFACE();
+	if( return_context < 0 ){
+		return;
+	}
+
+	/** a single transfer must be able to carry a full frame of the biggest MTU supported **/
+	min_size = ALIGN(mtu_to_size(device_context->device_max_mtu) + sizeof(struct rx_desc) + RX_ALIGN, 1024);
+	rx_engine.buf_size = ( min_size > RTL81XX_RX_AGG_SIZE ) ? min_size : RTL81XX_RX_AGG_SIZE;
+
+	RTL81XX_SLAB_INIT(&rx_engine.slab, RTL81XX_SLAB_RX, rx_engine.buf_size, RTL81XX_RX_URB_NUM, RTL81XX_SLAB_DEV_MEM | RTL81XX_SLAB_HUGEPAGE);
+	if( return_context < 0 ){
+		return;
+	}
+	for(int i = 0; i < RTL81XX_RX_URB_NUM; i++){
+		struct rtl_rx_urb *urb = &rx_engine.urb[i];
+
+		urb->transfer = libusb_alloc_transfer(0);
+		urb->buffer   = RTL81XX_SLAB_ALLOC(&rx_engine.slab);
+		if( urb->transfer == NULL || urb->buffer == NULL ){
+			DEBUG_PRINTF("[%s][line %d] %s\n", __FUNCTION__, __LINE__, "returned ERROR_OUT_OF_MEMORY!");
+			rx_engine.running = TRUE;
+			RTL81XX_RX_STOP();
+			return_context = -ERROR_OUT_OF_MEMORY;
+			return;
+		}
+		urb->state = RTL81XX_URB_IDLE;
+		urb->refs  = 0;
+	}
+
+	rx_engine.consumer	= consumer;
+	rx_engine.consumer_priv = priv;
+	rx_engine.done_head	= 0;
+	rx_engine.done_tail	= 0;
+	rx_engine.inflight	= 0;
+	rx_engine.err_streak	= 0;
+
+	rx_engine.parked_ns	= 0;
+
+	RTL81XX_RX_SET_AGGREGATION();
+	RTL81XX_ENABLE();
+
+	/** before the first submission, the other threads stop competing for the libusb event lock **/
+	rx_engine.completion_thread = 0;
+	__atomic_store_n(&rx_engine.owns_events, consumer != NULL, __ATOMIC_RELEASE);
+	rx_engine.running = TRUE;
+	for(int i = 0; i < RTL81XX_RX_URB_NUM; i++){
+		RTL81XX_RX_SUBMIT(&rx_engine.urb[i]);
+	}
+	if( rx_engine.inflight == 0 ){
+		RTL81XX_RX_STOP();
+		return_context = -ERROR_USB_TRANSFER_FAILED;
+		return;
+	}
+
+	if( consumer != NULL ){
+		if( pthread_create(&rx_engine.completion_thread, NULL, RTL81XX_RX_COMPLETION_THREAD, NULL) != 0 ){
+			rx_engine.completion_thread = 0;
+			RTL81XX_RX_STOP();
+			return_context = -ERROR_OUT_OF_MEMORY;
+			return;
+		}
+	}
+	DEBUG_PRINTF("[%s] %d bulk-IN transfers of %u bytes queued\n", __FUNCTION__, rx_engine.inflight, rx_engine.buf_size);
+	return_context = NO_ERROR;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RX_STOP(void){
+	struct timeval tv = { 0 };
+
+	if( !rx_engine.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	rx_engine.running = FALSE;
+	RTL81XX_RX_CANCEL_ALL();
+
+	if( rx_engine.consumer != NULL && rx_engine.completion_thread ){
+		pthread_join(rx_engine.completion_thread, NULL);
+		rx_engine.completion_thread = 0;
+	}else{
+		while( rx_engine.inflight > 0 ){
+			RTL81XX_RX_CANCEL_ALL();
+			tv.tv_sec  = 0;
+			tv.tv_usec = 100000;
+			libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+			if( rx_engine.consumer != NULL ){
+				RTL81XX_RX_REAP_HANDED();
+			}
+		}
+		if( rx_engine.owns_events ){
+			/** the completion thread never started **/
+			RTL81XX_RX_RELEASE_EVENTS();
+		}
+	}
+
+	for(int i = 0; i < RTL81XX_RX_URB_NUM; i++){
+		struct rtl_rx_urb *urb = &rx_engine.urb[i];
+		if( urb->transfer != NULL ){
+			libusb_free_transfer(urb->transfer);
+		}
+		urb->buffer   = NULL;
+		urb->transfer = NULL;
+		urb->state    = RTL81XX_URB_IDLE;
+	}
+	RTL81XX_SLAB_DESTROY(&rx_engine.slab);
+	rx_engine.consumer = NULL;
+	return_context = NO_ERROR;
+}
+
+/**
+ * RTL81XX_DO_RECEIVE - pull mode receive, this is the 'rtl_rx' callback
+ * @rx_buffer: array of struct rtl_rx_frame
+ * @rx_size:   number of entries inside @rx_buffer
+ * @timeout:   maximum wait in ms when nothing has been received yet
+ *
+ * return_context holds the number of views written. The views stay valid until
+ * the next call, which gives their buffers back to the chip.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DO_RECEIVE(void *rx_buffer, unsigned int rx_size, unsigned int timeout){
+	struct rtl_rx_frame *frames = (struct rtl_rx_frame *)rx_buffer;
+	struct timespec deadline    = { 0 };
+	struct timespec now	    = { 0 };
+	struct timeval tv	    = { 0 };
+	unsigned int count	    = 0;
+
+	if( frames == NULL || rx_size == 0 ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( !rx_engine.running ){
+		RTL81XX_RX_START(NULL, NULL);
+		if( return_context < 0 ){
+			return;
+		}
+	}
+	if( rx_engine.consumer != NULL ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+
+	for(int i = 0; i < RTL81XX_RX_URB_NUM; i++){
+		if( rx_engine.urb[i].state == RTL81XX_URB_HELD && __atomic_load_n(&rx_engine.urb[i].refs, __ATOMIC_ACQUIRE) == 0 ){
+			RTL81XX_RX_SUBMIT(&rx_engine.urb[i]);
+		}
+	}
+	RTL81XX_RX_UNPARK();
+	if( rx_engine.inflight == 0 && rx_engine.done_head == rx_engine.done_tail && !wd.recovering ){
+		/** every buffer is parked, nothing can arrive before RTL81XX_RX_ERR_BACKOFF_MS elapsed **/
+		return_context = -ERROR_USB_TRANSFER_FAILED;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec  += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000L;
+	if( deadline.tv_nsec >= 1000000000L ){
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	while( rx_engine.done_head == rx_engine.done_tail ){
+		long left_us = 0;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		left_us = (deadline.tv_sec - now.tv_sec) * 1000000L + (deadline.tv_nsec - now.tv_nsec) / 1000L;
+		if( left_us <= 0 ){
+			break;
+		}
+		tv.tv_sec  = left_us / 1000000L;
+		tv.tv_usec = left_us % 1000000L;
+		libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+	}
+
+	while( count < rx_size && rx_engine.done_head != rx_engine.done_tail ){
+		struct rtl_rx_urb *urb = &rx_engine.urb[rx_engine.done_ring[rx_engine.done_head % RTL81XX_RX_URB_NUM]];
+
+		unsigned int first = count;
+
+		count += RTL81XX_RX_PARSE_AGG(urb->buffer, urb->transfer->actual_length, &urb->offset, frames + count, rx_size - count);
+		for(unsigned int i = first; i < count; i++){
+			frames[i].urb = urb;
+		}
+		if( urb->offset >= (uint32_t)urb->transfer->actual_length ){
+			urb->state = RTL81XX_URB_HELD;
+			rx_engine.done_head++;
+		}
+	}
+	return_context = count;
+}
+
+/** TX DATA PATH, AGGREGATED BULK-OUT ENGINE **/
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_SUBMIT(struct rtl_tx_agg *agg){
+	struct timespec now = { 0 };
+
+	if( wd.recovering ){
+		/** parked with its frames, the watchdog submits it once the endpoint works again **/
+		agg->state     = RTL81XX_URB_HELD;
+		return_context = NO_ERROR;
+		return;
+	}
+	libusb_fill_bulk_transfer(agg->transfer, device_context->device_handler, RTL81XX_BULK_OUT_EP, agg->buffer, agg->len, RTL81XX_TX_COMPLETE, agg, 0);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	agg->submit_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	agg->state     = RTL81XX_URB_QUEUED;
+	tx_engine.inflight++;
+	RTL81XX_TX_KICK_LOCKED();
+	if( libusb_submit_transfer(agg->transfer) < 0 ){
+		tx_engine.inflight--;
+		tx_engine.tx_urb_errors++;
+		tx_engine.tx_errors += agg->frames;
+		RTL81XX_TX_TRACK_COMPLETE(agg, -ERROR_USB_TRANSFER_FAILED);
+		agg->len     = 0;
+		agg->frames  = 0;
+		agg->payload = 0;
+		agg->state   = RTL81XX_URB_IDLE;
+		tx_engine.free_list[tx_engine.free_count++] = (unsigned char)(agg - tx_engine.agg);
+		pthread_cond_broadcast(&tx_engine.free_cond);
+		return_context = -ERROR_USB_TRANSFER_FAILED;
+	}
+}
+
+/** must be called with tx_engine.lock held, there is a new buffer to reap or to flush **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_KICK_LOCKED(void){
+	switch(tx_engine.flusher){
+		case RTL81XX_TX_FLUSHER_IDLE:
+			pthread_cond_signal(&tx_engine.kick_cond);
+		break;
+		case RTL81XX_TX_FLUSHER_REAPING:
+			/** its timeout is longer than the flush deadline, make it look at the new buffer **/
+			if( tx_engine.fill != NULL ){
+				libusb_interrupt_event_handler(NULL);
+			}
+		break;
+		case RTL81XX_TX_FLUSHER_BUSY:
+		default:
+		break;
+	}
+}
+
+/** must be called with tx_engine.lock held **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_FLUSH_LOCKED(void){
+	struct rtl_tx_agg *agg = tx_engine.fill;
+
+	if( agg == NULL || agg->frames == 0 ){
+		return;
+	}
+	tx_engine.fill = NULL;
+	RTL81XX_TX_SUBMIT(agg);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_FLUSH(void){
+	pthread_mutex_lock(&tx_engine.lock);
+	RTL81XX_TX_FLUSH_LOCKED();
+	pthread_mutex_unlock(&tx_engine.lock);
+}
+
+/** called by libusb from the thread that is handling the events **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_COMPLETE(struct libusb_transfer *transfer){
+	struct rtl_tx_agg *agg = (struct rtl_tx_agg *)transfer->user_data;
+	bool ok		       = ( transfer->status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length == transfer->length );
+
+	if( wd.worker.running && (transfer->status == LIBUSB_TRANSFER_STALL || (transfer->status == LIBUSB_TRANSFER_CANCELLED && wd.recovering)) ){
+		/** the frames are kept, the watchdog submits the buffer again after the recovery **/
+		pthread_mutex_lock(&tx_engine.lock);
+		if( transfer->status == LIBUSB_TRANSFER_STALL ){
+			__atomic_or_fetch(&wd.halted, RTL81XX_WD_HALT_OUT, __ATOMIC_ACQ_REL);
+		}
+		agg->state = RTL81XX_URB_HELD;
+		tx_engine.inflight--;
+		pthread_mutex_unlock(&tx_engine.lock);
+		return;
+	}
+	/** the buffer is not on the free list yet, the injected frames are completed without the lock **/
+	RTL81XX_TX_TRACK_COMPLETE(agg, ok ? NO_ERROR : -ERROR_USB_TRANSFER_FAILED);
+
+	pthread_mutex_lock(&tx_engine.lock);
+	if( ok ){
+		tx_engine.tx_packets += agg->frames;
+		tx_engine.tx_bytes   += agg->payload;
+	}else{
+		tx_engine.tx_urb_errors++;
+		tx_engine.tx_errors += agg->frames;
+	}
+	agg->len     = 0;
+	agg->frames  = 0;
+	agg->payload = 0;
+	agg->state   = RTL81XX_URB_IDLE;
+	tx_engine.free_list[tx_engine.free_count++] = (unsigned char)(agg - tx_engine.agg);
+	tx_engine.inflight--;
+	pthread_cond_broadcast(&tx_engine.free_cond);
+	if( tx_engine.inflight == 0 ){
+		/** a parked flusher may be waiting for the last completion to exit **/
+		RTL81XX_TX_KICK_LOCKED();
+	}
+	pthread_mutex_unlock(&tx_engine.lock);
+}
+
+/** write the status of the injected frames of @agg and close the batches that are done **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_TRACK_COMPLETE(struct rtl_tx_agg *agg, int32_t status){
+	for(uint32_t i = 0; i < agg->tracked; i++){
+		struct rtl_inject_batch *batch = agg->track[i].batch;
+
+		agg->track[i].frame->status = status;
+		if( __atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) == 0 && batch->done != NULL ){
+			batch->done(batch);
+		}
+	}
+	agg->tracked = 0;
+}
+
+/**
+ * the flusher submits a partially filled buffer once its first frame is older
+ * than RTL81XX_TX_FLUSH_US and it reaps the bulk-OUT completions. It sleeps
+ * on kick_cond while there is nothing to send nor to reap, the AF_XDP TX ring
+ * has no doorbell and keeps it polling while it is bound.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_TX_FLUSH_THREAD(void *arg){
+	struct timespec now = { 0 };
+	struct timeval tv   = { 0 };
+	long age_us	    = 0;
+	long wait_us	    = 0;
+
+	while( tx_engine.running || tx_engine.inflight > 0 || tx_engine.fill != NULL ){
+		/** the host does not need to kick the TX ring, it is polled here **/
+		if( xsk.bound && tx_engine.running ){
+			RTL81XX_XSK_TX_KICK(RTL81XX_XSK_BATCH);
+		}
+		pthread_mutex_lock(&tx_engine.lock);
+		wait_us = xsk.bound ? RTL81XX_TX_FLUSH_US : RTL81XX_TX_REAP_US;
+		if( tx_engine.fill != NULL && tx_engine.fill->frames ){
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			age_us = (now.tv_sec - tx_engine.fill_ts.tv_sec) * 1000000L + (now.tv_nsec - tx_engine.fill_ts.tv_nsec) / 1000L;
+			if( age_us >= RTL81XX_TX_FLUSH_US || !tx_engine.running ){
+				RTL81XX_TX_FLUSH_LOCKED();
+			}else{
+				wait_us = RTL81XX_TX_FLUSH_US - age_us;
+			}
+		}
+		if( tx_engine.running && tx_engine.inflight == 0 && tx_engine.fill == NULL && !xsk.bound ){
+			tx_engine.flusher = RTL81XX_TX_FLUSHER_IDLE;
+			pthread_cond_wait(&tx_engine.kick_cond, &tx_engine.lock);
+			tx_engine.flusher = RTL81XX_TX_FLUSHER_BUSY;
+			pthread_mutex_unlock(&tx_engine.lock);
+			continue;
+		}
+		if( RTL81XX_EVENTS_OWNED() ){
+			/** the RX completion thread reaps the bulk-OUT completions, only the flush deadline is waited for **/
+			struct timespec deadline = { 0 };
+
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			deadline.tv_sec	 += wait_us / 1000000L;
+			deadline.tv_nsec += (wait_us % 1000000L) * 1000L;
+			if( deadline.tv_nsec >= 1000000000L ){
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			tx_engine.flusher = RTL81XX_TX_FLUSHER_IDLE;
+			pthread_cond_timedwait(&tx_engine.kick_cond, &tx_engine.lock, &deadline);
+			tx_engine.flusher = RTL81XX_TX_FLUSHER_BUSY;
+			pthread_mutex_unlock(&tx_engine.lock);
+			continue;
+		}
+		tx_engine.flusher = ( wait_us == RTL81XX_TX_REAP_US ) ? RTL81XX_TX_FLUSHER_REAPING : RTL81XX_TX_FLUSHER_BUSY;
+		pthread_mutex_unlock(&tx_engine.lock);
+
+		tv.tv_sec  = wait_us / 1000000L;
+		tv.tv_usec = wait_us % 1000000L;
+		libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+
+		pthread_mutex_lock(&tx_engine.lock);
+		tx_engine.flusher = RTL81XX_TX_FLUSHER_BUSY;
+		pthread_mutex_unlock(&tx_engine.lock);
+	}
+	return NULL;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_KICK(void){
+	pthread_mutex_lock(&tx_engine.lock);
+	RTL81XX_TX_KICK_LOCKED();
+	pthread_mutex_unlock(&tx_engine.lock);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_START(void){
+	pthread_mutex_lock(&tx_engine.start_lock);
+	RTL81XX_TX_START_LOCKED();
+	pthread_mutex_unlock(&tx_engine.start_lock);
+}
+
+/** with tx_engine.start_lock held, the conditions and the slab are set up only here; tx_engine.lock outlives the engine **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_START_LOCKED(void){
+	pthread_condattr_t attr;
+
+	if( tx_engine.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	RTL81XX_CLAIM_DATA_INTERFACE();
+	if( return_context < 0 ){
+		return;
+	}
+
+	/** a single buffer must be able to carry a full frame of the biggest MTU supported **/
+	tx_engine.buf_size = ALIGN(mtu_to_size(device_context->device_max_mtu) + sizeof(struct tx_desc) + TX_ALIGN, 1024);
+	if( tx_engine.buf_size < RTL81XX_TX_AGG_SIZE ){
+		tx_engine.buf_size = RTL81XX_TX_AGG_SIZE;
+	}
+	tx_engine.free_count = 0;
+	/** the smallest frame accepted by RTL81XX_INJECT_BATCH is an ethernet header **/
+	tx_engine.track_size = tx_engine.buf_size / ALIGN(sizeof(struct tx_desc) + ETH_HLEN, TX_ALIGN) + 1;
+
+	RTL81XX_SLAB_INIT(&tx_engine.slab, RTL81XX_SLAB_TX, tx_engine.buf_size, RTL81XX_TX_URB_NUM, RTL81XX_SLAB_DEV_MEM | RTL81XX_SLAB_HUGEPAGE);
+	if( return_context < 0 ){
+		return;
+	}
+	for(int i = 0; i < RTL81XX_TX_URB_NUM; i++){
+		struct rtl_tx_agg *agg = &tx_engine.agg[i];
+
+		agg->transfer = libusb_alloc_transfer(0);
+		agg->buffer   = RTL81XX_SLAB_ALLOC(&tx_engine.slab);
+		agg->track    = calloc(tx_engine.track_size, sizeof(struct rtl_tx_track));
+		agg->tracked  = 0;
+		if( agg->transfer == NULL || agg->buffer == NULL || agg->track == NULL ){
+			DEBUG_PRINTF("[%s][line %d] %s\n", __FUNCTION__, __LINE__, "returned ERROR_OUT_OF_MEMORY!");
+			tx_engine.running = TRUE;
+			RTL81XX_TX_STOP_LOCKED();
+			return_context = -ERROR_OUT_OF_MEMORY;
+			return;
+		}
+		agg->len     = 0;
+		agg->frames  = 0;
+		agg->payload = 0;
+		agg->state   = RTL81XX_URB_IDLE;
+		tx_engine.free_list[tx_engine.free_count++] = (unsigned char)i;
+	}
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&tx_engine.free_cond, &attr);
+	pthread_cond_init(&tx_engine.kick_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	tx_engine.fill	   = NULL;
+	tx_engine.inflight = 0;
+	tx_engine.flusher  = RTL81XX_TX_FLUSHER_BUSY;
+
+	RTL81XX_ENABLE();
+
+	tx_engine.running = TRUE;
+	if( pthread_create(&tx_engine.flush_thread, NULL, RTL81XX_TX_FLUSH_THREAD, NULL) != 0 ){
+		tx_engine.flush_thread = 0;
+		RTL81XX_TX_STOP_LOCKED();
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	DEBUG_PRINTF("[%s] %d bulk-OUT buffers of %u bytes ready\n", __FUNCTION__, RTL81XX_TX_URB_NUM, tx_engine.buf_size);
+	return_context = NO_ERROR;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_STOP(void){
+	pthread_mutex_lock(&tx_engine.start_lock);
+	RTL81XX_TX_STOP_LOCKED();
+	pthread_mutex_unlock(&tx_engine.start_lock);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TX_STOP_LOCKED(void){
+	if( !tx_engine.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	if( tx_engine.flush_thread ){
+		/** the flusher sends what is still pending and it waits for every bulk-OUT completion **/
+		pthread_mutex_lock(&tx_engine.lock);
+		tx_engine.running = FALSE;
+		RTL81XX_TX_KICK_LOCKED();
+		pthread_mutex_unlock(&tx_engine.lock);
+		pthread_join(tx_engine.flush_thread, NULL);
+		tx_engine.flush_thread = 0;
+		pthread_cond_destroy(&tx_engine.kick_cond);
+		pthread_cond_destroy(&tx_engine.free_cond);
+	}
+	tx_engine.running = FALSE;
+
+	for(int i = 0; i < RTL81XX_TX_URB_NUM; i++){
+		struct rtl_tx_agg *agg = &tx_engine.agg[i];
+		if( agg->transfer != NULL ){
+			libusb_free_transfer(agg->transfer);
+		}
+		free(agg->track);
+		agg->track    = NULL;
+		agg->buffer   = NULL;
+		agg->transfer = NULL;
+	}
+	RTL81XX_SLAB_DESTROY(&tx_engine.slab);
+	tx_engine.fill	     = NULL;
+	tx_engine.free_count = 0;
+	return_context	     = NO_ERROR;
+}
+
+/**
+ * RTL81XX_TX_RESERVE_LOCKED - reserve room for a tx_desc and @len bytes of frame
+ * @len:     bytes that will follow the descriptor
+ * @timeout: maximum wait in ms when every bulk-OUT buffer is in flight
+ *
+ * must be called with tx_engine.lock held, the lock can be released while
+ * waiting for a free buffer. The frame is sent after RTL81XX_TX_COMMIT_LOCKED.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline struct tx_desc *RTL81XX_TX_RESERVE_LOCKED(uint32_t len, unsigned int timeout){
+	struct rtl_tx_agg *agg	 = tx_engine.fill;
+	struct tx_desc *desc	 = NULL;
+	struct timespec deadline = { 0 };
+	uint32_t pos		 = 0;
+
+	if( agg != NULL && ALIGN(agg->len, TX_ALIGN) + sizeof(struct tx_desc) + len > tx_engine.buf_size ){
+		RTL81XX_TX_FLUSH_LOCKED();
+		agg = NULL;
+	}
+	if( agg == NULL ){
+		if( tx_engine.free_count == 0 ){
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			deadline.tv_sec  += timeout / 1000;
+			deadline.tv_nsec += (timeout % 1000) * 1000000L;
+			if( deadline.tv_nsec >= 1000000000L ){
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			while( tx_engine.free_count == 0 ){
+				if( pthread_cond_timedwait(&tx_engine.free_cond, &tx_engine.lock, &deadline) != 0 ){
+					break;
+				}
+			}
+			if( tx_engine.free_count == 0 ){
+				return_context = -ERROR_OUT_OF_TIME;
+				return NULL;
+			}
+		}
+		agg = &tx_engine.agg[tx_engine.free_list[--tx_engine.free_count]];
+		agg->state     = RTL81XX_URB_COMPLETED;	/** filling **/
+		tx_engine.fill = agg;
+		clock_gettime(CLOCK_MONOTONIC, &tx_engine.fill_ts);
+		RTL81XX_TX_KICK_LOCKED();
+	}
+
+	pos  = ALIGN(agg->len, TX_ALIGN);
+	desc = (struct tx_desc *)(agg->buffer + pos);
+	agg->len      = pos + sizeof(struct tx_desc) + len;
+	agg->frames  += 1;
+	agg->payload += len;
+	return desc;
+}
+
+/** must be called with tx_engine.lock held **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_COMMIT_LOCKED(void){
+	/** no room left for even the smallest frame, do not wait for the timer **/
+	if( tx_engine.fill != NULL && ALIGN(tx_engine.fill->len, TX_ALIGN) + sizeof(struct tx_desc) + ETH_ZLEN > tx_engine.buf_size ){
+		RTL81XX_TX_FLUSH_LOCKED();
+	}
+}
+
+/**
+ * RTL81XX_DO_TRANSMIT - queue a single ethernet frame, this is the 'rtl_tx' callback
+ * @tx_buf:  frame starting from the destination MAC address, without FCS
+ * @tx_len:  length of the frame
+ * @timeout: maximum wait in ms when every bulk-OUT buffer is in flight
+ *
+ * The frame is copied behind its own tx_desc inside the current aggregation
+ * buffer, the buffer is sent when the next frame would not fit or when the
+ * flusher timer expires. return_context holds @tx_len on success.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT(void *tx_buf, unsigned int tx_len, unsigned int timeout){
+	struct tx_desc *desc = NULL;
+
+	if( tx_buf == NULL || tx_len == 0 ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( !tx_engine.running ){
+		RTL81XX_TX_START();
+		if( return_context < 0 ){
+			return;
+		}
+	}
+	if( tx_len > TX_LEN_MAX || sizeof(struct tx_desc) + tx_len > tx_engine.buf_size ){
+		return_context = -ERROR_INVALID_SIZE;
+		return;
+	}
+
+	pthread_mutex_lock(&tx_engine.lock);
+	desc = RTL81XX_TX_RESERVE_LOCKED(tx_len, timeout);
+	if( desc == NULL ){
+		pthread_mutex_unlock(&tx_engine.lock);
+		return;
+	}
+	desc->opts1 = __cpu_to_le32(tx_len | TX_FS | TX_LS);
+	desc->opts2 = 0;
+	memcpy(desc + 1, tx_buf, tx_len);
+	RTL81XX_TX_COMMIT_LOCKED();
+	pthread_mutex_unlock(&tx_engine.lock);
+	return_context = tx_len;
+}
+
+/**
+ * RTL81XX_DO_TRANSMIT_VLAN - send an untagged frame, the chip inserts the 802.1Q tag, this is the 'rtl_tx_vlan' callback
+ * @tx_buf:   ethernet frame without the tag
+ * @tx_len:   frame length
+ * @vlan_tci: priority, DEI and VLAN id in host order
+ * @timeout:  maximum wait in ms when every bulk-OUT buffer is in flight
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT_VLAN(void *tx_buf, unsigned int tx_len, uint16_t vlan_tci, unsigned int timeout){
+	struct tx_desc *desc = NULL;
+
+	if( tx_buf == NULL || tx_len == 0 ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( !tx_engine.running ){
+		RTL81XX_TX_START();
+		if( return_context < 0 ){
+			return;
+		}
+	}
+	if( tx_len > TX_LEN_MAX || sizeof(struct tx_desc) + tx_len > tx_engine.buf_size ){
+		return_context = -ERROR_INVALID_SIZE;
+		return;
+	}
+
+	pthread_mutex_lock(&tx_engine.lock);
+	desc = RTL81XX_TX_RESERVE_LOCKED(tx_len, timeout);
+	if( desc == NULL ){
+		pthread_mutex_unlock(&tx_engine.lock);
+		return;
+	}
+	desc->opts1 = __cpu_to_le32(tx_len | TX_FS | TX_LS);
+	/** static void rtl_tx_vlan_tag(struct tx_desc *desc, struct sk_buff *skb) **/
+	desc->opts2 = __cpu_to_le32(swab16(vlan_tci) | TX_VLAN_TAG);
+	memcpy(desc + 1, tx_buf, tx_len);
+	RTL81XX_TX_COMMIT_LOCKED();
+	pthread_mutex_unlock(&tx_engine.lock);
+	return_context = tx_len;
+}
+
+/**
+ * RTL81XX_INJECT_BATCH - queue a batch of ethernet frames, this is the 'rtl_inject_batch' callback
+ * @batch:   frames to send, see struct rtl_inject_batch
+ * @timeout: maximum wait in ms when every bulk-OUT buffer is in flight
+ *
+ * Every frame is validated and copied behind a tx_desc built in place inside
+ * the aggregation buffers. The whole batch is packed into as few bulk-OUT
+ * transfers as RTL81XX_TX_AGG_SIZE allows and the last one is submitted right
+ * away. The status of each frame is written when its transfer completes;
+ * return_context holds the number of frames queued.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_INJECT_BATCH(struct rtl_inject_batch *batch, unsigned int timeout){
+	unsigned int queued = 0;
+	unsigned int i	    = 0;
+
+	if( batch == NULL || batch->frames == NULL || batch->count == 0 ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( !tx_engine.running ){
+		RTL81XX_TX_START();
+		if( return_context < 0 ){
+			return;
+		}
+	}
+	/** the extra reference keeps done from running before the whole batch is queued **/
+	batch->pending = 1;
+
+	pthread_mutex_lock(&tx_engine.lock);
+	for(i = 0; i < batch->count; i++){
+		struct rtl_inject_frame *frame = &batch->frames[i];
+		struct tx_desc *desc	       = NULL;
+
+		if( frame->data == NULL || frame->len < ETH_HLEN || frame->len > TX_LEN_MAX || sizeof(struct tx_desc) + frame->len > tx_engine.buf_size ){
+			frame->status = -ERROR_INVALID_SIZE;
+			continue;
+		}
+		desc = RTL81XX_TX_RESERVE_LOCKED(frame->len, timeout);
+		if( desc == NULL ){
+			break;
+		}
+		desc->opts1 = __cpu_to_le32(frame->len | TX_FS | TX_LS);
+		desc->opts2 = 0;
+		memcpy(desc + 1, frame->data, frame->len);
+
+		frame->status = RTL81XX_INJECT_PENDING;
+		__atomic_add_fetch(&batch->pending, 1, __ATOMIC_RELAXED);
+		tx_engine.fill->track[tx_engine.fill->tracked].frame = frame;
+		tx_engine.fill->track[tx_engine.fill->tracked].batch = batch;
+		tx_engine.fill->tracked++;
+		queued++;
+
+		RTL81XX_TX_COMMIT_LOCKED();
+	}
+	/** the batch is over, there is nothing to wait for **/
+	RTL81XX_TX_FLUSH_LOCKED();
+	pthread_mutex_unlock(&tx_engine.lock);
+
+	for(; i < batch->count; i++){
+		batch->frames[i].status = -ERROR_OUT_OF_TIME;
+	}
+	if( __atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) == 0 && batch->done != NULL ){
+		batch->done(batch);
+	}
+	return_context = queued;
+}
+
+/** INTERNET CHECKSUM HELPERS (RFC 1071) **/
+
+/** one's complement sum of @len bytes added to @sum, it has to be folded with RTL81XX_CSUM_FOLD **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint64_t RTL81XX_CSUM_PARTIAL_SCALAR(const void *buf, uint32_t len, uint64_t sum){
+	const uint8_t *ptr = (const uint8_t *)buf;
+	uint32_t word	   = 0;
+	uint16_t half	   = 0;
+
+	while( len >= 4 ){
+		memcpy(&word, ptr, 4);
+		sum += word;
+		ptr += 4;
+		len -= 4;
+	}
+	if( len >= 2 ){
+		memcpy(&half, ptr, 2);
+		sum += half;
+		ptr += 2;
+		len -= 2;
+	}
+	if( len ){
+		half = 0;
+		memcpy(&half, ptr, 1);
+		sum += half;
+	}
+	return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/** 32 bytes for each round, the 32 bit words are widened to 64 bit lanes so the accumulators never overflow **/
+__attribute__((target("avx2"))) static inline uint64_t RTL81XX_CSUM_PARTIAL_AVX2(const void *buf, uint32_t len, uint64_t sum){
+	const uint8_t *ptr = (const uint8_t *)buf;
+	__m256i zero	   = _mm256_setzero_si256();
+	__m256i acc_a	   = _mm256_setzero_si256();
+	__m256i acc_b	   = _mm256_setzero_si256();
+	uint64_t lanes[4]  = { 0 };
+
+	while( len >= 64 ){
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)ptr);
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)(ptr + 32));
+		acc_a = _mm256_add_epi64(acc_a, _mm256_unpacklo_epi32(v0, zero));
+		acc_b = _mm256_add_epi64(acc_b, _mm256_unpackhi_epi32(v0, zero));
+		acc_a = _mm256_add_epi64(acc_a, _mm256_unpacklo_epi32(v1, zero));
+		acc_b = _mm256_add_epi64(acc_b, _mm256_unpackhi_epi32(v1, zero));
+		ptr += 64;
+		len -= 64;
+	}
+	if( len >= 32 ){
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)ptr);
+		acc_a = _mm256_add_epi64(acc_a, _mm256_unpacklo_epi32(v0, zero));
+		acc_b = _mm256_add_epi64(acc_b, _mm256_unpackhi_epi32(v0, zero));
+		ptr += 32;
+		len -= 32;
+	}
+	_mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc_a, acc_b));
+	for(int i = 0; i < 4; i++){
+		/** end around carry, the lanes can be bigger than 32 bits **/
+		sum += lanes[i] & 0xffffffffULL;
+		sum += lanes[i] >> 32;
+	}
+	/** the scalar tail is SSE code, avoid the AVX to SSE transition penalty **/
+	_mm256_zeroupper();
+	return RTL81XX_CSUM_PARTIAL_SCALAR(ptr, len, sum);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+/** 16 bytes for each round, the 32 bit pairwise accumulators are drained before they can overflow **/
+static inline uint64_t RTL81XX_CSUM_PARTIAL_NEON(const void *buf, uint32_t len, uint64_t sum){
+	const uint8_t *ptr = (const uint8_t *)buf;
+	uint64x2_t acc64   = vdupq_n_u64(0);
+
+	while( len >= 16 ){
+		uint32x4_t acc32 = vdupq_n_u32(0);
+		/** 16 bit pairs are at most 0x1fffe, 4096 rounds fit inside 32 bits **/
+		for(int i = 0; i < 4096 && len >= 16; i++){
+			acc32 = vpadalq_u16(acc32, vreinterpretq_u16_u8(vld1q_u8(ptr)));
+			ptr += 16;
+			len -= 16;
+		}
+		acc64 = vpadalq_u32(acc64, acc32);
+	}
+	sum += vgetq_lane_u64(acc64, 0);
+	sum += vgetq_lane_u64(acc64, 1);
+	return RTL81XX_CSUM_PARTIAL_SCALAR(ptr, len, sum);
+}
+#endif
+
+/** pick the widest checksum kernel the CPU supports **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CSUM_SELECT(void){
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") ){
+		csum_partial_impl = RTL81XX_CSUM_PARTIAL_AVX2;
+		return;
+	}
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+	csum_partial_impl = RTL81XX_CSUM_PARTIAL_NEON;
+	return;
+#endif
+	csum_partial_impl = RTL81XX_CSUM_PARTIAL_SCALAR;
+}
+
+/** headers are summed inline, payloads go through the vector kernel **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint64_t RTL81XX_CSUM_PARTIAL(const void *buf, uint32_t len, uint64_t sum){
+	if( len < RTL81XX_CSUM_SIMD_MIN ){
+		return RTL81XX_CSUM_PARTIAL_SCALAR(buf, len, sum);
+	}
+	if( csum_partial_impl == NULL ){
+		RTL81XX_CSUM_SELECT();
+	}
+	return csum_partial_impl(buf, len, sum);
+}
+
+/** fold to 16 bits and complement, the result can be stored as it is inside the header **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint16_t RTL81XX_CSUM_FOLD(uint64_t sum){
+	sum = (sum & 0xffffffffULL) + (sum >> 32);
+	sum = (sum & 0xffffffffULL) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)~sum;
+}
+
+/** TCP/UDP pseudo header, @l3 points to the IPv4 or IPv6 header **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint64_t RTL81XX_CSUM_PSEUDO(const uint8_t *l3, bool is_ipv6, uint8_t proto, uint32_t l4_len){
+	uint64_t sum = 0;
+
+	if( is_ipv6 ){
+		sum = RTL81XX_CSUM_PARTIAL(l3 + offsetof(struct ipv6hdr, saddr), 2 * sizeof(struct in6_addr), 0);
+	}else{
+		sum = RTL81XX_CSUM_PARTIAL(l3 + offsetof(struct iphdr, saddr), 2 * sizeof(uint32_t), 0);
+	}
+	sum += __cpu_to_be32(proto);
+	sum += __cpu_to_be32(l4_len);
+	return sum;
+}
+
+/** LARGE SEND OFFLOAD **/
+
+/** find the IPv4/IPv6 and TCP/UDP headers of a frame, return_context is negative for any other layout **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_PARSE_L4(const uint8_t *frame, uint32_t len, struct rtl_gso_info *info){
+	uint16_t proto = 0;
+	uint32_t off   = ETH_HLEN;
+
+	if( len < ETH_HLEN + sizeof(struct iphdr) + sizeof(struct udphdr) ){
+		return_context = -ERROR_INVALID_SIZE;
+		return;
+	}
+	proto = (frame[12] << 8) | frame[13];
+	if( proto == ETH_P_8021Q || proto == ETH_P_8021AD ){
+		proto = (frame[16] << 8) | frame[17];
+		off  += 4;
+	}
+	info->l3_off = off;
+
+	if( proto == ETH_P_IP ){
+		const struct iphdr *iph = (const struct iphdr *)(frame + off);
+		if( off + sizeof(struct iphdr) > len || iph->ihl < 5 ){
+			return_context = -ERROR_INVALID_SIZE;
+			return;
+		}
+		info->is_ipv6  = FALSE;
+		info->l4_proto = iph->protocol;
+		off += iph->ihl * 4;
+	}else if( proto == ETH_P_IPV6 ){
+		const struct ipv6hdr *ip6h = (const struct ipv6hdr *)(frame + off);
+		if( off + sizeof(struct ipv6hdr) > len ){
+			return_context = -ERROR_INVALID_SIZE;
+			return;
+		}
+		/** extension headers are not walked **/
+		info->is_ipv6  = TRUE;
+		info->l4_proto = ip6h->nexthdr;
+		off += sizeof(struct ipv6hdr);
+	}else{
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	info->l4_off = off;
+
+	switch(info->l4_proto){
+		case IPPROTO_TCP:
+			if( off + sizeof(struct tcphdr) > len || ((const struct tcphdr *)(frame + off))->doff < 5 ){
+				return_context = -ERROR_INVALID_SIZE;
+				return;
+			}
+			info->hdr_len = off + ((const struct tcphdr *)(frame + off))->doff * 4;
+		break;
+		case IPPROTO_UDP:
+			info->hdr_len = off + sizeof(struct udphdr);
+		break;
+		default:
+			return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+			return;
+	}
+	if( info->hdr_len > len ){
+		return_context = -ERROR_INVALID_SIZE;
+		return;
+	}
+	return_context = NO_ERROR;
+}
+
+/**
+ * the chip needs the headers as the linux stack hands them to r8152: the TCP
+ * checksum is seeded with the pseudo header and, for IPv6, payload_len is zero.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_GSO_HW(const uint8_t *frame, uint32_t len, uint32_t mss, struct rtl_gso_info *info, unsigned int timeout){
+	struct tx_desc *desc = NULL;
+	struct tcphdr *th    = NULL;
+	uint8_t *copy	     = NULL;
+
+	pthread_mutex_lock(&tx_engine.lock);
+	desc = RTL81XX_TX_RESERVE_LOCKED(len, timeout);
+	if( desc == NULL ){
+		pthread_mutex_unlock(&tx_engine.lock);
+		return;
+	}
+	copy = (uint8_t *)(desc + 1);
+	memcpy(copy, frame, len);
+	th = (struct tcphdr *)(copy + info->l4_off);
+
+	if( info->is_ipv6 ){
+		/** static void tcp_v6_gso_csum_prep(struct sk_buff *skb) **/
+		((struct ipv6hdr *)(copy + info->l3_off))->payload_len = 0;
+		th->check = ~RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PSEUDO(copy + info->l3_off, TRUE, IPPROTO_TCP, 0));
+		desc->opts1 = __cpu_to_le32(len | TX_FS | TX_LS | GTSENDV6 | (info->l4_off << GTTCPHO_SHIFT));
+	}else{
+		struct iphdr *iph = (struct iphdr *)(copy + info->l3_off);
+		iph->tot_len = __cpu_to_be16(len - info->l3_off);
+		iph->check   = 0;
+		iph->check   = RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PARTIAL(iph, iph->ihl * 4, 0));
+		th->check    = ~RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PSEUDO(copy + info->l3_off, FALSE, IPPROTO_TCP, len - info->l4_off));
+		desc->opts1  = __cpu_to_le32(len | TX_FS | TX_LS | GTSENDV4 | (info->l4_off << GTTCPHO_SHIFT));
+	}
+	desc->opts2 = __cpu_to_le32(mss << MSS_SHIFT);
+	RTL81XX_TX_COMMIT_LOCKED();
+	pthread_mutex_unlock(&tx_engine.lock);
+	return_context = len;
+}
+
+/** cut the super-frame in MSS sized frames, each one is built straight inside the aggregation buffer **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TX_GSO_SW(const uint8_t *frame, uint32_t len, uint32_t mss, struct rtl_gso_info *info, unsigned int timeout){
+	const struct tcphdr *orig_th = (const struct tcphdr *)(frame + info->l4_off);
+	uint32_t payload_len	     = len - info->hdr_len;
+	uint32_t seq		     = __be32_to_cpu(orig_th->seq);
+	uint16_t ip_id		     = 0;
+	uint32_t seg_payload	     = 0;
+	uint32_t seg_len	     = 0;
+	uint32_t off		     = 0;
+
+	if( !info->is_ipv6 ){
+		ip_id = __be16_to_cpu(((const struct iphdr *)(frame + info->l3_off))->id);
+	}
+
+	pthread_mutex_lock(&tx_engine.lock);
+	do{
+		struct tx_desc *desc = NULL;
+		struct tcphdr *th    = NULL;
+		uint8_t *seg	     = NULL;
+
+		seg_payload = ( payload_len - off > mss ) ? mss : payload_len - off;
+		seg_len	    = info->hdr_len + seg_payload;
+
+		desc = RTL81XX_TX_RESERVE_LOCKED(seg_len, timeout);
+		if( desc == NULL ){
+			pthread_mutex_unlock(&tx_engine.lock);
+			return;
+		}
+		seg = (uint8_t *)(desc + 1);
+		memcpy(seg, frame, info->hdr_len);
+		memcpy(seg + info->hdr_len, frame + info->hdr_len + off, seg_payload);
+
+		if( info->is_ipv6 ){
+			((struct ipv6hdr *)(seg + info->l3_off))->payload_len = __cpu_to_be16(seg_len - info->l4_off);
+		}else{
+			struct iphdr *iph = (struct iphdr *)(seg + info->l3_off);
+			iph->tot_len = __cpu_to_be16(seg_len - info->l3_off);
+			iph->id	     = __cpu_to_be16(ip_id++);
+			iph->check   = 0;
+			iph->check   = RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PARTIAL(iph, iph->ihl * 4, 0));
+		}
+
+		th = (struct tcphdr *)(seg + info->l4_off);
+		th->seq = __cpu_to_be32(seq + off);
+		if( off ){
+			th->cwr = 0;
+		}
+		if( off + seg_payload < payload_len ){
+			th->fin = 0;
+			th->psh = 0;
+		}
+
+		desc->opts1 = __cpu_to_le32(seg_len | TX_FS | TX_LS);
+		desc->opts2 = 0;
+		if( info->l4_off <= TCPHO_MAX ){
+			th->check   = ~RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PSEUDO(seg + info->l3_off, info->is_ipv6, IPPROTO_TCP, seg_len - info->l4_off));
+			desc->opts2 = __cpu_to_le32(( info->is_ipv6 ? IPV6_CS : IPV4_CS ) | TCP_CS | (info->l4_off << TCPHO_SHIFT));
+		}else{
+			th->check = 0;
+			th->check = RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PARTIAL(th, seg_len - info->l4_off, RTL81XX_CSUM_PSEUDO(seg + info->l3_off, info->is_ipv6, IPPROTO_TCP, seg_len - info->l4_off)));
+		}
+		RTL81XX_TX_COMMIT_LOCKED();
+
+		off += seg_payload;
+	}while( off < payload_len );
+	pthread_mutex_unlock(&tx_engine.lock);
+	return_context = len;
+}
+
+/**
+ * RTL81XX_DO_TRANSMIT_GSO - queue a TCP super-frame, this is the 'rtl_tx_gso' callback
+ * @tx_buf:  ethernet frame carrying IPv4 or IPv6 and TCP, up to RTL81XX_GSO_MAX_SIZE bytes above L2
+ * @tx_len:  length of the super-frame
+ * @mss:     TCP payload carried by every segment
+ * @timeout: maximum wait in ms when every bulk-OUT buffer is in flight
+ *
+ * The IP and TCP checksums of the super-frame are ignored, they are computed
+ * for every segment. The chip segments the frame when the descriptor can
+ * describe it and it fits a single bulk-OUT buffer, otherwise the frame is
+ * segmented in software. return_context holds @tx_len on success; on a
+ * timeout the segments already queued are sent anyway.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT_GSO(void *tx_buf, unsigned int tx_len, unsigned int mss, unsigned int timeout){
+	struct rtl_gso_info info = { 0 };
+	const uint8_t *frame	 = (const uint8_t *)tx_buf;
+
+	if( frame == NULL || tx_len == 0 || mss == 0 ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( !tx_engine.running ){
+		RTL81XX_TX_START();
+		if( return_context < 0 ){
+			return;
+		}
+	}
+	RTL81XX_TX_PARSE_L4(frame, tx_len, &info);
+	if( return_context < 0 ){
+		return;
+	}
+	if( info.l4_proto != IPPROTO_TCP ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	if( tx_len - info.l3_off > RTL81XX_GSO_MAX_SIZE || sizeof(struct tx_desc) + info.hdr_len + mss > tx_engine.buf_size ){
+		return_context = -ERROR_INVALID_SIZE;
+		return;
+	}
+
+	if( mss <= MSS_MAX && info.l4_off <= GTTCPHO_MAX && tx_len - info.hdr_len > mss && sizeof(struct tx_desc) + tx_len <= tx_engine.buf_size ){
+		RTL81XX_TX_GSO_HW(frame, tx_len, mss, &info, timeout);
+	}else{
+		RTL81XX_TX_GSO_SW(frame, tx_len, mss, &info, timeout);
+	}
+}
+
+/**
+ * the chip can fill the checksum only for plain TCP/UDP over IPv4/IPv6 when
+ * @csum_start is the transport header, return 0 for any other layout.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_TX_CSUM_OPTS(const uint8_t *frame, uint32_t len, uint32_t csum_start, uint32_t csum_offset){
+	struct rtl_gso_info info = { 0 };
+
+	if( csum_start > TCPHO_MAX ){
+		return 0;
+	}
+	RTL81XX_TX_PARSE_L4(frame, len, &info);
+	if( return_context < 0 || info.l4_off != csum_start ){
+		return 0;
+	}
+	/** static int r8152_tx_csum(struct r8152 *tp, struct tx_desc *desc, struct sk_buff *skb, u32 len) **/
+	if( info.l4_proto == IPPROTO_TCP && csum_offset == offsetof(struct tcphdr, check) ){
+		return ( info.is_ipv6 ? IPV6_CS : IPV4_CS ) | TCP_CS | (csum_start << TCPHO_SHIFT);
+	}
+	if( info.l4_proto == IPPROTO_UDP && csum_offset == offsetof(struct udphdr, check) ){
+		return ( info.is_ipv6 ? IPV6_CS : IPV4_CS ) | UDP_CS | (csum_start << TCPHO_SHIFT);
+	}
+	return 0;
+}
+
+/**
+ * RTL81XX_DO_TRANSMIT_CSUM - queue a frame whose checksum has to be filled, this is the 'rtl_tx_csum' callback
+ * @tx_buf:      frame starting from the destination MAC address, without FCS
+ * @tx_len:      length of the frame
+ * @csum_start:  first byte covered by the checksum
+ * @csum_offset: where the checksum is stored, from @csum_start
+ * @timeout:     maximum wait in ms when every bulk-OUT buffer is in flight
+ *
+ * Same contract of CHECKSUM_PARTIAL: the checksum field holds the pseudo header
+ * sum. The chip computes it when it can, otherwise it is computed in software
+ * (tunnels, IPv6 extension headers, transport headers deeper than TCPHO_MAX).
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_DO_TRANSMIT_CSUM(void *tx_buf, unsigned int tx_len, unsigned int csum_start, unsigned int csum_offset, unsigned int timeout){
+	struct tx_desc *desc = NULL;
+	uint8_t *copy	     = NULL;
+	uint32_t opts2	     = 0;
+	uint16_t csum	     = 0;
+
+	if( tx_buf == NULL || tx_len == 0 || csum_start + csum_offset + sizeof(uint16_t) > tx_len ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( !tx_engine.running ){
+		RTL81XX_TX_START();
+		if( return_context < 0 ){
+			return;
+		}
+	}
+	if( tx_len > TX_LEN_MAX || sizeof(struct tx_desc) + tx_len > tx_engine.buf_size ){
+		return_context = -ERROR_INVALID_SIZE;
+		return;
+	}
+	opts2 = RTL81XX_TX_CSUM_OPTS((const uint8_t *)tx_buf, tx_len, csum_start, csum_offset);
+
+	pthread_mutex_lock(&tx_engine.lock);
+	desc = RTL81XX_TX_RESERVE_LOCKED(tx_len, timeout);
+	if( desc == NULL ){
+		pthread_mutex_unlock(&tx_engine.lock);
+		return;
+	}
+	copy = (uint8_t *)(desc + 1);
+	memcpy(copy, tx_buf, tx_len);
+	if( opts2 == 0 ){
+		/** static int skb_checksum_help(struct sk_buff *skb) **/
+		csum = RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PARTIAL(copy + csum_start, tx_len - csum_start, 0));
+		if( csum == 0 ){
+			csum = CSUM_MANGLED_0;
+		}
+		memcpy(copy + csum_start + csum_offset, &csum, sizeof(csum));
+	}
+	desc->opts1 = __cpu_to_le32(tx_len | TX_FS | TX_LS);
+	desc->opts2 = __cpu_to_le32(opts2);
+	RTL81XX_TX_COMMIT_LOCKED();
+	pthread_mutex_unlock(&tx_engine.lock);
+	return_context = tx_len;
+}
+
+/** SHARED MEMORY RINGS, SINGLE PRODUCER AND SINGLE CONSUMER **/
+
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_XSK_RING_SETUP(struct rtl_xsk_ring *ring, void *mem, uint32_t entries){
+	if( mem == NULL || entries == 0 || (entries & (entries - 1)) != 0 ){
+		return FALSE;
+	}
+	ring->hdr	  = (struct rtl_xsk_ring_hdr *)mem;
+	ring->entries	  = (uint8_t *)mem + sizeof(struct rtl_xsk_ring_hdr);
+	ring->size	  = entries;
+	ring->mask	  = entries - 1;
+	ring->hdr->producer = 0;
+	ring->hdr->consumer = 0;
+	ring->cached_prod = 0;
+	ring->cached_cons = 0;
+	return TRUE;
+}
+
+/** return how many of @count entries can be produced, starting from *index **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_XSK_PROD_RESERVE(struct rtl_xsk_ring *ring, uint32_t count, uint32_t *index){
+	uint32_t free_entries = ring->cached_cons + ring->size - ring->cached_prod;
+
+	if( free_entries < count ){
+		ring->cached_cons = __atomic_load_n(&ring->hdr->consumer, __ATOMIC_ACQUIRE);
+		free_entries	  = ring->cached_cons + ring->size - ring->cached_prod;
+	}
+	*index = ring->cached_prod;
+	return ( free_entries < count ) ? free_entries : count;
+}
+
+/** publish @count entries written after RTL81XX_XSK_PROD_RESERVE **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_PROD_SUBMIT(struct rtl_xsk_ring *ring, uint32_t count){
+	ring->cached_prod += count;
+	__atomic_store_n(&ring->hdr->producer, ring->cached_prod, __ATOMIC_RELEASE);
+}
+
+/** return how many of @count entries can be consumed, starting from *index **/
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_XSK_CONS_PEEK(struct rtl_xsk_ring *ring, uint32_t count, uint32_t *index){
+	uint32_t entries = ring->cached_prod - ring->cached_cons;
+
+	if( entries < count ){
+		ring->cached_prod = __atomic_load_n(&ring->hdr->producer, __ATOMIC_ACQUIRE);
+		entries		  = ring->cached_prod - ring->cached_cons;
+	}
+	*index = ring->cached_cons;
+	return ( entries < count ) ? entries : count;
+}
+
+/** give back @count entries read after RTL81XX_XSK_CONS_PEEK **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_CONS_RELEASE(struct rtl_xsk_ring *ring, uint32_t count){
+	ring->cached_cons += count;
+	__atomic_store_n(&ring->hdr->consumer, ring->cached_cons, __ATOMIC_RELEASE);
+}
+
+/**
+ * RX engine consumer: every frame is copied once into a UMEM frame taken from
+ * the fill ring, the frames are split by the chip inside an aggregated
+ * bulk-IN buffer so they can not be received in place.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_RX_CONSUMER(struct rtl_rx_frame *frames, unsigned int count, void *priv){
+	struct rtl_xsk *ctx	  = (struct rtl_xsk *)priv;
+	uint64_t *fill_addr	  = (uint64_t *)ctx->fill.entries;
+	struct rtl_xsk_desc *desc = (struct rtl_xsk_desc *)ctx->rx.entries;
+	uint32_t fill_idx	  = 0;
+	uint32_t rx_idx		  = 0;
+	uint32_t avail		  = 0;
+	uint32_t used		  = 0;
+
+	avail = RTL81XX_XSK_PROD_RESERVE(&ctx->rx, count, &rx_idx);
+	avail = RTL81XX_XSK_CONS_PEEK(&ctx->fill, avail, &fill_idx);
+
+	for(unsigned int i = 0; i < count && used < avail; i++){
+		uint64_t base = fill_addr[(fill_idx + used) & ctx->fill.mask];
+		uint64_t addr = base + ctx->cfg.headroom;
+
+		/** the fill entries are written by the host, compare against what is left so that nothing wraps **/
+		if( frames[i].len > ctx->cfg.frame_size - ctx->cfg.headroom || base > ctx->cfg.size - ctx->cfg.headroom || frames[i].len > ctx->cfg.size - addr ){
+			/** its fill entry is kept for the next frame, the drop is counted with the others below **/
+			continue;
+		}
+		memcpy((uint8_t *)ctx->cfg.area + addr, frames[i].data, frames[i].len);
+		desc[(rx_idx + used) & ctx->rx.mask].addr    = addr;
+		desc[(rx_idx + used) & ctx->rx.mask].len     = frames[i].len;
+		desc[(rx_idx + used) & ctx->rx.mask].options = frames[i].csum;
+		used++;
+	}
+	if( used ){
+		RTL81XX_XSK_CONS_RELEASE(&ctx->fill, used);
+		RTL81XX_XSK_PROD_SUBMIT(&ctx->rx, used);
+	}
+	/** every frame not delivered is dropped once: too big, no fill entry or no room in the rx ring **/
+	ctx->rx_packets += used;
+	ctx->rx_dropped += count - used;
+}
+
+/**
+ * RTL81XX_XSK_TX_KICK - move up to @budget frames from the TX ring to the bulk-OUT engine, this is the 'rtl_xsk_kick' callback
+ *
+ * the frames are copied behind their tx_desc inside the aggregation buffer, so
+ * their UMEM addresses are completed as soon as the copy is done. The TX
+ * flusher calls it on every round, the host calls it only to skip the wait.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_XSK_TX_KICK(unsigned int budget){
+	struct rtl_xsk_desc *txd = NULL;
+	uint64_t *comp_addr	 = NULL;
+	uint32_t tx_idx		 = 0;
+	uint32_t comp_idx	 = 0;
+	uint32_t count		 = 0;
+	uint32_t done		 = 0;
+
+	if( !xsk.bound ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	/** the flusher and the host can kick at the same time, the lock keeps a single consumer on the rings **/
+	pthread_mutex_lock(&tx_engine.lock);
+	/** RTL81XX_XSK_UNBIND detaches the rings under the lock **/
+	if( !xsk.bound ){
+		pthread_mutex_unlock(&tx_engine.lock);
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	txd	  = (struct rtl_xsk_desc *)xsk.tx.entries;
+	comp_addr = (uint64_t *)xsk.comp.entries;
+	/** a frame is taken only if its address can be completed **/
+	count = RTL81XX_XSK_PROD_RESERVE(&xsk.comp, budget, &comp_idx);
+	count = RTL81XX_XSK_CONS_PEEK(&xsk.tx, count, &tx_idx);
+	for(done = 0; done < count; done++){
+		struct rtl_xsk_desc *d = &txd[(tx_idx + done) & xsk.tx.mask];
+		struct tx_desc *desc   = NULL;
+
+		/** the descriptor is written by the host, d->addr + d->len could wrap **/
+		if( d->len == 0 || d->len > TX_LEN_MAX || d->addr > xsk.cfg.size || d->len > xsk.cfg.size - d->addr || sizeof(struct tx_desc) + d->len > tx_engine.buf_size ){
+			xsk.tx_invalid++;
+		}else{
+			desc = RTL81XX_TX_RESERVE_LOCKED(d->len, 0);
+			if( desc == NULL ){
+				/** every bulk-OUT buffer is in flight, retry on the next round **/
+				break;
+			}
+			desc->opts1 = __cpu_to_le32(d->len | TX_FS | TX_LS);
+			desc->opts2 = 0;
+			memcpy(desc + 1, (uint8_t *)xsk.cfg.area + d->addr, d->len);
+			RTL81XX_TX_COMMIT_LOCKED();
+			xsk.tx_packets++;
+		}
+		comp_addr[(comp_idx + done) & xsk.comp.mask] = d->addr;
+	}
+	if( done ){
+		RTL81XX_XSK_CONS_RELEASE(&xsk.tx, done);
+		RTL81XX_XSK_PROD_SUBMIT(&xsk.comp, done);
+	}
+	pthread_mutex_unlock(&tx_engine.lock);
+	return_context = done;
+}
+
+/**
+ * RTL81XX_XSK_BIND - attach the host UMEM and rings, this is the 'rtl_xsk_bind' callback
+ *
+ * the RX engine is started in push mode with the ring consumer and the TX
+ * engine starts polling the TX ring. The ring memory is reset here.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_XSK_BIND(struct rtl_xsk_umem_cfg *cfg){
+	if( cfg == NULL || cfg->area == NULL || cfg->frame_size <= cfg->headroom || cfg->size < cfg->frame_size ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( xsk.bound || rx_engine.running ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	if( !RTL81XX_XSK_RING_SETUP(&xsk.fill, cfg->fill_mem, cfg->fill_entries) ||
+	    !RTL81XX_XSK_RING_SETUP(&xsk.rx, cfg->rx_mem, cfg->rx_entries) ||
+	    !RTL81XX_XSK_RING_SETUP(&xsk.tx, cfg->tx_mem, cfg->tx_entries) ||
+	    !RTL81XX_XSK_RING_SETUP(&xsk.comp, cfg->comp_mem, cfg->comp_entries) ){
+		return_context = -ERROR_INVALID_SIZE;
+		return;
+	}
+	memcpy(&xsk.cfg, cfg, sizeof(xsk.cfg));
+	xsk.rx_packets = 0;
+	xsk.rx_dropped = 0;
+	xsk.tx_packets = 0;
+	xsk.tx_invalid = 0;
+
+	RTL81XX_TX_START();
+	if( return_context < 0 ){
+		return;
+	}
+	xsk.bound = TRUE;
+	/** the flusher polls the TX ring from now on **/
+	RTL81XX_TX_KICK();
+	RTL81XX_RX_START(RTL81XX_XSK_RX_CONSUMER, &xsk);
+	if( return_context < 0 ){
+		/** the flusher may be reading the rings right now **/
+		pthread_mutex_lock(&tx_engine.lock);
+		xsk.bound = FALSE;
+		pthread_mutex_unlock(&tx_engine.lock);
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_XSK_UNBIND(void){
+	if( !xsk.bound ){
+		return_context = NO_ERROR;
+		return;
+	}
+	RTL81XX_RX_STOP();
+	/** the TX engine is shared with rtl_tx and rtl_inject_batch, only the rings are detached: RTL81XX_XSK_TX_KICK checks again under the lock **/
+	pthread_mutex_lock(&tx_engine.lock);
+	xsk.bound = FALSE;
+	memset(&xsk.cfg, 0, sizeof(xsk.cfg));
+	pthread_mutex_unlock(&tx_engine.lock);
+	return_context = NO_ERROR;
+}
+
+/** SINGLE CONSUMER WAKE-UP **/
+
+/**
+ * RTL81XX_WAITER_SLEEP - park the consumer until *@head moves away from @seen or *@running is cleared
+ *
+ * the flag is published before *@head is read again, the producer publishes
+ * *@head before reading the flag: one of the two always sees the other.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WAITER_SLEEP(struct rtl_waiter *waiter, volatile uint32_t *head, uint32_t seen, volatile bool *running){
+	pthread_mutex_lock(&waiter->lock);
+	__atomic_store_n(&waiter->sleeping, 1, __ATOMIC_SEQ_CST);
+	while( __atomic_load_n(head, __ATOMIC_SEQ_CST) == seen && *running ){
+		pthread_cond_wait(&waiter->cond, &waiter->lock);
+	}
+	__atomic_store_n(&waiter->sleeping, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&waiter->lock);
+}
+
+/** called by the producer after publishing its head with __ATOMIC_SEQ_CST, free while the consumer is busy **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_WAITER_WAKE(struct rtl_waiter *waiter){
+	if( __atomic_load_n(&waiter->sleeping, __ATOMIC_SEQ_CST) ){
+		pthread_mutex_lock(&waiter->lock);
+		pthread_cond_signal(&waiter->cond);
+		pthread_mutex_unlock(&waiter->lock);
+	}
+}
+
+/** used on stop, after clearing the running flag **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WAITER_WAKE_ALL(struct rtl_waiter *waiter){
+	pthread_mutex_lock(&waiter->lock);
+	pthread_cond_broadcast(&waiter->cond);
+	pthread_mutex_unlock(&waiter->lock);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_COPY_RING_INIT(struct rtl_copy_ring *ring, uint32_t size){
+	ring->size = size;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->data = malloc(size);
+	return ( ring->data != NULL );
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_COPY_RING_DESTROY(struct rtl_copy_ring *ring){
+	free(ring->data);
+	ring->data = NULL;
+}
+
+/**
+ * RTL81XX_COPY_RING_RESERVE - producer side, room for a record of @len bytes
+ * @head: private copy of ring->head, moved past the record
+ * @tail: cached ring->tail, reloaded only when the ring looks full
+ *
+ * return NULL when the ring is full. The record size is already written, the
+ * records become visible to the consumer when *@head is stored into ring->head.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_COPY_RING_RESERVE(struct rtl_copy_ring *ring, uint32_t *head, uint32_t *tail, uint32_t len){
+	uint32_t need	= ALIGN(len, 16);
+	uint32_t room	= ring->size - (*head & (ring->size - 1));
+	uint32_t skip	= ( room < need ) ? room : 0;
+	uint32_t *rec	= NULL;
+
+	if( ring->size - (*head - *tail) < skip + need ){
+		*tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		if( ring->size - (*head - *tail) < skip + need ){
+			return NULL;
+		}
+	}
+	if( skip ){
+		*(uint32_t *)(ring->data + (*head & (ring->size - 1))) = RTL81XX_COPY_RING_WRAP;
+		*head += skip;
+	}
+	rec   = (uint32_t *)(ring->data + (*head & (ring->size - 1)));
+	*rec  = need;
+	*head += need;
+	return rec;
+}
+
+/** consumer side, the record at *@tail or NULL once *@tail reached @head; *@tail moves by the record size when it is done **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void *RTL81XX_COPY_RING_NEXT(struct rtl_copy_ring *ring, uint32_t *tail, uint32_t head){
+	while( *tail != head ){
+		uint32_t *rec = (uint32_t *)(ring->data + (*tail & (ring->size - 1)));
+
+		if( *rec != RTL81XX_COPY_RING_WRAP ){
+			return rec;
+		}
+		*tail += ring->size - (*tail & (ring->size - 1));
+	}
+	return NULL;
+}
+
+/** PCAPNG CAPTURE, MMAP'D ROTATING FILES WRITTEN BY A DEDICATED THREAD **/
+
+/** create @path, map it and write the section and interface headers **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_CAPTURE_OPEN_FILE(struct rtl_capture_file *file, const char *path){
+	uint32_t shb[7]	  = { 0 };
+	uint32_t idb[8]	  = { 0 };
+
+	file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if( file->fd < 0 ){
+		DEBUG_PRINTF("[%s][line %d] failed to create %s\n", __FUNCTION__, __LINE__, path);
+		return FALSE;
+	}
+	/** reserve the blocks now, a full disk must not turn into a SIGBUS inside the writer **/
+	if( posix_fallocate(file->fd, 0, RTL81XX_CAPTURE_FILE_SIZE) != 0 ){
+		close(file->fd);
+		file->fd = -1;
+		return FALSE;
+	}
+	file->map = mmap(NULL, RTL81XX_CAPTURE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, file->fd, 0);
+	if( file->map == MAP_FAILED ){
+		file->map = NULL;
+		close(file->fd);
+		file->fd = -1;
+		return FALSE;
+	}
+	file->map_size = RTL81XX_CAPTURE_FILE_SIZE;
+
+	/** Section Header Block, no options, section length unknown **/
+	shb[0] = PCAPNG_BLOCK_SHB;
+	shb[1] = sizeof(shb);
+	shb[2] = PCAPNG_BYTE_ORDER_MAGIC;
+	shb[3] = 1;			/** major 1, minor 0 **/
+	shb[4] = 0xffffffff;
+	shb[5] = 0xffffffff;
+	shb[6] = sizeof(shb);
+	/** Interface Description Block, nanosecond timestamps **/
+	idb[0] = PCAPNG_BLOCK_IDB;
+	idb[1] = sizeof(idb);
+	idb[2] = PCAPNG_LINKTYPE_ETHERNET;
+	idb[3] = 0;			/** no snaplen limit **/
+	idb[4] = PCAPNG_OPT_IF_TSRESOL | (1 << 16);
+	idb[5] = 9;			/** 10^-9, padded to 32 bits **/
+	idb[6] = PCAPNG_OPT_ENDOFOPT;
+	idb[7] = sizeof(idb);
+
+	memcpy(file->map, shb, sizeof(shb));
+	memcpy(file->map + sizeof(shb), idb, sizeof(idb));
+	file->pos = sizeof(shb) + sizeof(idb);
+	return TRUE;
+}
+
+/** cut the file to the bytes really written so it can be read while the next one is filled **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CAPTURE_CLOSE_FILE(struct rtl_capture_file *file){
+	if( file->map != NULL ){
+		munmap(file->map, file->map_size);
+		file->map = NULL;
+	}
+	if( file->fd >= 0 ){
+		if( ftruncate(file->fd, file->pos) != 0 ){
+			DEBUG_PRINTF("[%s][line %d] failed to truncate the capture file\n", __FUNCTION__, __LINE__);
+		}
+		close(file->fd);
+		file->fd = -1;
+	}
+}
+
+/**
+ * keeps the allocation and the page population of the next file, and the
+ * unmap of the previous one, away from the writer. The next file is created
+ * as <prefix>.next.pcapng and renamed at the rotation, so the oldest file of
+ * the ring stays readable until it is really replaced.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_CAPTURE_FILE_THREAD(void *arg){
+	char path[300]			= { 0 };
+	struct rtl_capture_file file	= { .fd = -1 };
+	bool ok				= FALSE;
+
+	snprintf(path, sizeof(path), "%s.next.pcapng", capture.prefix);
+	pthread_mutex_lock(&capture.file_lock);
+	while( !capture.file_stop ){
+		if( capture.retired.fd >= 0 ){
+			file = capture.retired;
+			capture.retired.fd  = -1;
+			capture.retired.map = NULL;
+			pthread_mutex_unlock(&capture.file_lock);
+			RTL81XX_CAPTURE_CLOSE_FILE(&file);
+			pthread_mutex_lock(&capture.file_lock);
+			continue;
+		}
+		if( !capture.spare_ready && !capture.spare_failed ){
+			pthread_mutex_unlock(&capture.file_lock);
+			ok = RTL81XX_CAPTURE_OPEN_FILE(&file, path);
+			pthread_mutex_lock(&capture.file_lock);
+			capture.spare	     = file;
+			capture.spare_ready  = ok;
+			capture.spare_failed = !ok;
+			pthread_cond_broadcast(&capture.file_cond);
+			continue;
+		}
+		pthread_cond_wait(&capture.file_cond, &capture.file_lock);
+	}
+	pthread_mutex_unlock(&capture.file_lock);
+	/** the writer is gone, nothing else owns these two anymore **/
+	RTL81XX_CAPTURE_CLOSE_FILE(&capture.retired);
+	if( capture.spare_ready ){
+		capture.spare.pos = 0;
+		RTL81XX_CAPTURE_CLOSE_FILE(&capture.spare);
+		unlink(path);
+		capture.spare_ready = FALSE;
+	}
+	return NULL;
+}
+
+/** writer side: switch to the file prepared by the file thread, it only waits when the disk is slower than the link **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_CAPTURE_ROTATE(void){
+	char from[300] = { 0 };
+	char to[300]   = { 0 };
+
+	pthread_mutex_lock(&capture.file_lock);
+	while( !capture.spare_ready && !capture.spare_failed ){
+		pthread_cond_wait(&capture.file_cond, &capture.file_lock);
+	}
+	if( capture.spare_failed ){
+		/** ask for another try and drop in the meantime **/
+		capture.spare_failed = FALSE;
+		pthread_cond_broadcast(&capture.file_cond);
+		pthread_mutex_unlock(&capture.file_lock);
+		return FALSE;
+	}
+	capture.file_index = (capture.file_index + 1) % RTL81XX_CAPTURE_FILES;
+	snprintf(from, sizeof(from), "%s.next.pcapng", capture.prefix);
+	snprintf(to, sizeof(to), "%s.%u.pcapng", capture.prefix, capture.file_index);
+	if( rename(from, to) != 0 ){
+		DEBUG_PRINTF("[%s][line %d] failed to rename %s\n", __FUNCTION__, __LINE__, from);
+	}
+	capture.retired	    = capture.cur;
+	capture.cur	    = capture.spare;
+	capture.spare_ready = FALSE;
+	capture.rotations++;
+	pthread_cond_broadcast(&capture.file_cond);
+	pthread_mutex_unlock(&capture.file_lock);
+	return TRUE;
+}
+
+/** RX engine consumer: copy the frames into the ring, the bulk-IN buffer goes back to the chip as soon as it returns **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CAPTURE_CONSUMER(struct rtl_rx_frame *frames, unsigned int count, void *priv){
+	struct timespec ts = { 0 };
+	uint32_t head	   = capture.ring.head;
+	uint32_t tail	   = __atomic_load_n(&capture.ring.tail, __ATOMIC_ACQUIRE);
+	uint64_t ts_ns	   = 0;
+
+	if( !capture.accepting ){
+		return;
+	}
+	/** one timestamp for the whole batch, the frames left the chip inside the same transfer **/
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	for(unsigned int i = 0; i < count; i++){
+		struct rtl_capture_entry *entry = RTL81XX_COPY_RING_RESERVE(&capture.ring, &head, &tail, sizeof(struct rtl_capture_entry) + frames[i].len);
+
+		if( entry == NULL ){
+			capture.dropped++;
+			continue;
+		}
+		entry->len   = frames[i].len;
+		entry->ts_ns = ts_ns;
+		memcpy(entry + 1, frames[i].data, frames[i].len);
+	}
+	if( head != capture.ring.head ){
+		__atomic_store_n(&capture.ring.head, head, __ATOMIC_SEQ_CST);
+		RTL81XX_WAITER_WAKE(&capture.waiter);
+	}
+}
+
+/** append an Enhanced Packet Block **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CAPTURE_WRITE(struct rtl_capture_entry *entry){
+	uint32_t padded	    = ALIGN(entry->len, 4);
+	uint32_t block_len  = 28 + padded + 4;
+	uint32_t header[7]  = { 0 };
+	uint8_t *block	    = NULL;
+
+	if( capture.cur.pos + block_len > capture.cur.map_size && !RTL81XX_CAPTURE_ROTATE() ){
+		capture.write_dropped++;
+		return;
+	}
+	block	  = capture.cur.map + capture.cur.pos;
+	header[0] = PCAPNG_BLOCK_EPB;
+	header[1] = block_len;
+	header[2] = 0;				/** interface id **/
+	header[3] = (uint32_t)(entry->ts_ns >> 32);
+	header[4] = (uint32_t)entry->ts_ns;
+	header[5] = entry->len;			/** captured length **/
+	header[6] = entry->len;			/** original length **/
+	memcpy(block, header, sizeof(header));
+	memcpy(block + sizeof(header), entry + 1, entry->len);
+	memset(block + sizeof(header) + entry->len, 0, padded - entry->len);
+	memcpy(block + sizeof(header) + padded, &block_len, sizeof(block_len));
+	capture.cur.pos += block_len;
+	capture.captured++;
+	capture.bytes += entry->len;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_CAPTURE_WRITER_THREAD(void *arg){
+	struct rtl_capture_entry *entry = NULL;
+	uint32_t tail			= capture.ring.tail;
+	uint32_t head			= 0;
+
+	for(;;){
+		head = __atomic_load_n(&capture.ring.head, __ATOMIC_ACQUIRE);
+		if( head == tail ){
+			if( !capture.running ){
+				break;
+			}
+			RTL81XX_WAITER_SLEEP(&capture.waiter, &capture.ring.head, tail, &capture.running);
+			continue;
+		}
+		while( (entry = RTL81XX_COPY_RING_NEXT(&capture.ring, &tail, head)) != NULL ){
+			RTL81XX_CAPTURE_WRITE(entry);
+			tail += entry->size;
+		}
+		__atomic_store_n(&capture.ring.tail, tail, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/**
+ * RTL81XX_CAPTURE_START - capture everything received in promiscuous mode, this is the 'rtl_capture_start' callback
+ * @path_prefix: files are named <path_prefix>.<n>.pcapng, n goes from 0 to RTL81XX_CAPTURE_FILES - 1
+ *
+ * the RX engine runs in push mode and copies every frame into a single
+ * producer ring, the writer thread moves them into the mapped file. A full
+ * ring drops frames (capture.dropped) instead of slowing the receive path.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CAPTURE_START(const char *path_prefix){
+	char path[300] = { 0 };
+
+	if( path_prefix == NULL || strlen(path_prefix) >= sizeof(capture.prefix) ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( capture.running || rx_engine.running ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	strcpy(capture.prefix, path_prefix);
+	capture.file_index    = 0;
+	capture.captured      = 0;
+	capture.bytes	      = 0;
+	capture.dropped	      = 0;
+	capture.write_dropped = 0;
+	capture.rotations     = 0;
+	capture.spare_ready   = FALSE;
+	capture.spare_failed  = FALSE;
+	capture.file_stop     = FALSE;
+	if( !RTL81XX_COPY_RING_INIT(&capture.ring, RTL81XX_CAPTURE_RING_SIZE) ){
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	snprintf(path, sizeof(path), "%s.%u.pcapng", capture.prefix, capture.file_index);
+	if( !RTL81XX_CAPTURE_OPEN_FILE(&capture.cur, path) ){
+		RTL81XX_COPY_RING_DESTROY(&capture.ring);
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+
+	capture.running = TRUE;
+	if( pthread_create(&capture.file_thread, NULL, RTL81XX_CAPTURE_FILE_THREAD, NULL) != 0 ){
+		capture.running = FALSE;
+		RTL81XX_CAPTURE_CLOSE_FILE(&capture.cur);
+		RTL81XX_COPY_RING_DESTROY(&capture.ring);
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	if( pthread_create(&capture.writer, NULL, RTL81XX_CAPTURE_WRITER_THREAD, NULL) != 0 ){
+		capture.writer = 0;
+		RTL81XX_CAPTURE_STOP();
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	RTL81XX_SET_RX_MODE(RTL81XX_PROMISC_MODE);
+	capture.accepting = TRUE;
+	RTL81XX_RX_START(RTL81XX_CAPTURE_CONSUMER, &capture);
+	if( return_context < 0 ){
+		int ret = return_context;
+
+		RTL81XX_CAPTURE_STOP();
+		return_context = ret;
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CAPTURE_STOP(void){
+	if( !capture.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	/** the consumer runs on the RX completion thread, it is gone once the bulk-IN loop stopped **/
+	capture.accepting = FALSE;
+	RTL81XX_RX_STOP();
+	/** then the writer drains the ring and the file thread closes what is left **/
+	capture.running = FALSE;
+	RTL81XX_WAITER_WAKE_ALL(&capture.waiter);
+	if( capture.writer ){
+		pthread_join(capture.writer, NULL);
+		capture.writer = 0;
+	}
+	pthread_mutex_lock(&capture.file_lock);
+	capture.file_stop = TRUE;
+	pthread_cond_broadcast(&capture.file_cond);
+	pthread_mutex_unlock(&capture.file_lock);
+	pthread_join(capture.file_thread, NULL);
+	RTL81XX_CAPTURE_CLOSE_FILE(&capture.cur);
+	RTL81XX_COPY_RING_DESTROY(&capture.ring);
+	DEBUG_PRINTF("[%s] %lu frames (%lu bytes) captured, %lu dropped, %lu rotations\n", __FUNCTION__,
+		(unsigned long)capture.captured, (unsigned long)capture.bytes, (unsigned long)(capture.dropped + capture.write_dropped), (unsigned long)capture.rotations);
+	return_context = NO_ERROR;
+}
+
+/** SOFTWARE RECEIVE SIDE SCALING, FLOW HASH FAN-OUT TO WORKER THREADS **/
+
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_RSS_MIX_SCALAR(const uint32_t *key, unsigned int words){
+	uint32_t hash = 0x9747b28c;
+
+	for(unsigned int i = 0; i < words; i++){
+		hash ^= key[i];
+		hash *= 0x9e3779b1;
+		hash ^= hash >> 15;
+	}
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/** one crc32 instruction per key word, it is about as cheap as a multiply and spreads better **/
+__attribute__((target("sse4.2"))) static inline uint32_t RTL81XX_RSS_MIX_CRC32C(const uint32_t *key, unsigned int words){
+	uint32_t hash = 0xffffffff;
+
+	for(unsigned int i = 0; i < words; i++){
+		hash = _mm_crc32_u32(hash, key[i]);
+	}
+	return hash;
+}
+#elif defined(__ARM_FEATURE_CRC32)
+static inline uint32_t RTL81XX_RSS_MIX_CRC32C(const uint32_t *key, unsigned int words){
+	uint32_t hash = 0xffffffff;
+
+	for(unsigned int i = 0; i < words; i++){
+		hash = __builtin_aarch64_crc32cw(hash, key[i]);
+	}
+	return hash;
+}
+#endif
+
+/**
+ * symmetric flow hash: the addresses and the ports are sorted before mixing,
+ * so both directions of a connection land on the same worker. Fragments and
+ * non TCP/UDP traffic hash on the addresses only, frames that are not IP go
+ * to the first worker.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline uint32_t RTL81XX_RSS_HASH(const uint8_t *frame, uint32_t len){
+	uint32_t key[4]	   = { 0 };
+	uint32_t addr[2]   = { 0 };
+	uint16_t port[2]   = { 0 };
+	uint16_t proto	   = 0;
+	uint32_t l3	   = ETH_HLEN;
+	uint32_t l4	   = 0;
+	uint8_t	 l4_proto  = 0;
+	bool	 has_ports = FALSE;
+
+	if( len < ETH_HLEN ){
+		return 0;
+	}
+	proto = (frame[12] << 8) | frame[13];
+	if( proto == ETH_P_8021Q && len >= ETH_HLEN + VLAN_HLEN ){
+		proto = (frame[16] << 8) | frame[17];
+		l3   += VLAN_HLEN;
+	}
+	if( proto == ETH_P_IP && len >= l3 + sizeof(struct iphdr) ){
+		const struct iphdr *iph = (const struct iphdr *)(frame + l3);
+
+		memcpy(&addr[0], &iph->saddr, 4);
+		memcpy(&addr[1], &iph->daddr, 4);
+		l4_proto  = iph->protocol;
+		l4	  = l3 + iph->ihl * 4;
+		/** only the first fragment carries the ports, keep every fragment on the same worker **/
+		has_ports = !(__be16_to_cpu(iph->frag_off) & 0x3fff);	/** IP_MF | IP_OFFSET **/
+	}else if( proto == ETH_P_IPV6 && len >= l3 + sizeof(struct ipv6hdr) ){
+		const struct ipv6hdr *ip6h = (const struct ipv6hdr *)(frame + l3);
+		uint32_t words[8];
+
+		memcpy(words, &ip6h->saddr, 16);
+		memcpy(words + 4, &ip6h->daddr, 16);
+		addr[0]	  = words[0] ^ words[1] ^ words[2] ^ words[3];
+		addr[1]	  = words[4] ^ words[5] ^ words[6] ^ words[7];
+		l4_proto  = ip6h->nexthdr;
+		l4	  = l3 + sizeof(struct ipv6hdr);
+		has_ports = TRUE;
+	}else{
+		return 0;
+	}
+	if( has_ports && (l4_proto == IPPROTO_TCP || l4_proto == IPPROTO_UDP) && len >= l4 + 4 ){
+		memcpy(port, frame + l4, 4);
+	}else{
+		l4_proto = 0;
+	}
+
+	key[0] = ( addr[0] < addr[1] ) ? addr[0] : addr[1];
+	key[1] = ( addr[0] < addr[1] ) ? addr[1] : addr[0];
+	key[2] = ( port[0] < port[1] ) ? ((uint32_t)port[0] << 16 | port[1]) : ((uint32_t)port[1] << 16 | port[0]);
+	key[3] = l4_proto;
+	return rss.mix(key, 4);
+}
+
+/** RX engine consumer: copy every frame into the ring of the worker owning its flow **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RSS_DISPATCH(struct rtl_rx_frame *frames, unsigned int count, void *priv){
+	uint32_t head[RTL81XX_RSS_MAX_WORKERS];
+	uint32_t tail[RTL81XX_RSS_MAX_WORKERS];
+	uint32_t touched = 0;
+
+	if( !rss.accepting ){
+		return;
+	}
+	for(unsigned int i = 0; i < count; i++){
+		/** multiply and shift, no division on the hot path **/
+		unsigned int q		   = (unsigned int)(((uint64_t)RTL81XX_RSS_HASH(frames[i].data, frames[i].len) * rss.workers) >> 32);
+		struct rtl_rss_queue *queue = &rss.queue[q];
+		struct rtl_rss_entry *entry = NULL;
+		uint32_t depth		   = 0;
+
+		if( !(touched & BIT(q)) ){
+			touched |= BIT(q);
+			head[q]	 = queue->ring.head;
+			tail[q]	 = __atomic_load_n(&queue->ring.tail, __ATOMIC_ACQUIRE);
+		}
+		entry = RTL81XX_COPY_RING_RESERVE(&queue->ring, &head[q], &tail[q], sizeof(struct rtl_rss_entry) + frames[i].len);
+		if( entry == NULL ){
+			queue->dropped++;
+			continue;
+		}
+		/** the copy does not belong to a bulk-IN buffer, the worker's consumer can not hold it **/
+		entry->frame	  = frames[i];
+		entry->desc	  = *frames[i].desc;
+		entry->frame.desc = &entry->desc;
+		entry->frame.data = (uint8_t *)(entry + 1);
+		entry->frame.urb  = NULL;
+		memcpy(entry + 1, frames[i].data, frames[i].len);
+		queue->enqueued++;
+		depth = (uint32_t)(queue->enqueued - __atomic_load_n(&queue->processed, __ATOMIC_RELAXED));
+		if( depth > queue->max_depth ){
+			queue->max_depth = depth;
+		}
+	}
+	/** publish once per batch and queue, the workers see whole batches **/
+	for(unsigned int q = 0; q < rss.workers; q++){
+		if( touched & BIT(q) && head[q] != rss.queue[q].ring.head ){
+			__atomic_store_n(&rss.queue[q].ring.head, head[q], __ATOMIC_SEQ_CST);
+			RTL81XX_WAITER_WAKE(&rss.queue[q].waiter);
+		}
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_RSS_WORKER_THREAD(void *arg){
+	struct rtl_rss_queue *queue		= (struct rtl_rss_queue *)arg;
+	struct rtl_rx_frame frames[RTL81XX_RX_BATCH];
+	struct rtl_rss_entry *entry		= NULL;
+	uint32_t tail				= queue->ring.tail;
+	uint32_t head				= 0;
+
+	for(;;){
+		unsigned int count = 0;
+		uint32_t next	   = tail;
+
+		head = __atomic_load_n(&queue->ring.head, __ATOMIC_ACQUIRE);
+		if( head == tail ){
+			if( !rss.running ){
+				break;
+			}
+			RTL81XX_WAITER_SLEEP(&queue->waiter, &queue->ring.head, tail, &rss.running);
+			continue;
+		}
+		while( count < RTL81XX_RX_BATCH && (entry = RTL81XX_COPY_RING_NEXT(&queue->ring, &next, head)) != NULL ){
+			frames[count++] = entry->frame;
+			next += entry->size;
+		}
+		/** the queue is FIFO and a flow never changes worker, so its frames keep their order **/
+		rss.consumer(frames, count, rss.consumer_priv);
+		tail = next;
+		__atomic_store_n(&queue->processed, queue->processed + count, __ATOMIC_RELAXED);
+		__atomic_store_n(&queue->ring.tail, tail, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/**
+ * RTL81XX_RSS_START - spread received frames over worker threads, this is the 'rtl_rss_start' callback
+ * @consumer: called from the workers, possibly in parallel, with frames of the flows each one owns
+ * @priv:     passed back to @consumer
+ * @workers:  number of worker threads, 1 to RTL81XX_RSS_MAX_WORKERS
+ *
+ * the RX completion thread hashes and copies every frame into the ring of its
+ * worker, the bulk-IN buffer goes back to the chip right away. The views are
+ * valid until the worker's consumer returns and can not be held. Frames of one
+ * flow (both directions) are always handled by the same worker in arrival order.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RSS_START(rtl_rx_consumer_t consumer, void *priv, unsigned int workers){
+	if( consumer == NULL || workers == 0 || workers > RTL81XX_RSS_MAX_WORKERS ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( rss.running || rx_engine.running ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	rss.mix = RTL81XX_RSS_MIX_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("sse4.2") ){
+		rss.mix = RTL81XX_RSS_MIX_CRC32C;
+	}
+#elif defined(__ARM_FEATURE_CRC32)
+	rss.mix = RTL81XX_RSS_MIX_CRC32C;
+#endif
+	rss.consumer	  = consumer;
+	rss.consumer_priv = priv;
+	rss.workers	  = 0;
+	rss.running	  = TRUE;
+	for(unsigned int q = 0; q < workers; q++){
+		struct rtl_rss_queue *queue = &rss.queue[q];
+
+		queue->enqueued	 = 0;
+		queue->dropped	 = 0;
+		queue->processed = 0;
+		queue->max_depth = 0;
+		pthread_mutex_init(&queue->waiter.lock, NULL);
+		pthread_cond_init(&queue->waiter.cond, NULL);
+		queue->waiter.sleeping = 0;
+		if( !RTL81XX_COPY_RING_INIT(&queue->ring, RTL81XX_RSS_RING_SIZE) ){
+			RTL81XX_RSS_STOP();
+			return_context = -ERROR_OUT_OF_MEMORY;
+			return;
+		}
+		if( pthread_create(&queue->thread, NULL, RTL81XX_RSS_WORKER_THREAD, queue) != 0 ){
+			RTL81XX_COPY_RING_DESTROY(&queue->ring);
+			RTL81XX_RSS_STOP();
+			return_context = -ERROR_OUT_OF_MEMORY;
+			return;
+		}
+		rss.workers = q + 1;
+	}
+	rss.accepting = TRUE;
+	RTL81XX_RX_START(RTL81XX_RSS_DISPATCH, &rss);
+	if( return_context < 0 ){
+		int ret = return_context;
+
+		RTL81XX_RSS_STOP();
+		return_context = ret;
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RSS_STOP(void){
+	if( !rss.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	/** the dispatcher runs on the RX completion thread, it is gone once the bulk-IN loop stopped **/
+	rss.accepting = FALSE;
+	RTL81XX_RX_STOP();
+	/** then the workers drain their rings **/
+	rss.running = FALSE;
+	for(unsigned int q = 0; q < rss.workers; q++){
+		RTL81XX_WAITER_WAKE_ALL(&rss.queue[q].waiter);
+		pthread_join(rss.queue[q].thread, NULL);
+		RTL81XX_COPY_RING_DESTROY(&rss.queue[q].ring);
+		pthread_cond_destroy(&rss.queue[q].waiter.cond);
+		pthread_mutex_destroy(&rss.queue[q].waiter.lock);
+	}
+	return_context = NO_ERROR;
+}
+
+/** RTL81XX_RSS_STATS - per worker queue counters, this is the 'rtl_rss_stats' callback **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RSS_STATS(unsigned int queue, struct rtl_rss_stats *stats){
+	struct rtl_rss_queue *rq = NULL;
+
+	if( stats == NULL || queue >= rss.workers ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	rq		 = &rss.queue[queue];
+	stats->enqueued	 = rq->enqueued;
+	stats->dropped	 = rq->dropped;
+	stats->processed = rq->processed;
+	stats->depth	 = (uint32_t)(rq->enqueued - __atomic_load_n(&rq->processed, __ATOMIC_RELAXED));
+	stats->max_depth = rq->max_depth;
+	return_context	 = NO_ERROR;
+}
+
+/** PERIODIC WORKERS, ONE THREAD AND ONE TICK EACH **/
+
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_PERIODIC_THREAD(void *arg){
+	struct rtl_periodic *worker = (struct rtl_periodic *)arg;
+	struct timespec deadline    = { 0 };
+
+	pthread_mutex_lock(&worker->lock);
+	while( worker->running ){
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec  += worker->interval_ms / 1000;
+		deadline.tv_nsec += (long)(worker->interval_ms % 1000) * 1000000L;
+		if( deadline.tv_nsec >= 1000000000L ){
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		while( worker->running && pthread_cond_timedwait(&worker->cond, &worker->lock, &deadline) != ETIMEDOUT ){
+		}
+		if( !worker->running ){
+			break;
+		}
+		/** the tick may take its time, RTL81XX_PERIODIC_STOP must not wait for it to get the lock **/
+		pthread_mutex_unlock(&worker->lock);
+		worker->tick();
+		pthread_mutex_lock(&worker->lock);
+	}
+	pthread_mutex_unlock(&worker->lock);
+	return NULL;
+}
+
+/**
+ * RTL81XX_PERIODIC_START - call @tick every @interval_ms from a thread of its own
+ *
+ * the first call comes one period after the start. -ERROR_OUT_OF_MEMORY when
+ * the thread cannot be created, @worker is then left stopped.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PERIODIC_START(struct rtl_periodic *worker, unsigned int interval_ms, void (*tick)(void)){
+	pthread_condattr_t attr;
+
+	worker->interval_ms = interval_ms;
+	worker->tick	    = tick;
+	pthread_mutex_init(&worker->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&worker->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	worker->running = TRUE;
+	if( pthread_create(&worker->thread, NULL, RTL81XX_PERIODIC_THREAD, worker) != 0 ){
+		worker->running = FALSE;
+		pthread_cond_destroy(&worker->cond);
+		pthread_mutex_destroy(&worker->lock);
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	return_context = NO_ERROR;
+}
+
+/** wakes the thread up instead of waiting for the end of the period, FALSE when @worker was not running **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_PERIODIC_STOP(struct rtl_periodic *worker){
+	if( !worker->running ){
+		return FALSE;
+	}
+	pthread_mutex_lock(&worker->lock);
+	worker->running = FALSE;
+	pthread_cond_broadcast(&worker->cond);
+	pthread_mutex_unlock(&worker->lock);
+	pthread_join(worker->thread, NULL);
+	pthread_cond_destroy(&worker->cond);
+	pthread_mutex_destroy(&worker->lock);
+	return TRUE;
+}
+
+/** TALLY COUNTERS, SAMPLED IN THE BACKGROUND AND EXTENDED TO 64 BITS **/
+
+#define RTL81XX_TALLY_FIELD(name)	{ offsetof(struct tally_counter, name), sizeof(((struct tally_counter *)0)->name), offsetof(struct rtl_tally_stats, name) }
+
+static const struct rtl_tally_field tally_fields[] = {
+	RTL81XX_TALLY_FIELD(tx_packets),
+	RTL81XX_TALLY_FIELD(rx_packets),
+	RTL81XX_TALLY_FIELD(tx_errors),
+	RTL81XX_TALLY_FIELD(rx_errors),
+	RTL81XX_TALLY_FIELD(rx_missed),
+	RTL81XX_TALLY_FIELD(align_errors),
+	RTL81XX_TALLY_FIELD(tx_one_collision),
+	RTL81XX_TALLY_FIELD(tx_multi_collision),
+	RTL81XX_TALLY_FIELD(rx_unicast),
+	RTL81XX_TALLY_FIELD(rx_broadcast),
+	RTL81XX_TALLY_FIELD(rx_multicast),
+	RTL81XX_TALLY_FIELD(tx_aborted),
+	RTL81XX_TALLY_FIELD(tx_underrun),
+};
+
+/** static void rtl8152_get_stats(...), the whole block in a single control transfer **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_READ(struct tally_counter *tally){
+	RTL81XX_GENERIC_REG_READ(PLA_TALLYCNT, sizeof(*tally), tally, MCU_TYPE_PLA);
+	return_context = ( return_context < 0 ) ? -ERROR_USB_TRANSFER_FAILED : NO_ERROR;
+}
+
+/** read the block and fold the difference with the previous one into the accumulators **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_SAMPLE(void){
+	struct tally_counter raw     = { 0 };
+	struct rtl_tally_stats delta = { 0 };
+	struct timespec now	     = { 0 };
+
+	RTL81XX_TALLY_READ(&raw);
+	if( return_context < 0 ){
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	delta.ts_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	for(unsigned int i = 0; i < sizeof(tally_fields) / sizeof(tally_fields[0]); i++){
+		const struct rtl_tally_field *field = &tally_fields[i];
+		uint64_t cur  = 0;
+		uint64_t prev = 0;
+		uint64_t mask = ( field->width == 8 ) ? ~0ULL : (1ULL << (field->width * 8)) - 1;
+
+		/** little endian on the wire, the low bytes come first **/
+		for(int b = field->width - 1; b >= 0; b--){
+			cur  = (cur << 8) | ((uint8_t *)&raw)[field->raw + b];
+			prev = (prev << 8) | ((uint8_t *)&tally.raw)[field->raw + b];
+		}
+		/** unsigned difference inside the width of the counter survives one wrap between samples **/
+		*(uint64_t *)((uint8_t *)&delta + field->stat) = (cur - prev) & mask;
+	}
+
+	__atomic_store_n(&tally.seq, tally.seq + 1, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for(unsigned int i = 0; i < sizeof(tally_fields) / sizeof(tally_fields[0]); i++){
+		uint8_t off = tally_fields[i].stat;
+		*(uint64_t *)((uint8_t *)&tally.total + off) += *(uint64_t *)((uint8_t *)&delta + off);
+	}
+	tally.total.ts_ns = delta.ts_ns;
+	tally.delta	  = delta;
+	__atomic_store_n(&tally.seq, tally.seq + 1, __ATOMIC_RELEASE);
+	tally.raw = raw;
+}
+
+/**
+ * RTL81XX_TALLY_START - sample the MAC statistics in the background, this is the 'rtl_tally_start' callback
+ * @interval_ms: sampling period, 0 picks RTL81XX_TALLY_INTERVAL_MS
+ *
+ * the accumulators start from zero, the narrow hardware counters must not wrap
+ * twice inside one period (the 16 bit ones hold 65535 events).
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_START(unsigned int interval_ms){
+	if( tally.worker.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	RTL81XX_TALLY_READ(&tally.raw);
+	if( return_context < 0 ){
+		return;
+	}
+	__atomic_store_n(&tally.seq, tally.seq + 1, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	memset(&tally.total, 0, sizeof(tally.total));
+	memset(&tally.delta, 0, sizeof(tally.delta));
+	__atomic_store_n(&tally.seq, tally.seq + 1, __ATOMIC_RELEASE);
+	tally.started = TRUE;
+	RTL81XX_PERIODIC_START(&tally.worker, ( interval_ms != 0 ) ? interval_ms : RTL81XX_TALLY_INTERVAL_MS, RTL81XX_TALLY_SAMPLE);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TALLY_STOP(void){
+	RTL81XX_PERIODIC_STOP(&tally.worker);
+	return_context = NO_ERROR;
+}
+
+/**
+ * RTL81XX_TALLY_SNAPSHOT - copy the counters, this is the 'rtl_tally_snapshot' callback
+ * @total: totals since RTL81XX_TALLY_START, can be NULL
+ * @delta: increments of the last sampling period, can be NULL
+ *
+ * never touches the USB pipe, any thread can call it as often as it wants.
+ * Once the sampler stopped the counters of its last period stay readable,
+ * only a sampler that never ran makes it fail.
+ */
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_TALLY_SNAPSHOT(struct rtl_tally_stats *total, struct rtl_tally_stats *delta){
+	uint32_t seq = 0;
+
+	if( !tally.started ){
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+	do{
+		while( (seq = __atomic_load_n(&tally.seq, __ATOMIC_ACQUIRE)) & 1 ){
+		}
+		if( total != NULL ){
+			*total = tally.total;
+		}
+		if( delta != NULL ){
+			*delta = tally.delta;
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}while( __atomic_load_n(&tally.seq, __ATOMIC_RELAXED) != seq );
+	return_context = NO_ERROR;
+}
+
+/** ADAPTIVE FLOW CONTROL, PAUSE THRESHOLDS DRIVEN BY THE RX FIFO OVERRUNS **/
+
+/** called with ocp_lock held, @pause_on is clamped inside the bounds of the current MTU **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_PROGRAM(uint32_t pause_on, uint32_t missed){
+	uint32_t frame		= ALIGN(mtu_to_size(device_context->device_mtu), 1024);
+	struct timespec now	= { 0 };
+	struct rtl_fc_event *ev = NULL;
+
+	if( pause_on < frame + RTL81XX_FC_MIN_MARGIN ){
+		pause_on = frame + RTL81XX_FC_MIN_MARGIN;
+	}
+	if( pause_on > frame + RTL81XX_FC_MAX_MARGIN ){
+		pause_on = frame + RTL81XX_FC_MAX_MARGIN;
+	}
+	if( pause_on == fc.pause_on ){
+		return;
+	}
+	fc.pause_on  = pause_on;
+	fc.pause_off = pause_on + RTL81XX_FC_HYSTERESIS;
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_RX_FIFO_FULL, fc.pause_on / 16 ) );
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_RX_FIFO_EMPTY, fc.pause_off / 16 ) );
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ev	      = &fc.events[fc.adjustments % RTL81XX_FC_EVENTS];
+	ev->ts_ns     = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	ev->missed    = missed;
+	ev->pause_on  = fc.pause_on;
+	ev->pause_off = fc.pause_off;
+	fc.adjustments++;
+	DEBUG_PRINTF("[%s] %u overruns, pause on below %u bytes free, off above %u\n", __FUNCTION__, missed, fc.pause_on, fc.pause_off);
+}
+
+/**
+ * overruns mean the PAUSE went out too late: it is sent earlier right away.
+ * A long quiet stretch lowers it one step at a time, so a burst that is over
+ * does not leave the link pausing more than it needs to.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_TICK(void){
+	struct tally_counter raw     = { 0 };
+	struct rtl_tally_stats total = { 0 };
+	uint32_t missed		     = 0;
+
+	if( tally.worker.running ){
+		/** the sampler reads the same block, a round without a new sample is not a quiet one **/
+		RTL81XX_TALLY_SNAPSHOT(&total, NULL);
+		if( return_context < 0 || total.ts_ns == 0 || total.ts_ns == fc.last_ts_ns ){
+			return;
+		}
+		/** first sample used, or the sampler restarted from zero: only the baseline is taken **/
+		if( fc.last_ts_ns != 0 && total.rx_missed >= fc.last_total ){
+			missed = (uint32_t)(total.rx_missed - fc.last_total);
+		}
+		fc.last_ts_ns = total.ts_ns;
+		fc.last_total = total.rx_missed;
+		pthread_mutex_lock(&ocp_lock);
+	}else{
+		pthread_mutex_lock(&ocp_lock);
+		RTL81XX_TALLY_READ(&raw);
+		if( return_context < 0 ){
+			pthread_mutex_unlock(&ocp_lock);
+			return;
+		}
+		/** back from the accumulator, fc.last_missed is stale **/
+		if( fc.last_ts_ns == 0 ){
+			missed = (uint16_t)(__le16_to_cpu(raw.rx_missed) - fc.last_missed);
+		}
+		fc.last_missed = __le16_to_cpu(raw.rx_missed);
+		fc.last_ts_ns  = 0;
+	}
+	fc.missed += missed;
+	if( fc.pause_on == 0 ){
+		/** first round, or RTL81XX_SET_MTU put back the r8156_fc_parameter values **/
+		RTL81XX_FC_PROGRAM(ALIGN(mtu_to_size(device_context->device_mtu), 1024) + 6 * 1024, 0);
+	}
+	if( missed != 0 ){
+		fc.quiet = 0;
+		RTL81XX_FC_PROGRAM(fc.pause_on + RTL81XX_FC_STEP * ( missed > 64 ? 2 : 1 ), missed);
+	}else if( ++fc.quiet >= RTL81XX_FC_RELAX_PERIODS ){
+		fc.quiet = 0;
+		RTL81XX_FC_PROGRAM(fc.pause_on - RTL81XX_FC_STEP, 0);
+	}
+	pthread_mutex_unlock(&ocp_lock);
+}
+
+/**
+ * RTL81XX_FC_START - adapt the PAUSE thresholds to the observed overruns, this is the 'rtl_fc_start' callback
+ * @interval_ms: sampling period, 0 picks RTL81XX_FC_INTERVAL_MS
+ *
+ * only the RTL8156 family exposes PLA_RX_FIFO_FULL/EMPTY. The tally block has
+ * no PAUSE counters, the RX FIFO overruns (rx_missed) are the only input;
+ * every adjustment is kept inside fc.events.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_START(unsigned int interval_ms){
+	struct tally_counter tally = { 0 };
+
+	if( !device_context->device_chip->fifo_fc ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	if( fc.worker.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	RTL81XX_TALLY_READ(&tally);
+	if( return_context < 0 ){
+		return;
+	}
+	fc.last_missed = __le16_to_cpu(tally.rx_missed);
+	fc.last_ts_ns  = 0;
+	fc.pause_on    = 0;
+	fc.quiet       = 0;
+	RTL81XX_PERIODIC_START(&fc.worker, ( interval_ms != 0 ) ? interval_ms : RTL81XX_FC_INTERVAL_MS, RTL81XX_FC_TICK);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_FC_STOP(void){
+	RTL81XX_PERIODIC_STOP(&fc.worker);
+	return_context = NO_ERROR;
+}
+
+/** EARLY DROP RX CLASSIFIER, RULES COMPILED TO KEY/MASK PAIRS **/
+
+/** the only branchy part, every other step works on the fixed layout of struct rtl_cls_key **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CLS_EXTRACT(const struct rtl_rx_frame *frame, struct rtl_cls_key *key){
+	const uint8_t *data = frame->data;
+	uint32_t l3	    = ETH_HLEN;
+
+	memset(key, 0, sizeof(*key));
+	memcpy(key->dst_mac, data, ETH_ALEN);
+	memcpy(&key->ethertype, data + 12, 2);
+	if( frame->has_vlan ){
+		key->vlan_id = __cpu_to_be16(frame->vlan_tci & 0x0fff);
+		key->flags  |= RTL81XX_CLS_KEY_VLAN;
+	}else if( key->ethertype == __cpu_to_be16(ETH_P_8021Q) && frame->len >= ETH_HLEN + VLAN_HLEN ){
+		key->vlan_id = __cpu_to_be16(((data[14] << 8) | data[15]) & 0x0fff);
+		key->flags  |= RTL81XX_CLS_KEY_VLAN;
+		memcpy(&key->ethertype, data + 16, 2);
+		l3 += VLAN_HLEN;
+	}
+	if( key->ethertype == __cpu_to_be16(ETH_P_IP) && frame->len >= l3 + sizeof(struct iphdr) ){
+		const struct iphdr *iph = (const struct iphdr *)(data + l3);
+		uint32_t l4		= l3 + iph->ihl * 4;
+
+		key->flags   |= RTL81XX_CLS_KEY_IPV4;
+		key->ip_proto = iph->protocol;
+		memcpy(&key->src_ip, &iph->saddr, 4);
+		memcpy(&key->dst_ip, &iph->daddr, 4);
+		/** later fragments carry no ports, they never match a port rule **/
+		if( (iph->protocol == IPPROTO_TCP || iph->protocol == IPPROTO_UDP) && !(__be16_to_cpu(iph->frag_off) & 0x1fff) && frame->len >= l4 + 4 ){
+			memcpy(&key->src_port, data + l4, 4);
+			key->flags |= RTL81XX_CLS_KEY_PORTS;
+		}
+	}else if( key->ethertype == __cpu_to_be16(ETH_P_IPV6) && frame->len >= l3 + sizeof(struct ipv6hdr) ){
+		key->ip_proto = ((const struct ipv6hdr *)(data + l3))->nexthdr;
+	}
+}
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_CLS_MATCH_SCALAR(const struct rtl_cls_key *keys, unsigned int count, uint8_t *verdict){
+	for(unsigned int f = 0; f < count; f++){
+		const uint64_t *key = (const uint64_t *)&keys[f];
+		unsigned int r	    = 0;
+
+		for(; r < cls.rules; r++){
+			const uint64_t *value = (const uint64_t *)&cls.value[r];
+			const uint64_t *mask  = (const uint64_t *)&cls.mask[r];
+
+			if( !(((key[0] & mask[0]) ^ value[0]) | ((key[1] & mask[1]) ^ value[1]) |
+			      ((key[2] & mask[2]) ^ value[2]) | ((key[3] & mask[3]) ^ value[3])) ){
+				break;
+			}
+		}
+		cls.hits[r]++;
+		verdict[f] = cls.action[r];
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static inline void RTL81XX_CLS_MATCH_AVX2(const struct rtl_cls_key *keys, unsigned int count, uint8_t *verdict){
+	for(unsigned int f = 0; f < count; f++){
+		__m256i key    = _mm256_load_si256((const __m256i *)&keys[f]);
+		unsigned int r = 0;
+
+		for(; r < cls.rules; r++){
+			__m256i masked = _mm256_and_si256(key, _mm256_load_si256((const __m256i *)&cls.mask[r]));
+			if( _mm256_movemask_epi8(_mm256_cmpeq_epi8(masked, _mm256_load_si256((const __m256i *)&cls.value[r]))) == -1 ){
+				break;
+			}
+		}
+		cls.hits[r]++;
+		verdict[f] = cls.action[r];
+	}
+	_mm256_zeroupper();
+}
+#elif defined(__aarch64__)
+static inline void RTL81XX_CLS_MATCH_NEON(const struct rtl_cls_key *keys, unsigned int count, uint8_t *verdict){
+	for(unsigned int f = 0; f < count; f++){
+		uint8x16_t key_lo = vld1q_u8((const uint8_t *)&keys[f]);
+		uint8x16_t key_hi = vld1q_u8((const uint8_t *)&keys[f] + 16);
+		unsigned int r	  = 0;
+
+		for(; r < cls.rules; r++){
+			const uint8_t *value = (const uint8_t *)&cls.value[r];
+			const uint8_t *mask  = (const uint8_t *)&cls.mask[r];
+			uint8x16_t eq_lo     = vceqq_u8(vandq_u8(key_lo, vld1q_u8(mask)), vld1q_u8(value));
+			uint8x16_t eq_hi     = vceqq_u8(vandq_u8(key_hi, vld1q_u8(mask + 16)), vld1q_u8(value + 16));
+
+			if( vminvq_u8(vandq_u8(eq_lo, eq_hi)) == 0xff ){
+				break;
+			}
+		}
+		cls.hits[r]++;
+		verdict[f] = cls.action[r];
+	}
+}
+#endif
+
+/** classify a parsed batch and compact the accepted frames in place, their order is kept **/
+RTL_PLUGIN_IO_OPTIMIZE static inline unsigned int RTL81XX_CLS_RUN(struct rtl_rx_frame *frames, unsigned int count){
+	struct rtl_cls_key keys[RTL81XX_RX_BATCH];
+	uint8_t verdict[RTL81XX_RX_BATCH];
+	unsigned int kept = 0;
+
+	for(unsigned int base = 0; base < count; base += RTL81XX_RX_BATCH){
+		unsigned int chunk = ( count - base < RTL81XX_RX_BATCH ) ? count - base : RTL81XX_RX_BATCH;
+
+		for(unsigned int i = 0; i < chunk; i++){
+			RTL81XX_CLS_EXTRACT(&frames[base + i], &keys[i]);
+		}
+		cls.match(keys, chunk, verdict);
+		for(unsigned int i = 0; i < chunk; i++){
+			frames[kept] = frames[base + i];
+			kept	    += ( verdict[i] == RTL81XX_CLS_ACCEPT );
+		}
+	}
+	cls.dropped += count - kept;
+	return kept;
+}
+
+/**
+ * RTL81XX_CLS_LOAD - compile the receive rules, this is the 'rtl_cls_load' callback
+ * @rules:	    evaluated in order, the first match decides
+ * @count:	    up to RTL81XX_CLS_MAX_RULES, 0 removes the classifier
+ * @default_action: taken by frames no rule matches
+ *
+ * the tables are read without locks by the thread parsing the bulk-IN
+ * buffers, so the rules can only be replaced while the receive path is stopped.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CLS_LOAD(const struct rtl_cls_rule *rules, unsigned int count, uint8_t default_action){
+	if( count > RTL81XX_CLS_MAX_RULES || (count != 0 && rules == NULL) || default_action > RTL81XX_CLS_DROP ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( rx_engine.running ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	memset(cls.value, 0, sizeof(cls.value));
+	memset(cls.mask, 0, sizeof(cls.mask));
+	memset(cls.hits, 0, sizeof(cls.hits));
+	cls.dropped = 0;
+	cls.enabled = FALSE;
+	cls.rules   = 0;
+	if( count == 0 ){
+		return_context = NO_ERROR;
+		return;
+	}
+
+	for(unsigned int r = 0; r < count; r++){
+		const struct rtl_cls_rule *rule = &rules[r];
+		struct rtl_cls_key *value	= &cls.value[r];
+		struct rtl_cls_key *mask	= &cls.mask[r];
+
+		if( rule->action > RTL81XX_CLS_DROP || rule->src_prefix_len > 32 || rule->dst_prefix_len > 32 ){
+			return_context = -ERROR_INVALID_ARGS;
+			return;
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_DST_MAC ){
+			memcpy(value->dst_mac, rule->dst_mac, ETH_ALEN);
+			memset(mask->dst_mac, 0xff, ETH_ALEN);
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_ETHERTYPE ){
+			value->ethertype = __cpu_to_be16(rule->ethertype);
+			mask->ethertype	 = 0xffff;
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_VLAN ){
+			value->vlan_id = __cpu_to_be16(rule->vlan_id & 0x0fff);
+			mask->vlan_id  = 0xffff;
+			value->flags  |= RTL81XX_CLS_KEY_VLAN;
+			mask->flags   |= RTL81XX_CLS_KEY_VLAN;
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_IP_PROTO ){
+			value->ip_proto = rule->ip_proto;
+			mask->ip_proto	= 0xff;
+		}
+		/** prefixes and ports only exist for IPv4 inside the key **/
+		if( rule->fields & (RTL81XX_CLS_MATCH_SRC_IP | RTL81XX_CLS_MATCH_DST_IP | RTL81XX_CLS_MATCH_SRC_PORT | RTL81XX_CLS_MATCH_DST_PORT) ){
+			value->flags |= RTL81XX_CLS_KEY_IPV4;
+			mask->flags  |= RTL81XX_CLS_KEY_IPV4;
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_SRC_IP ){
+			mask->src_ip  = __cpu_to_be32(rule->src_prefix_len ? ~0U << (32 - rule->src_prefix_len) : 0);
+			value->src_ip = rule->src_ip & mask->src_ip;
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_DST_IP ){
+			mask->dst_ip  = __cpu_to_be32(rule->dst_prefix_len ? ~0U << (32 - rule->dst_prefix_len) : 0);
+			value->dst_ip = rule->dst_ip & mask->dst_ip;
+		}
+		if( rule->fields & (RTL81XX_CLS_MATCH_SRC_PORT | RTL81XX_CLS_MATCH_DST_PORT) ){
+			value->flags |= RTL81XX_CLS_KEY_PORTS;
+			mask->flags  |= RTL81XX_CLS_KEY_PORTS;
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_SRC_PORT ){
+			value->src_port = __cpu_to_be16(rule->src_port);
+			mask->src_port	= 0xffff;
+		}
+		if( rule->fields & RTL81XX_CLS_MATCH_DST_PORT ){
+			value->dst_port = __cpu_to_be16(rule->dst_port);
+			mask->dst_port	= 0xffff;
+		}
+		cls.action[r] = rule->action;
+	}
+	cls.rules	   = count;
+	cls.action[count]  = default_action;
+
+	cls.match = RTL81XX_CLS_MATCH_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") ){
+		cls.match = RTL81XX_CLS_MATCH_AVX2;
+	}
+#elif defined(__aarch64__)
+	cls.match = RTL81XX_CLS_MATCH_NEON;
+#endif
+	cls.enabled    = TRUE;
+	return_context = NO_ERROR;
+}
+
+/** LINK POWER MANAGEMENT GOVERNOR, U1/U2 AND U2P3 ONLY WHILE THE LINK IS IDLE **/
+
+/** called with ocp_lock held, only the states that change are written **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_PROGRAM(bool u1u2, bool u2p3){
+	uint32_t ocp_data = 0;
+
+	if( u1u2 != lpm.u1u2 ){
+		switch( device_context->device_chip->lpm ){
+		case RTL81XX_LPM_TOLERANCE:
+			/** static void r8153_u1u2en(struct r8152 *tp, bool enable) **/
+			{
+				uint8_t tolerance[8];
+
+				memset(tolerance, u1u2 ? 0xff : 0x00, sizeof(tolerance));
+				DEBUG_RTL81XX( RTL81XX_GENERIC_REG_WRITE( USB_TOLERANCE, BYTE_EN_SIX_BYTES, sizeof(tolerance), tolerance, MCU_TYPE_USB ) );
+			}
+			break;
+		case RTL81XX_LPM_CONFIG:
+			/** static void r8153b_u1u2en(struct r8152 *tp, bool enable) **/
+			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_LPM_CONFIG ) );
+			ocp_data = u1u2 ? (return_context | LPM_U1U2_EN) : (return_context & ~LPM_U1U2_EN);
+			DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_LPM_CONFIG, ocp_data ) );
+			break;
+		default:
+			break;
+		}
+		lpm.u1u2 = u1u2;
+	}
+	if( u2p3 != lpm.u2p3 ){
+		/** static void r8153_u2p3en(struct r8152 *tp, bool enable) **/
+		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_U2P3_CTRL ) );
+		ocp_data = u2p3 ? (return_context | U2P3_ENABLE) : (return_context & ~U2P3_ENABLE);
+		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_U2P3_CTRL, ocp_data ) );
+		lpm.u2p3 = u2p3;
+	}
+}
+
+/**
+ * the idle time grows while the packet rate stays at or below enter_pps and
+ * drops to zero above exit_pps, or above enter_pps while nothing is allowed;
+ * in between it is frozen, so a trickle of traffic neither puts the link to
+ * sleep nor wakes it up. The allowed states follow from the idle time alone.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_TICK(void){
+	struct timespec now = { 0 };
+
+	uint64_t now_ns	 = 0;
+	uint64_t dt	 = 0;
+	uint64_t packets = 0;
+	uint64_t pps	 = 0;
+	bool u1u2	 = FALSE;
+	bool u2p3	 = FALSE;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns	= (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	dt	= now_ns - lpm.last_ns;
+	packets = rx_engine.rx_packets + tx_engine.tx_packets;
+	pps	= ( dt != 0 ) ? (packets - lpm.last_packets) * 1000000000ULL / dt : 0;
+
+	pthread_mutex_lock(&lpm.stats_lock);
+	if( lpm.u1u2 ){
+		lpm.stats.u1u2_ns += dt;
+	}
+	if( lpm.u2p3 ){
+		lpm.stats.u2p3_ns += dt;
+	}
+	pthread_mutex_unlock(&lpm.stats_lock);
+	if( pps > lpm.cfg.exit_pps || (pps > lpm.cfg.enter_pps && !lpm.u1u2 && !lpm.u2p3) ){
+		lpm.idle_ns = 0;
+	}else if( pps <= lpm.cfg.enter_pps ){
+		lpm.idle_ns += dt;
+	}
+	u1u2 = device_context->device_chip->lpm != RTL81XX_LPM_NONE && lpm.idle_ns >= lpm.cfg.u1u2_idle_ms * 1000000ULL;
+	u2p3 = lpm.cfg.u2p3_idle_ms != 0 && lpm.idle_ns >= lpm.cfg.u2p3_idle_ms * 1000000ULL;
+
+	if( u1u2 != lpm.u1u2 || u2p3 != lpm.u2p3 ){
+		bool woke	      = (lpm.u1u2 || lpm.u2p3) && !u1u2 && !u2p3;
+		uint64_t u1u2_entries = ( u1u2 && !lpm.u1u2 );
+		uint64_t u2p3_entries = ( u2p3 && !lpm.u2p3 );
+		uint64_t latency      = 0;
+
+		pthread_mutex_lock(&ocp_lock);
+		RTL81XX_LPM_PROGRAM(u1u2, u2p3);
+		pthread_mutex_unlock(&ocp_lock);
+		if( woke ){
+			/** the burst may have started right after the previous sample **/
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			latency = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - lpm.last_ns;
+		}
+		pthread_mutex_lock(&lpm.stats_lock);
+		lpm.stats.u1u2_entries += u1u2_entries;
+		lpm.stats.u2p3_entries += u2p3_entries;
+		if( woke ){
+			lpm.stats.exits++;
+			lpm.stats.exit_packets	  += packets - lpm.last_packets;
+			lpm.stats.exit_latency_ns += latency;
+			if( latency > lpm.stats.exit_latency_max_ns ){
+				lpm.stats.exit_latency_max_ns = latency;
+			}
+		}
+		pthread_mutex_unlock(&lpm.stats_lock);
+	}
+	lpm.last_ns	 = now_ns;
+	lpm.last_packets = packets;
+}
+
+/**
+ * RTL81XX_LPM_START - allow U1/U2 and U2P3 only on an idle link, this is the 'rtl_lpm_start' callback
+ * @cfg: NULL, or zero fields, for the RTL81XX_LPM_* defaults; u2p3_idle_ms
+ *	 equal to UINT_MAX keeps U2P3 off
+ *
+ * the governor owns both states until RTL81XX_LPM_STOP which switches them
+ * off again; RTL8156B_UP/DOWN stop it, so it is started once the interface
+ * is up. The rate is taken from the packets counted by the bulk engines.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_START(const struct rtl_lpm_cfg *cfg){
+	struct rtl_lpm_cfg def = { 0 };
+	struct timespec now    = { 0 };
+
+	if( device_context->device_chip->lpm == RTL81XX_LPM_NONE ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	if( lpm.worker.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	if( cfg == NULL ){
+		cfg = &def;
+	}
+	lpm.cfg.interval_ms  = ( cfg->interval_ms != 0 ) ? cfg->interval_ms : RTL81XX_LPM_INTERVAL_MS;
+	lpm.cfg.u1u2_idle_ms = ( cfg->u1u2_idle_ms != 0 ) ? cfg->u1u2_idle_ms : RTL81XX_LPM_U1U2_IDLE_MS;
+	lpm.cfg.u2p3_idle_ms = ( cfg->u2p3_idle_ms != 0 ) ? cfg->u2p3_idle_ms : RTL81XX_LPM_U2P3_IDLE_MS;
+	lpm.cfg.enter_pps    = ( cfg->enter_pps != 0 ) ? cfg->enter_pps : RTL81XX_LPM_ENTER_PPS;
+	lpm.cfg.exit_pps     = ( cfg->exit_pps != 0 ) ? cfg->exit_pps : RTL81XX_LPM_EXIT_PPS;
+	if( lpm.cfg.u2p3_idle_ms == UINT_MAX ){
+		lpm.cfg.u2p3_idle_ms = 0;
+	}
+	if( lpm.cfg.exit_pps < lpm.cfg.enter_pps ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+
+	/** nothing is known about what was programmed before, both states are written off **/
+	pthread_mutex_lock(&ocp_lock);
+	lpm.u1u2 = TRUE;
+	lpm.u2p3 = TRUE;
+	RTL81XX_LPM_PROGRAM(FALSE, FALSE);
+	pthread_mutex_unlock(&ocp_lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&lpm.stats_lock);
+	memset(&lpm.stats, 0, sizeof(lpm.stats));
+	pthread_mutex_unlock(&lpm.stats_lock);
+	lpm.idle_ns	 = 0;
+	lpm.last_ns	 = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	lpm.last_packets = rx_engine.rx_packets + tx_engine.tx_packets;
+	RTL81XX_PERIODIC_START(&lpm.worker, lpm.cfg.interval_ms, RTL81XX_LPM_TICK);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_STOP(void){
+	if( RTL81XX_PERIODIC_STOP(&lpm.worker) ){
+		pthread_mutex_lock(&ocp_lock);
+		RTL81XX_LPM_PROGRAM(FALSE, FALSE);
+		pthread_mutex_unlock(&ocp_lock);
+	}
+	return_context = NO_ERROR;
+}
+
+/** 'rtl_lpm_stats' callback, the counters are updated once per period and copied as a whole **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_LPM_STATS(struct rtl_lpm_stats *stats){
+	if( stats == NULL ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	pthread_mutex_lock(&lpm.stats_lock);
+	memcpy(stats, &lpm.stats, sizeof(*stats));
+	pthread_mutex_unlock(&lpm.stats_lock);
+	return_context = NO_ERROR;
+}
+
+/** LOAD ADAPTIVE EEE, ALDPS AND GREEN ETHERNET **/
+
+/** RTL81XX_PWR_* currently on in the chip, called with ocp_lock held **/
+RTL81XX_DISABLE_INSTRUMENT static inline unsigned long RTL81XX_PWR_READ(void){
+	unsigned long on = 0;
+
+	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
+	if( (return_context & (EEE_RX_EN | EEE_TX_EN)) == (EEE_RX_EN | EEE_TX_EN) ){
+		on |= RTL81XX_PWR_EEE;
+	}
+	if( device_context->device_chip->eee == RTL81XX_EEE_R8152 ){
+		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_ALDPS_CONFIG ) );
+		on |= ( return_context & ENPWRSAVE ) ? RTL81XX_PWR_ALDPS : 0;
+	}else{
+		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_POWER_CFG ) );
+		on |= ( return_context & EN_ALDPS ) ? RTL81XX_PWR_ALDPS : 0;
+		DEBUG_RTL81XX( RTL81XX_OCP_IO_SRAM( RTL81XX_OPTYPE_READ, SRAM_GREEN_CFG, 0 ) );
+		on |= ( return_context & GREEN_ETH_EN ) ? RTL81XX_PWR_GREEN : 0;
+	}
+	return on;
+}
+
+/**
+ * called with ocp_lock held, only the features that change are written.
+ * EEE is the MAC half of r8153_eee_en: the advertisement, and so the link,
+ * stay as they are and LPI is simply no longer requested.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_PROGRAM(unsigned long on){
+	unsigned long change = on ^ pwr.on;
+	uint32_t ocp_data    = 0;
+
+	if( change & RTL81XX_PWR_EEE ){
+		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
+		ocp_data = return_context;
+		if( on & RTL81XX_PWR_EEE ){
+			ocp_data |= EEE_RX_EN | EEE_TX_EN;
+		}else{
+			ocp_data &= ~(EEE_RX_EN | EEE_TX_EN);
+		}
+		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
+	}
+	if( change & RTL81XX_PWR_ALDPS ){
+		RTL81XX_ALDPS_ENABLE( (on & RTL81XX_PWR_ALDPS) != 0 );
+	}
+	if( change & RTL81XX_PWR_GREEN ){
+		RTL81XX_GREEN_EN( (on & RTL81XX_PWR_GREEN) != 0 );
+	}
+	pwr.on = on;
+}
+
+/**
+ * same hysteresis as RTL81XX_LPM_TICK, on the utilisation of the link:
+ * the idle time grows at or below enter_permille and drops to zero above
+ * exit_permille, above burst_pps, or above enter_permille while everything
+ * is off. Every switch is timed and kept in pwr.stats.events.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_TICK(void){
+	struct timespec now = { 0 };
+
+	uint64_t now_ns	  = 0;
+	uint64_t dt	  = 0;
+	uint64_t packets  = 0;
+	uint64_t bytes	  = 0;
+	uint64_t pps	  = 0;
+	uint64_t util	  = 0;
+	uint32_t speed	  = 0;
+	uint16_t status	  = 0;
+	unsigned long want = 0;
+
+	pthread_mutex_lock(&ocp_lock);
+	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_PHYSTATUS ) );
+	status = ( return_context < 0 ) ? 0 : return_context;
+	pthread_mutex_unlock(&ocp_lock);
+	if( status & LINK_STATUS ){
+		speed = ( status & _2500bps ) ? 2500 : ( status & _1000bps ) ? 1000 : ( status & _100bps ) ? 100 : 10;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns	= (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	dt	= now_ns - pwr.last_ns;
+	packets = rx_engine.rx_packets + tx_engine.tx_packets;
+	bytes	= rx_engine.rx_bytes + tx_engine.tx_bytes;
+	if( dt != 0 ){
+		pps = (packets - pwr.last_packets) * 1000000000ULL / dt;
+		/** bits * 1000 / (Mbps * dt / 1000) **/
+		util = ( speed != 0 ) ? (bytes - pwr.last_bytes) * 8 * 1000000ULL / (speed * dt) : 0;
+	}
+
+	if( pwr.on != 0 ){
+		pthread_mutex_lock(&pwr.stats_lock);
+		pwr.stats.saving_ns += dt;
+		pthread_mutex_unlock(&pwr.stats_lock);
+	}
+	if( util > pwr.cfg.exit_permille || pps > pwr.cfg.burst_pps || (util > pwr.cfg.enter_permille && pwr.on == 0) ){
+		pwr.idle_ns = 0;
+	}else if( util <= pwr.cfg.enter_permille ){
+		pwr.idle_ns += dt;
+	}
+	if( pwr.idle_ns >= pwr.cfg.idle_ms * 1000000ULL ){
+		want = pwr.cfg.features;
+		/** LPI is pointless when EEE is not advertised **/
+		if( !device_context->device_eee->eee_enabled ){
+			want &= ~RTL81XX_PWR_EEE;
+		}
+	}
+
+	if( want != pwr.on ){
+		struct rtl_pwr_event *ev = NULL;
+		uint64_t start	    = 0;
+		uint64_t end	    = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		start = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+		pthread_mutex_lock(&ocp_lock);
+		RTL81XX_PWR_PROGRAM(want);
+		pthread_mutex_unlock(&ocp_lock);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		end = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+		pthread_mutex_lock(&pwr.stats_lock);
+		ev		= &pwr.stats.events[(pwr.stats.entries + pwr.stats.exits) % RTL81XX_PWR_EVENTS];
+		ev->ts_ns	= end;
+		ev->duration_ns = end - start;
+		ev->reaction_ns = 0;
+		ev->speed	= speed;
+		ev->util	= ( util > UINT32_MAX ) ? UINT32_MAX : util;
+		ev->pps		= ( pps > UINT32_MAX ) ? UINT32_MAX : pps;
+		ev->on		= want;
+		if( want == 0 ){
+			/** the burst may have started right after the previous sample **/
+			ev->reaction_ns = end - pwr.last_ns;
+			pwr.stats.exits++;
+			pwr.stats.exit_packets	   += packets - pwr.last_packets;
+			pwr.stats.exit_ns	   += ev->duration_ns;
+			pwr.stats.exit_reaction_ns += ev->reaction_ns;
+			if( ev->duration_ns > pwr.stats.exit_max_ns ){
+				pwr.stats.exit_max_ns = ev->duration_ns;
+			}
+			if( ev->reaction_ns > pwr.stats.exit_reaction_max_ns ){
+				pwr.stats.exit_reaction_max_ns = ev->reaction_ns;
+			}
+		}else{
+			pwr.stats.entries++;
+			pwr.stats.enter_ns += ev->duration_ns;
+			if( ev->duration_ns > pwr.stats.enter_max_ns ){
+				pwr.stats.enter_max_ns = ev->duration_ns;
+			}
+		}
+		pthread_mutex_unlock(&pwr.stats_lock);
+	}
+	pwr.last_ns	 = now_ns;
+	pwr.last_packets = packets;
+	pwr.last_bytes	 = bytes;
+}
+
+/**
+ * RTL81XX_PWR_START - EEE, ALDPS and green ethernet only while the link is lightly loaded,
+ * this is the 'rtl_pwr_start' callback
+ * @cfg: NULL, or zero fields, for the RTL81XX_PWR_* defaults
+ *
+ * the features are switched off first, latency wins until the link has been
+ * idle for idle_ms; RTL81XX_PWR_STOP puts back what was programmed before.
+ * The load is taken from the bytes and packets counted by the bulk engines.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_START(const struct rtl_pwr_cfg *cfg){
+	struct rtl_pwr_cfg def = { 0 };
+	struct timespec now    = { 0 };
+	unsigned long features = 0;
+
+	if( pwr.worker.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	if( cfg == NULL ){
+		cfg = &def;
+	}
+	features = ( cfg->features != 0 ) ? cfg->features : RTL81XX_PWR_ALL;
+	switch( device_context->device_chip->eee ){
+		case RTL81XX_EEE_NONE:
+			features &= ~RTL81XX_PWR_EEE;
+		break;
+		case RTL81XX_EEE_R8152:
+			/** no green ethernet SRAM on the RTL8152 PHY **/
+			features &= ~RTL81XX_PWR_GREEN;
+		break;
+		default:
+		break;
+	}
+	features &= RTL81XX_PWR_ALL;
+	if( features == 0 ){
+		return_context = -ERROR_OPERATION_NOT_SUPPORTED;
+		return;
+	}
+	pwr.cfg.interval_ms    = ( cfg->interval_ms != 0 ) ? cfg->interval_ms : RTL81XX_PWR_INTERVAL_MS;
+	pwr.cfg.idle_ms	       = ( cfg->idle_ms != 0 ) ? cfg->idle_ms : RTL81XX_PWR_IDLE_MS;
+	pwr.cfg.enter_permille = ( cfg->enter_permille != 0 ) ? cfg->enter_permille : RTL81XX_PWR_ENTER_PERMILLE;
+	pwr.cfg.exit_permille  = ( cfg->exit_permille != 0 ) ? cfg->exit_permille : RTL81XX_PWR_EXIT_PERMILLE;
+	pwr.cfg.burst_pps      = ( cfg->burst_pps != 0 ) ? cfg->burst_pps : RTL81XX_PWR_BURST_PPS;
+	pwr.cfg.features       = features;
+	if( pwr.cfg.exit_permille < pwr.cfg.enter_permille ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+
+	pthread_mutex_lock(&ocp_lock);
+	pwr.on	  = RTL81XX_PWR_READ();
+	pwr.saved = pwr.on;
+	RTL81XX_PWR_PROGRAM(pwr.on & ~features);
+	pthread_mutex_unlock(&ocp_lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&pwr.stats_lock);
+	memset(&pwr.stats, 0, sizeof(pwr.stats));
+	pthread_mutex_unlock(&pwr.stats_lock);
+	pwr.idle_ns	 = 0;
+	pwr.last_ns	 = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	pwr.last_packets = rx_engine.rx_packets + tx_engine.tx_packets;
+	pwr.last_bytes	 = rx_engine.rx_bytes + tx_engine.tx_bytes;
+	RTL81XX_PERIODIC_START(&pwr.worker, pwr.cfg.interval_ms, RTL81XX_PWR_TICK);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_STOP(void){
+	if( RTL81XX_PERIODIC_STOP(&pwr.worker) ){
+		pthread_mutex_lock(&ocp_lock);
+		RTL81XX_PWR_PROGRAM(pwr.saved);
+		pthread_mutex_unlock(&ocp_lock);
+	}
+	return_context = NO_ERROR;
+}
+
+/** 'rtl_pwr_stats' callback, the counters are updated once per period and copied as a whole **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_PWR_STATS(struct rtl_pwr_stats *stats){
+	if( stats == NULL ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	pthread_mutex_lock(&pwr.stats_lock);
+	memcpy(stats, &pwr.stats, sizeof(*stats));
+	pthread_mutex_unlock(&pwr.stats_lock);
+	return_context = NO_ERROR;
+}
+
+/** STALL WATCHDOG, ESCALATING RECOVERY THAT KEEPS THE PACKET BUFFERS **/
+
+/**
+ * park every bulk buffer: the queued transfers are cancelled and, while
+ * wd.recovering is set, their completions and new submissions leave the
+ * buffers (and the frames inside the bulk-OUT ones) to RTL81XX_WD_RESUME.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_QUIESCE(void){
+	struct timeval tv   = { 0 };
+	struct timespec now = { 0 };
+	uint64_t deadline   = 0;
+
+	wd.recovering = TRUE;
+	__atomic_store_n(&wd.halted, 0, __ATOMIC_RELEASE);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	deadline = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec + RTL81XX_WD_DRAIN_MS * 1000000ULL;
+	do{
+		if( rx_engine.running ){
+			RTL81XX_RX_CANCEL_ALL();
+		}
+		if( tx_engine.running ){
+			pthread_mutex_lock(&tx_engine.lock);
+			for(int i = 0; i < RTL81XX_TX_URB_NUM; i++){
+				if( tx_engine.agg[i].state == RTL81XX_URB_QUEUED ){
+					libusb_cancel_transfer(tx_engine.agg[i].transfer);
+				}
+			}
+			pthread_mutex_unlock(&tx_engine.lock);
+		}
+		tv.tv_sec  = 0;
+		tv.tv_usec = 10000;
+		RTL81XX_HANDLE_EVENTS(&tv, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	}while( (__atomic_load_n(&rx_engine.inflight, __ATOMIC_ACQUIRE) > 0 || (tx_engine.running && tx_engine.inflight > 0))
+		&& (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec < deadline );
+}
+
+/** give the parked buffers back to the chip, in their original order for the bulk-OUT ones **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_RESUME(void){
+	if( tx_engine.running ){
+		/** a producer holding the lock would otherwise submit a new buffer ahead of the parked ones **/
+		pthread_mutex_lock(&tx_engine.lock);
+		wd.recovering = FALSE;
+		for(int i = 0; i < RTL81XX_TX_URB_NUM; i++){
+			struct rtl_tx_agg *agg = NULL;
+
+			for(int j = 0; j < RTL81XX_TX_URB_NUM; j++){
+				if( tx_engine.agg[j].state == RTL81XX_URB_HELD && (agg == NULL || tx_engine.agg[j].submit_ns < agg->submit_ns) ){
+					agg = &tx_engine.agg[j];
+				}
+			}
+			if( agg == NULL ){
+				break;
+			}
+			RTL81XX_TX_SUBMIT(agg);
+			wd.stats.preserved++;
+		}
+		pthread_mutex_unlock(&tx_engine.lock);
+	}
+	wd.recovering = FALSE;
+	if( rx_engine.running ){
+		/** the endpoint works again, the errors before the recovery do not count **/
+		rx_engine.err_streak = 0;
+		rx_engine.parked_ns  = 0;
+		wd.stats.preserved  += RTL81XX_RX_RESUBMIT_IDLE();
+	}
+}
+
+/**
+ * RTL81XX_WD_RECOVER - run a recovery level, the traffic is stopped for its duration only
+ * @level: RTL81XX_WD_CLEAR_HALT, RTL81XX_WD_RESET or RTL81XX_WD_REINIT
+ *
+ * the bulk buffers survive every level; RTL81XX_WD_REINIT reads the
+ * registers of rtl_state_regs first and writes them back after the init,
+ * so the MTU, the MAC address and the filters stay as the host set them.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_RECOVER(unsigned int level){
+	__le32 regs[RTL81XX_STATE_REGS];
+	bool dirty[RTL81XX_STATE_REGS];
+	bool snapshot	 = FALSE;
+	bool failed	 = FALSE;
+
+	DEBUG_PRINTF("[%s][line %d] stall detected, recovery level %u\n", __FUNCTION__, __LINE__, level);
+	RTL81XX_WD_QUIESCE();
+	pthread_mutex_lock(&ocp_lock);
+	if( level >= RTL81XX_WD_REINIT ){
+		RTL81XX_STATE_XFER(regs, NULL);
+		snapshot = ( return_context >= 0 );
+		bringup.serial = TRUE;
+		RTL81XX_INIT();
+		RTL81XX_POST_INIT();
+		bringup.serial = FALSE;
+		if( snapshot ){
+			memset(dirty, TRUE, sizeof(dirty));
+			RTL81XX_STATE_XFER(regs, dirty);
+		}
+		/** the init wrote U1/U2, U2P3 and ALDPS behind the governors, their caches no longer match the chip **/
+		if( lpm.worker.running ){
+			bool u1u2 = lpm.u1u2;
+			bool u2p3 = lpm.u2p3;
+
+			lpm.u1u2 = !u1u2;
+			lpm.u2p3 = !u2p3;
+			RTL81XX_LPM_PROGRAM(u1u2, u2p3);
+		}
+		if( pwr.worker.running ){
+			unsigned long on = pwr.on;
+
+			pwr.on = RTL81XX_PWR_READ();
+			RTL81XX_PWR_PROGRAM(on);
+		}
+	}
+	if( level >= RTL81XX_WD_RESET ){
+		RTL81XX_NIC_RESET();
+		RTL81XX_RESET_BMU();
+		if( rx_engine.running ){
+			RTL81XX_RX_SET_AGGREGATION();
+		}
+		RTL81XX_ENABLE();
+		failed = ( return_context < 0 );
+	}
+	pthread_mutex_unlock(&ocp_lock);
+	/** the data toggles of the host and of the chip are both back to DATA0 **/
+	if( libusb_clear_halt(device_context->device_handler, RTL81XX_BULK_IN_EP) < 0 ||
+	    libusb_clear_halt(device_context->device_handler, RTL81XX_BULK_OUT_EP) < 0 ){
+		failed = TRUE;
+	}
+	RTL81XX_WD_RESUME();
+
+	wd.stats.recoveries[level]++;
+	wd.stats.failures += failed;
+	return_context = failed ? -ERROR_USB_TRANSFER_FAILED : NO_ERROR;
+}
+
+/** the level needed by what is seen now, 0 when everything is fine **/
+RTL81XX_DISABLE_INSTRUMENT static inline unsigned int RTL81XX_WD_CHECK(uint64_t now_ns){
+	unsigned int level = 0;
+	unsigned int halted = __atomic_load_n(&wd.halted, __ATOMIC_ACQUIRE);
+	uint64_t rx_errors  = rx_engine.rx_urb_errors;
+	uint64_t rx_packets = rx_engine.rx_packets;
+	bool tx_stall	    = FALSE;
+
+	if( halted ){
+		wd.stats.halts++;
+		level = RTL81XX_WD_CLEAR_HALT;
+	}
+	if( rx_engine.running && rx_errors - wd.last_rx_errors >= wd.cfg.rx_errors && rx_packets == wd.last_rx_packets ){
+		wd.stats.rx_stalls++;
+		level = RTL81XX_WD_CLEAR_HALT;
+	}
+	wd.last_rx_errors  = rx_errors;
+	wd.last_rx_packets = rx_packets;
+
+	if( tx_engine.running ){
+		pthread_mutex_lock(&tx_engine.lock);
+		for(int i = 0; i < RTL81XX_TX_URB_NUM; i++){
+			if( tx_engine.agg[i].state == RTL81XX_URB_QUEUED && now_ns - tx_engine.agg[i].submit_ns > wd.cfg.tx_timeout_ms * 1000000ULL ){
+				tx_stall = TRUE;
+			}
+		}
+		pthread_mutex_unlock(&tx_engine.lock);
+	}
+	if( tx_stall ){
+		wd.stats.tx_stalls++;
+		level = ( level > RTL81XX_WD_CLEAR_HALT ) ? level : RTL81XX_WD_CLEAR_HALT;
+		/** the endpoint is fine but the MCU does not drain its FIFO **/
+		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_TCR0 ) );
+		if( return_context >= 0 && !(return_context & TCR0_TX_EMPTY) ){
+			wd.stats.mcu_stalls++;
+			level = RTL81XX_WD_RESET;
+		}
+	}
+	if( wd.ctrl_failures >= wd.cfg.ctrl_failures ){
+		wd.stats.ctrl_stalls++;
+		level = RTL81XX_WD_REINIT;
+	}
+	return level;
+}
+
+/**
+ * a stall that comes back within settle_ms of a recovery escalates to the
+ * next level, RTL81XX_WD_REINIT is retried until it sticks.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_TICK(void){
+	struct timespec now = { 0 };
+
+	uint64_t now_ns	   = 0;
+	uint64_t end_ns	   = 0;
+	unsigned int level = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	level  = RTL81XX_WD_CHECK(now_ns);
+	if( level == 0 || !wd.worker.running ){
+		return;
+	}
+	if( wd.level != 0 && now_ns - wd.last_ns < wd.cfg.settle_ms * 1000000ULL && level <= wd.level ){
+		level = ( wd.level < RTL81XX_WD_REINIT ) ? wd.level + 1 : RTL81XX_WD_REINIT;
+	}
+	RTL81XX_WD_RECOVER(level);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	end_ns		   = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	wd.level	   = level;
+	wd.last_ns	   = end_ns;
+	wd.stats.outage_ns += end_ns - now_ns;
+	if( end_ns - now_ns > wd.stats.outage_max_ns ){
+		wd.stats.outage_max_ns = end_ns - now_ns;
+	}
+	/** the transfers were just resubmitted, errors of the recovery itself are not a new stall **/
+	wd.last_rx_errors  = rx_engine.rx_urb_errors;
+	wd.last_rx_packets = rx_engine.rx_packets;
+}
+
+/**
+ * RTL81XX_WD_START - watch the bulk endpoints, the MCU and the control path, this is the 'rtl_wd_start' callback
+ * @cfg: NULL, or zero fields, for the RTL81XX_WD_* defaults
+ *
+ * started after the bulk engines, RTL81XX_TEAR_DOWN stops it first.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_START(const struct rtl_wd_cfg *cfg){
+	struct rtl_wd_cfg def = { 0 };
+
+	if( wd.worker.running ){
+		return_context = NO_ERROR;
+		return;
+	}
+	if( cfg == NULL ){
+		cfg = &def;
+	}
+	wd.cfg.interval_ms   = ( cfg->interval_ms != 0 ) ? cfg->interval_ms : RTL81XX_WD_INTERVAL_MS;
+	wd.cfg.tx_timeout_ms = ( cfg->tx_timeout_ms != 0 ) ? cfg->tx_timeout_ms : RTL81XX_WD_TX_TIMEOUT_MS;
+	wd.cfg.rx_errors     = ( cfg->rx_errors != 0 ) ? cfg->rx_errors : RTL81XX_WD_RX_ERRORS;
+	wd.cfg.ctrl_failures = ( cfg->ctrl_failures != 0 ) ? cfg->ctrl_failures : RTL81XX_WD_CTRL_FAILURES;
+	wd.cfg.settle_ms     = ( cfg->settle_ms != 0 ) ? cfg->settle_ms : RTL81XX_WD_SETTLE_MS;
+
+	memset(&wd.stats, 0, sizeof(wd.stats));
+	wd.recovering	   = FALSE;
+	wd.halted	   = 0;
+	wd.ctrl_failures   = 0;
+	wd.level	   = 0;
+	wd.last_ns	   = 0;
+	wd.last_rx_errors  = rx_engine.rx_urb_errors;
+	wd.last_rx_packets = rx_engine.rx_packets;
+	RTL81XX_PERIODIC_START(&wd.worker, wd.cfg.interval_ms, RTL81XX_WD_TICK);
+}
+
+/** a recovery in progress is completed first, no buffer stays parked **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_STOP(void){
+	RTL81XX_PERIODIC_STOP(&wd.worker);
+	return_context = NO_ERROR;
+}
+
+/** 'rtl_wd_stats' callback **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_WD_STATS(struct rtl_wd_stats *stats){
+	if( stats == NULL ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	memcpy(stats, &wd.stats, sizeof(*stats));
+	return_context = NO_ERROR;
+}
+
+/** OVERLAPPED BRING-UP, PHY PATCHING AND MAC SETUP AS A DEPENDENCY GRAPH **/
+
+/**
+ * run the steps of @lane in table order, each one once its dependencies are
+ * finished. Every transfer takes ocp_lock on its own, so the other lane gets
+ * the control pipe whenever this one sleeps on the PHY.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_LANE(unsigned int lane){
+	struct timespec now = { 0 };
+
+	for(unsigned int i = 0; i < bringup.stats.count; i++){
+		const struct rtl_init_step *step = &bringup.steps[i];
+
+		if( lane != RTL81XX_LANE_ALL && step->lane != lane ){
+			continue;
+		}
+		pthread_mutex_lock(&bringup.lock);
+		while( (bringup.done & step->deps) != step->deps ){
+			pthread_cond_wait(&bringup.cond, &bringup.lock);
+		}
+		pthread_mutex_unlock(&bringup.lock);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		bringup.stats.start_ns[i] = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - bringup.base_ns;
+		return_context = NO_ERROR;
+		step->fn();
+		bringup.stats.status[i] = return_context;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		bringup.stats.end_ns[i] = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - bringup.base_ns;
+
+		pthread_mutex_lock(&bringup.lock);
+		bringup.done |= BIT(i);
+		pthread_cond_broadcast(&bringup.cond);
+		pthread_mutex_unlock(&bringup.lock);
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_BRINGUP_THREAD(void *arg){
+	RTL81XX_BRINGUP_LANE(RTL81XX_LANE_PHY);
+	return NULL;
+}
+
+/**
+ * walk back from the step that finished last: a step was held by whichever of
+ * its dependencies, or of the steps before it on its lane, finished last.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_CRITICAL(void){
+	const struct rtl_init_step *steps = bringup.steps;
+	struct rtl_bringup_stats *stats   = &bringup.stats;
+	int last			  = 0;
+
+	for(unsigned int i = 1; i < stats->count; i++){
+		if( stats->end_ns[i] > stats->end_ns[last] ){
+			last = i;
+		}
+	}
+	while( last >= 0 ){
+		int prev = -1;
+
+		stats->critical    |= BIT(last);
+		stats->critical_ns += stats->end_ns[last] - stats->start_ns[last];
+		for(int i = 0; i < last; i++){
+			bool held = ( steps[last].deps & BIT(i) ) || !stats->concurrent || steps[i].lane == steps[last].lane;
+			if( held && ( prev < 0 || stats->end_ns[i] > stats->end_ns[prev] ) ){
+				prev = i;
+			}
+		}
+		last = prev;
+	}
+}
+
+/**
+ * RTL81XX_BRINGUP_RUN - run an init table on two lanes
+ * @steps: in dependency order, see struct rtl_init_step
+ * @count: up to RTL81XX_BRINGUP_STEPS
+ *
+ * the PHY lane gets its own thread, the caller runs the MAC lane. Without the
+ * thread, or with bringup.serial set, the caller runs the table in order.
+ * return_context is the one left by the last step of the table.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_RUN(const struct rtl_init_step *steps, unsigned int count){
+	struct timespec now = { 0 };
+	pthread_t thread;
+	bool concurrent	    = FALSE;
+
+	if( steps == NULL || count == 0 || count > RTL81XX_BRINGUP_STEPS ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	for(unsigned int i = 0; i < count; i++){
+		if( steps[i].deps & ~(BIT(i) - 1) ){
+			return_context = -ERROR_INVALID_ARGS;
+			return;
+		}
+	}
+	memset(&bringup.stats, 0, sizeof(bringup.stats));
+	bringup.steps	    = steps;
+	bringup.stats.count = count;
+	bringup.done	    = 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	bringup.base_ns	    = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+	concurrent = !bringup.serial && pthread_create(&thread, NULL, RTL81XX_BRINGUP_THREAD, NULL) == 0;
+	bringup.stats.concurrent = concurrent;
+	RTL81XX_BRINGUP_LANE( concurrent ? RTL81XX_LANE_MAC : RTL81XX_LANE_ALL );
+	if( concurrent ){
+		pthread_join(thread, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	bringup.stats.total_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - bringup.base_ns;
+	for(unsigned int i = 0; i < count; i++){
+		bringup.stats.serial_ns += bringup.stats.end_ns[i] - bringup.stats.start_ns[i];
+	}
+	RTL81XX_BRINGUP_CRITICAL();
+
+	for(unsigned int i = 0; i < count; i++){
+		DEBUG_PRINTF("[%s] %c %-12s %s %8llu .. %8llu us, status %d\n", __FUNCTION__,
+			( bringup.stats.critical & BIT(i) ) ? '*' : ' ', steps[i].name,
+			( steps[i].lane == RTL81XX_LANE_PHY ) ? "phy" : "mac",
+			(unsigned long long)(bringup.stats.start_ns[i] / 1000), (unsigned long long)(bringup.stats.end_ns[i] / 1000),
+			bringup.stats.status[i]);
+	}
+	DEBUG_PRINTF("[%s] %llu us, %llu us in order, critical path %llu us%s\n", __FUNCTION__,
+		(unsigned long long)(bringup.stats.total_ns / 1000), (unsigned long long)(bringup.stats.serial_ns / 1000),
+		(unsigned long long)(bringup.stats.critical_ns / 1000), concurrent ? "" : " (single lane)");
+	return_context = bringup.stats.status[count - 1];
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRINGUP_STATS(struct rtl_bringup_stats *stats){
+	if( stats == NULL ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	memcpy(stats, &bringup.stats, sizeof(*stats));
+	return_context = NO_ERROR;
+}
+
+/** REGISTER SNAPSHOT, FAST RESTORE OF A RE-ENUMERATED ADAPTER **/
+
+/** called by libusb from the thread that is handling the events **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CTRL_COMPLETE(struct libusb_transfer *transfer){
+	struct rtl_ctrl_urb *urb = (struct rtl_ctrl_urb *)transfer->user_data;
+
+	if( transfer->status == LIBUSB_TRANSFER_COMPLETED ){
+		urb->req->status = transfer->actual_length;
+		if( urb->req->request_type == RTL8152_REQT_READ ){
+			memcpy(urb->req->data, libusb_control_transfer_get_data(transfer), transfer->actual_length);
+		}
+	}else{
+		urb->req->status = -ERROR_USB_TRANSFER_FAILED;
+	}
+	if( __atomic_sub_fetch(&urb->batch->pending, 1, __ATOMIC_ACQ_REL) == 0 ){
+		__atomic_store_n(&urb->batch->done, 1, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * RTL81XX_CTRL_BATCH - submit every request at once and wait for all of them
+ * @reqs:  run in order, the default control pipe does not reorder them
+ * @count: number of requests
+ *
+ * RTL81XX_MANIP_REG pays a full round trip for each register, here the host
+ * controller keeps the control pipe busy. A submit failure stops the batch,
+ * the requests after it keep a negative status. ocp_lock is held until the
+ * last completion so nobody switches the PHY page in the middle.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_CTRL_BATCH(struct rtl_ctrl_req *reqs, unsigned int count){
+	struct rtl_ctrl_batch batch = { .pending = 1, .done = 0 };
+	struct rtl_ctrl_urb *urbs   = NULL;
+	struct timeval tv	    = { 0 };
+	unsigned int failed	    = 0;
+
+	urbs = (struct rtl_ctrl_urb *)calloc(count, sizeof(*urbs));
+	if( urbs == NULL ){
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	for( unsigned int i = 0; i < count; i++ ){
+		reqs[i].status = -ERROR_USB_TRANSFER_FAILED;
+	}
+	pthread_mutex_lock(&ocp_lock);
+	for( unsigned int i = 0; i < count; i++ ){
+		unsigned char *buffer = NULL;
+
+		urbs[i].req	 = &reqs[i];
+		urbs[i].batch	 = &batch;
+		urbs[i].transfer = libusb_alloc_transfer(0);
+		buffer		 = (unsigned char *)malloc(LIBUSB_CONTROL_SETUP_SIZE + reqs[i].len);
+		if( urbs[i].transfer == NULL || buffer == NULL ){
+			free(buffer);
+			break;
+		}
+		libusb_fill_control_setup(buffer, reqs[i].request_type, ( reqs[i].request_type == RTL8152_REQT_READ ) ? RTL8152_REQ_GET_REGS : RTL8152_REQ_SET_REGS, reqs[i].value, reqs[i].index, reqs[i].len);
+		if( reqs[i].request_type == RTL8152_REQT_WRITE ){
+			memcpy(buffer + LIBUSB_CONTROL_SETUP_SIZE, reqs[i].data, reqs[i].len);
+		}
+		libusb_fill_control_transfer(urbs[i].transfer, device_context->device_handler, buffer, RTL81XX_CTRL_COMPLETE, &urbs[i], DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG);
+		urbs[i].transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+		__atomic_add_fetch(&batch.pending, 1, __ATOMIC_ACQ_REL);
+		if( libusb_submit_transfer(urbs[i].transfer) < 0 ){
+			__atomic_sub_fetch(&batch.pending, 1, __ATOMIC_ACQ_REL);
+			break;
+		}
+	}
+	/** drop the reference of the submit loop, the last completion raises batch.done **/
+	if( __atomic_sub_fetch(&batch.pending, 1, __ATOMIC_ACQ_REL) == 0 ){
+		__atomic_store_n(&batch.done, 1, __ATOMIC_RELEASE);
+	}
+	while( !__atomic_load_n(&batch.done, __ATOMIC_ACQUIRE) ){
+		tv.tv_sec  = 0;
+		tv.tv_usec = 100000;
+		RTL81XX_HANDLE_EVENTS(&tv, &batch.done);
+	}
+	pthread_mutex_unlock(&ocp_lock);
+
+	for( unsigned int i = 0; i < count; i++ ){
+		libusb_free_transfer(urbs[i].transfer);
+		if( reqs[i].status < 0 ){
+			failed++;
+		}
+	}
+	free(urbs);
+	return_context = ( failed == 0 ) ? NO_ERROR : -ERROR_USB_TRANSFER_FAILED;
+}
+
+/** a single control transfer through RTL81XX_CTRL_BATCH, the result of libusb_control_transfer is returned **/
+RTL81XX_DISABLE_INSTRUMENT static inline int RTL81XX_CTRL_XFER(uint8_t request_type, uint16_t value, uint16_t index, void *data, uint16_t len){
+	struct rtl_ctrl_req req = { .request_type = request_type, .value = value, .index = index, .len = len, .data = data };
+
+	RTL81XX_CTRL_BATCH(&req, 1);
+	return ( return_context == -ERROR_OUT_OF_MEMORY ) ? LIBUSB_ERROR_NO_MEM : req.status;
+}
+
+/** <RTL81XX_STATE_DIR>/rtl81xx-<vid>-<pid>-<serial>.state, FALSE when the adapter has no serial number **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_STATE_PATH(char *path, size_t size){
+	char serial[RTL81XX_SERIAL_LEN] = { 0 };
+	unsigned int len		= 0;
+	struct stat st;
+
+	/** the string comes from the device, keep only what is safe inside a file name **/
+	for( unsigned int i = 0; device_context->device_serial[i] != '\0' && i < sizeof(device_context->device_serial); i++ ){
+		if( isalnum(device_context->device_serial[i]) ){
+			serial[len++] = device_context->device_serial[i];
+		}
+	}
+	if( len == 0 || device_context->device_id == NULL ){
+		return FALSE;
+	}
+	/** whoever can write the directory can swap the snapshot, or plant a link where it is written **/
+	if( mkdir(RTL81XX_STATE_DIR, 0700) != 0 && errno != EEXIST ){
+		return FALSE;
+	}
+	if( lstat(RTL81XX_STATE_DIR, &st) != 0 || !RTL81XX_STATE_TRUSTED(&st, TRUE) ){
+		DEBUG_PRINTF("[%s][line %d] %s is not a private directory, no snapshot\n", __FUNCTION__, __LINE__, RTL81XX_STATE_DIR);
+		return FALSE;
+	}
+	snprintf(path, size, RTL81XX_STATE_DIR "/rtl81xx-%04x-%04x-%s.state", device_context->device_id->vid, device_context->device_id->pid, serial);
+	return TRUE;
+}
+
+/** owned by us, of the expected type, and nobody else may write it **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_STATE_TRUSTED(const struct stat *st, bool directory){
+	if( directory ? !S_ISDIR(st->st_mode) : !S_ISREG(st->st_mode) ){
+		return FALSE;
+	}
+	return st->st_uid == geteuid() && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+/**
+ * RTL81XX_STATE_XFER - move the dwords of rtl_state_regs in a single batch
+ * @values: one little endian dword per entry
+ * @dirty:  entries to program from @values, NULL reads every entry into @values
+ *
+ * the PHY entries go through the PLA_OCP_GPHY_BASE window like RTL81XX_OCP_REG_READ,
+ * the page switch is part of the batch and global_ocp_base follows it.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_XFER(__le32 *values, const bool *dirty){
+	/** a page switch per entry at worst, plus the two PLA_CRWECR writes **/
+	struct rtl_ctrl_req reqs[RTL81XX_STATE_REGS * 2 + 2];
+	__le32 pages[RTL81XX_STATE_REGS];
+	__le32 crwecr[2]   = { __cpu_to_le32(CRWECR_CONFIG), __cpu_to_le32(CRWECR_NORAML) };
+	uint16_t ocp_base  = 0;
+	unsigned int count = 0;
+	bool config	   = FALSE;
+
+	memset(reqs, 0, sizeof(reqs));
+	pthread_mutex_lock(&ocp_lock);
+	ocp_base = global_ocp_base;
+	for( unsigned int i = 0; i < RTL81XX_STATE_REGS; i++ ){
+		const struct rtl_state_reg *reg = &rtl_state_regs[i];
+		uint16_t addr			= reg->addr;
+		uint16_t byen			= reg->byen | (reg->byen << 4);
+
+		if( dirty != NULL && !dirty[i] ){
+			continue;
+		}
+		if( dirty != NULL && (reg->flags & RTL81XX_STATE_CONFIG) && !config ){
+			reqs[count++] = (struct rtl_ctrl_req){ .request_type = RTL8152_REQT_WRITE, .value = PLA_CRWECR, .index = MCU_TYPE_PLA | BYTE_EN_BYTE, .len = sizeof(crwecr[0]), .data = &crwecr[0] };
+			config	      = TRUE;
+		}
+		if( reg->flags & RTL81XX_STATE_PHY ){
+			if( (reg->addr & 0xf000) != ocp_base ){
+				ocp_base      = reg->addr & 0xf000;
+				pages[i]      = __cpu_to_le32(ocp_base);
+				reqs[count++] = (struct rtl_ctrl_req){ .request_type = RTL8152_REQT_WRITE, .value = PLA_OCP_GPHY_BASE, .index = MCU_TYPE_PLA | BYTE_EN_WORD, .len = sizeof(pages[i]), .data = &pages[i] };
+			}
+			addr = (reg->addr & 0x0fff) | 0xb000;
+		}
+		reqs[count++] = (struct rtl_ctrl_req){
+			.request_type = ( dirty == NULL ) ? RTL8152_REQT_READ : RTL8152_REQT_WRITE,
+			.value	      = addr,
+			/** the byte enables only mean something to a write, reads take the bare type **/
+			.index	      = ( dirty == NULL ) ? reg->type : reg->type | byen,
+			.len	      = sizeof(values[i]),
+			.data	      = &values[i],
+		};
+	}
+	if( config ){
+		reqs[count++] = (struct rtl_ctrl_req){ .request_type = RTL8152_REQT_WRITE, .value = PLA_CRWECR, .index = MCU_TYPE_PLA | BYTE_EN_BYTE, .len = sizeof(crwecr[1]), .data = &crwecr[1] };
+	}
+	RTL81XX_CTRL_BATCH(reqs, count);
+	/** even after a failure the page is whatever the batch selected last **/
+	global_ocp_base = ocp_base;
+	pthread_mutex_unlock(&ocp_lock);
+}
+
+/**
+ * RTL81XX_STATE_SAVE - snapshot the programmed registers, also the 'rtl_state_save' callback
+ *
+ * taken at the end of every bring-up, restored or not, and by RTL81XX_STATE_REFRESH
+ * after each host callback that changes the configuration, so a re-attach puts
+ * back what the host last programmed.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_SAVE(void){
+	char path[300]			  = { 0 };
+	char tmp_path[310]		  = { 0 };
+	struct rtl_state_hdr hdr	  = { 0 };
+	__le32 values[RTL81XX_STATE_REGS] = { 0 };
+	int fd				  = -1;
+	bool written			  = FALSE;
+
+	if( !RTL81XX_STATE_PATH(path, sizeof(path)) ){
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+	RTL81XX_STATE_XFER(values, NULL);
+	if( return_context < 0 ){
+		return;
+	}
+	hdr.magic    = RTL81XX_STATE_MAGIC;
+	hdr.format   = RTL81XX_STATE_FORMAT;
+	hdr.count    = RTL81XX_STATE_REGS;
+	hdr.vid	     = device_context->device_id->vid;
+	hdr.pid	     = device_context->device_id->pid;
+	hdr.version  = device_context->device_version_identifier;
+	hdr.mtu	     = device_context->device_mtu;
+	hdr.features = device_context->dev_flags.features;
+	hdr.crc	     = RTL81XX_ETHER_CRC((const uint8_t *)values, sizeof(values));
+
+	/** written aside and renamed, a crash never leaves a torn snapshot behind **/
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if( fd < 0 && errno == EEXIST ){
+		/** left by a crash between open and rename, the directory is ours so it is safe to drop **/
+		unlink(tmp_path);
+		fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	}
+	if( fd < 0 ){
+		DEBUG_PRINTF("[%s][line %d] failed to create %s\n", __FUNCTION__, __LINE__, tmp_path);
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+	written = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && write(fd, values, sizeof(values)) == sizeof(values);
+	close(fd);
+	if( !written || rename(tmp_path, path) != 0 ){
+		unlink(tmp_path);
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+	return_context = NO_ERROR;
+}
+
+/**
+ * RTL81XX_STATE_RESTORE - bring a re-enumerated adapter back from its snapshot
+ *
+ * only valid while the chip kept its power: the firmware, the PHY patches and
+ * whatever else the init sequence programmed are still in place. The current
+ * values are read in one batch and only the dwords that differ from the
+ * snapshot are written back, in a second one. NO_ERROR means RTL81XX_INIT
+ * can be skipped.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_RESTORE(void){
+	char path[300]			  = { 0 };
+	struct rtl_state_hdr hdr	  = { 0 };
+	__le32 saved[RTL81XX_STATE_REGS]  = { 0 };
+	__le32 values[RTL81XX_STATE_REGS] = { 0 };
+	bool dirty[RTL81XX_STATE_REGS]	  = { 0 };
+	unsigned int changed		  = 0;
+	int fd				  = -1;
+	bool valid			  = FALSE;
+	struct stat st;
+
+	if( !RTL81XX_STATE_PATH(path, sizeof(path)) ){
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if( fd < 0 ){
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+	valid = fstat(fd, &st) == 0 && RTL81XX_STATE_TRUSTED(&st, FALSE) &&
+		read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && read(fd, saved, sizeof(saved)) == sizeof(saved);
+	close(fd);
+	/** same adapter, same revision, and a table layout this build understands **/
+	if( !valid || hdr.magic != RTL81XX_STATE_MAGIC || hdr.format != RTL81XX_STATE_FORMAT || hdr.count != RTL81XX_STATE_REGS ||
+	    hdr.vid != device_context->device_id->vid || hdr.pid != device_context->device_id->pid ||
+	    hdr.version != device_context->device_version_identifier || hdr.mtu > device_context->device_max_mtu ||
+	    hdr.crc != RTL81XX_ETHER_CRC((const uint8_t *)saved, sizeof(saved)) ){
+		DEBUG_PRINTF("[%s][line %d] %s does not match the adapter\n", __FUNCTION__, __LINE__, path);
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+
+	/** a power cut wiped the firmware and the PHY patches, only the full init brings them back **/
+	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_MISC_0 ) );
+	if( return_context < 0 || (return_context & PCUT_STATUS) ){
+		return_context = -ERROR_STATE_UNAVAILABLE;
+		return;
+	}
+
+	RTL81XX_STATE_XFER(values, NULL);
+	if( return_context < 0 ){
+		return;
+	}
+	for( unsigned int i = 0; i < RTL81XX_STATE_REGS; i++ ){
+		uint32_t mask = 0;
+
+		for( unsigned int b = 0; b < 4; b++ ){
+			if( rtl_state_regs[i].byen & BIT(b) ){
+				mask |= 0xffU << (b * 8);
+			}
+		}
+		if( (__le32_to_cpu(values[i]) ^ __le32_to_cpu(saved[i])) & mask ){
+			dirty[i] = TRUE;
+			changed++;
+		}
+	}
+	if( changed != 0 ){
+		RTL81XX_STATE_XFER(saved, dirty);
+		if( return_context < 0 ){
+			return;
+		}
+	}
+	device_context->device_mtu	   = hdr.mtu;
+	device_context->dev_flags.features = hdr.features;
+	DEBUG_PRINTF("[%s] %s restored, %u of %zu registers programmed\n", __FUNCTION__, device_context->device_name, changed, RTL81XX_STATE_REGS);
+	return_context = NO_ERROR;
+}
+
+/** re-snapshot after a configuration change that succeeded, its return_context is kept: no snapshot is not an error for the caller **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_STATE_REFRESH(void){
+	signed int status = return_context;
+
+	if( status < 0 ){
+		return;
+	}
+	RTL81XX_STATE_SAVE();
+	return_context = status;
+}
+
+/** REGISTER SPACE DUMP, PIPELINED READS INTO A MAPPED FILE **/
+
+/** FIPS 180-4 **/
+static const uint32_t rtl_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define RTL81XX_SHA256_ROR(x, n)	( ((x) >> (n)) | ((x) << (32 - (n))) )
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_INIT(struct rtl_sha256 *sha){
+	static const uint32_t h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(sha->h, h, sizeof(h));
+	sha->bytes = 0;
+	sha->fill  = 0;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_BLOCK(struct rtl_sha256 *sha, const uint8_t *p){
+	uint32_t w[64] = { 0 };
+	uint32_t v[8]  = { 0 };
+
+	for(int i = 0; i < 16; i++){
+		w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) | ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+	}
+	for(int i = 16; i < 64; i++){
+		uint32_t s0 = RTL81XX_SHA256_ROR(w[i - 15], 7) ^ RTL81XX_SHA256_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = RTL81XX_SHA256_ROR(w[i - 2], 17) ^ RTL81XX_SHA256_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	memcpy(v, sha->h, sizeof(v));
+	for(int i = 0; i < 64; i++){
+		uint32_t s1 = RTL81XX_SHA256_ROR(v[4], 6) ^ RTL81XX_SHA256_ROR(v[4], 11) ^ RTL81XX_SHA256_ROR(v[4], 25);
+		uint32_t t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + rtl_sha256_k[i] + w[i];
+		uint32_t s0 = RTL81XX_SHA256_ROR(v[0], 2) ^ RTL81XX_SHA256_ROR(v[0], 13) ^ RTL81XX_SHA256_ROR(v[0], 22);
+		uint32_t t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+
+		v[7] = v[6];
+		v[6] = v[5];
+		v[5] = v[4];
+		v[4] = v[3] + t1;
+		v[3] = v[2];
+		v[2] = v[1];
+		v[1] = v[0];
+		v[0] = t1 + t2;
+	}
+	for(int i = 0; i < 8; i++){
+		sha->h[i] += v[i];
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_UPDATE(struct rtl_sha256 *sha, const uint8_t *data, size_t len){
+	sha->bytes += len;
+	while( len > 0 ){
+		if( sha->fill == 0 && len >= sizeof(sha->block) ){
+			RTL81XX_SHA256_BLOCK(sha, data);
+			data += sizeof(sha->block);
+			len  -= sizeof(sha->block);
+			continue;
+		}
+		size_t n = sizeof(sha->block) - sha->fill;
+		if( n > len ){
+			n = len;
+		}
+		memcpy(sha->block + sha->fill, data, n);
+		sha->fill += n;
+		data	  += n;
+		len	  -= n;
+		if( sha->fill == sizeof(sha->block) ){
+			RTL81XX_SHA256_BLOCK(sha, sha->block);
+			sha->fill = 0;
+		}
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SHA256_FINAL(struct rtl_sha256 *sha, uint8_t *digest){
+	uint64_t bits = sha->bytes * 8;
+
+	sha->block[sha->fill++] = 0x80;
+	if( sha->fill > sizeof(sha->block) - 8 ){
+		memset(sha->block + sha->fill, 0, sizeof(sha->block) - sha->fill);
+		RTL81XX_SHA256_BLOCK(sha, sha->block);
+		sha->fill = 0;
+	}
+	memset(sha->block + sha->fill, 0, sizeof(sha->block) - 8 - sha->fill);
+	for(int i = 0; i < 8; i++){
+		sha->block[sizeof(sha->block) - 1 - i] = (uint8_t)(bits >> (8 * i));
+	}
+	RTL81XX_SHA256_BLOCK(sha, sha->block);
+	for(int i = 0; i < 8; i++){
+		digest[4 * i]	  = (uint8_t)(sha->h[i] >> 24);
+		digest[4 * i + 1] = (uint8_t)(sha->h[i] >> 16);
+		digest[4 * i + 2] = (uint8_t)(sha->h[i] >> 8);
+		digest[4 * i + 3] = (uint8_t)sha->h[i];
+	}
+}
+
+/**
+ * RTL81XX_DUMP - copy register ranges of the chip into a file
+ * @path:     created or truncated, the ranges are stored back to back
+ * @ranges:   dword aligned, inside the 64 KiB of their MCU space
+ * @count:    number of ranges
+ * @progress: called after every window of reads, may be NULL
+ * @arg:      passed to @progress
+ * @result:   bytes, time and SHA-256 of the file, may be NULL
+ *
+ * the reads go out RTL81XX_DUMP_DEPTH at a time through RTL81XX_CTRL_BATCH and
+ * land straight in the mapping of the file, each window is hashed while it is
+ * still in the cache. The first failed read stops the dump, the file keeps
+ * what was read before it.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DUMP(const char *path, const struct rtl_dump_range *ranges, unsigned int count, rtl_dump_progress_t progress, void *arg, struct rtl_dump_result *result){
+	struct rtl_dump_result res = { 0 };
+	struct rtl_sha256 sha	   = { 0 };
+	struct rtl_ctrl_req *reqs  = NULL;
+	struct timespec now	   = { 0 };
+	unsigned char *map	   = NULL;
+	uint64_t start_ns	   = 0;
+	uint64_t total		   = 0;
+	uint64_t done		   = 0;
+	signed int ret		   = NO_ERROR;
+	int fd			   = -1;
+
+	if( path == NULL || ranges == NULL || count == 0 ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	for(unsigned int i = 0; i < count; i++){
+		if( ( ranges[i].type != MCU_TYPE_PLA && ranges[i].type != MCU_TYPE_USB ) || ranges[i].length == 0 ||
+		    ( ranges[i].start & 3 ) || ( ranges[i].length & 3 ) || (uint32_t)ranges[i].start + ranges[i].length > 0x10000 ){
+			return_context = -ERROR_INVALID_ARGS;
+			return;
+		}
+		total += ranges[i].length;
+	}
+	reqs = (struct rtl_ctrl_req *)calloc(RTL81XX_DUMP_DEPTH, sizeof(*reqs));
+	if( reqs == NULL ){
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	/** reserve the blocks now, a full disk must not turn into a SIGBUS inside the completions **/
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if( fd >= 0 && posix_fallocate(fd, 0, total) == 0 ){
+		map = (unsigned char *)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if( map == NULL || map == MAP_FAILED ){
+		DEBUG_PRINTF("[%s][line %d] failed to create %s\n", __FUNCTION__, __LINE__, path);
+		if( fd >= 0 ){
+			close(fd);
+		}
+		free(reqs);
+		return_context = -FAILED_TO_GET_DUMP;
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	start_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	RTL81XX_SHA256_INIT(&sha);
+
+	for(unsigned int r = 0; r < count && ret == NO_ERROR; r++){
+		uint32_t offset = 0;
+
+		while( offset < ranges[r].length ){
+			uint64_t window = done;
+			uint64_t pos	= done;
+			unsigned int n  = 0;
+
+			for(n = 0; n < RTL81XX_DUMP_DEPTH && offset < ranges[r].length; n++){
+				uint32_t len = ranges[r].length - offset;
+
+				if( len > RTL81XX_DUMP_CHUNK ){
+					len = RTL81XX_DUMP_CHUNK;
+				}
+				reqs[n].request_type = RTL8152_REQT_READ;
+				reqs[n].value	     = ranges[r].start + offset;
+				reqs[n].index	     = ranges[r].type;
+				reqs[n].len	     = len;
+				reqs[n].data	     = map + pos;
+				offset		    += len;
+				pos		    += len;
+			}
+			RTL81XX_CTRL_BATCH(reqs, n);
+			if( return_context == -ERROR_OUT_OF_MEMORY ){
+				ret = -ERROR_OUT_OF_MEMORY;
+				break;
+			}
+			/** the control pipe keeps the order, what follows a failed read is not trusted either **/
+			for(unsigned int i = 0; i < n; i++){
+				if( reqs[i].status != reqs[i].len ){
+					DEBUG_PRINTF("[%s][line %d] read of 0x%04x/0x%04x failed after %llu bytes\n", __FUNCTION__, __LINE__, reqs[i].value, reqs[i].index, (unsigned long long)done);
+					ret = -FAILED_TO_GET_DUMP;
+					break;
+				}
+				done += reqs[i].len;
+			}
+			RTL81XX_SHA256_UPDATE(&sha, map + window, done - window);
+			if( progress != NULL ){
+				progress(&ranges[r], done, total, arg);
+			}
+			if( ret != NO_ERROR ){
+				break;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	res.duration_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec - start_ns;
+	res.bytes	= done;
+	RTL81XX_SHA256_FINAL(&sha, res.sha256);
+	DEBUG_PRINTF("[%s] %s: %llu of %llu bytes in %llu us, sha256 ", __FUNCTION__, path, (unsigned long long)done, (unsigned long long)total, (unsigned long long)(res.duration_ns / 1000));
+	for(unsigned int i = 0; i < sizeof(res.sha256); i++){
+		DEBUG_PRINTF("%02x", res.sha256[i]);
+	}
+	DEBUG_PRINTF("\n");
+	if( result != NULL ){
+		memcpy(result, &res, sizeof(res));
+	}
+	munmap(map, total);
+	if( done < total && ftruncate(fd, done) != 0 ){
+		ret = -FAILED_TO_GET_DUMP;
+	}
+	close(fd);
+	free(reqs);
+	return_context = ret;
+}
+
+/** HOTPLUG DRIVEN DISCOVERY **/
+
+/** last entry whose (vid, pid, bcd_lo) is not above the key, then the bcdDevice range decides **/
+RTL81XX_DISABLE_INSTRUMENT static inline const struct rtl_usb_id *RTL81XX_ID_LOOKUP(uint16_t vid, uint16_t pid, uint16_t bcd){
+	const uint64_t key = RTL81XX_USB_ID_KEY(vid, pid, bcd);
+	size_t lo	   = 0;
+	size_t hi	   = sizeof(rtl_usb_ids) / sizeof(rtl_usb_ids[0]);
+	size_t mid	   = 0;
+
+	while( lo < hi ){
+		mid = lo + (hi - lo) / 2;
+		if( RTL81XX_USB_ID_KEY(rtl_usb_ids[mid].vid, rtl_usb_ids[mid].pid, rtl_usb_ids[mid].bcd_lo) <= key ){
+			lo = mid + 1;
+		}else{
+			hi = mid;
+		}
+	}
+	if( lo == 0 ){
+		return NULL;
+	}
+	if( rtl_usb_ids[lo - 1].vid != vid || rtl_usb_ids[lo - 1].pid != pid || bcd > rtl_usb_ids[lo - 1].bcd_hi ){
+		return NULL;
+	}
+	return &rtl_usb_ids[lo - 1];
+}
+
+/** the binary search above silently misses adapters when an entry is added out of order **/
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_ID_TABLE_SORTED(void){
+	for(size_t i = 1; i < sizeof(rtl_usb_ids) / sizeof(rtl_usb_ids[0]); i++){
+		const struct rtl_usb_id *prev = &rtl_usb_ids[i - 1];
+		const struct rtl_usb_id *cur  = &rtl_usb_ids[i];
+
+		if( RTL81XX_USB_ID_KEY(prev->vid, prev->pid, prev->bcd_lo) >= RTL81XX_USB_ID_KEY(cur->vid, cur->pid, cur->bcd_lo) ){
+			return FALSE;
+		}
+		if( prev->vid == cur->vid && prev->pid == cur->pid && prev->bcd_hi >= cur->bcd_lo ){
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/** NULL when the device is not one of ours **/
+RTL81XX_DISABLE_INSTRUMENT static inline const struct rtl_usb_id *RTL81XX_HOTPLUG_MATCH(libusb_device *dev){
+	struct libusb_device_descriptor desc = { 0 };
+
+	if( libusb_get_device_descriptor(dev, &desc) < 0 ){
+		return NULL;
+	}
+	return RTL81XX_ID_LOOKUP(desc.idVendor, desc.idProduct, desc.bcdDevice);
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HOTPLUG_QUEUE(libusb_device *dev, libusb_hotplug_event event){
+	pthread_mutex_lock(&hotplug.lock);
+	if( hotplug.tail - hotplug.head == RTL81XX_HOTPLUG_EVENTS ){
+		pthread_mutex_unlock(&hotplug.lock);
+		DEBUG_PRINTF("[%s][line %d] event queue full, dropping event %d\n", __FUNCTION__, __LINE__, event);
+		return;
+	}
+	hotplug.queue[hotplug.tail % RTL81XX_HOTPLUG_EVENTS].dev   = libusb_ref_device(dev);
+	hotplug.queue[hotplug.tail % RTL81XX_HOTPLUG_EVENTS].event = event;
+	hotplug.tail++;
+	pthread_cond_broadcast(&hotplug.cond);
+	pthread_mutex_unlock(&hotplug.lock);
+}
+
+/** called from libusb_handle_events, only the descriptor is read here and the rest is left to the worker **/
+RTL81XX_DISABLE_INSTRUMENT static int LIBUSB_CALL RTL81XX_HOTPLUG_CALLBACK(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data){
+	if( event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED && RTL81XX_HOTPLUG_MATCH(dev) == NULL ){
+		return 0;
+	}
+	RTL81XX_HOTPLUG_QUEUE(dev, event);
+	/** stay registered **/
+	return 0;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_HOTPLUG_EVENT_THREAD(void *arg){
+	struct timeval tv = { 0 };
+
+	while( hotplug.running ){
+		if( RTL81XX_EVENTS_OWNED() ){
+			/** the hotplug callback is called by the RX completion thread in the meantime **/
+			pthread_mutex_lock(&hotplug.lock);
+			while( hotplug.running && RTL81XX_EVENTS_OWNED() ){
+				pthread_cond_wait(&hotplug.cond, &hotplug.lock);
+			}
+			pthread_mutex_unlock(&hotplug.lock);
+			continue;
+		}
+		tv.tv_sec  = 0;
+		tv.tv_usec = RTL81XX_HOTPLUG_POLL_MS * 1000;
+		libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+	}
+	return NULL;
+}
+
+/** 'rtl8152_probe' on attach and 'rtl8152_disconnect' on detach, one adapter is serviced at a time **/
+RTL81XX_DISABLE_INSTRUMENT static inline void *RTL81XX_HOTPLUG_WORKER_THREAD(void *arg){
+	struct rtl_hotplug_event ev = { 0 };
+	const struct rtl_usb_id *id = NULL;
+
+	for(;;){
+		pthread_mutex_lock(&hotplug.lock);
+		while( hotplug.running && hotplug.head == hotplug.tail ){
+			pthread_cond_wait(&hotplug.cond, &hotplug.lock);
+		}
+		if( !hotplug.running ){
+			pthread_mutex_unlock(&hotplug.lock);
+			break;
+		}
+		ev = hotplug.queue[hotplug.head % RTL81XX_HOTPLUG_EVENTS];
+		hotplug.head++;
+		pthread_mutex_unlock(&hotplug.lock);
+
+		if( ev.event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED ){
+			id = RTL81XX_HOTPLUG_MATCH(ev.dev);
+			if( hotplug.active != NULL || id == NULL ){
+				DEBUG_PRINTF("[%s][line %d] an adapter is already in use, ignoring the new one\n", __FUNCTION__, __LINE__);
+			}else{
+				RTL81XX_BRING_UP(ev.dev, id);
+				if( return_context >= 0 ){
+					pthread_mutex_lock(&hotplug.lock);
+					hotplug.active = libusb_ref_device(ev.dev);
+					hotplug.attached++;
+					pthread_cond_broadcast(&hotplug.cond);
+					pthread_mutex_unlock(&hotplug.lock);
+				}else{
+					RTL81XX_TEAR_DOWN();
+				}
+			}
+		}else if( ev.dev == hotplug.active ){
+			DEBUG_PRINTF("[!] %s has been unplugged!\n", device_context->device_name);
+			RTL81XX_TEAR_DOWN();
+			pthread_mutex_lock(&hotplug.lock);
+			libusb_unref_device(hotplug.active);
+			hotplug.active = NULL;
+			hotplug.detached++;
+			pthread_cond_broadcast(&hotplug.cond);
+			pthread_mutex_unlock(&hotplug.lock);
+		}
+		libusb_unref_device(ev.dev);
+	}
+	return NULL;
+}
+
+/** open the adapter and reproduce the driver's init sequence **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BRING_UP(libusb_device *dev, const struct rtl_usb_id *id){
+	struct libusb_device_handle *handle = NULL;
+	struct libusb_device_descriptor desc;
+
+	__atomic_store_n(&device_ready, FALSE, __ATOMIC_RELEASE);
+	if( libusb_open(dev, &handle) < 0 ){
+		DEBUG_PRINTF("[%s][line %d] failed to open %s\n", __FUNCTION__, __LINE__, RTL81XX_LIST[id->device].device_name);
+		return_context = -ERROR_DEV_NOT_FOUND;
+		return;
+	}
+	RTL81XX_LIST[id->device].device_handler = handle;
+	// set the device context
+	device_context			  = &RTL81XX_LIST[id->device];
+	device_context->device_id	  = id;
+	device_context->device_cb	  = id->ops;
+	device_context->dev_flags.quirks = id->quirks;
+	DEBUG_PRINTF("[!] found a new device: %s!\n", device_context->device_name);
+	/** names the register snapshot of the adapter **/
+	device_context->device_serial[0] = '\0';
+	if( libusb_get_device_descriptor(dev, &desc) == 0 && desc.iSerialNumber != 0 ){
+		if( libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, device_context->device_serial, sizeof(device_context->device_serial)) < 0 ){
+			device_context->device_serial[0] = '\0';
+		}
+	}
 
-							for (short i = 0; i < DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG; i++) {
-								DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_POL_GPIO_CTRL ) );
-								ocp_data = return_context;
-								if (!(ocp_data) & POL_GPHY_PATCH){
-									break;
-								}
-							}
-						}
-						/** reset the global_ocp_base offset **/
-                                                global_ocp_base = -1;
-						RTL81XX_PHY_PATCH_REQUEST(false, wait);
-					}
-				break;
-				default:
-					/** DO NOTHING **/
-				break;
-			}
-		i += ALIGN(__le32_to_cpu(block->length), 8);
+	RTL81XX_GET_HW_VERSION();
+	if( return_context < 0 ){
+		/** no device_chip, the caller tears the half opened adapter down **/
+		return;
+	}
+	/** find out if we can use WoWlan feature **/
+	RTL81XX_GET_WOWLAN();
+	RTL81XX_ASSIGN_MTU();
+	/** rtl_ops_init defaults, 'rtl_set_eee' changes them **/
+	memset(&eee, 0, sizeof(eee));
+	eee.cmd				  = ETHTOOL_GEEE;
+	eee.eee_enabled			  = ( device_context->device_chip->eee != RTL81XX_EEE_NONE );
+	device_context->device_eee	  = &eee;
+	device_context->dev_flags.eee_adv  = ( device_context->device_chip->eee == RTL81XX_EEE_R8152 ) ? MDIO_EEE_100TX : MDIO_EEE_1000T | MDIO_EEE_100TX;
+	device_context->dev_flags.eee_adv2 = ( device_context->device_chip->eee == RTL81XX_EEE_R8156 ) ? MDIO_EEE_2_5GT : 0;
+	RTL81XX_PKT_SLAB_INIT();
+	if( return_context < 0 ){
+		return;
+	}
+	/** re-attached without a power cut, only the registers that drifted are programmed **/
+	RTL81XX_STATE_RESTORE();
+	if( return_context == NO_ERROR ){
+		RTL81XX_SELECT_OPS();
+		if( device_context->device_cb->rtl_resume != NULL ){
+			device_context->device_cb->rtl_resume();
 		}
-	post_fw:
-		if( device_context->device_firmware->device_post_fw_loading != NULL ){
-			device_context->device_firmware->device_post_fw_loading();
-		}else{
-			DEBUG_PRINTF("[!] device_post_fw_loading is disabled!\n");
+		/** the resume programs registers of its own, the snapshot follows what the chip has now **/
+		RTL81XX_STATE_SAVE();
+		__atomic_store_n(&device_ready, TRUE, __ATOMIC_RELEASE);
+		return_context = NO_ERROR;
+		return;
+	}
+	RTL81XX_INIT();
+	RTL81XX_POST_INIT();
+	RTL81XX_STATE_SAVE();
+	/** the callbacks may run from now on, not alongside the init sequence **/
+	__atomic_store_n(&device_ready, TRUE, __ATOMIC_RELEASE);
+	return_context = NO_ERROR;
+}
+
+/**
+ * RTL81XX_DEVICE_GET - pin the adapter for the length of an operation
+ *
+ * FALSE, with return_context at -ERROR_DEV_NOT_FOUND, when there is none, it
+ * is still being brought up or RTL81XX_TEAR_DOWN started. Nests, every TRUE
+ * needs its RTL81XX_DEVICE_PUT.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline bool RTL81XX_DEVICE_GET(void){
+	/**
+	 * never blocks on the teardown: a consumer called from a thread it joins
+	 * would wait for it forever. The lock is only busy while device_gone is set.
+	 */
+	while( pthread_rwlock_tryrdlock(&device_lock) != 0 ){
+		if( __atomic_load_n(&device_gone, __ATOMIC_ACQUIRE) ){
+			return_context = -ERROR_DEV_NOT_FOUND;
+			return FALSE;
 		}
-		//strncpy(rtl_fw->version, fw_hdr->version, RTL_VER_SIZE);
-	        /** reset the global_ocp_base offset **/
-                global_ocp_base = -1;
+		sched_yield();
+	}
+	/** RTL81XX_BRING_UP has not finished with the adapter yet **/
+	if( device_context == NULL || !__atomic_load_n(&device_ready, __ATOMIC_ACQUIRE) || __atomic_load_n(&device_gone, __ATOMIC_ACQUIRE) ){
+		pthread_rwlock_unlock(&device_lock);
+		return_context = -ERROR_DEV_NOT_FOUND;
+		return FALSE;
 	}
+	return TRUE;
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DEVICE_PUT(void){
+	pthread_rwlock_unlock(&device_lock);
 }
 
-RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DO_TRANSMIT(void *tx_buf, unsigned int tx_len){
+/**
+ * stop everything that still talks to the adapter and drop the handle, also used after an unplug
+ *
+ * the callbacks fail from the moment device_gone is set, the ones in flight
+ * are waited for before the threads are stopped and the handle is closed.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_TEAR_DOWN(void){
+	if( device_context == NULL ){
+		return;
+	}
+	__atomic_store_n(&device_gone, TRUE, __ATOMIC_RELEASE);
+	pthread_rwlock_wrlock(&device_lock);
+	__atomic_store_n(&device_ready, FALSE, __ATOMIC_RELEASE);
+	RTL81XX_WD_STOP();
+	RTL81XX_FC_STOP();
+	RTL81XX_LPM_STOP();
+	RTL81XX_PWR_STOP();
+	RTL81XX_TALLY_STOP();
+	RTL81XX_XSK_UNBIND();
+	RTL81XX_CAPTURE_STOP();
+	RTL81XX_RSS_STOP();
+	RTL81XX_TX_STOP();
+	RTL81XX_RX_STOP();
+	RTL81XX_SLAB_DESTROY(&pkt_slab);
+	if( data_intf_claimed ){
+		libusb_release_interface(device_context->device_handler, 0);
+		data_intf_claimed = FALSE;
+	}
+	libusb_close(device_context->device_handler);
+	if( device_context->device_firmware != NULL ){
+		free(device_context->device_firmware->device_fw_blob_name);
+		free(device_context->device_firmware);
+		device_context->device_firmware = NULL;
+	}
+	device_context->device_handler = NULL;
+	device_context->device_chip    = NULL;
+	device_context		       = NULL;
+	__atomic_store_n(&device_gone, FALSE, __ATOMIC_RELEASE);
+	pthread_rwlock_unlock(&device_lock);
+}
 
+/**
+ * RTL81XX_HOTPLUG_WAIT - wait until an adapter has been brought up, this is the 'rtl_wait_device' callback
+ * @timeout_ms: 0 waits forever
+ *
+ * return_context is -ERROR_OUT_OF_TIME when nothing has been plugged in time.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HOTPLUG_WAIT(unsigned int timeout_ms){
+	struct timespec deadline = { 0 };
+	int ret			 = 0;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec  += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if( deadline.tv_nsec >= 1000000000L ){
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&hotplug.lock);
+	while( hotplug.active == NULL && ret == 0 ){
+		if( timeout_ms == 0 ){
+			ret = pthread_cond_wait(&hotplug.cond, &hotplug.lock);
+		}else{
+			ret = pthread_cond_timedwait(&hotplug.cond, &hotplug.lock, &deadline);
+		}
+	}
+	return_context = ( hotplug.active != NULL ) ? NO_ERROR : -ERROR_OUT_OF_TIME;
+	pthread_mutex_unlock(&hotplug.lock);
+}
 
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_HOTPLUG_STOP(void){
+	if( !hotplug.running ){
+		return;
+	}
+	if( hotplug.registered ){
+		libusb_hotplug_deregister_callback(NULL, hotplug.handle);
+		hotplug.registered = FALSE;
+	}
+	pthread_mutex_lock(&hotplug.lock);
+	hotplug.running = FALSE;
+	pthread_cond_broadcast(&hotplug.cond);
+	pthread_mutex_unlock(&hotplug.lock);
+	pthread_join(hotplug.event_thread, NULL);
+	pthread_join(hotplug.worker_thread, NULL);
+	/** events nobody got to **/
+	while( hotplug.head != hotplug.tail ){
+		libusb_unref_device(hotplug.queue[hotplug.head % RTL81XX_HOTPLUG_EVENTS].dev);
+		hotplug.head++;
+	}
 }
 
 /** MAIN DETECTION ROUTINE, IT WILL BE MERGED IN THE GENERIC SUBSYSTEM USB INTERFACE SOON! **/
+/** this is 'rtl8152_probe_once': the bus is enumerated a single time, then attach/detach events bring the adapter up and down **/
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_INITIALIZE_USB_INTERFACE(void){
+	libusb_device **list	    = NULL;
+	ssize_t count		    = 0;
+	const struct rtl_usb_id *id = NULL;
+
+	if( !RTL81XX_ID_TABLE_SORTED() ){
+		DEBUG_PRINTF("[%s][line %d] rtl_usb_ids is not sorted by vid, pid and bcd_lo, or two ranges overlap\n", __FUNCTION__, __LINE__);
+		exit(-ERROR_INVALID_ARGS);
+	}
 	libusb_init(NULL);
-        struct libusb_device_handle *dev = NULL;
-	for(short j = 0; j < TIMING_COUNTER; j++){
-		for(int z = 0; RTL81XX_LIST[z].device_name != NULL; z++){
-			dev = libusb_open_device_with_vid_pid(NULL, RTL81XX_LIST[z].device_pid, RTL81XX_LIST[z].device_vid);
-			if( dev != NULL ){
-				RTL81XX_LIST[z].device_handler = dev;
-				// set the device context
-				device_context = &RTL81XX_LIST[z];
-                                DEBUG_PRINTF("[!] found a new device: %s!\n", device_context->device_name);
-				return;
-			}
-			if( RTL81XX_LIST[z + 1].device_name == NULL ){
-				z -= z;
+	if( !libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) ){
+		/** no hotplug support on this platform, a single pass over the bus **/
+		count = libusb_get_device_list(NULL, &list);
+		for(ssize_t i = 0; i < count; i++){
+			id = RTL81XX_HOTPLUG_MATCH(list[i]);
+			if( id != NULL ){
+				RTL81XX_BRING_UP(list[i], id);
+				if( return_context < 0 ){
+					RTL81XX_TEAR_DOWN();
+				}
+				break;
 			}
 		}
+		libusb_free_device_list(list, 1);
+		if( device_context == NULL ){
+			DEBUG_PRINTF("[!] failed to search for a new device!\n");
+			exit(-ERROR_DEV_NOT_FOUND);
+		}
+		return;
+	}
+
+	hotplug.running = TRUE;
+	if( pthread_create(&hotplug.worker_thread, NULL, RTL81XX_HOTPLUG_WORKER_THREAD, NULL) != 0 ){
+		hotplug.running = FALSE;
+		DEBUG_PRINTF("[%s][line %d] failed to start the hotplug worker\n", __FUNCTION__, __LINE__);
+		exit(-ERROR_DEV_NOT_FOUND);
+	}
+	/** LIBUSB_HOTPLUG_ENUMERATE reports the adapters already plugged as arrivals, this is the only enumeration **/
+	if( libusb_hotplug_register_callback(NULL,
+					LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+					LIBUSB_HOTPLUG_ENUMERATE,
+					LIBUSB_HOTPLUG_MATCH_ANY,
+					LIBUSB_HOTPLUG_MATCH_ANY,
+					LIBUSB_HOTPLUG_MATCH_ANY,
+					RTL81XX_HOTPLUG_CALLBACK,
+					NULL,
+					&hotplug.handle) == LIBUSB_SUCCESS ){
+		hotplug.registered = TRUE;
+	}
+	if( !hotplug.registered || pthread_create(&hotplug.event_thread, NULL, RTL81XX_HOTPLUG_EVENT_THREAD, NULL) != 0 ){
+		if( hotplug.registered ){
+			libusb_hotplug_deregister_callback(NULL, hotplug.handle);
+			hotplug.registered = FALSE;
+		}
+		pthread_mutex_lock(&hotplug.lock);
+		hotplug.running = FALSE;
+		pthread_cond_broadcast(&hotplug.cond);
+		pthread_mutex_unlock(&hotplug.lock);
+		pthread_join(hotplug.worker_thread, NULL);
+		DEBUG_PRINTF("[%s][line %d] failed to register for hotplug events\n", __FUNCTION__, __LINE__);
+		exit(-ERROR_DEV_NOT_FOUND);
+	}
 
-		sleep(TIMING_COUNTER / TIMING_COUNTER);
+	/** the standalone tools need an adapter to start with, once up the process survives the unplugs **/
+	RTL81XX_HOTPLUG_WAIT(TIMING_COUNTER * 1000);
+	if( return_context < 0 ){
+		DEBUG_PRINTF("[!] failed to search for a new device!\n");
+		exit(-ERROR_DEV_NOT_FOUND);
 	}
-	DEBUG_PRINTF("[!] failed to search for a new device!\n");
-	exit(-ERROR_DEV_NOT_FOUND);
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_GET_HW_VERSION(void){
         __le32 *version_buffer = malloc(sizeof(*version_buffer));
         memset(version_buffer, 0x00, sizeof(*version_buffer));
+	device_context->device_version_identifier = RTL_VER_UNKNOWN;
+	device_context->device_chip		   = NULL;
+	return_context				   = NO_ERROR;
         if( libusb_control_transfer(
                                 device_context->device_handler,
                                 RTL8152_REQT_READ,
@@ -1846,54 +8705,81 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_GET_HW_VERSION(void){
 			break;
 			default:
 				device_context->device_version_identifier = RTL_VER_UNKNOWN;
-				if( device_context->device_version_identifier = RTL_VER_UNKNOWN ){
-					exit(-ERROR_FAILED_TO_READ_HW_VERSION);
-				}
 			break;
 	}
-			DEBUG_PRINTF("[!] THE IDENTIFIED ADAPTER VERSION IS %d\n", ocp_data);
+		}
+		if( device_context->device_version_identifier == RTL_VER_UNKNOWN ){
+			/** rtl_chips[RTL_VER_UNKNOWN] has no callbacks, the caller must not go on **/
+			DEBUG_PRINTF("[!] UNSUPPORTED ADAPTER VERSION %x\n", ocp_data);
+			return_context = -ERROR_FAILED_TO_READ_HW_VERSION;
+		}else{
+			/** everything depending on the revision comes from here on **/
+			device_context->device_chip = &rtl_chips[device_context->device_version_identifier];
+			DEBUG_PRINTF("[!] THE IDENTIFIED ADAPTER VERSION IS %d (%s)\n", ocp_data, device_context->device_chip->name);
 		}
 	}else{
-			device_context->device_version_identifier = ERROR_FAILED_TO_IDENTIFY_ADAPTER;
-			if( device_context->device_version_identifier == ERROR_FAILED_TO_IDENTIFY_ADAPTER ){
-				DEBUG_PRINTF("[!] FAILED...\n");
-				exit(-ERROR_FAILED_TO_IDENTIFY_ADAPTER);
-			}
+			DEBUG_PRINTF("[!] FAILED...\n");
+			return_context = -ERROR_FAILED_TO_IDENTIFY_ADAPTER;
 	}
 	free(version_buffer);
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ASSIGN_MTU(void){
-	switch(device_context->device_version_identifier){
-		case RTL_VER_03:
-		case RTL_VER_04:
-		case RTL_VER_05:
-		case RTL_VER_06:
-		case RTL_VER_08:
-		case RTL_VER_09:
-		case RTL_VER_14:
-			device_context->device_max_mtu = size_to_mtu(9 * 1024);
-		break;
-		case RTL_VER_10:
-		case RTL_VER_11:
-			device_context->device_max_mtu = size_to_mtu(15 * 1024);
-		break;
-		case RTL_VER_12:
-		case RTL_VER_13:
-		case RTL_VER_15:
-			device_context->device_max_mtu = size_to_mtu(16 * 1024);
-		break;
-		case RTL_VER_01:
-		case RTL_VER_02:
-		case RTL_VER_07:
-		default:
-			device_context->device_max_mtu = ETH_DATA_LEN;
-		break;
+	device_context->device_max_mtu = device_context->device_chip->max_mtu;
+	device_context->device_mtu = device_context->device_max_mtu;
+}
+
+/**
+ * RTL81XX_SET_MTU - change the MTU of a live link, this is the 'rtl_set_mtu' callback
+ * @mtu: between ETH_MIN_MTU and device_max_mtu
+ *
+ * static int rtl8152_change_mtu(struct net_device *dev, int new_mtu)
+ *
+ * the bulk-IN/OUT and packet buffers are always sized for device_max_mtu, so
+ * nothing is reallocated: the receive path is gated at the chip, the bulk-OUT
+ * transfers are drained with new frames held back, then the size registers,
+ * the FIFO thresholds and the RX aggregation are programmed again.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_MTU(unsigned int mtu){
+	if( mtu < ETH_MIN_MTU || mtu > device_context->device_max_mtu ){
+		return_context = -ERROR_INVALID_ARGS;
+		return;
+	}
+	if( mtu == device_context->device_mtu ){
+		return_context = NO_ERROR;
+		return;
+	}
+
+	/** static void rxdy_gated_en(struct r8152 *tp, bool enable) **/
+	DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_MISC_1, 2, RXDY_GATED_EN ) );
+
+	if( tx_engine.running ){
+		pthread_mutex_lock(&tx_engine.lock);
+		RTL81XX_TX_FLUSH_LOCKED();
+		while( tx_engine.inflight > 0 ){
+			pthread_cond_wait(&tx_engine.free_cond, &tx_engine.lock);
+		}
+	}
+
+	/** the flow control thread reprograms the same FIFO thresholds **/
+	pthread_mutex_lock(&ocp_lock);
+	device_context->device_mtu = mtu;
+	fc.pause_on		   = 0;
+	device_context->device_chip->change_mtu();
+	pthread_mutex_unlock(&ocp_lock);
+	if( rx_engine.running ){
+		RTL81XX_RX_SET_AGGREGATION();
 	}
+
+	if( tx_engine.running ){
+		pthread_mutex_unlock(&tx_engine.lock);
+	}
+	DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_MISC_1, 2, RXDY_GATED_EN ) );
+	DEBUG_PRINTF("[%s] MTU set to %u\n", __FUNCTION__, mtu);
+	return_context = NO_ERROR;
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ENABLE_GREEN_FEATURE(bool enable){
-	uint16_t data = 0;
 	if( enable == TRUE ){
 		DEBUG_RTL81XX( RTL81XX_OCP_IO_SRAM( RTL81XX_OPTYPE_WRITE, 0x8045, 0 ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_IO_SRAM( RTL81XX_OPTYPE_WRITE, 0x804d, 0x1222 ) );
@@ -1903,7 +8789,15 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ENABLE_GREEN_FEATURE(bool
 		DEBUG_RTL81XX( RTL81XX_OCP_IO_SRAM( RTL81XX_OPTYPE_WRITE, 0x804D, 0x2444 ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_IO_SRAM( RTL81XX_OPTYPE_WRITE, 0x805d, 0x2444 ) );
 	}
-	/** static void rtl_green_en(struct r8152 *tp, bool enable) **/
+	RTL81XX_GREEN_EN(enable);
+}
+
+/** static void rtl_green_en(struct r8152 *tp, bool enable) **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_GREEN_EN(bool enable){
+	uint16_t data = 0;
+
+	/** the power policy thread switches it too **/
+	pthread_mutex_lock(&ocp_lock);
 	DEBUG_RTL81XX( RTL81XX_OCP_IO_SRAM( RTL81XX_OPTYPE_READ, SRAM_GREEN_CFG, 0 ) );
 	data = return_context;
 	if( enable ){
@@ -1912,9 +8806,148 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ENABLE_GREEN_FEATURE(bool
 		data &= ~GREEN_ETH_EN;
 	}
 	DEBUG_RTL81XX( RTL81XX_OCP_IO_SRAM( RTL81XX_OPTYPE_WRITE, SRAM_GREEN_CFG, data ) );
+	pthread_mutex_unlock(&ocp_lock);
+}
+
+/**
+ * RTL81XX_EEE_ENABLE - rtl_eee_enable of the kernel, for every EEE style
+ * @enable: TRUE advertises dev_flags.eee_adv (and eee_adv2 on the RTL8156),
+ *	    FALSE withdraws the advertisement and switches LPI off
+ *
+ * the link partner sees the new advertisement after the next nway only.
+ */
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_EEE_ENABLE(bool enable){
+	uint32_t ocp_data = 0;
+
+	/** PLA_EEE_CR is switched by the power policy thread as well **/
+	pthread_mutex_lock(&ocp_lock);
+	switch( device_context->device_chip->eee ){
+		case RTL81XX_EEE_R8152:
+			/** static void r8152_eee_en(struct r8152 *tp, bool enable) **/
+			{
+				uint16_t config1 = 0;
+				uint16_t config2 = 0;
+				uint16_t config3 = 0;
+
+				DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
+				ocp_data = return_context;
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG1 ) );
+				config1 = return_context & ~sd_rise_time_mask;
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG2 ) );
+				config2 = return_context;
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG3 ) );
+				config3 = return_context & ~fast_snr_mask;
+
+				if( enable ){
+					ocp_data |= EEE_RX_EN | EEE_TX_EN;
+					config1  |= EEE_10_CAP | EEE_NWAY_EN | TX_QUIET_EN | RX_QUIET_EN;
+					config1  |= sd_rise_time(1);
+					config2  |= RG_DACQUIET_EN | RG_LDVQUIET_EN;
+					config3  |= fast_snr(42);
+				}else{
+					ocp_data &= ~(EEE_RX_EN | EEE_TX_EN);
+					config1  &= ~(EEE_10_CAP | EEE_NWAY_EN | TX_QUIET_EN | RX_QUIET_EN);
+					config1  |= sd_rise_time(7);
+					config2  &= ~(RG_DACQUIET_EN | RG_LDVQUIET_EN);
+					config3  |= fast_snr(511);
+				}
+				DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG1, config1 ) );
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG2, config2 ) );
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG3, config3 ) );
+			}
+			/** static void r8152_mmd_write(struct r8152 *tp, u16 dev, u16 reg, u16 data) **/
+			{
+				/** static inline void r8152_mmd_indirect(struct r8152 *tp, u16 dev, u16 reg) **/
+				{
+					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, FUN_ADDR | MDIO_MMD_AN ) );
+					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_DATA, MDIO_AN_EEE_ADV ) );
+					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, FUN_DATA | MDIO_MMD_AN ) );
+				}
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_DATA, enable ? device_context->dev_flags.eee_adv : 0 ) );
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, 0x0000 ) );
+			}
+		break;
+		case RTL81XX_EEE_R8153:
+		case RTL81XX_EEE_R8156:
+			/** static void r8153_eee_en(struct r8152 *tp, bool enable) **/
+			{
+				uint16_t config = 0;
+
+				DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
+				ocp_data = return_context;
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CFG ) );
+				config = return_context;
+				if( enable ){
+					ocp_data |= EEE_RX_EN | EEE_TX_EN;
+					config	 |= EEE10_EN;
+				}else{
+					ocp_data &= ~(EEE_RX_EN | EEE_TX_EN);
+					config	 &= ~EEE10_EN;
+				}
+				DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CFG, config ) );
+			}
+			if( device_context->device_chip->eee == RTL81XX_EEE_R8156 ){
+				/** static void r8156_eee_en(struct r8152 *tp, bool enable) **/
+				uint16_t config = 0;
+
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_ADV2 ) );
+				config = return_context;
+				if( enable && (device_context->dev_flags.eee_adv2 & MDIO_EEE_2_5GT) ){
+					config |= MDIO_EEE_2_5GT;
+				}else{
+					config &= ~MDIO_EEE_2_5GT;
+				}
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV2, config ) );
+			}
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV, enable ? device_context->dev_flags.eee_adv : 0 ) );
+		break;
+		default:
+		break;
+	}
+	pthread_mutex_unlock(&ocp_lock);
+}
+
+/** r8152_aldps_en and r8153_aldps_en, disabling waits until the PHY is out of the power saving state **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_ALDPS_ENABLE(bool enable){
+	uint16_t data = 0;
+
+	if( device_context->device_chip->eee == RTL81XX_EEE_R8152 ){
+		/** static void r8152_aldps_en(struct r8152 *tp, bool enable) **/
+		if( enable ){
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_ALDPS_CONFIG, ENPWRSAVE | ENPDNPS | LINKENA | DIS_SDSAVE ) );
+		}else{
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_ALDPS_CONFIG, ENPDNPS | LINKENA | DIS_SDSAVE ) );
+			usleep(20 * 1000);
+		}
+		return;
+	}
+	/** static void r8153_aldps_en(struct r8152 *tp, bool enable) **/
+	pthread_mutex_lock(&ocp_lock);
+	DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_POWER_CFG ) );
+	data = return_context;
+	if( enable ){
+		data |= EN_ALDPS;
+	}else{
+		data &= ~EN_ALDPS;
+	}
+	DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_POWER_CFG, data ) );
+	pthread_mutex_unlock(&ocp_lock);
+	if( !enable ){
+		for(unsigned char i = 0; i < 20; i++){
+			usleep(1100);
+			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, 0xe000 ) );
+			if( return_context & 0x0100 ){
+				break;
+			}
+		}
+	}
 }
 
 RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_IO_SRAM(unsigned char op_type, uint16_t addr, uint16_t data){
+	/** OCP_SRAM_DATA goes to whatever OCP_SRAM_ADDR holds, nobody may move it in between **/
+	pthread_mutex_lock(&ocp_lock);
 	switch(op_type){
 		case RTL81XX_OPTYPE_READ:
 			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_SRAM_ADDR, addr ) );
@@ -1928,38 +8961,19 @@ RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_OCP_IO_SRAM(unsigned char op_t
 			/** STILL TO DO **/
 		break;
 	}
+	pthread_mutex_unlock(&ocp_lock);
 }
 
 
 #ifdef DEBUG
+/** PLA space into FW.bin **/
 static inline void RTL81XX_DUMP_ROM(void){
 	#ifndef MAX_READ_LEN
 		#define MAX_READ_LEN	64000
 	#endif
-        FILE *ptr = NULL;
-        ptr = fopen("FW.bin", "wb");
-        short tmp_buffer_s = 16;
-        unsigned char *fw_dump = (unsigned char *)malloc(tmp_buffer_s);
-        for(int value_counter = 0; value_counter < MAX_READ_LEN; value_counter += tmp_buffer_s){
-        if( libusb_control_transfer(
-                                device_context->device_handler,
-                                RTL8152_REQT_READ,
-                                RTL8152_REQ_GET_REGS,
-                                value_counter, // value
-                                0x100, 	       //index,
-                                fw_dump,
-                                tmp_buffer_s,
-                                DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG
-                                ) > 0 ){
-                fwrite(fw_dump, tmp_buffer_s, sizeof(char), ptr);
-                memset(fw_dump, 0x00, tmp_buffer_s);
-        }else{
-                DEBUG_PRINTF("[!] fail after %d bytes written...\n", value_counter);
-        	free(fw_dump);
-	        return_context = -FAILED_TO_GET_DUMP;
- 	       }
-        }
-	free(fw_dump);
+	const struct rtl_dump_range range = { .type = MCU_TYPE_PLA, .start = 0, .length = MAX_READ_LEN & ~3 };
+
+	RTL81XX_DUMP("FW.bin", &range, 1, NULL, NULL, NULL);
 }
 #endif
 
@@ -2137,7 +9151,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
 
 	switch (data) {
 	case PHY_STAT_EXT_INIT:
-		RTL81XX_LOAD_FIRMWARE( true );
+		RTL81XX_LOAD_FIRMWARE( true, RTL81XX_FW_ALL );
 
 		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( 0xa466 ) );
 		data = return_context;
@@ -2152,7 +9166,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
 	case PHY_STAT_LAN_ON:
 	case PHY_STAT_PWRDN:
 	default:
-		RTL81XX_LOAD_FIRMWARE( false );
+		RTL81XX_LOAD_FIRMWARE( false, RTL81XX_FW_ALL );
 		break;
 	}
 
@@ -2163,139 +9177,16 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
 	if (data & BMCR_PDOWN) {
 		data &= ~BMCR_PDOWN;
 	        /** static inline void r8152_mdio_write(struct r8152 *tp, u32 reg_addr, u32 value) **/
-                {
-	                DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_BMCR * 2, data ) );
-                }
-	}
-
-	/* disable ALDPS before updating the PHY parameters */
-	/** static void r8153_aldps_en(struct r8152 *tp, bool enable) **/
-	{
-		uint16_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_POWER_CFG ) );
-		ocp_data = return_context;
-		data &= ~EN_ALDPS;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_POWER_CFG, data ) );
-		for(char i = 0; i < 20; i++){
-			usleep( 1500 );
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, 0xe000 ) );
-			if( return_context & 0x0100 ){
-				break;
-			}
-		}
-	}
-
-	/* disable EEE before updating the PHY parameters */
-	/** static void rtl_eee_enable(struct r8152 *tp, bool enable) **/
-	{
-		switch( device_context->device_version_identifier ){
-			case RTL_VER_01:
-			case RTL_VER_02:
-			case RTL_VER_07:
-				/** static void r8152_eee_en(struct r8152 *tp, bool enable) **/
-				{
-					uint16_t config1  = 0;
-					uint16_t config2  = 0;
-					uint16_t config3  = 0;
-					uint32_t ocp_data = 0;
-
-					DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
-					ocp_data = return_context;
-					#ifndef sd_rise_time_mask
-						#define fast_snr_mask		0xff80
-						#define sd_rise_time_mask	0x0070
-					#endif
-					/** acquire every value and put them in config1, config2 and config3 **/
-
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG1 ) );
-					config1 = return_context & ~sd_rise_time_mask;
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG2 ) );
-					config2 = return_context;
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG3 ) );
-					config3 = return_context & ~fast_snr_mask;
-
-					ocp_data &= ~(EEE_RX_EN | EEE_TX_EN);
-					config1 &= ~(EEE_10_CAP | EEE_NWAY_EN | TX_QUIET_EN | RX_QUIET_EN);
-					config1 |= 7 << 4;
-					config2 &= ~(RG_DACQUIET_EN | RG_LDVQUIET_EN);
-					config3 |= 0x1ff << 7;
-
-					DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG1, config1 ) );
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG2, config2 ) );
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG3, config3 ) );
-				}
-				/** static void r8152_mmd_write(struct r8152 *tp, u16 dev, u16 reg, u16 data) **/
-				{
-					/** r8152_mmd_indirect(tp, dev, reg); **/
-					{
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, FUN_ADDR | MDIO_MMD_AN ) );
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_DATA, MDIO_AN_EEE_ADV ) );
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, FUN_DATA | MDIO_MMD_AN ) );
-					}
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_DATA, 0    ) );
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, 0x0000 ) );
-				}
-			break;
-			case RTL_VER_03:
-			case RTL_VER_04:
-			case RTL_VER_05:
-			case RTL_VER_06:
-			case RTL_VER_08:
-			case RTL_VER_09:
-			case RTL_VER_14:
-				/** static void r8153_eee_en(struct r8152 *tp, bool enable) **/
-				{
-					uint32_t ocp_data = 0;
-					uint16_t config   = 0;
-
-					DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
-					ocp_data = return_context;
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CFG ) );
-					config = return_context;
-
-					ocp_data &= ~(EEE_RX_EN | EEE_TX_EN);
-					config &= ~EEE10_EN;
-
-					DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CFG, config) );
-
-				}
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV, 0 ) );
-			break;
-			case RTL_VER_10:
-			case RTL_VER_11:
-			case RTL_VER_12:
-			case RTL_VER_13:
-			case RTL_VER_15:
-				/** static void r8156_eee_en(struct r8152 *tp, bool enable) **/
-				{
-					uint16_t config = 0;
-					/** static void r8153_eee_en(struct r8152 *tp, bool enable) **/
-					{
-						uint32_t ocp_data = 0;
-						uint16_t config   = 0;
-
-						DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
-						ocp_data = return_context;
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CFG ) );
-						config = return_context;
-						ocp_data &= ~(EEE_RX_EN | EEE_TX_EN);
-						config &= ~EEE10_EN;
-						DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CFG, config ) );
-					}
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_ADV2 ) );
-					config = return_context;
-					config &= ~MDIO_EEE_2_5GT;
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV2, config ) );
-				}
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV, 0 ) );
-			break;
-			default:
-			break;
-		}
+                {
+	                DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_BMCR * 2, data ) );
+                }
 	}
+
+	/* disable ALDPS before updating the PHY parameters */
+	RTL81XX_ALDPS_ENABLE(FALSE);
+
+	/* disable EEE before updating the PHY parameters */
+	RTL81XX_EEE_ENABLE(FALSE);
 	/** data = r8153_phy_status(tp, PHY_STAT_LAN_ON) **/;
         {
      	        uint16_t data = 0;
@@ -2326,10 +9217,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
                 }
 	}
 
-	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_PHY_PWR ) );
-	ocp_data = return_context;
-	ocp_data |= PFM_PWM_SWITCH;
-	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_PHY_PWR, ocp_data ) );
+	DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_PHY_PWR, 2, PFM_PWM_SWITCH ) );
 
 	switch ( device_context->device_version_identifier ) {
 	case RTL_VER_12:
@@ -2420,10 +9308,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
 		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xb87c, 0x8fd8) );
 		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xb87e, 0xf600) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ( MCU_TYPE_PLA, PLA_USB_CFG ) );
-		ocp_data = return_context;
-		ocp_data |= EN_XG_LIP | EN_G_LIP;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE( MCU_TYPE_PLA, PLA_USB_CFG, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_USB_CFG, 1, EN_XG_LIP | EN_G_LIP ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xb87c, 0x813d ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xb87e, 0x390e ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xb87c, 0x814f ) );
@@ -2692,10 +9577,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
 		return;
 	}
 
-	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL4 ) );
-	ocp_data = return_context;
-	ocp_data |= EEE_SPDWN_EN;
-	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL4, ocp_data ) );
+	DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL4, 2, EEE_SPDWN_EN ) );
 
 	DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_DOWN_SPEED ) );
 	data = return_context;
@@ -2734,136 +9616,11 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
 	data &= ~BIT(0);
 	DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xa5ea, data ) );
 
-	/** static void rtl_eee_enable(struct r8152 *tp, bool enable) **/
-	{
-		switch( device_context->device_version_identifier ){
-			case RTL_VER_01:
-			case RTL_VER_02:
-			case RTL_VER_07:
-			/** static void r8152_eee_en(struct r8152 *tp, bool enable) **/
-			{
-				#ifndef fast_snr_mask
-					#define fast_snr_mask		0xff80
-				#endif
-
-				uint16_t config1 = 0;
-				uint16_t config2 = 0;
-				uint16_t config3 = 0;
-
-				uint32_t ocp_data = 0;
-
-				DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
-				ocp_data = return_context;
-
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG1 ) );
-				config1 = return_context & ~sd_rise_time_mask;
-
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG2 ) );
-				config2 = return_context;
-
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CONFIG3 ) );
-				config3 = return_context & ~fast_snr_mask;
-
-				ocp_data |= EEE_RX_EN | EEE_TX_EN;
-				config1 |= EEE_10_CAP | EEE_NWAY_EN | TX_QUIET_EN | RX_QUIET_EN;
-				config1 |= 1 << 4;
-				config2 |= RG_DACQUIET_EN | RG_LDVQUIET_EN;
-				config3 |= 42 << 7;
-				DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG1, config1 ) );
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG2, config2 ) );
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CONFIG3, config3 ) );
-			}
-
-				/** static void r8152_mmd_write(struct r8152 *tp, u16 dev, u16 reg, u16 data) **/
-				{
-					/** static inline void r8152_mmd_indirect(struct r8152 *tp, u16 dev, u16 reg) **/
-					{
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, FUN_ADDR | MDIO_MMD_AN ) );
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_DATA, MDIO_AN_EEE_ADV ) );
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, FUN_DATA | MDIO_MMD_AN ) );
-					}
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_DATA, MDIO_EEE_100TX ) );
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_AR, 0x0000 ) );
-				}
-			break;
-			case RTL_VER_03:
-			case RTL_VER_04:
-			case RTL_VER_05:
-			case RTL_VER_06:
-			case RTL_VER_08:
-			case RTL_VER_09:
-			case RTL_VER_14:
-				/** static void r8153_eee_en(struct r8152 *tp, bool enable) **/
-				{
-					uint32_t ocp_data = 0;
-					uint16_t config   = 0;
-
-					DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
-					ocp_data = return_context;
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CFG ) );
-					config = return_context;
-
-					ocp_data |= EEE_RX_EN | EEE_TX_EN;
-					config |= EEE10_EN;
-
-					DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
-					DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CFG, config ) );
-
-				}
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV, MDIO_EEE_1000T | MDIO_EEE_100TX ) );
-			break;
-			case RTL_VER_10:
-			case RTL_VER_11:
-			case RTL_VER_12:
-			case RTL_VER_13:
-			case RTL_VER_15:
-				/** static void r8156_eee_en(struct r8152 *tp, bool enable) **/
-				{
-						uint16_t config = 0;
-
-						/** static void r8153_eee_en(struct r8152 *tp, bool enable) **/
-						{
-							uint32_t ocp_data = 0;
-							uint16_t config   = 0;
-
-							DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EEE_CR ) );
-							ocp_data = return_context;
-							DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_CFG ) );
-							config = return_context;
-
-							ocp_data |= EEE_RX_EN | EEE_TX_EN;
-							config |= EEE10_EN;
-							DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EEE_CR, ocp_data ) );
-							DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_CFG, config ) );
-
-						}
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_EEE_ADV2 ) );
-						config = return_context;
-						config |= MDIO_EEE_2_5GT;
-						DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV2, config ) );
-				}
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_EEE_ADV, MDIO_EEE_1000T | MDIO_EEE_100TX ) );
-			break;
-			default:
-			break;
-		}
+	if( device_context->device_eee->eee_enabled ){
+		RTL81XX_EEE_ENABLE(TRUE);
 	}
 
-        /** static void r8153_aldps_en(struct r8152 *tp, bool enable) **/
-        {
-                uint16_t data = 0;
-                DEBUG_RTL81XX( RTL81XX_OCP_REG_READ(OCP_POWER_CFG) );
-                data &= ~EN_ALDPS;
-                DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE(OCP_POWER_CFG, data) );
-                for (unsigned char i = 0; i < 20; i++) {
-                        usleep(1100);
-                        DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, 0xe000) );
-                        if( return_context & 0x0100){
-                                break;
-                        }
-                }
-        }
+	RTL81XX_ALDPS_ENABLE(TRUE);
 	/** static void r8152b_enable_fc(struct r8152 *tp) **/
 	{
 		uint16_t anar = 0;
@@ -2877,48 +9634,36 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_HW_PHY_CFG(void){
 	}
 	/** static void r8153_u2p3en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_U2P3_CTRL ) );
-		ocp_data = return_context;
-		ocp_data |= U2P3_ENABLE;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_U2P3_CTRL, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_USB, USB_U2P3_CTRL, 2, U2P3_ENABLE ) );
 	}
 }
 
-RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
-	volatile uint32_t ocp_data = 0;
-	uint16_t data = 0;
-
+/** USB_ECM_OP, USB_SPEED_OPTION, BYPASS_MAC_RESET and RX_DETECT8 **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_USB_MODE(void){
 	{
-		DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_USB, USB_ECM_OP) );
-		ocp_data = return_context;
-		ocp_data &= ~EN_ALL_SPEED;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_USB, USB_ECM_OP, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_ECM_OP, 1, EN_ALL_SPEED ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_SPEED_OPTION, 0) );
 	}
 
 	{
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_ECM_OPTION) );
-		ocp_data = return_context;
-		ocp_data |= BYPASS_MAC_RESET;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_ECM_OPTION, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_USB, USB_ECM_OPTION, 2, BYPASS_MAC_RESET ) );
 	}
 
 	{
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_U2P3_CTRL) );
-		ocp_data = return_context;
-		ocp_data |= RX_DETECT8;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_U2P3_CTRL, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_USB, USB_U2P3_CTRL, 2, RX_DETECT8 ) );
 	}
+}
 
+/** U1/U2 off until the LPM governor decides otherwise **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_U1U2(void){
 	/** static void r8153b_u1u2en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_LPM_CONFIG) );
-		ocp_data = return_context;
-		ocp_data &= ~LPM_U1U2_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_LPM_CONFIG, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_LPM_CONFIG, 2, LPM_U1U2_EN ) );
 	}
+}
+
+/** RTL_VER_13 and RTL_VER_15 load the GPHY from the flash **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_FLASH(void){
 	switch (device_context->device_version_identifier){
 		case RTL_VER_13:
 		case RTL_VER_15:
@@ -2941,7 +9686,10 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 
 	break;
 		}
+}
 
+/** the MCU registers are valid once PLA_BOOT_CTRL reports AUTOLOAD_DONE **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_AUTOLOAD(void){
 	{
 
 	for(short i = 0; i < DEFAULT_SLEEP_TIME_FOR_USB_CONTROL_MSG; i++) {
@@ -2952,6 +9700,12 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 		usleep( CONVERT_TO_MS(20) );
 		}
 	}
+}
+
+/** the PHY is out of its reset and powered **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_PHY_STATUS(void){
+	uint16_t data = 0;
+
 	/** data = r8153_phy_status(tp, 0); **/
 	{
 		uint16_t data = 0;
@@ -2997,14 +9751,13 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 			usleep( CONVERT_TO_MS( 20 ) );
 		}
 	}
+}
 
+/** U2P3 off, USB_MSC_TIMER and USB_U1U2_TIMER **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_U2P3(void){
 	/** static void r8153_u2p3en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_U2P3_CTRL) );
-		ocp_data = return_context;
-		ocp_data &= ~U2P3_ENABLE;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_U2P3_CTRL, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_U2P3_CTRL, 2, U2P3_ENABLE ) );
 
 	}
 	{
@@ -3013,18 +9766,15 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_U1U2_TIMER, 500) );
 
 	}
+}
+
+/** power cut and UPS off **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_POWER_CUT(void){
 	/** static void r8153b_power_cut_en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_POWER_CUT) );
-		ocp_data = return_context;
-		ocp_data &= ~PWR_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_POWER_CUT, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_POWER_CUT, 2, PWR_EN ) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_MISC_0) );
-		ocp_data = return_context;
-		ocp_data &= ~PCUT_STATUS;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_MISC_0, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_MISC_0, 2, PCUT_STATUS ) );
 
 	}
 	/** static void r8156_ups_en(struct r8152 *tp, bool enable) **/
@@ -3037,14 +9787,25 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 		ocp_data &= ~(UPS_EN | USP_PREWAKE);
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_USB, USB_POWER_CUT, ocp_data) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_USB, USB_MISC_2) );
-		ocp_data = return_context;
-		ocp_data &= ~UPS_FORCE_PWR_DOWN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_USB, USB_MISC_2, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_MISC_2, 1, UPS_FORCE_PWR_DOWN ) );
+	}
+}
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_MISC_0) );
-		ocp = return_context;
-		if (ocp & PCUT_STATUS) {
+/** r8156b_hw_phy_cfg, the PLA and USB MCU part of the firmware patch **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_MCU_PATCH(void){
+	/** a power cut left PCUT_STATUS set, RTL8156B_INIT_PHY_CFG clears it once the PHY is patched too **/
+	DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_MISC_0) );
+	bringup.pcut = ( return_context & PCUT_STATUS ) != 0;
+	if( bringup.pcut ){
+		RTL81XX_LOAD_FIRMWARE(FALSE, RTL81XX_FW_MAC);
+	}
+}
+
+/** r8156b_hw_phy_cfg, the PHY part of the firmware patch and green ethernet **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_PHY_CFG(void){
+	/** a power cut left PCUT_STATUS set, the PHY is configured and patched again **/
+	{
+		if (bringup.pcut) {
 			/** static void r8156b_hw_phy_cfg(struct r8152 *tp) **/
 			{
 				uint32_t ocp_data = 0;
@@ -3118,7 +9879,7 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
                 	switch (data){
 				case PHY_STAT_EXT_INIT:
 					DEBUG_PRINTF("[!] loading the firmware... (TRUE)\n");
-					RTL81XX_LOAD_FIRMWARE(TRUE);
+					RTL81XX_LOAD_FIRMWARE(TRUE, RTL81XX_FW_PHY);
 
 					DEBUG_RTL81XX( RTL81XX_OCP_REG_READ(0xa466) );
 					data = return_context;
@@ -3134,80 +9895,25 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 				case PHY_STAT_PWRDN:
 				default:
 					DEBUG_PRINTF("[!] loading the firmware... (FALSE)\n");
-					RTL81XX_LOAD_FIRMWARE(FALSE);
+					RTL81XX_LOAD_FIRMWARE(FALSE, RTL81XX_FW_PHY);
 				break;
 			}
 			RTL81XX_ENABLE_GREEN_FEATURE(TRUE);
 		}
 	}
 	}
-	/** rtl8152_set_speed(tp, tp->autoneg, tp->speed, tp->duplex, tp->advertising); **/
-	/** static int rtl8152_set_speed(struct r8152 *tp, u8 autoneg, u32 speed, u8 duplex, u32 advertising) **/
-	{
-		/** force the autonegotiation feature, even if the HW did not support it **/
-		uint16_t bmcr    = 0;
-		uint16_t orig    = 0;
-		uint32_t support = 0;
-		uint16_t new1    = 0;
-
-		/** static inline int r8152_mdio_read(struct r8152 *tp, u32 reg_addr) **/
-		{
-			DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_BASE_MII + MII_ADVERTISE * 2 ) );
-			orig = return_context;
-		}
-		new1 = orig & ~(ADVERTISE_10HALF | ADVERTISE_10FULL | ADVERTISE_100HALF | ADVERTISE_100FULL);
-		if( orig != new1 ){
-			/** static inline void r8152_mdio_write(struct r8152 *tp, u32 reg_addr, u32 value) **/
-			{
-				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_ADVERTISE * 2, new1) );
-			}
-		}
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_BASE_MII + MII_CTRL1000 * 2) );
-		orig = return_context;
-		new1 = orig & ~(ADVERTISE_1000FULL | ADVERTISE_1000HALF);
-		if( orig != new1 ){
-			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_CTRL1000 * 2, new1 ) );
-		}
-		/** if ( support 2.5 Gbps ) **/
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_10GBT_CTRL ) );
-		orig = return_context;
-		new1 = orig & ~MDIO_AN_10GBT_CTRL_ADV2_5G;
-
-		new1 != MDIO_AN_10GBT_CTRL_ADV2_5G;
-		if( orig != new1 ){
-			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_10GBT_CTRL, new1 ) );
-		}
-		bmcr = BMCR_ANENABLE | BMCR_ANRESTART;
-
-	DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_BMCR * 2, bmcr ) );
-	if( bmcr & BMCR_RESET ){
-		for(char i = 0; i < 50; i++){
-			usleep( CONVERT_TO_MS(20) );
-			DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_BASE_MII + MII_BMCR * 2 ) );
-			if( ( return_context & BMCR_RESET ) == 0 ){
-				break;
-			}
-		}
-	}
-	}
 	}
+}
+
+/** wake events, WoL and runtime suspend **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_WAKE(void){
 	/** static void r8153_queue_wake(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ( MCU_TYPE_PLA, PLA_INDICATE_FALG ) );
-		ocp_data = return_context;
-		ocp_data &= ~UPCOMING_RUNTIME_D3;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE( MCU_TYPE_PLA, PLA_INDICATE_FALG, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_INDICATE_FALG, 1, UPCOMING_RUNTIME_D3 ) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ( MCU_TYPE_PLA, PLA_SUSPEND_FLAG ) );
-		ocp_data = return_context;
-		ocp_data &= ~LINK_CHG_EVENT;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE( MCU_TYPE_PLA, PLA_SUSPEND_FLAG, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_SUSPEND_FLAG, 1, LINK_CHG_EVENT ) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EXTRA_STATUS ) );
-		ocp_data = return_context;
-		ocp_data &= ~LINK_CHANGE_FLAG;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EXTRA_STATUS, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_EXTRA_STATUS, 2, LINK_CHANGE_FLAG ) );
 	}
 	/** static void rtl_runtime_suspend_enable(struct r8152 *tp, bool enable) **/
 	{
@@ -3255,20 +9961,123 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE( MCU_TYPE_PLA, PLA_CONFIG34, ocp_data ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE( MCU_TYPE_PLA, PLA_CRWECR, CRWECR_NORAML ) );
 	}
+}
+
+/** SLOT_EN, flow control and USB_FC_TIMER **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_RX_FC(void){
+	{
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_RCR, 2, SLOT_EN ) );
+
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_CPCR, 2, FLOW_CTRL_EN ) );
+		/* enable fc timer and set timer to 600 ms. */
+		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_FC_TIMER, CTRL_TIMER_EN | (600 / 8) ) );
+	}
+}
+
+/** MAC clock speed down and RX aggregation **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_MAC_CLK(void){
+	/** static void r8156_mac_clk_spd(struct r8152 *tp, bool enable) **/
+	{
+		uint32_t ocp_data = 0;
+		/* MAC clock speed down */
+		/* aldps_spdwn_ratio, tp10_spdwn_ratio */
+		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL, 0x0403 ) );
+
+		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL2 ) );
+		ocp_data = return_context;
+		ocp_data &= ~EEE_SPDWN_RATIO_MASK;
+		ocp_data |= MAC_CLK_SPDWN_EN | 0x03; /* eee_spdwn_ratio */
+		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL2, ocp_data ) );
+	}
+	{
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL3, 2, PLA_MCU_SPDWN_EN ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_USB_CTRL, 2, RX_AGG_DISABLE | RX_ZERO_EN ) );
+	}
+}
+
+/** set_ethernet_addr, RTL81XX_POST_INIT does not do it again **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_ETHER_ADDR(void){
+	RTL81XX_SET_ETHER_ADDR();
+	bringup.ether_addr = TRUE;
+}
+
+/** rtl8152_set_speed, autonegotiation restarted **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_SPEED(void){
+	/** rtl8152_set_speed(tp, tp->autoneg, tp->speed, tp->duplex, tp->advertising); **/
+	/** static int rtl8152_set_speed(struct r8152 *tp, u8 autoneg, u32 speed, u8 duplex, u32 advertising) **/
+	{
+		/** force the autonegotiation feature, even if the HW did not support it **/
+		uint16_t bmcr    = 0;
+		uint16_t orig    = 0;
+		uint32_t support = 0;
+		uint16_t new1    = 0;
+
+		/** static inline int r8152_mdio_read(struct r8152 *tp, u32 reg_addr) **/
+		{
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_BASE_MII + MII_ADVERTISE * 2 ) );
+			orig = return_context;
+		}
+		new1 = orig & ~(ADVERTISE_10HALF | ADVERTISE_10FULL | ADVERTISE_100HALF | ADVERTISE_100FULL);
+		if( orig != new1 ){
+			/** static inline void r8152_mdio_write(struct r8152 *tp, u32 reg_addr, u32 value) **/
+			{
+				DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_ADVERTISE * 2, new1) );
+			}
+		}
+		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_BASE_MII + MII_CTRL1000 * 2) );
+		orig = return_context;
+		new1 = orig & ~(ADVERTISE_1000FULL | ADVERTISE_1000HALF);
+		if( orig != new1 ){
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_CTRL1000 * 2, new1 ) );
+		}
+		/** if ( support 2.5 Gbps ) **/
+		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_10GBT_CTRL ) );
+		orig = return_context;
+		new1 = orig & ~MDIO_AN_10GBT_CTRL_ADV2_5G;
+
+		new1 != MDIO_AN_10GBT_CTRL_ADV2_5G;
+		if( orig != new1 ){
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_10GBT_CTRL, new1 ) );
+		}
+		bmcr = BMCR_ANENABLE | BMCR_ANRESTART;
+
+	DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_BMCR * 2, bmcr ) );
+	if( bmcr & BMCR_RESET ){
+		for(char i = 0; i < 50; i++){
+			usleep( CONVERT_TO_MS(20) );
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_BASE_MII + MII_BMCR * 2 ) );
+			if( ( return_context & BMCR_RESET ) == 0 ){
+				break;
+			}
+		}
+	}
+	}
+}
+
+/** MDIO force mode **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_MDIO_FORCE(void){
+	/** static void r8156_mdio_force_mode(struct r8152 *tp) **/
+	{
+		uint16_t data;
+		/* Select force mode through 0xa5b4 bit 15
+		 * 0: MDIO force mode
+		 * 1: MMD force mode
+		 */
+		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( 0xa5b4 ) );
+		data = return_context;
+		if (data & BIT(15)) {
+			data &= ~BIT(15);
+			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xa5b4, data ) );
+		}
+	}
+}
+
+/** flow control patch of the MAC firmware **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_FW_TASK(void){
+	/** FLOW_CTRL_PATCH_2 and FC_PATCH_TASK belong to the MAC firmware **/
 	{
 		uint32_t ocp_data = 0;
 		uint32_t ocp	  = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_RCR ) );
-		ocp_data = return_context;
-		ocp_data &= ~SLOT_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_RCR, ocp_data ) );
-
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_CPCR ) );
-		ocp_data = return_context;
-	        ocp_data |= FLOW_CTRL_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_CPCR, ocp_data ) );
-		/* enable fc timer and set timer to 600 ms. */
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_FC_TIMER, CTRL_TIMER_EN | (600 / 8) ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_FW_CTRL ) );
 		ocp_data = return_context;
 		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_POL_GPIO_CTRL ) );
@@ -3279,31 +10088,15 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 		}
 		ocp_data &= ~AUTO_SPEEDUP;
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_FW_CTRL, ocp_data ) );
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_FW_TASK ) );
-		ocp_data = return_context;
-		ocp_data |= FC_PATCH_TASK;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_FW_TASK, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_USB, USB_FW_TASK, 2, FC_PATCH_TASK ) );
 	}
-	/** static void r8156_mac_clk_spd(struct r8152 *tp, bool enable) **/
-	{
-		uint32_t ocp_data = 0;
-		/* MAC clock speed down */
-		/* aldps_spdwn_ratio, tp10_spdwn_ratio */
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL, 0x0403 ) );
+}
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL2 ) );
-		ocp_data = return_context;
-		ocp_data &= ~EEE_SPDWN_RATIO_MASK;
-		ocp_data |= MAC_CLK_SPDWN_EN | 0x03; /* eee_spdwn_ratio */
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL2, ocp_data ) );
-	}
+/** CUR_LINK_OK from the PHY that was just set up **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_LINK(void){
 	{
 		uint32_t ocp_data = 0;
 		uint32_t ocp = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL3 ) );
-		ocp_data = return_context;
-		ocp_data &= ~PLA_MCU_SPDWN_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL3, ocp_data ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_EXTRA_STATUS ) );
 		ocp_data = return_context;
 		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_PHYSTATUS ) );
@@ -3315,49 +10108,91 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
 		}
 		ocp_data |= POLL_LINK_CHG;
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_EXTRA_STATUS, ocp_data ) );
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_USB_CTRL ) );
-		ocp_data = return_context;
-		ocp_data &= ~(RX_AGG_DISABLE | RX_ZERO_EN);
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_USB_CTRL, ocp_data ) );
-	}
-	/** static void r8156_mdio_force_mode(struct r8152 *tp) **/
-	{
-		uint16_t data;
-		/* Select force mode through 0xa5b4 bit 15
-		 * 0: MDIO force mode
-		 * 1: MMD force mode
-		 */
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( 0xa5b4 ) );
-		data = return_context;
-		if (data & BIT(15)) {
-			data &= ~BIT(15);
-			DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( 0xa5b4, data ) );
-		}
 	}
+}
+
+/** tally counters **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT_TALLY(void){
 	/** static void rtl_tally_reset(struct r8152 *tp) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_RSTTALLY ) );
-		ocp_data = return_context;
-		ocp_data |= TALLY_RESET;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_RSTTALLY, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_RSTTALLY, 2, TALLY_RESET ) );
 	}
+}
+
+/** steps of r8156_init, the order is the one of the kernel inside a lane **/
+enum rtl8156b_init_step{
+	RTL8156B_STEP_USB_MODE,
+	RTL8156B_STEP_U1U2,
+	RTL8156B_STEP_FLASH,
+	RTL8156B_STEP_AUTOLOAD,
+	RTL8156B_STEP_PHY_STATUS,
+	RTL8156B_STEP_U2P3,
+	RTL8156B_STEP_POWER_CUT,
+	RTL8156B_STEP_MCU_PATCH,
+	RTL8156B_STEP_PHY_CFG,
+	RTL8156B_STEP_WAKE,
+	RTL8156B_STEP_RX_FC,
+	RTL8156B_STEP_MAC_CLK,
+	RTL8156B_STEP_ETHER_ADDR,
+	RTL8156B_STEP_SPEED,
+	RTL8156B_STEP_MDIO_FORCE,
+	RTL8156B_STEP_FW_TASK,
+	RTL8156B_STEP_LINK,
+	RTL8156B_STEP_TALLY,
+	RTL8156B_STEPS
+};
+
+/**
+ * only the PHY needs the flash and the PHY status, the MAC lane programs the
+ * USB MCU while the PHY lane sleeps on them. The blob is applied in two parts:
+ * MCU_PATCH puts the PLA and USB MCU patches in on the MAC lane, then PHY_CFG
+ * the PHY and SRAM ones on the PHY lane. The MAC steps that touch the PLA
+ * (CRWECR and CONFIG34, RCR, CPCR, MAC_PWR_CTRL3, IDR) only wait for the
+ * first, so they run while the PHY is being patched.
+ */
+static const struct rtl_init_step rtl8156b_init_steps[] = {
+	[RTL8156B_STEP_USB_MODE]   = { "usb_mode",	RTL8156B_INIT_USB_MODE,	  0,									RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_U1U2]	   = { "u1u2",		RTL8156B_INIT_U1U2,	  0,									RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_FLASH]	   = { "flash",		RTL8156B_INIT_FLASH,	  0,									RTL81XX_LANE_PHY },
+	[RTL8156B_STEP_AUTOLOAD]   = { "autoload",	RTL8156B_INIT_AUTOLOAD,	  BIT(RTL8156B_STEP_FLASH),						RTL81XX_LANE_PHY },
+	[RTL8156B_STEP_PHY_STATUS] = { "phy_status",	RTL8156B_INIT_PHY_STATUS, BIT(RTL8156B_STEP_AUTOLOAD),						RTL81XX_LANE_PHY },
+	[RTL8156B_STEP_U2P3]	   = { "u2p3",		RTL8156B_INIT_U2P3,	  BIT(RTL8156B_STEP_USB_MODE) | BIT(RTL8156B_STEP_AUTOLOAD),		RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_POWER_CUT]  = { "power_cut",	RTL8156B_INIT_POWER_CUT,  BIT(RTL8156B_STEP_AUTOLOAD),						RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_MCU_PATCH]  = { "mcu_patch",	RTL8156B_INIT_MCU_PATCH,  BIT(RTL8156B_STEP_POWER_CUT),						RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_PHY_CFG]	   = { "phy_cfg",	RTL8156B_INIT_PHY_CFG,	  BIT(RTL8156B_STEP_PHY_STATUS) | BIT(RTL8156B_STEP_MCU_PATCH),	RTL81XX_LANE_PHY },
+	[RTL8156B_STEP_WAKE]	   = { "wake",		RTL8156B_INIT_WAKE,	  BIT(RTL8156B_STEP_MCU_PATCH),						RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_RX_FC]	   = { "rx_fc",		RTL8156B_INIT_RX_FC,	  BIT(RTL8156B_STEP_MCU_PATCH),						RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_MAC_CLK]	   = { "mac_clk",	RTL8156B_INIT_MAC_CLK,	  BIT(RTL8156B_STEP_MCU_PATCH),						RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_ETHER_ADDR] = { "ether_addr",	RTL8156B_INIT_ETHER_ADDR, BIT(RTL8156B_STEP_MCU_PATCH),						RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_SPEED]	   = { "speed",		RTL8156B_INIT_SPEED,	  BIT(RTL8156B_STEP_PHY_CFG),						RTL81XX_LANE_PHY },
+	[RTL8156B_STEP_MDIO_FORCE] = { "mdio_force",	RTL8156B_INIT_MDIO_FORCE, BIT(RTL8156B_STEP_SPEED),						RTL81XX_LANE_PHY },
+	[RTL8156B_STEP_FW_TASK]	   = { "fw_task",	RTL8156B_INIT_FW_TASK,	  BIT(RTL8156B_STEP_PHY_CFG) | BIT(RTL8156B_STEP_RX_FC),		RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_LINK]	   = { "link",		RTL8156B_INIT_LINK,	  BIT(RTL8156B_STEP_SPEED) | BIT(RTL8156B_STEP_WAKE),			RTL81XX_LANE_MAC },
+	[RTL8156B_STEP_TALLY]	   = { "tally",		RTL8156B_INIT_TALLY,	  BIT(RTL8156B_STEP_LINK),						RTL81XX_LANE_MAC },
+};
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_INIT(void){
+	RTL81XX_BRINGUP_RUN(rtl8156b_init_steps, RTL8156B_STEPS);
 	if( return_context > 0 ){
-		/** NOW COMPLETE THE FUNCTION POINTER TABLE OF THE HW SPECIFIC STRUCTURE **/
-		rtl_ops[RTL8156B].rtl_exit 	= RTL8156B_EXIT;
-		rtl_ops[RTL8156B].rtl_intf_up 	= RTL8156B_UP;
-		rtl_ops[RTL8156B].rtl_intf_down = RTL8156B_DOWN;
-		rtl_ops[RTL8156B].rtl_get_eee   = RTL8156_GET_EEE;
-		rtl_ops[RTL8156B].rtl_set_eee   = RTL8156_SET_EEE;
+		RTL8156B_RESUME();
 	}
 	DEBUG_PRINTF("[!][%s] initialization finished! everything went fine...\n", device_context->device_firmware->device_fw_blob_name);
 }
 
+/** the chip is initialized, either by RTL8156B_INIT or before a re-enumeration **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_RESUME(void){
+	/** NOW COMPLETE THE FUNCTION POINTER TABLE OF THE HW SPECIFIC STRUCTURE **/
+	rtl_ops[RTL8156B].rtl_exit 	= RTL8156B_EXIT;
+	rtl_ops[RTL8156B].rtl_intf_up 	= RTL8156B_UP;
+	rtl_ops[RTL8156B].rtl_intf_down = RTL8156B_DOWN;
+	rtl_ops[RTL8156B].rtl_get_eee   = RTL8156_GET_EEE;
+	rtl_ops[RTL8156B].rtl_set_eee   = RTL8156_SET_EEE_OP;
+}
+
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_POST_INIT(void){
 
 	/** static void rtl_hw_phy_work_func_t(struct work_struct *work) **/
 	{
-		uint32_t ocp_data = 0;
 		/** call the pointer to 'tp->rtl_ops.hw_phy_cfg' **/
                 /** static void r8156b_hw_phy_cfg(struct r8152 *tp) **/
 		{
@@ -3365,6 +10200,15 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_POST_INIT(void){
 		
 		}
 	}
+	/** already programmed by the MAC lane of the bring-up graph **/
+	if( bringup.ether_addr ){
+		bringup.ether_addr = FALSE;
+	}else{
+		RTL81XX_SET_ETHER_ADDR();
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_SET_ETHER_ADDR(void){
 	/** static int set_ethernet_addr(struct r8152 *tp, bool in_resume) **/
 	{
 		int ret = 0;
@@ -3394,16 +10238,22 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_POST_INIT(void){
 	}
 }
 
+/** static void rtl8153_change_mtu(struct r8152 *tp) **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL8153_CHANGE_MTU(void){
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_RMS, mtu_to_size(device_context->device_mtu) ) );
+	DEBUG_RTL81XX( RTL81XX_OCP_WRITE( MCU_TYPE_PLA, PLA_MTPS, MTPS_JUMBO ) );
+}
+
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_CHANGE_MTU(void){
-	uint32_t rx_max_size = mtu_to_size(device_context->device_max_mtu);
+	uint32_t rx_max_size = mtu_to_size(device_context->device_mtu);
 	DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_RMS, rx_max_size) );
 	DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_PLA, PLA_MTPS, MTPS_JUMBO) );
 	/** static void r8156_fc_parameter(struct r8152 *tp) **/
 	{
 		uint32_t ofc_pause_on_auto  = 0;
 		uint32_t ofc_pause_off_auto = 0;
-		ofc_pause_on_auto  = (ALIGN(mtu_to_size(device_context->device_max_mtu), 1024) + 6 * 1024);
-		ofc_pause_off_auto = (ALIGN(mtu_to_size(device_context->device_max_mtu), 1024) + 14 * 1024);
+		ofc_pause_on_auto  = (ALIGN(mtu_to_size(device_context->device_mtu), 1024) + 6 * 1024);
+		ofc_pause_off_auto = (ALIGN(mtu_to_size(device_context->device_mtu), 1024) + 14 * 1024);
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_RX_FIFO_FULL,  ofc_pause_on_auto / 16 ) );
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_RX_FIFO_EMPTY, ofc_pause_off_auto / 16 ) );
 
@@ -3415,43 +10265,22 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_CHANGE_MTU(void){
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_UP(void){
+	/** U1/U2, U2P3 and ALDPS are switched off below, as in RTL8156B_DOWN the governors must not turn them on again **/
+	RTL81XX_LPM_STOP();
+	RTL81XX_PWR_STOP();
+
 	/** static void r8153b_u1u2en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_LPM_CONFIG) );
-		ocp_data = return_context;
-		ocp_data &= ~LPM_U1U2_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_LPM_CONFIG, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_LPM_CONFIG, 2, LPM_U1U2_EN ) );
 	}
 	/** static void r8153_u2p3en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_USB, USB_U2P3_CTRL) );
-		ocp_data = return_context;
-		ocp_data &= ~U2P3_ENABLE;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_USB, USB_U2P3_CTRL, ocp_data) );
-	}
-	/** static void r8153_aldps_en(struct r8152 *tp, bool enable) **/
-	{
-		uint16_t data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ(OCP_POWER_CFG) );
-		data &= ~EN_ALDPS;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE(OCP_POWER_CFG, data) );
-		for (unsigned char i = 0; i < 20; i++) {
-			usleep(1100);
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, 0xe000) );
-			if( return_context & 0x0100){
-				break;
-			}
-		}
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_U2P3_CTRL, 2, U2P3_ENABLE ) );
 	}
+	RTL81XX_ALDPS_ENABLE(FALSE);
 	/** static void rxdy_gated_en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, PLA_MISC_1) );
-		ocp_data = return_context;
-		ocp_data |= RXDY_GATED_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_MISC_1, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_MISC_1, 2, RXDY_GATED_EN ) );
 	}
 	/** static void r8153_teredo_off(struct r8152 *tp) **/
 	{
@@ -3461,36 +10290,16 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_UP(void){
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_TEREDO_TIMER, 0)  );
 	}
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_DWORD(MCU_TYPE_PLA, PLA_RCR) );
-		ocp_data = return_context;
-		ocp_data &= ~RCR_ACPT_ALL;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_DWORD(MCU_TYPE_PLA, PLA_RCR, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_RCR, 4, RCR_ACPT_ALL ) );
 	}
 	RTL81XX_NIC_RESET();
-	/** static void rtl_reset_bmu(struct r8152 *tp) **/
-	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_USB, USB_BMU_RESET) );
-		ocp_data = return_context;
-		ocp_data &= ~(BMU_RESET_EP_IN | BMU_RESET_EP_OUT);
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_USB, USB_BMU_RESET, ocp_data) );
-		ocp_data |= BMU_RESET_EP_IN | BMU_RESET_EP_OUT;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_USB, USB_BMU_RESET, ocp_data) );
-	}
+	RTL81XX_RESET_BMU();
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_PLA, PLA_OOB_CTRL) );
-		ocp_data = return_context;
-		ocp_data &= ~NOW_IS_OOB;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_PLA, PLA_OOB_CTRL, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_OOB_CTRL, 1, NOW_IS_OOB ) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, PLA_SFF_STS_7) );
-		ocp_data = return_context;
-		ocp_data &= ~MCU_BORW_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_SFF_STS_7, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_SFF_STS_7, 2, MCU_BORW_EN ) );
 	}
-	char enable_bit = 0;
+	char enable_bit = !!(device_context->dev_flags.features & RTL81XX_FEATURE_RX_VLAN);
 	RTL81XX_RX_VLAN_ENABLE(enable_bit);
 	/** static void rtl8156_change_mtu(struct r8152 *tp) **/
 	{
@@ -3499,63 +10308,33 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_UP(void){
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_DOWN(void){
-	uint32_t ocp_data = 0;
+	/** the OOB thresholds written below must not be adjusted **/
+	RTL81XX_FC_STOP();
+	/** U1/U2 and U2P3 are switched off below, the governor must not turn them on again **/
+	RTL81XX_LPM_STOP();
+	/** same for ALDPS, switched on again at the end **/
+	RTL81XX_PWR_STOP();
 
 	{
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD(MCU_TYPE_PLA, PLA_MAC_PWR_CTRL3) );
-		ocp_data = return_context;
-		ocp_data |= PLA_MCU_SPDWN_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD(MCU_TYPE_PLA, PLA_MAC_PWR_CTRL3, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_MAC_PWR_CTRL3, 2, PLA_MCU_SPDWN_EN ) );
 	}
 	/** static void r8153b_u1u2en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_LPM_CONFIG ) );
-		ocp_data = return_context;
-		ocp_data &= ~LPM_U1U2_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_LPM_CONFIG, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_LPM_CONFIG, 2, LPM_U1U2_EN ) );
 	}
 	/** static void r8153_u2p3en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_U2P3_CTRL ) );
-		ocp_data = return_context;
-		ocp_data &= ~U2P3_ENABLE;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_U2P3_CTRL, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_U2P3_CTRL, 2, U2P3_ENABLE ) );
 	}
 	/** static void r8153b_power_cut_en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_POWER_CUT ) );
-		ocp_data = return_context;
-		ocp_data &= ~PWR_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_POWER_CUT, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_POWER_CUT, 2, PWR_EN ) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_USB, USB_MISC_0 ) );
-		ocp_data = return_context;
-		ocp_data &= ~PCUT_STATUS;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_USB, USB_MISC_0, ocp_data ) );
-	}
-	/** static void r8153_aldps_en(struct r8152 *tp, bool enable) **/
-	{
-		uint16_t data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ(OCP_POWER_CFG) );
-		data = return_context;
-		data &= ~EN_ALDPS;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_POWER_CFG, data ) );
-		for (char i = 0; i < 20; i++) {
-			usleep(1100);
-			DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, 0xe000 ) );
-			if( return_context & 0x0100){
-				break;
-			}
-		}
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_USB, USB_MISC_0, 2, PCUT_STATUS ) );
 	}
+	RTL81XX_ALDPS_ENABLE(FALSE);
 	{
-		DEBUG_RTL81XX( RTL81XX_OCP_READ(MCU_TYPE_PLA, PLA_OOB_CTRL) );
-		ocp_data = return_context;
-		ocp_data &= ~NOW_IS_OOB;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE(MCU_TYPE_PLA, PLA_OOB_CTRL, ocp_data) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_OOB_CTRL, 1, NOW_IS_OOB ) );
 	}
 
 	{
@@ -3586,39 +10365,19 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156B_DOWN(void){
 		 * the events. Set them to all 1 to clear them.
 		 */
 		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_TEREDO_WAKE_BASE, 0x00ff ) );
-		DEBUG_RTL81XX( RTL81XX_OCP_READ( MCU_TYPE_PLA, PLA_OOB_CTRL ) );
-		ocp_data = return_context;
-		ocp_data |= NOW_IS_OOB;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE( MCU_TYPE_PLA, PLA_OOB_CTRL, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_OOB_CTRL, 1, NOW_IS_OOB ) );
 
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_SFF_STS_7 ) );
-		ocp_data = return_context;
-		ocp_data |= MCU_BORW_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_SFF_STS_7, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_SFF_STS_7, 2, MCU_BORW_EN ) );
 	}
 	RTL81XX_RX_VLAN_ENABLE(TRUE);
 	/** static void rxdy_gated_en(struct r8152 *tp, bool enable) **/
 	{
-		uint32_t ocp_data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_WORD( MCU_TYPE_PLA, PLA_MISC_1 ) );
-		ocp_data = return_context;
-		ocp_data &= ~RXDY_GATED_EN;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_WORD( MCU_TYPE_PLA, PLA_MISC_1, ocp_data ) );
-	}
-	{
-		DEBUG_RTL81XX( RTL81XX_OCP_READ_DWORD( MCU_TYPE_PLA, PLA_RCR ) );
-		ocp_data = return_context;
-		ocp_data |= RCR_APM | RCR_AM | RCR_AB;
-		DEBUG_RTL81XX( RTL81XX_OCP_WRITE_DWORD( MCU_TYPE_PLA, PLA_RCR, ocp_data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_CLR_BITS( MCU_TYPE_PLA, PLA_MISC_1, 2, RXDY_GATED_EN ) );
 	}
-	/** static void r8153_aldps_en(struct r8152 *tp, bool enable) **/
 	{
-		uint16_t data = 0;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_POWER_CFG ) );
-		data = return_context;
-		data |= EN_ALDPS;
-		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_POWER_CFG, data ) );
+		DEBUG_RTL81XX( RTL81XX_OCP_SET_BITS( MCU_TYPE_PLA, PLA_RCR, 4, RCR_APM | RCR_AM | RCR_AB ) );
 	}
+	RTL81XX_ALDPS_ENABLE(TRUE);
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_GET_EEE(void){
@@ -3699,9 +10458,14 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_GET_EEE(void){
 	device_context->device_eee->lp_advertised = lp;
 }
 
+/**
+ * 'rtl_set_eee' callback, device_eee carries the new eee_enabled and advertised;
+ * the legacy ADVERTISED_* mask has no 2.5G bit, dev_flags.eee_adv2 stays as it is.
+ */
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_SET_EEE(void){
-	/** WE MUST SUPPOSE THAT THE 'device_eee' HAS BEEN CHANGED IN ORDER TO MODIFY THE EEE OPTIONS **/
-	uint16_t adv = 0;
+	bool	 enable = device_context->device_eee->eee_enabled;
+	uint16_t adv	= 0;
+	uint16_t bmcr	= 0;
 
 	if(device_context->device_eee->advertised & ADVERTISED_100baseT_Full){
 		adv |= MDIO_EEE_100TX;
@@ -3721,41 +10485,26 @@ RTL81XX_DISABLE_INSTRUMENT static inline void RTL8156_SET_EEE(void){
 	if(device_context->device_eee->advertised & ADVERTISED_10000baseKR_Full){
 		adv |= MDIO_EEE_10GKR;
 	}
+	device_context->dev_flags.eee_adv = adv;
 
-	device_context->device_eee->advertised = adv;
-
-	/** static void rtl_eee_enable(struct r8152 *tp, bool enable) **/
-	{
-		switch(device_context->device_version_identifier){
-			case RTL_VER_01:
-			case RTL_VER_02:
-			case RTL_VER_07:
-				/* TODO */
-			break;
-
-			case RTL_VER_03:
-			case RTL_VER_04:
-			case RTL_VER_05:
-			case RTL_VER_06:
-			case RTL_VER_08:
-			case RTL_VER_09:
-			case RTL_VER_14:
+	pthread_mutex_lock(&ocp_lock);
+	RTL81XX_EEE_ENABLE(enable);
+	if( pwr.worker.running ){
+		/** rtl_eee_enable left the LPI bits as 'enable' says, they follow the policy again **/
+		unsigned long on = pwr.on;
 
-			break;
-
-			case RTL_VER_10:
-			case RTL_VER_11:
-			case RTL_VER_12:
-			case RTL_VER_13:
-			case RTL_VER_15:
-
-			break;
-
-			default:
-
-			break;
-		}
+		pwr.on	  = enable ? (pwr.on | RTL81XX_PWR_EEE) : (pwr.on & ~RTL81XX_PWR_EEE);
+		pwr.saved = enable ? (pwr.saved | RTL81XX_PWR_EEE) : (pwr.saved & ~RTL81XX_PWR_EEE);
+		RTL81XX_PWR_PROGRAM(enable ? on : (on & ~RTL81XX_PWR_EEE));
+	}
+	/** int mii_nway_restart(struct mii_if_info *mii), the partner only learns the advertisement on a new nway **/
+	DEBUG_RTL81XX( RTL81XX_OCP_REG_READ( OCP_BASE_MII + MII_BMCR * 2 ) );
+	bmcr = return_context;
+	if( bmcr & BMCR_ANENABLE ){
+		DEBUG_RTL81XX( RTL81XX_OCP_REG_WRITE( OCP_BASE_MII + MII_BMCR * 2, bmcr | BMCR_ANRESTART ) );
 	}
+	pthread_mutex_unlock(&ocp_lock);
+	return_context = NO_ERROR;
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL8153_INIT(void){
@@ -3789,20 +10538,374 @@ RTL81XX_DISABLE_INSTRUMENT PLUGIN_EXIT static inline void RTL81XX_SHUTDOWN(void)
 }
 
 RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_DEINITIALIZE_USB_INTERFACE(void){
+	/** no more bring-up or teardown from the worker past this point **/
+	RTL81XX_HOTPLUG_STOP();
+	RTL81XX_TEAR_DOWN();
+	if( hotplug.active != NULL ){
+		libusb_unref_device(hotplug.active);
+		hotplug.active = NULL;
+	}
 	libusb_exit(NULL);
 }
 
 #if	COMPILE_AS_STANDALONE
+/** STANDALONE BENCHMARKS, THEY DO NOT NEED THE ADAPTER **/
+
+RTL81XX_DISABLE_INSTRUMENT static inline uint64_t RTL81XX_BENCH_NOW_NS(void){
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** scalar against the kernel picked by RTL81XX_CSUM_SELECT, the folded results must match **/
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BENCH_CSUM(void){
+	const uint32_t sizes[]	 = { 64, 576, 1500, 4096, 9000, 65535 };
+	const uint64_t total	 = 512ULL * 1024 * 1024;
+	uint8_t *buf		 = NULL;
+	volatile uint64_t sink	 = 0;
+
+	buf = malloc(65536 + 1);
+	if( buf == NULL ){
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	for(int i = 0; i < 65536 + 1; i++){
+		buf[i] = (uint8_t)(i * 131 + 7);
+	}
+	RTL81XX_CSUM_SELECT();
+	printf("%-8s %12s %12s %8s\n", "size", "scalar GB/s", "simd GB/s", "match");
+	for(unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+		uint64_t rounds = total / sizes[s];
+		uint64_t start	= 0;
+		double t_scalar = 0, t_simd = 0;
+		/** odd start address, the payload is rarely aligned behind the headers **/
+		const uint8_t *data = buf + 1;
+
+		start = RTL81XX_BENCH_NOW_NS();
+		for(uint64_t r = 0; r < rounds; r++){
+			sink += RTL81XX_CSUM_PARTIAL_SCALAR(data, sizes[s], r);
+		}
+		t_scalar = (RTL81XX_BENCH_NOW_NS() - start) / 1e9;
+
+		start = RTL81XX_BENCH_NOW_NS();
+		for(uint64_t r = 0; r < rounds; r++){
+			sink += csum_partial_impl(data, sizes[s], r);
+		}
+		t_simd = (RTL81XX_BENCH_NOW_NS() - start) / 1e9;
+
+		printf("%-8u %12.2f %12.2f %8s\n", sizes[s], total / t_scalar / 1e9, total / t_simd / 1e9,
+			RTL81XX_CSUM_FOLD(RTL81XX_CSUM_PARTIAL_SCALAR(data, sizes[s], 0)) == RTL81XX_CSUM_FOLD(csum_partial_impl(data, sizes[s], 0)) ? "yes" : "NO");
+	}
+	free(buf);
+	return_context = NO_ERROR;
+}
+
+/**
+ * pktgen like generator built on RTL81XX_INJECT_BATCH, RTL81XX_PKTGEN_BATCHES
+ * batches are kept in flight and every one is queued again once it is done.
+ */
+#ifndef RTL81XX_PKTGEN_SECONDS
+	#define RTL81XX_PKTGEN_SECONDS	3
+#endif
+
+#ifndef RTL81XX_PKTGEN_BATCH
+	#define RTL81XX_PKTGEN_BATCH	64
+#endif
+
+#ifndef RTL81XX_PKTGEN_BATCHES
+	#define RTL81XX_PKTGEN_BATCHES	8
+#endif
+
+/** status of a frame not queued yet, it is neither counted as sent nor as an error **/
+#define RTL81XX_PKTGEN_IDLE	(RTL81XX_INJECT_PENDING + 1)
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BENCH_PKTGEN(void){
+	const uint32_t sizes[]	= { 60, 128, 256, 512, 1024, 1514, 0 };
+	struct rtl_inject_batch batch[RTL81XX_PKTGEN_BATCHES];
+	struct rtl_inject_frame *frames = NULL;
+	uint8_t *payload		= NULL;
+	uint32_t max_len		= mtu_to_size(device_context->device_max_mtu) - ETH_FCS_LEN;
+
+	payload = malloc(max_len);
+	frames	= calloc(RTL81XX_PKTGEN_BATCHES * RTL81XX_PKTGEN_BATCH, sizeof(*frames));
+	if( payload == NULL || frames == NULL ){
+		free(payload);
+		free(frames);
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	/** broadcast, locally administered source, local experimental ethertype **/
+	memset(payload, 0xff, 6);
+	memcpy(payload + 6, "\x02\x00\x00\x00\x00\x01", 6);
+	payload[12] = 0x88;
+	payload[13] = 0xb5;
+	for(uint32_t i = ETH_HLEN; i < max_len; i++){
+		payload[i] = (uint8_t)i;
+	}
+
+	printf("%-8s %14s %10s %10s\n", "size", "pps", "Gb/s", "errors");
+	for(unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+		/** the last round uses the biggest frame the MTU allows **/
+		uint32_t len	= ( sizes[s] != 0 ) ? sizes[s] : max_len;
+		uint64_t sent	= 0;
+		uint64_t errors = 0;
+		uint64_t start	= 0;
+		uint64_t now	= 0;
+
+		if( len > max_len ){
+			continue;
+		}
+		for(int b = 0; b < RTL81XX_PKTGEN_BATCHES; b++){
+			batch[b].frames  = &frames[b * RTL81XX_PKTGEN_BATCH];
+			batch[b].count	 = RTL81XX_PKTGEN_BATCH;
+			batch[b].pending = 0;
+			batch[b].done	 = NULL;
+			for(int f = 0; f < RTL81XX_PKTGEN_BATCH; f++){
+				batch[b].frames[f].data	  = payload;
+				batch[b].frames[f].len	  = len;
+				batch[b].frames[f].status = RTL81XX_PKTGEN_IDLE;
+			}
+		}
+		start = RTL81XX_BENCH_NOW_NS();
+		do{
+			for(int b = 0; b < RTL81XX_PKTGEN_BATCHES; b++){
+				if( __atomic_load_n(&batch[b].pending, __ATOMIC_ACQUIRE) != 0 ){
+					continue;
+				}
+				/** collect the previous round of this batch before queuing it again **/
+				for(int f = 0; f < RTL81XX_PKTGEN_BATCH; f++){
+					if( batch[b].frames[f].status == NO_ERROR ){
+						sent++;
+					}else if( batch[b].frames[f].status < 0 ){
+						errors++;
+					}
+					batch[b].frames[f].status = RTL81XX_PKTGEN_IDLE;
+				}
+				RTL81XX_INJECT_BATCH(&batch[b], 100);
+			}
+			now = RTL81XX_BENCH_NOW_NS();
+		}while( now - start < RTL81XX_PKTGEN_SECONDS * 1000000000ULL );
+
+		/** wait for the tail, it is not counted **/
+		for(int b = 0; b < RTL81XX_PKTGEN_BATCHES; b++){
+			while( __atomic_load_n(&batch[b].pending, __ATOMIC_ACQUIRE) != 0 ){
+				usleep(100);
+			}
+		}
+		printf("%-8u %14.0f %10.3f %10lu\n", len, sent / ((now - start) / 1e9), sent * (len + ETH_FCS_LEN) * 8 / ((now - start) / 1e9) / 1e9, (unsigned long)errors);
+	}
+	free(payload);
+	free(frames);
+	return_context = NO_ERROR;
+}
+
+/**
+ * ping-pong latency: one frame at a time is sent and timed until it comes back,
+ * the link partner has to reflect it (loopback plug or a MAC swapping reflector).
+ * Each RX poll mode is measured in turn with the consumer running inline.
+ */
+#ifndef RTL81XX_LATENCY_SAMPLES
+	#define RTL81XX_LATENCY_SAMPLES		20000
+#endif
+
+#ifndef RTL81XX_LATENCY_TIMEOUT_US
+	#define RTL81XX_LATENCY_TIMEOUT_US	100000
+#endif
+
+/** core the spinning completion thread is pinned on, away from the sender on the main thread **/
+#ifndef RTL81XX_LATENCY_CPU
+	#define RTL81XX_LATENCY_CPU		1
+#endif
+
+#define RTL81XX_LATENCY_MAGIC		0x524c4154	/** "RLAT" **/
+
+struct rtl_latency_probe{
+	volatile uint32_t	expected;
+	volatile uint64_t	rx_ns;
+};
+
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_LATENCY_CONSUMER(struct rtl_rx_frame *frames, unsigned int count, void *priv){
+	struct rtl_latency_probe *probe = (struct rtl_latency_probe *)priv;
+
+	for(unsigned int i = 0; i < count; i++){
+		uint32_t magic = 0;
+		uint32_t seq   = 0;
+
+		if( frames[i].len < ETH_HLEN + 8 || frames[i].data[12] != 0x88 || frames[i].data[13] != 0xb5 ){
+			continue;
+		}
+		memcpy(&magic, frames[i].data + ETH_HLEN, 4);
+		memcpy(&seq, frames[i].data + ETH_HLEN + 4, 4);
+		if( magic == RTL81XX_LATENCY_MAGIC && seq == probe->expected ){
+			probe->rx_ns = RTL81XX_BENCH_NOW_NS();
+		}
+	}
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline int RTL81XX_LATENCY_CMP(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return ( x > y ) - ( x < y );
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_BENCH_LATENCY(void){
+	const char *names[]		= { "event", "busy", "hybrid" };
+	struct rtl_latency_probe probe	= { 0 };
+	uint8_t frame[ETH_ZLEN]		= { 0 };
+	uint32_t magic			= RTL81XX_LATENCY_MAGIC;
+	uint64_t *samples		= NULL;
+	enum rtl_rx_poll_mode_t mode_0	= rx_engine.poll_mode;
+	int cpu_0			= rx_engine.poll_cpu;
+	unsigned int idle_us_0		= rx_engine.poll_idle_us;
+
+	samples = malloc(RTL81XX_LATENCY_SAMPLES * sizeof(*samples));
+	if( samples == NULL ){
+		return_context = -ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	memset(frame, 0xff, 6);
+	memcpy(frame + 6, "\x02\x00\x00\x00\x00\x01", 6);
+	frame[12] = 0x88;
+	frame[13] = 0xb5;
+	memcpy(frame + ETH_HLEN, &magic, 4);
+
+	printf("%-8s %10s %8s %10s %10s %10s\n", "mode", "samples", "lost", "p50 us", "p99 us", "p999 us");
+	for(int mode = RTL81XX_RX_POLL_EVENT; mode <= RTL81XX_RX_POLL_HYBRID; mode++){
+		unsigned int n	  = 0;
+		unsigned int lost = 0;
+
+		RTL81XX_RX_SET_POLL_MODE(mode, ( mode == RTL81XX_RX_POLL_EVENT ) ? -1 : RTL81XX_LATENCY_CPU, 0);
+		RTL81XX_RX_START(RTL81XX_LATENCY_CONSUMER, &probe);
+		if( return_context < 0 ){
+			break;
+		}
+		for(uint32_t seq = 0; seq < RTL81XX_LATENCY_SAMPLES; seq++){
+			uint64_t start = 0;
+
+			probe.rx_ns    = 0;
+			probe.expected = seq;
+			memcpy(frame + ETH_HLEN + 4, &seq, 4);
+			start = RTL81XX_BENCH_NOW_NS();
+			RTL81XX_DO_TRANSMIT(frame, sizeof(frame), 100);
+			/** do not wait for the aggregation timer, one frame is the whole burst **/
+			RTL81XX_TX_FLUSH();
+			while( probe.rx_ns == 0 && RTL81XX_BENCH_NOW_NS() - start < RTL81XX_LATENCY_TIMEOUT_US * 1000ULL ){
+			}
+			if( probe.rx_ns == 0 ){
+				lost++;
+				continue;
+			}
+			samples[n++] = probe.rx_ns - start;
+		}
+		RTL81XX_RX_STOP();
+		if( n == 0 ){
+			printf("%-8s %10u %8u %10s %10s %10s\n", names[mode], n, lost, "-", "-", "-");
+			continue;
+		}
+		qsort(samples, n, sizeof(*samples), RTL81XX_LATENCY_CMP);
+		printf("%-8s %10u %8u %10.1f %10.1f %10.1f\n", names[mode], n, lost,
+			samples[n * 50 / 100] / 1e3, samples[n * 99 / 100] / 1e3, samples[n * 999 / 1000] / 1e3);
+	}
+	free(samples);
+	/** back to the policy of the caller, the pinned completion thread already exited in RTL81XX_RX_STOP **/
+	rx_engine.poll_mode    = mode_0;
+	rx_engine.poll_cpu     = cpu_0;
+	rx_engine.poll_idle_us = idle_us_0;
+}
+
+/** receive with RTL81XX_RSS_START for RTL81XX_RSS_SECONDS and print every worker queue each second **/
+#ifndef RTL81XX_RSS_SECONDS
+	#define RTL81XX_RSS_SECONDS	10
+#endif
+
+/** the per worker work is left to the application, here the frames are only counted by the queues **/
+RTL_PLUGIN_IO_OPTIMIZE static inline void RTL81XX_RSS_SINK(struct rtl_rx_frame *frames, unsigned int count, void *priv){
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_RSS_RUN(unsigned int workers){
+	struct rtl_rss_stats stats = { 0 };
+
+	RTL81XX_RSS_START(RTL81XX_RSS_SINK, NULL, workers);
+	if( return_context < 0 ){
+		return;
+	}
+	for(int t = 0; t < RTL81XX_RSS_SECONDS; t++){
+		sleep(1);
+		printf("%-6s %12s %12s %10s %8s %10s\n", "queue", "enqueued", "processed", "dropped", "depth", "max depth");
+		for(unsigned int q = 0; q < workers; q++){
+			RTL81XX_RSS_STATS(q, &stats);
+			printf("%-6u %12lu %12lu %10lu %8u %10u\n", q, (unsigned long)stats.enqueued, (unsigned long)stats.processed,
+				(unsigned long)stats.dropped, stats.depth, stats.max_depth);
+		}
+	}
+	RTL81XX_RSS_STOP();
+}
+
+RTL81XX_DISABLE_INSTRUMENT static inline void RTL81XX_USAGE(const char *name){
+	printf("usage: %s [-b benchmark] [-w workers] [-h]\n", name);
+	printf("\t-b csum\tinternet checksum, scalar against SIMD kernel\n");
+	printf("\t-b pktgen\tpackets per second injected with rtl_inject_batch, from 60 bytes up to the biggest MTU\n");
+	printf("\t-b latency\tping-pong round trip for each RX poll mode, the link partner has to reflect the frames\n");
+	printf("\t-w workers\treceive with the flow hash spread over 1 to %d worker threads\n", RTL81XX_RSS_MAX_WORKERS);
+}
+
 RTL81XX_DISABLE_INSTRUMENT int main(int argc, char *argv[], char *envp[]){
-	/** this is 'rtl8152_probe_once' **/
+	char *benchmark	     = NULL;
+	unsigned int workers = 0;
+	int opt		     = 0;
+
+	while( (opt = getopt(argc, argv, "b:w:h")) != -1 ){
+		switch(opt){
+			case 'b':
+				benchmark = optarg;
+			break;
+			case 'w':
+				workers = (unsigned int)strtoul(optarg, NULL, 0);
+				if( workers == 0 || workers > RTL81XX_RSS_MAX_WORKERS ){
+					RTL81XX_USAGE(argv[0]);
+					return 1;
+				}
+			break;
+			case 'h':
+			default:
+				RTL81XX_USAGE(argv[0]);
+				return ( opt == 'h' ) ? 0 : 1;
+		}
+	}
+	if( benchmark != NULL && strcmp(benchmark, "pktgen") != 0 && strcmp(benchmark, "latency") != 0 ){
+		if( strcmp(benchmark, "csum") == 0 ){
+			RTL81XX_BENCH_CSUM();
+		}else{
+			RTL81XX_USAGE(argv[0]);
+			return 1;
+		}
+		return ( return_context < 0 ) ? 1 : 0;
+	}
+
+	/** returns once the first adapter has been brought up **/
 	RTL81XX_INITIALIZE_USB_INTERFACE();
-	/** reproduce the driver's init sequence **/
-	RTL81XX_GET_HW_VERSION();
-	/** find out if we can use WoWlan feature **/
-	RTL81XX_GET_WOWLAN();
-	RTL81XX_ASSIGN_MTU();
-	RTL81XX_INIT();
-	RTL81XX_POST_INIT();
+
+	/** the benchmarks below need the adapter, an unplug waits for them to return **/
+	if( benchmark != NULL ){
+		if( RTL81XX_DEVICE_GET() ){
+			if( strcmp(benchmark, "pktgen") == 0 ){
+				RTL81XX_BENCH_PKTGEN();
+			}else{
+				RTL81XX_BENCH_LATENCY();
+			}
+			RTL81XX_DEVICE_PUT();
+		}
+		RTL81XX_DEINITIALIZE_USB_INTERFACE();
+		return ( return_context < 0 ) ? 1 : 0;
+	}
+	if( workers != 0 ){
+		if( RTL81XX_DEVICE_GET() ){
+			RTL81XX_RSS_RUN(workers);
+			RTL81XX_DEVICE_PUT();
+		}
+		RTL81XX_DEINITIALIZE_USB_INTERFACE();
+		return ( return_context < 0 ) ? 1 : 0;
+	}
 	return 0;
 }
 #endif